@@ -0,0 +1,154 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+size_t const BENCH_SIZES[] = { 1, 10, 100, 1000, 10000, 50000 };
+
+size_t const BENCH_SIZE_COUNT = sizeof( BENCH_SIZES ) / sizeof( BENCH_SIZES[0] );
+
+char const * bench_filter = NULL;
+
+int bench_is_csv = 0;
+
+unsigned long long bench_min_time = 200000000;
+
+/*
+ * The allocator of glibc, which is wrapped in order to count allocations.
+ */
+void* __libc_malloc( size_t size );
+void* __libc_calloc( size_t count, size_t size );
+void* __libc_realloc( void* ptr, size_t size );
+void* __libc_memalign( size_t alignment, size_t size );
+void __libc_free( void* ptr );
+
+static _Atomic int is_counting = 0;
+
+static _Atomic uint64_t alloc_count = 0;
+
+static _Atomic uint64_t alloc_bytes = 0;
+
+static void count_alloc( size_t const size ) {
+	if( !atomic_load_explicit( &is_counting, memory_order_relaxed ) )
+		return;
+	atomic_fetch_add_explicit( &alloc_count, 1, memory_order_relaxed );
+	atomic_fetch_add_explicit( &alloc_bytes, size, memory_order_relaxed );
+}
+
+void* malloc( size_t size ) {
+	count_alloc( size );
+	return __libc_malloc( size );
+}
+
+void* calloc( size_t count, size_t size ) {
+	count_alloc( count * size );
+	return __libc_calloc( count, size );
+}
+
+void* realloc( void* ptr, size_t size ) {
+	count_alloc( size );
+	return __libc_realloc( ptr, size );
+}
+
+void* aligned_alloc( size_t alignment, size_t size ) {
+	count_alloc( size );
+	return __libc_memalign( alignment, size );
+}
+
+int posix_memalign( void** ptr, size_t alignment, size_t size ) {
+	count_alloc( size );
+	*ptr = __libc_memalign( alignment, size );
+	return *ptr != NULL ? 0 : 12; // ENOMEM
+}
+
+void free( void* ptr ) {
+	__libc_free( ptr );
+}
+
+static uint64_t now_nsec( void ) {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Runs a benchmark a number of times.
+ *
+ * @param elapsed Output parameter for the measured time in nanoseconds
+ * @return The number of operations
+ */
+static uint64_t measure( struct benchmark_t const * const benchmark, void* const state, uint64_t const iterations, uint64_t* const elapsed ) {
+	uint64_t ops = 0;
+	*elapsed = 0;
+	if( benchmark->prepare == NULL ) {
+		atomic_store( &is_counting, 1 );
+		uint64_t const start = now_nsec();
+		for( uint64_t i = 0; i != iterations; ++i )
+			ops += benchmark->run( state );
+		*elapsed = now_nsec() - start;
+		atomic_store( &is_counting, 0 );
+		return ops;
+	}
+	for( uint64_t i = 0; i != iterations; ++i ) {
+		benchmark->prepare( state );
+		atomic_store( &is_counting, 1 );
+		uint64_t const start = now_nsec();
+		ops += benchmark->run( state );
+		*elapsed += now_nsec() - start;
+		atomic_store( &is_counting, 0 );
+	}
+	return ops;
+}
+
+void run_benchmark( struct benchmark_t const * const benchmark ) {
+	if( bench_filter != NULL && strstr( benchmark->name, bench_filter ) == NULL )
+		return;
+	void* const state = benchmark->setup( benchmark->size, benchmark->variant );
+	if( state == NULL ) {
+		fprintf( stderr, "%s: setup failed\n", benchmark->name );
+		return;
+	}
+
+	// Warm up the caches and the allocator, then grow the number of
+	// iterations until the measurement takes long enough
+	uint64_t elapsed = 0;
+	measure( benchmark, state, 1, &elapsed );
+	uint64_t iterations = 1;
+	uint64_t ops = 0;
+	for( ;; ) {
+		atomic_store( &alloc_count, 0 );
+		atomic_store( &alloc_bytes, 0 );
+		ops = measure( benchmark, state, iterations, &elapsed );
+		if( elapsed >= bench_min_time )
+			break;
+		uint64_t next = elapsed != 0 ? iterations * bench_min_time / elapsed * 6 / 5 + 1 : 100 * iterations;
+		if( next > 100 * iterations )
+			next = 100 * iterations;
+		iterations = next > iterations ? next : iterations + 1;
+	}
+	benchmark->teardown( state );
+
+	double const ns_per_op = ops != 0 ? (double)elapsed / (double)ops : 0;
+	double const allocs_per_op = ops != 0 ? (double)atomic_load( &alloc_count ) / (double)ops : 0;
+	double const bytes_per_op = ops != 0 ? (double)atomic_load( &alloc_bytes ) / (double)ops : 0;
+	if( bench_is_csv )
+		fprintf( stdout, "%s,%zu,%.2f,%.3f,%.1f\n", benchmark->name, benchmark->size, ns_per_op, allocs_per_op, bytes_per_op );
+	else
+		fprintf( stdout, "%-44s %8zu %12.2f %10.3f %12.1f\n", benchmark->name, benchmark->size, ns_per_op, allocs_per_op, bytes_per_op );
+	fflush( stdout );
+}
+
+size_t format_bench_address( size_t const index, char* const buf, size_t const size ) {
+	// A multiplicative hash permutes the indices
+	uint32_t const scrambled = (uint32_t)( index * 2654435761u );
+	int len;
+	if( index % 7 == 3 )
+		len = snprintf( buf, size, "User%08x+list%zu@Example%zu.org", scrambled, index % 5, index % 13 );
+	else
+		len = snprintf( buf, size, "user%08x@example%zu.org", scrambled, index % 13 );
+	return len > 0 ? (size_t)len : 0;
+}
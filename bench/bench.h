@@ -0,0 +1,87 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+/**
+ * @file
+ * @brief A minimal harness for microbenchmarks.
+ */
+
+#include <stddef.h>
+
+/**
+ * The input sizes, i.e. numbers of addresses, of benchmarks which scale
+ * with the number of recipients.
+ */
+extern size_t const BENCH_SIZES[];
+
+/**
+ * The number of elements of ::BENCH_SIZES.
+ */
+extern size_t const BENCH_SIZE_COUNT;
+
+/**
+ * Only benchmarks whose name contains this string are run; all
+ * benchmarks, if `NULL`.
+ */
+extern char const * bench_filter;
+
+/**
+ * Non-zero, if the results are printed as CSV instead of a table.
+ */
+extern int bench_is_csv;
+
+/**
+ * The minimal measured time of each benchmark in nanoseconds.
+ */
+extern unsigned long long bench_min_time;
+
+/**
+ * A benchmark of one kernel with one input size.
+ */
+struct benchmark_t {
+	char const * name; /**< The name of the benchmark, e.g. the kernel and a variant. */
+	size_t size; /**< The input size which is passed to `setup`. */
+	int variant; /**< A parameter of the benchmark which is passed to `setup`. */
+	/**
+	 * Creates the state of the benchmark; the state must not be `NULL`.
+	 */
+	void* ( *setup )( size_t size, int variant );
+	/**
+	 * Restores the state before each call of `run`, e.g. copies an input
+	 * which `run` modifies in place; may be `NULL`.
+	 *
+	 * The time and the allocations of `prepare` are not measured, but each
+	 * call of `run` is timed individually instead.
+	 */
+	void ( *prepare )( void* state );
+	/**
+	 * Runs the kernel and returns the number of operations it has performed.
+	 */
+	size_t ( *run )( void* state );
+	/**
+	 * Frees the state.
+	 */
+	void ( *teardown )( void* state );
+};
+
+/**
+ * Runs a benchmark, unless its name does not match the filter of the
+ * command line, and prints the time, the number of allocations and the
+ * allocated bytes per operation.
+ */
+void run_benchmark( struct benchmark_t const * benchmark );
+
+/**
+ * Formats a pseudo-random but deterministic mail address.
+ *
+ * Consecutive indices yield unsorted addresses; some of them have a
+ * sub-address or upper-case letters.
+ *
+ * @param index The index of the address
+ * @param buf The buffer
+ * @param size The size of `buf`
+ * @return The length of the address
+ */
+size_t format_bench_address( size_t index, char* buf, size_t size );
+
+#endif
@@ -0,0 +1,46 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "../src/extstring.h"
+
+/**
+ * The numbers of placeholders in the replaced string.
+ */
+static size_t const PLACEHOLDER_COUNTS[] = { 1, 10, 100 };
+
+static char const * const PLACEHOLDER = "%u";
+
+static char const * const REPLACEMENT = "alice.wonderland@example.org";
+
+static void* setup_str_replace_bench( size_t const size, int const variant ) {
+	(void)variant;
+	static char const segment[] = "(mailAccount=%u)";
+	char* const orig = malloc( size * ( sizeof( segment ) - 1 ) + 4 );
+	if( orig == NULL )
+		return NULL;
+	strcpy( orig, "(|" );
+	for( size_t i = 0; i != size; ++i )
+		strcat( orig, segment );
+	strcat( orig, ")" );
+	return orig;
+}
+
+static size_t run_str_replace_bench( void* state ) {
+	free( str_replace( (char const *)state, PLACEHOLDER, REPLACEMENT ) );
+	return 1;
+}
+
+static void teardown_str_replace_bench( void* state ) {
+	free( state );
+}
+
+void run_extstring_benchmarks( void ) {
+	for( size_t i = 0; i != sizeof( PLACEHOLDER_COUNTS ) / sizeof( PLACEHOLDER_COUNTS[0] ); ++i ) {
+		struct benchmark_t const benchmark = {
+			"str_replace", PLACEHOLDER_COUNTS[i], 0,
+			setup_str_replace_bench, NULL, run_str_replace_bench, teardown_str_replace_bench
+		};
+		run_benchmark( &benchmark );
+	}
+}
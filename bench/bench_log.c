@@ -0,0 +1,92 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "../src/log.h"
+#include "../src/runtime_setting.h"
+
+/**
+ * The number of messages of one operation.
+ */
+#define MESSAGE_COUNT 100
+
+/**
+ * Variants with this flag log through the queue of the writer thread.
+ */
+#define LOG_BENCH_QUEUED 0x100
+
+/**
+ * The state of the benchmarks of logging.
+ */
+struct log_bench_t {
+	int priority; /**< The priority of the messages. */
+	int stdout_fd; /**< A duplicate of the original standard output. */
+	int is_queued; /**< Non-zero, if the writer thread has been started. */
+};
+
+/**
+ * Redirects the standard output, to which the messages are written in the
+ * foreground, to `/dev/null` and opens the log.
+ *
+ * The threshold is `info`, hence messages at `debug` measure the cost of
+ * discarding a message.
+ */
+static void* setup_log_bench( size_t const size, int const variant ) {
+	(void)size;
+	struct log_bench_t* const bench = calloc( 1, sizeof( struct log_bench_t ) );
+	int const null_fd = open( "/dev/null", O_WRONLY | O_CLOEXEC );
+	if( bench == NULL || null_fd == -1 ) {
+		free( bench );
+		if( null_fd != -1 )
+			close( null_fd );
+		return NULL;
+	}
+	fflush( stdout );
+	bench->stdout_fd = dup( STDOUT_FILENO );
+	dup2( null_fd, STDOUT_FILENO );
+	close( null_fd );
+
+	bench->priority = variant & ~LOG_BENCH_QUEUED;
+	bench->is_queued = ( variant & LOG_BENCH_QUEUED ) != 0;
+	rt_setting.daemon_mode = DAEMON_MODE_FOREGROUND;
+	rt_setting.log_level = LOG_INFO;
+	rt_setting.log_journal = 0;
+	rt_setting.log_queue_size = bench->is_queued ? 1024 : 0;
+	open_log();
+	return bench;
+}
+
+static size_t run_log_bench( void* state ) {
+	struct log_bench_t const * const bench = (struct log_bench_t const *)state;
+	for( size_t i = 0; i != MESSAGE_COUNT; ++i )
+		log_msg( bench->priority, "bench_log: added %zu recipients for sender %s\n", i, "alice@example.org" );
+	return MESSAGE_COUNT;
+}
+
+static void teardown_log_bench( void* state ) {
+	struct log_bench_t* const bench = (struct log_bench_t*)state;
+	close_log();
+	fflush( stdout );
+	dup2( bench->stdout_fd, STDOUT_FILENO );
+	close( bench->stdout_fd );
+	free( bench );
+}
+
+void run_log_benchmarks( void ) {
+	static int const priorities[] = { LOG_ERR, LOG_WARNING, LOG_NOTICE, LOG_INFO, LOG_DEBUG };
+	static char const * const names[] = {
+		"log_msg err", "log_msg warning", "log_msg notice", "log_msg info", "log_msg debug",
+		"log_msg err queued", "log_msg warning queued", "log_msg notice queued", "log_msg info queued", "log_msg debug queued"
+	};
+	for( size_t i = 0; i != 2 * sizeof( priorities ) / sizeof( priorities[0] ); ++i ) {
+		size_t const level = i % ( sizeof( priorities ) / sizeof( priorities[0] ) );
+		int const variant = priorities[level] | ( i != level ? LOG_BENCH_QUEUED : 0 );
+		struct benchmark_t const benchmark = {
+			names[i], MESSAGE_COUNT, variant, setup_log_bench, NULL, run_log_bench, teardown_log_bench
+		};
+		run_benchmark( &benchmark );
+	}
+}
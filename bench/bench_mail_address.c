@@ -0,0 +1,81 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "../src/mail_address.h"
+
+/**
+ * The number of distinct addresses which are decomposed in turn.
+ */
+#define ADDRESS_COUNT 1000
+
+/**
+ * The state of the benchmarks of mail addresses.
+ */
+struct mail_address_bench_t {
+	int options; /**< The normalization options. */
+	char addresses[ADDRESS_COUNT][64]; /**< The addresses. */
+	size_t lens[ADDRESS_COUNT]; /**< The lengths of the addresses. */
+	uint64_t checksum; /**< Accumulates the results, such that they are used. */
+};
+
+/* Variants of the normalization */
+#define NORMALIZE_DOMAIN 0 /**< Only the domain is lower-cased. */
+#define NORMALIZE_FOLD 1 /**< The local part is lower-cased, too. */
+#define NORMALIZE_STRIP 2 /**< The sub-address is stripped. */
+#define NORMALIZE_FOLD_STRIP 3 /**< The local part is lower-cased and the sub-address is stripped. */
+
+static void* setup_mail_address_bench( size_t const size, int const variant ) {
+	(void)size;
+	struct mail_address_bench_t* const bench = calloc( 1, sizeof( struct mail_address_bench_t ) );
+	if( bench == NULL )
+		return NULL;
+	bench->options =
+		( variant == NORMALIZE_FOLD || variant == NORMALIZE_FOLD_STRIP ? MAIL_ADDRESS_FOLD_LOCAL_PART : 0 ) |
+		( variant == NORMALIZE_STRIP || variant == NORMALIZE_FOLD_STRIP ? MAIL_ADDRESS_STRIP_TAG : 0 );
+	for( size_t i = 0; i != ADDRESS_COUNT; ++i )
+		bench->lens[i] = format_bench_address( i, bench->addresses[i], sizeof( bench->addresses[i] ) );
+	return bench;
+}
+
+/**
+ * Decomposes and normalizes all addresses; an operation is one address.
+ */
+static size_t run_normalize_bench( void* state ) {
+	struct mail_address_bench_t* const bench = (struct mail_address_bench_t*)state;
+	char key[64];
+	for( size_t i = 0; i != ADDRESS_COUNT; ++i )
+		bench->checksum += normalize_mail_address( bench->addresses[i], bench->lens[i], bench->options, key );
+	return ADDRESS_COUNT;
+}
+
+/**
+ * Normalizes and hashes all addresses like a lookup key; an operation is
+ * one address.
+ */
+static size_t run_hash_bench( void* state ) {
+	struct mail_address_bench_t* const bench = (struct mail_address_bench_t*)state;
+	char key[64];
+	for( size_t i = 0; i != ADDRESS_COUNT; ++i ) {
+		size_t const len = normalize_mail_address( bench->addresses[i], bench->lens[i], bench->options, key );
+		bench->checksum += hash_mail_address_key( key, len );
+	}
+	return ADDRESS_COUNT;
+}
+
+static void teardown_mail_address_bench( void* state ) {
+	free( state );
+}
+
+void run_mail_address_benchmarks( void ) {
+	struct benchmark_t const benchmarks[] = {
+		{ "normalize_mail_address", ADDRESS_COUNT, NORMALIZE_DOMAIN, setup_mail_address_bench, NULL, run_normalize_bench, teardown_mail_address_bench },
+		{ "normalize_mail_address fold", ADDRESS_COUNT, NORMALIZE_FOLD, setup_mail_address_bench, NULL, run_normalize_bench, teardown_mail_address_bench },
+		{ "normalize_mail_address strip", ADDRESS_COUNT, NORMALIZE_STRIP, setup_mail_address_bench, NULL, run_normalize_bench, teardown_mail_address_bench },
+		{ "normalize_mail_address fold strip", ADDRESS_COUNT, NORMALIZE_FOLD_STRIP, setup_mail_address_bench, NULL, run_normalize_bench, teardown_mail_address_bench },
+		{ "hash_mail_address_key fold strip", ADDRESS_COUNT, NORMALIZE_FOLD_STRIP, setup_mail_address_bench, NULL, run_hash_bench, teardown_mail_address_bench },
+	};
+	for( size_t i = 0; i != sizeof( benchmarks ) / sizeof( benchmarks[0] ); ++i )
+		run_benchmark( &benchmarks[i] );
+}
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "../src/arena.h"
+#include "../src/mail_address.h"
+#include "../src/string_array.h"
+
+/**
+ * The state of the benchmarks of string arrays.
+ */
+struct string_array_bench_t {
+	int variant; /**< The variant of the benchmark. */
+	size_t size; /**< The number of addresses. */
+	char** addresses; /**< The addresses for `push_onto_string_array_l`. */
+	size_t* lens; /**< The lengths of `addresses`. */
+	struct string_array_t* source; /**< The input of the kernels which modify an array in place. */
+	struct string_array_t* diff; /**< The addresses which are substracted; half of them are in `source`. */
+	struct string_array_t* work; /**< A copy of `source` which is modified. */
+	struct string_array_t* work_diff; /**< A copy of `diff` which may be reordered. */
+};
+
+/* Variants of push_onto_string_array_l */
+#define PUSH_HEAP 0 /**< Into an array on the heap which grows from a capacity of one. */
+#define PUSH_ARENA 1 /**< Into an array in an arena like the results of searches. */
+#define PUSH_NORMALIZED 2 /**< Into an array which computes normalized keys. */
+
+/**
+ * The block size of arenas like the arena of a session.
+ */
+static size_t const ARENA_BLOCK_SIZE = 16384;
+
+static struct string_array_t* create_address_array( size_t const first, size_t const count ) {
+	struct string_array_t* const array = create_string_array( count != 0 ? count : 1 );
+	char buf[128];
+	for( size_t i = first; array != NULL && i != first + count; ++i ) {
+		size_t const len = format_bench_address( i, buf, sizeof( buf ) );
+		push_onto_string_array_l( array, buf, len );
+	}
+	return array;
+}
+
+static void teardown_string_array_bench( void* state ) {
+	struct string_array_bench_t* const bench = (struct string_array_bench_t*)state;
+	for( size_t i = 0; bench->addresses != NULL && i != bench->size; ++i )
+		free( bench->addresses[i] );
+	free( bench->addresses );
+	free( bench->lens );
+	struct string_array_t* const arrays[] = { bench->source, bench->diff, bench->work, bench->work_diff };
+	for( size_t i = 0; i != sizeof( arrays ) / sizeof( arrays[0] ); ++i ) {
+		if( arrays[i] != NULL )
+			free_string_array( arrays[i] );
+	}
+	free( bench );
+}
+
+static void* setup_push_bench( size_t const size, int const variant ) {
+	struct string_array_bench_t* const bench = calloc( 1, sizeof( struct string_array_bench_t ) );
+	if( bench == NULL )
+		return NULL;
+	bench->variant = variant;
+	bench->size = size;
+	bench->addresses = calloc( size, sizeof( char* ) );
+	bench->lens = calloc( size, sizeof( size_t ) );
+	if( bench->addresses == NULL || bench->lens == NULL ) {
+		teardown_string_array_bench( bench );
+		return NULL;
+	}
+	char buf[128];
+	for( size_t i = 0; i != size; ++i ) {
+		bench->lens[i] = format_bench_address( i, buf, sizeof( buf ) );
+		bench->addresses[i] = strdup( buf );
+		if( bench->addresses[i] == NULL ) {
+			teardown_string_array_bench( bench );
+			return NULL;
+		}
+	}
+	return bench;
+}
+
+/**
+ * Pushes all addresses into a new array; an operation is one push.
+ */
+static size_t run_push_bench( void* state ) {
+	struct string_array_bench_t* const bench = (struct string_array_bench_t*)state;
+	struct arena_t* arena = NULL;
+	struct string_array_t* array = NULL;
+	if( bench->variant == PUSH_ARENA ) {
+		arena = create_arena( ARENA_BLOCK_SIZE );
+		array = create_string_array_arena( arena, 1 );
+	} else {
+		array = create_string_array( 1 );
+		if( bench->variant == PUSH_NORMALIZED )
+			set_mail_address_normalization( array, MAIL_ADDRESS_FOLD_LOCAL_PART | MAIL_ADDRESS_STRIP_TAG );
+	}
+	for( size_t i = 0; i != bench->size; ++i )
+		push_onto_string_array_l( array, bench->addresses[i], bench->lens[i] );
+	if( arena != NULL )
+		free_arena( arena );
+	else
+		free_string_array( array );
+	return bench->size;
+}
+
+/**
+ * Creates the source array and, for the substractions, the array which is
+ * substracted.
+ *
+ * The variant is non-zero, if both arrays must be sorted.
+ */
+static void* setup_modify_bench( size_t const size, int const variant ) {
+	struct string_array_bench_t* const bench = calloc( 1, sizeof( struct string_array_bench_t ) );
+	if( bench == NULL )
+		return NULL;
+	bench->variant = variant;
+	bench->size = size;
+	bench->source = create_address_array( 0, size );
+	// Every other address of the source and as many other addresses
+	bench->diff = create_address_array( size / 2, size );
+	if( bench->source == NULL || bench->diff == NULL ) {
+		teardown_string_array_bench( bench );
+		return NULL;
+	}
+	if( variant ) {
+		sort_string_array( bench->source );
+		sort_string_array( bench->diff );
+	}
+	return bench;
+}
+
+static void prepare_modify_bench( void* state ) {
+	struct string_array_bench_t* const bench = (struct string_array_bench_t*)state;
+	if( bench->work != NULL )
+		free_string_array( bench->work );
+	if( bench->work_diff != NULL )
+		free_string_array( bench->work_diff );
+	bench->work = copy_string_array( bench->source );
+	bench->work_diff = copy_string_array( bench->diff );
+}
+
+static size_t run_sort_bench( void* state ) {
+	struct string_array_bench_t* const bench = (struct string_array_bench_t*)state;
+	sort_string_array( bench->work );
+	return 1;
+}
+
+static size_t run_substract_bench( void* state ) {
+	struct string_array_bench_t* const bench = (struct string_array_bench_t*)state;
+	substract_string_array( bench->work, bench->work_diff );
+	return 1;
+}
+
+static size_t run_substract_mail_addresses_bench( void* state ) {
+	struct string_array_bench_t* const bench = (struct string_array_bench_t*)state;
+	substract_mail_addresses( bench->work, bench->work_diff );
+	return 1;
+}
+
+void run_string_array_benchmarks( void ) {
+	for( size_t i = 0; i != BENCH_SIZE_COUNT; ++i ) {
+		size_t const size = BENCH_SIZES[i];
+		struct benchmark_t const benchmarks[] = {
+			{ "push_onto_string_array_l", size, PUSH_HEAP, setup_push_bench, NULL, run_push_bench, teardown_string_array_bench },
+			{ "push_onto_string_array_l arena", size, PUSH_ARENA, setup_push_bench, NULL, run_push_bench, teardown_string_array_bench },
+			{ "push_onto_string_array_l normalized", size, PUSH_NORMALIZED, setup_push_bench, NULL, run_push_bench, teardown_string_array_bench },
+			{ "sort_string_array", size, 0, setup_modify_bench, prepare_modify_bench, run_sort_bench, teardown_string_array_bench },
+			{ "substract_string_array", size, 1, setup_modify_bench, prepare_modify_bench, run_substract_bench, teardown_string_array_bench },
+			{ "substract_mail_addresses", size, 0, setup_modify_bench, prepare_modify_bench, run_substract_mail_addresses_bench, teardown_string_array_bench },
+		};
+		for( size_t j = 0; j != sizeof( benchmarks ) / sizeof( benchmarks[0] ); ++j )
+			run_benchmark( &benchmarks[j] );
+	}
+}
@@ -0,0 +1,67 @@
+#include <stdlib.h>
+
+#include "bench.h"
+#include "../src/template.h"
+
+/**
+ * The number of distinct addresses which are substituted in turn.
+ */
+#define ADDRESS_COUNT 1000
+
+/**
+ * The default filters of etc/milter-alias.conf.
+ */
+static char const * const FILTERS[] = {
+	"(&(objectClass=mailAccount)(mailAccount=%u))",
+	"(&(|(objectClass=mailAlias)(objectClass=mailAliasRelatedObject))(mailAlias=%n))",
+};
+
+/**
+ * The state of the benchmarks of templates.
+ */
+struct template_bench_t {
+	struct template_t* template; /**< The compiled filter. */
+	char addresses[ADDRESS_COUNT][64]; /**< The substituted addresses. */
+	size_t checksum; /**< Accumulates the results, such that they are used. */
+};
+
+static void teardown_template_bench( void* state ) {
+	struct template_bench_t* const bench = (struct template_bench_t*)state;
+	free_template( bench->template );
+	free( bench );
+}
+
+static void* setup_template_bench( size_t const size, int const variant ) {
+	(void)size;
+	struct template_bench_t* const bench = calloc( 1, sizeof( struct template_bench_t ) );
+	if( bench == NULL )
+		return NULL;
+	bench->template = compile_template( FILTERS[variant], TEMPLATE_ESCAPE_FILTER );
+	if( bench->template == NULL ) {
+		teardown_template_bench( bench );
+		return NULL;
+	}
+	for( size_t i = 0; i != ADDRESS_COUNT; ++i )
+		format_bench_address( i, bench->addresses[i], sizeof( bench->addresses[i] ) );
+	return bench;
+}
+
+/**
+ * Expands the filter for all addresses; an operation is one address.
+ */
+static size_t run_template_bench( void* state ) {
+	struct template_bench_t* const bench = (struct template_bench_t*)state;
+	char buf[512];
+	for( size_t i = 0; i != ADDRESS_COUNT; ++i )
+		bench->checksum += expand_template( bench->template, bench->addresses[i], buf, sizeof( buf ) );
+	return ADDRESS_COUNT;
+}
+
+void run_template_benchmarks( void ) {
+	struct benchmark_t const benchmarks[] = {
+		{ "expand_template acct filter", ADDRESS_COUNT, 0, setup_template_bench, NULL, run_template_bench, teardown_template_bench },
+		{ "expand_template list filter", ADDRESS_COUNT, 1, setup_template_bench, NULL, run_template_bench, teardown_template_bench },
+	};
+	for( size_t i = 0; i != sizeof( benchmarks ) / sizeof( benchmarks[0] ); ++i )
+		run_benchmark( &benchmarks[i] );
+}
@@ -0,0 +1,231 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "milter_shim.h"
+#include "../src/extldap.h"
+#include "../src/log.h"
+#include "../src/metrics.h"
+#include "../src/runtime_setting.h"
+#include "../src/smfi_cb.h"
+
+/**
+ * @file
+ * @brief Drives the callbacks of the milter directly from several threads.
+ *
+ * The milter is configured by its configuration file as usual, but the
+ * callbacks are called through the in-process shim of libmilter, hence
+ * the results isolate the CPU cost and the lock contention of the milter
+ * from the socket and the MTA.
+ * Use the LDAP stand-in or enable the caches to remove the directory from
+ * the measurement, too.
+ */
+
+static char const * const CLI_OPTS = "a:c:hn:S:t:";
+
+/**
+ * The maximum number of senders and accounts given on the command line.
+ */
+#define MAX_ADDRESSES 64
+
+static char* const AUTH_ACCT_MACRO = "{auth_authen}";
+
+/**
+ * The settings of a run.
+ */
+struct cb_bench_setting_t {
+	unsigned int thread_count; /**< The number of threads. */
+	unsigned int messages; /**< The number of messages per thread. */
+	char* senders[MAX_ADDRESSES]; /**< The envelope senders; messages use them in turn. */
+	size_t sender_count; /**< The number of senders. */
+	char const * accounts[MAX_ADDRESSES]; /**< The authenticated accounts; messages use them in turn. */
+	size_t account_count; /**< The number of accounts. */
+};
+
+/**
+ * The state and results of a thread.
+ */
+struct cb_bench_thread_t {
+	pthread_t thread; /**< The thread. */
+	struct cb_bench_setting_t const * setting; /**< The settings of the run. */
+	unsigned int index; /**< The index of the thread. */
+	SMFICTX ctx; /**< The fake context of the thread. */
+	uint64_t continued; /**< The number of messages which have been continued. */
+	uint64_t failed; /**< The number of messages which have been rejected or failed temporarily. */
+};
+
+static void print_cb_bench_usage( char const * const prog ) {
+	fprintf( stdout, "Usage: %s [options]\n", prog );
+	fprintf( stdout, "    -a account      Authenticated account; may be repeated; default: the sender\n" );
+	fprintf( stdout, "    -c config_file  Configuration file of the milter; default: /etc/milter-alias.conf\n" );
+	fprintf( stdout, "    -h              Print this help and exit\n" );
+	fprintf( stdout, "    -n messages     Number of messages per thread; default: 100000\n" );
+	fprintf( stdout, "    -S sender       Envelope sender; may be repeated; default: list@example.org\n" );
+	fprintf( stdout, "    -t threads      Number of threads; default: 4\n" );
+}
+
+static uint64_t now_usec( void ) {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/**
+ * Runs the callbacks of one SMTP session with all messages of the thread.
+ */
+static void* run_cb_bench_thread( void* arg ) {
+	struct cb_bench_thread_t* const thread = (struct cb_bench_thread_t*)arg;
+	struct cb_bench_setting_t const * const setting = thread->setting;
+	init_milter_shim_context( &thread->ctx );
+	for( unsigned int i = 0; i != setting->messages; ++i ) {
+		size_t const n = (size_t)thread->index * setting->messages + i;
+		char* const sender = setting->senders[ n % setting->sender_count ];
+		char const * const account = setting->account_count != 0 ? setting->accounts[ n % setting->account_count ] : sender;
+		set_milter_shim_macro( &thread->ctx, AUTH_ACCT_MACRO, account );
+		char* envfrom[] = { sender, NULL };
+		mlfi_envfrom_cb( &thread->ctx, envfrom );
+		if( mlfi_eom_cb( &thread->ctx ) == SMFIS_CONTINUE )
+			++thread->continued;
+		else
+			++thread->failed;
+	}
+	mlfi_close_cb( &thread->ctx );
+	return NULL;
+}
+
+static int parse_uint( char const * const value, unsigned int* const result ) {
+	char* end = NULL;
+	unsigned long const parsed = strtoul( value, &end, 10 );
+	if( *value == '\0' || *end != '\0' || parsed == 0 || parsed > UINT32_MAX )
+		return -1;
+	*result = (unsigned int)parsed;
+	return 0;
+}
+
+/**
+ * Prints the quantiles of a latency histogram of the callbacks.
+ */
+static void print_summary( int const histogram ) {
+	char buf[256];
+	if( format_metric_summary( histogram, buf, sizeof( buf ) ) != 0 )
+		fprintf( stdout, "%s\n", buf );
+}
+
+int main( int argc, char* argv[] ) {
+	struct cb_bench_setting_t setting;
+	memset( &setting, 0, sizeof( setting ) );
+	setting.thread_count = 4;
+	setting.messages = 100000;
+
+	int result_code = init_rt_setting();
+	if( result_code != EX_OK )
+		return result_code;
+
+	int opt;
+	while( ( opt = getopt( argc, argv, CLI_OPTS ) ) != -1 ) {
+		int is_valid = 1;
+		switch( opt ) {
+		case 'a':
+			if( setting.account_count == MAX_ADDRESSES )
+				is_valid = 0;
+			else
+				setting.accounts[setting.account_count++] = optarg;
+			break;
+		case 'c':
+			free( rt_setting.config_file );
+			rt_setting.config_file = strdup( optarg );
+			is_valid = ( rt_setting.config_file != NULL );
+			break;
+		case 'h':
+			print_cb_bench_usage( argv[0] );
+			cleanup_rt_setting();
+			return EX_OK;
+		case 'n':
+			is_valid = ( parse_uint( optarg, &setting.messages ) == 0 );
+			break;
+		case 'S':
+			if( setting.sender_count == MAX_ADDRESSES )
+				is_valid = 0;
+			else
+				setting.senders[setting.sender_count++] = optarg;
+			break;
+		case 't':
+			is_valid = ( parse_uint( optarg, &setting.thread_count ) == 0 );
+			break;
+		default:
+			is_valid = 0;
+		}
+		if( !is_valid ) {
+			print_cb_bench_usage( argv[0] );
+			cleanup_rt_setting();
+			return EX_USAGE;
+		}
+	}
+	if( setting.sender_count == 0 )
+		setting.senders[setting.sender_count++] = "list@example.org";
+
+	result_code = parse_ini();
+	if( result_code != EX_OK ) {
+		cleanup_rt_setting();
+		return result_code;
+	}
+	// Messages of the milter go to the terminal
+	rt_setting.daemon_mode = DAEMON_MODE_FOREGROUND;
+	enable_metrics();
+	open_log();
+	result_code = connect_ldap();
+	if( result_code != EX_OK ) {
+		close_log();
+		cleanup_rt_setting();
+		return result_code;
+	}
+
+	struct cb_bench_thread_t* const threads = calloc( setting.thread_count, sizeof( struct cb_bench_thread_t ) );
+	if( threads == NULL ) {
+		disconnect_ldap();
+		close_log();
+		cleanup_rt_setting();
+		return EX_OSERR;
+	}
+	unsigned int started = 0;
+	uint64_t const start = now_usec();
+	for( unsigned int i = 0; i != setting.thread_count; ++i ) {
+		threads[i].setting = &setting;
+		threads[i].index = i;
+		if( pthread_create( &threads[i].thread, NULL, run_cb_bench_thread, &threads[i] ) != 0 )
+			break;
+		++started;
+	}
+	uint64_t continued = 0;
+	uint64_t failed = 0;
+	uint64_t recipients = 0;
+	for( unsigned int i = 0; i != started; ++i ) {
+		pthread_join( threads[i].thread, NULL );
+		continued += threads[i].continued;
+		failed += threads[i].failed;
+		recipients += threads[i].ctx.recipients_added;
+	}
+	double const duration = ( now_usec() - start ) / 1e6;
+
+	fprintf(
+		stdout, "threads=%u messages=%llu duration=%.3fs messages_per_s=%.0f continued=%llu failed=%llu recipients_added=%llu\n",
+		started, (unsigned long long)( continued + failed ), duration, ( continued + failed ) / duration,
+		(unsigned long long)continued, (unsigned long long)failed, (unsigned long long)recipients
+	);
+	print_summary( METRIC_ENVFROM_LATENCY );
+	print_summary( METRIC_EOM_LATENCY );
+	print_summary( METRIC_SUBSTRACT_LATENCY );
+	print_summary( METRIC_ADDRCPT_LATENCY );
+
+	free( threads );
+	disconnect_ldap();
+	free_metrics();
+	close_log();
+	cleanup_rt_setting();
+	return started != 0 ? EX_OK : EX_OSERR;
+}
@@ -0,0 +1,1162 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @file
+ * @brief Minimal LDAP server which serves entries from a fixture file with
+ * injected latency, errors and connection drops.
+ *
+ * The server understands simple binds, unbinds, abandons and subtree
+ * searches with the filter types `&`, `|`, `!`, `=`, `=*` and substrings.
+ * Of the controls, only the paged results control (RFC 2696) is supported.
+ * Entries are read from an LDIF file without base64 values and without
+ * continuation lines.
+ * Each request is answered by its own thread after the injected delay,
+ * hence pipelined asynchronous searches overlap like on a real server.
+ */
+
+static char const * const CLI_OPTS = "d:e:E:f:hj:np:r:s:u:w:x:";
+
+/**
+ * The maximum length of a request which is accepted.
+ */
+#define MAX_REQUEST_SIZE ( 1024 * 1024 )
+
+/**
+ * The maximum number of entries of a fixture file.
+ */
+#define MAX_ENTRIES ( 1024 * 1024 )
+
+/* BER tags of the LDAP protocol */
+#define TAG_BOOLEAN 0x01
+#define TAG_INTEGER 0x02
+#define TAG_OCTET_STRING 0x04
+#define TAG_ENUMERATED 0x0A
+#define TAG_SEQUENCE 0x30
+#define TAG_SET 0x31
+#define TAG_BIND_REQUEST 0x60
+#define TAG_BIND_RESPONSE 0x61
+#define TAG_UNBIND_REQUEST 0x42
+#define TAG_SEARCH_REQUEST 0x63
+#define TAG_SEARCH_ENTRY 0x64
+#define TAG_SEARCH_DONE 0x65
+#define TAG_ABANDON_REQUEST 0x50
+#define TAG_EXTENDED_RESPONSE 0x78
+#define TAG_FILTER_AND 0xA0
+#define TAG_FILTER_OR 0xA1
+#define TAG_FILTER_NOT 0xA2
+#define TAG_FILTER_EQUALITY 0xA3
+#define TAG_FILTER_SUBSTRINGS 0xA4
+#define TAG_FILTER_PRESENT 0x87
+#define TAG_SUBSTRING_INITIAL 0x80
+#define TAG_SUBSTRING_ANY 0x81
+#define TAG_SUBSTRING_FINAL 0x82
+#define TAG_CONTROLS 0xA0
+
+/* LDAP result codes */
+#define LDAP_SUCCESS 0
+#define LDAP_PROTOCOL_ERROR 2
+#define LDAP_TIMELIMIT_EXCEEDED 3
+#define LDAP_SIZELIMIT_EXCEEDED 4
+#define LDAP_UNAVAILABLE_CRITICAL_EXTENSION 12
+#define LDAP_BUSY 51
+
+/**
+ * The OID of the paged results control.
+ */
+static char const * const PAGED_RESULTS_OID = "1.2.840.113556.1.4.319";
+
+/* Kinds of latency distributions */
+#define DISTRIBUTION_FIXED 0 /**< Always the first parameter. */
+#define DISTRIBUTION_UNIFORM 1 /**< Uniform between the first and the second parameter. */
+#define DISTRIBUTION_EXPONENTIAL 2 /**< Exponential with the first parameter as mean. */
+#define DISTRIBUTION_LOGNORMAL 3 /**< Log-normal with the first parameter as median and the second as sigma. */
+
+/**
+ * An attribute of an entry with a single value.
+ *
+ * Attributes with several values are stored as several consecutive
+ * attributes of the same name.
+ */
+struct attribute_t {
+	char* name; /**< The name of the attribute. */
+	char* value; /**< The value. */
+};
+
+/**
+ * An entry of the fixture file.
+ */
+struct entry_t {
+	char* dn; /**< The distinguished name. */
+	struct attribute_t* attributes; /**< The attributes. */
+	size_t attribute_count; /**< The number of attributes. */
+};
+
+/**
+ * The settings of the server.
+ */
+struct standin_setting_t {
+	char const * fixture_file; /**< The LDIF file with the entries. */
+	char const * unix_socket; /**< The path of the Unix socket or `NULL`. */
+	unsigned int port; /**< The loopback TCP port, if no Unix socket is used. */
+	int distribution; /**< The kind of the latency distribution. */
+	double latency_parms[2]; /**< The parameters of the latency distribution in milliseconds. */
+	double jitter; /**< The maximum uniform jitter in milliseconds which is added to the latency. */
+	double error_rate; /**< The probability that a search fails with `error_code`. */
+	int error_code; /**< The result code of failed searches. */
+	double withhold_rate; /**< The probability that a request is never answered. */
+	double drop_rate; /**< The probability that the connection is dropped instead of answering a request. */
+	long size_limit; /**< The maximum number of entries of a search or of a page; zero means no limit. */
+	int is_paging_disabled; /**< Non-zero, if the paged results control is rejected. */
+	uint64_t seed; /**< The seed of the random numbers. */
+};
+
+static struct standin_setting_t setting;
+
+static struct entry_t* entries = NULL;
+
+static size_t entry_count = 0;
+
+static _Atomic uint64_t random_counter = 0;
+
+/* Statistics which are printed on exit */
+static _Atomic uint64_t stat_connections = 0;
+static _Atomic uint64_t stat_requests = 0;
+static _Atomic uint64_t stat_errors = 0;
+static _Atomic uint64_t stat_withheld = 0;
+static _Atomic uint64_t stat_drops = 0;
+
+/**
+ * A client connection which is shared by its reader and the threads
+ * answering its requests.
+ */
+struct connection_t {
+	int fd; /**< The socket. */
+	pthread_mutex_t write_mutex; /**< Serializes the responses. */
+	_Atomic unsigned int ref_count; /**< The number of threads using this connection. */
+};
+
+/**
+ * A request which is answered by its own thread.
+ */
+struct request_t {
+	struct connection_t* connection; /**< The connection of the request. */
+	int message_id; /**< The message ID. */
+	int tag; /**< The tag of the protocol operation. */
+	uint8_t* data; /**< The protocol operation followed by the controls. */
+	size_t len; /**< The length of the protocol operation. */
+	size_t controls_len; /**< The length of the controls. */
+};
+
+/**
+ * A read-only view on BER encoded data.
+ */
+struct ber_cursor_t {
+	uint8_t const * data; /**< The next byte. */
+	size_t len; /**< The number of remaining bytes. */
+};
+
+/**
+ * A growable buffer for BER encoded data.
+ */
+struct ber_buffer_t {
+	uint8_t* data; /**< The encoded data. */
+	size_t size; /**< The length of the encoded data. */
+	size_t capacity; /**< The capacity of `data`. */
+	int is_failed; /**< Non-zero, if an allocation has failed. */
+};
+
+static void print_usage( char const * const prog ) {
+	fprintf( stdout, "Usage: %s -f fixture.ldif (-u socket_path | -p port) [options]\n", prog );
+	fprintf( stdout, "    -d distribution  Latency of each request in milliseconds: fixed:<ms>, uniform:<min>:<max>,\n" );
+	fprintf( stdout, "                     exp:<mean> or lognormal:<median>:<sigma>; default: fixed:0\n" );
+	fprintf( stdout, "    -e rate          Probability that a search fails; default: 0\n" );
+	fprintf( stdout, "    -E code          LDAP result code of failed searches; default: %d (busy)\n", LDAP_BUSY );
+	fprintf( stdout, "    -f file          LDIF file with the entries\n" );
+	fprintf( stdout, "    -h               Print this help and exit\n" );
+	fprintf( stdout, "    -j ms            Maximum uniform jitter which is added to the latency; default: 0\n" );
+	fprintf( stdout, "    -n               Reject the paged results control like a server which does not support it\n" );
+	fprintf( stdout, "    -p port          Listen on this TCP port of the loopback interface\n" );
+	fprintf( stdout, "    -r seed          Seed of the random numbers; default: 1\n" );
+	fprintf( stdout, "    -s limit         Maximum number of entries of a search or of a page, e.g. 500 like slapd;\n" );
+	fprintf( stdout, "                     default: 0 (no limit)\n" );
+	fprintf( stdout, "    -u path          Listen on this Unix socket, e.g. for ldapi://%%2ftmp%%2fldap.sock\n" );
+	fprintf( stdout, "    -w rate          Probability that a request is never answered; default: 0\n" );
+	fprintf( stdout, "    -x rate          Probability that the connection is dropped instead; default: 0\n" );
+}
+
+/**
+ * Returns a uniformly distributed random number in `[0, 1)`.
+ *
+ * The numbers are derived from a shared counter with SplitMix64, hence the
+ * sequence only depends on the seed and the order of the requests.
+ */
+static double get_random( void ) {
+	uint64_t z = setting.seed + 0x9E3779B97F4A7C15ULL * ( atomic_fetch_add( &random_counter, 1 ) + 1 );
+	z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+	z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBULL;
+	z ^= z >> 31;
+	return (double)( z >> 11 ) / 9007199254740992.0;
+}
+
+/**
+ * Draws the latency of a request from the configured distribution.
+ *
+ * @return The latency in milliseconds
+ */
+static double draw_latency( void ) {
+	double latency = 0;
+	double const a = setting.latency_parms[0];
+	double const b = setting.latency_parms[1];
+	if( setting.distribution == DISTRIBUTION_FIXED ) {
+		latency = a;
+	} else if( setting.distribution == DISTRIBUTION_UNIFORM ) {
+		latency = a + ( b - a ) * get_random();
+	} else if( setting.distribution == DISTRIBUTION_EXPONENTIAL ) {
+		latency = -a * log( 1.0 - get_random() );
+	} else {
+		// Box-Muller transform
+		double const u1 = 1.0 - get_random();
+		double const u2 = get_random();
+		latency = a * exp( b * sqrt( -2.0 * log( u1 ) ) * cos( 2.0 * M_PI * u2 ) );
+	}
+	if( setting.jitter > 0 )
+		latency += setting.jitter * get_random();
+	return latency > 0 ? latency : 0;
+}
+
+static void sleep_msec( double const msec ) {
+	if( msec <= 0 )
+		return;
+	struct timespec ts = { (time_t)( msec / 1000 ), (long)( fmod( msec, 1000 ) * 1000000 ) };
+	while( nanosleep( &ts, &ts ) != 0 && errno == EINTR )
+		;
+}
+
+/**
+ * Parses a latency distribution of the form `<kind>:<parm>[:<parm>]`.
+ *
+ * @return Zero on success, non-zero in case of an error
+ */
+static int parse_distribution( char const * const spec ) {
+	static char const * const names[] = { "fixed", "uniform", "exp", "lognormal" };
+	static int const parm_counts[] = { 1, 2, 1, 2 };
+	char const * const colon = strchr( spec, ':' );
+	if( colon == NULL )
+		return -1;
+	for( int kind = 0; kind != 4; ++kind ) {
+		if( strlen( names[kind] ) != (size_t)( colon - spec ) || strncmp( spec, names[kind], (size_t)( colon - spec ) ) != 0 )
+			continue;
+		char* end = NULL;
+		setting.latency_parms[0] = strtod( colon + 1, &end );
+		setting.latency_parms[1] = 0;
+		if( parm_counts[kind] == 2 ) {
+			if( *end != ':' )
+				return -1;
+			setting.latency_parms[1] = strtod( end + 1, &end );
+		}
+		if( *end != '\0' || setting.latency_parms[0] < 0 || setting.latency_parms[1] < 0 )
+			return -1;
+		setting.distribution = kind;
+		return 0;
+	}
+	return -1;
+}
+
+static int parse_rate( char const * const value, double* const rate ) {
+	char* end = NULL;
+	*rate = strtod( value, &end );
+	return ( *value == '\0' || *end != '\0' || *rate < 0 || *rate > 1 ) ? -1 : 0;
+}
+
+static char* trim( char* str ) {
+	while( *str == ' ' || *str == '\t' )
+		++str;
+	size_t len = strlen( str );
+	while( len != 0 && ( str[len - 1] == ' ' || str[len - 1] == '\t' || str[len - 1] == '\n' || str[len - 1] == '\r' ) )
+		str[--len] = '\0';
+	return str;
+}
+
+/**
+ * Loads the entries of an LDIF file.
+ *
+ * Entries are separated by empty lines and start with `dn:`.
+ * Comments start with `#`.
+ *
+ * @return `EX_OK` on success, another error code from `sysexits.h`
+ * otherwise
+ */
+static int load_fixture( char const * const fixture_file ) {
+	FILE* const file = fopen( fixture_file, "r" );
+	if( file == NULL ) {
+		fprintf( stderr, "could not open %s: %s\n", fixture_file, strerror( errno ) );
+		return EX_NOINPUT;
+	}
+	entries = calloc( MAX_ENTRIES, sizeof( struct entry_t ) );
+	if( entries == NULL ) {
+		fclose( file );
+		return EX_OSERR;
+	}
+	char* line = NULL;
+	size_t line_capacity = 0;
+	struct entry_t* entry = NULL;
+	unsigned int line_no = 0;
+	int result = EX_OK;
+	while( result == EX_OK && getline( &line, &line_capacity, file ) != -1 ) {
+		++line_no;
+		char* const content = trim( line );
+		if( *content == '#' )
+			continue;
+		if( *content == '\0' ) {
+			entry = NULL;
+			continue;
+		}
+		char* const colon = strchr( content, ':' );
+		if( colon == NULL || colon[1] == ':' ) {
+			fprintf( stderr, "%s:%u: unsupported line\n", fixture_file, line_no );
+			result = EX_DATAERR;
+			break;
+		}
+		*colon = '\0';
+		char* const name = trim( content );
+		char* const value = trim( colon + 1 );
+		if( entry == NULL ) {
+			if( strcasecmp( name, "dn" ) != 0 || entry_count == MAX_ENTRIES ) {
+				fprintf( stderr, "%s:%u: entry does not start with a DN\n", fixture_file, line_no );
+				result = EX_DATAERR;
+				break;
+			}
+			entry = &entries[entry_count++];
+			entry->dn = strdup( value );
+			if( entry->dn == NULL )
+				result = EX_OSERR;
+			continue;
+		}
+		struct attribute_t* const attributes = realloc( entry->attributes, ( entry->attribute_count + 1 ) * sizeof( struct attribute_t ) );
+		if( attributes == NULL ) {
+			result = EX_OSERR;
+			break;
+		}
+		entry->attributes = attributes;
+		attributes[entry->attribute_count].name = strdup( name );
+		attributes[entry->attribute_count].value = strdup( value );
+		if( attributes[entry->attribute_count].name == NULL || attributes[entry->attribute_count].value == NULL )
+			result = EX_OSERR;
+		++entry->attribute_count;
+	}
+	free( line );
+	fclose( file );
+	return result;
+}
+
+/**
+ * Reads the next element.
+ *
+ * @param tag Output parameter for the tag
+ * @param value Output parameter for the contents of the element
+ * @return Zero on success, non-zero if the data is malformed
+ */
+static int read_element( struct ber_cursor_t* const cursor, int* const tag, struct ber_cursor_t* const value ) {
+	if( cursor->len < 2 )
+		return -1;
+	*tag = cursor->data[0];
+	size_t len = cursor->data[1];
+	size_t header_len = 2;
+	if( len & 0x80 ) {
+		size_t const len_bytes = len & 0x7F;
+		if( len_bytes == 0 || len_bytes > 4 || cursor->len < 2 + len_bytes )
+			return -1;
+		len = 0;
+		for( size_t i = 0; i != len_bytes; ++i )
+			len = ( len << 8 ) | cursor->data[2 + i];
+		header_len += len_bytes;
+	}
+	if( cursor->len - header_len < len )
+		return -1;
+	value->data = cursor->data + header_len;
+	value->len = len;
+	cursor->data += header_len + len;
+	cursor->len -= header_len + len;
+	return 0;
+}
+
+/**
+ * Reads the next element and checks its tag.
+ */
+static int read_expected( struct ber_cursor_t* const cursor, int const expected_tag, struct ber_cursor_t* const value ) {
+	int tag = 0;
+	return ( read_element( cursor, &tag, value ) != 0 || tag != expected_tag ) ? -1 : 0;
+}
+
+static long decode_integer( struct ber_cursor_t const * const value ) {
+	long result = ( value->len != 0 && ( value->data[0] & 0x80 ) ) ? -1 : 0;
+	for( size_t i = 0; i != value->len && i != sizeof( long ); ++i )
+		result = (long)( ( (unsigned long)result << 8 ) | value->data[i] );
+	return result;
+}
+
+static int is_equal( struct ber_cursor_t const * const value, char const * const str ) {
+	return strlen( str ) == value->len && strncasecmp( str, (char const *)value->data, value->len ) == 0;
+}
+
+/**
+ * Checks whether a string contains the substrings of a substring filter in
+ * order.
+ */
+static int match_substrings( char const * const str, struct ber_cursor_t substrings ) {
+	size_t const str_len = strlen( str );
+	size_t pos = 0;
+	while( substrings.len != 0 ) {
+		int tag = 0;
+		struct ber_cursor_t part;
+		if( read_element( &substrings, &tag, &part ) != 0 )
+			return 0;
+		if( tag == TAG_SUBSTRING_INITIAL ) {
+			if( part.len > str_len || strncasecmp( str, (char const *)part.data, part.len ) != 0 )
+				return 0;
+			pos = part.len;
+		} else if( tag == TAG_SUBSTRING_ANY ) {
+			size_t found = pos;
+			while( found + part.len <= str_len && strncasecmp( str + found, (char const *)part.data, part.len ) != 0 )
+				++found;
+			if( found + part.len > str_len )
+				return 0;
+			pos = found + part.len;
+		} else if( tag == TAG_SUBSTRING_FINAL ) {
+			if( part.len > str_len - pos || strncasecmp( str + str_len - part.len, (char const *)part.data, part.len ) != 0 )
+				return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+ * Evaluates a search filter for an entry.
+ *
+ * @return Non-zero, if the entry matches, zero otherwise
+ */
+static int match_filter( struct entry_t const * const entry, int const tag, struct ber_cursor_t value ) {
+	if( tag == TAG_FILTER_AND || tag == TAG_FILTER_OR ) {
+		while( value.len != 0 ) {
+			int sub_tag = 0;
+			struct ber_cursor_t sub_value;
+			if( read_element( &value, &sub_tag, &sub_value ) != 0 )
+				return 0;
+			int const is_match = match_filter( entry, sub_tag, sub_value );
+			if( tag == TAG_FILTER_AND && !is_match )
+				return 0;
+			if( tag == TAG_FILTER_OR && is_match )
+				return 1;
+		}
+		return tag == TAG_FILTER_AND;
+	}
+	if( tag == TAG_FILTER_NOT ) {
+		int sub_tag = 0;
+		struct ber_cursor_t sub_value;
+		return read_element( &value, &sub_tag, &sub_value ) == 0 && !match_filter( entry, sub_tag, sub_value );
+	}
+	if( tag == TAG_FILTER_PRESENT ) {
+		for( size_t i = 0; i != entry->attribute_count; ++i ) {
+			if( is_equal( &value, entry->attributes[i].name ) )
+				return 1;
+		}
+		return 0;
+	}
+	if( tag == TAG_FILTER_EQUALITY || tag == TAG_FILTER_SUBSTRINGS ) {
+		struct ber_cursor_t name;
+		struct ber_cursor_t assertion;
+		int assertion_tag = 0;
+		if( read_expected( &value, TAG_OCTET_STRING, &name ) != 0 || read_element( &value, &assertion_tag, &assertion ) != 0 )
+			return 0;
+		for( size_t i = 0; i != entry->attribute_count; ++i ) {
+			if( !is_equal( &name, entry->attributes[i].name ) )
+				continue;
+			if( tag == TAG_FILTER_EQUALITY && is_equal( &assertion, entry->attributes[i].value ) )
+				return 1;
+			if( tag == TAG_FILTER_SUBSTRINGS && match_substrings( entry->attributes[i].value, assertion ) )
+				return 1;
+		}
+		return 0;
+	}
+	// Other filter types are not supported and never match
+	return 0;
+}
+
+/**
+ * Checks whether an entry is the base or below the base.
+ */
+static int is_in_subtree( struct entry_t const * const entry, struct ber_cursor_t const * const base ) {
+	size_t const dn_len = strlen( entry->dn );
+	if( base->len == 0 )
+		return 1;
+	if( dn_len < base->len || strncasecmp( entry->dn + dn_len - base->len, (char const *)base->data, base->len ) != 0 )
+		return 0;
+	return dn_len == base->len || entry->dn[dn_len - base->len - 1] == ',';
+}
+
+static void reserve_buffer( struct ber_buffer_t* const buffer, size_t const len ) {
+	if( buffer->size + len <= buffer->capacity || buffer->is_failed )
+		return;
+	size_t capacity = buffer->capacity != 0 ? buffer->capacity : 256;
+	while( capacity < buffer->size + len )
+		capacity *= 2;
+	uint8_t* const data = realloc( buffer->data, capacity );
+	if( data == NULL ) {
+		buffer->is_failed = 1;
+		return;
+	}
+	buffer->data = data;
+	buffer->capacity = capacity;
+}
+
+/**
+ * Starts a constructed element whose length is patched by
+ * ::end_element().
+ *
+ * @return The position of the element
+ */
+static size_t begin_element( struct ber_buffer_t* const buffer, int const tag ) {
+	reserve_buffer( buffer, 6 );
+	if( buffer->is_failed )
+		return 0;
+	size_t const position = buffer->size;
+	buffer->data[position] = (uint8_t)tag;
+	// Lengths are always encoded in the long form with four bytes, which
+	// BER permits
+	buffer->data[position + 1] = 0x84;
+	buffer->size += 6;
+	return position;
+}
+
+static void end_element( struct ber_buffer_t* const buffer, size_t const position ) {
+	if( buffer->is_failed )
+		return;
+	uint32_t const len = htonl( (uint32_t)( buffer->size - position - 6 ) );
+	memcpy( buffer->data + position + 2, &len, 4 );
+}
+
+static void put_bytes( struct ber_buffer_t* const buffer, int const tag, void const * const data, size_t const len ) {
+	size_t const position = begin_element( buffer, tag );
+	reserve_buffer( buffer, len );
+	if( buffer->is_failed )
+		return;
+	memcpy( buffer->data + buffer->size, data, len );
+	buffer->size += len;
+	end_element( buffer, position );
+}
+
+static void put_string( struct ber_buffer_t* const buffer, char const * const str ) {
+	put_bytes( buffer, TAG_OCTET_STRING, str, strlen( str ) );
+}
+
+static void put_integer( struct ber_buffer_t* const buffer, int const tag, long const value ) {
+	uint8_t bytes[sizeof( long )];
+	size_t len = sizeof( long );
+	for( size_t i = 0; i != sizeof( long ); ++i )
+		bytes[i] = (uint8_t)( (unsigned long)value >> ( 8 * ( sizeof( long ) - 1 - i ) ) );
+	// Minimal two's complement encoding
+	size_t start = 0;
+	while( len - start > 1 && (
+		( bytes[start] == 0x00 && !( bytes[start + 1] & 0x80 ) ) ||
+		( bytes[start] == 0xFF && ( bytes[start + 1] & 0x80 ) )
+	) )
+		++start;
+	put_bytes( buffer, tag, bytes + start, len - start );
+}
+
+/**
+ * Starts an LDAP message.
+ *
+ * @return The position of the message and the position of the protocol
+ * operation
+ */
+static size_t begin_message( struct ber_buffer_t* const buffer, int const message_id, int const tag, size_t* const op_position ) {
+	size_t const position = begin_element( buffer, TAG_SEQUENCE );
+	put_integer( buffer, TAG_INTEGER, message_id );
+	*op_position = begin_element( buffer, tag );
+	return position;
+}
+
+static void end_message( struct ber_buffer_t* const buffer, size_t const position, size_t const op_position ) {
+	end_element( buffer, op_position );
+	end_element( buffer, position );
+}
+
+/**
+ * Appends a result message, e.g. a bind response or the end of a search.
+ */
+static void put_result( struct ber_buffer_t* const buffer, int const message_id, int const tag, int const result_code, char const * const message ) {
+	size_t op_position = 0;
+	size_t const position = begin_message( buffer, message_id, tag, &op_position );
+	put_integer( buffer, TAG_ENUMERATED, result_code );
+	put_string( buffer, "" );
+	put_string( buffer, message );
+	end_message( buffer, position, op_position );
+}
+
+/**
+ * Appends the end of a paged search with the paged results control.
+ *
+ * @param cookie The cookie of the next page; empty after the last page
+ */
+static void put_paged_result( struct ber_buffer_t* const buffer, int const message_id, char const * const cookie ) {
+	size_t op_position = 0;
+	size_t const position = begin_message( buffer, message_id, TAG_SEARCH_DONE, &op_position );
+	put_integer( buffer, TAG_ENUMERATED, LDAP_SUCCESS );
+	put_string( buffer, "" );
+	put_string( buffer, "" );
+	end_element( buffer, op_position );
+	size_t const controls_position = begin_element( buffer, TAG_CONTROLS );
+	size_t const control_position = begin_element( buffer, TAG_SEQUENCE );
+	put_string( buffer, PAGED_RESULTS_OID );
+	size_t const value_position = begin_element( buffer, TAG_OCTET_STRING );
+	size_t const page_position = begin_element( buffer, TAG_SEQUENCE );
+	put_integer( buffer, TAG_INTEGER, 0 );
+	put_string( buffer, cookie );
+	end_element( buffer, page_position );
+	end_element( buffer, value_position );
+	end_element( buffer, control_position );
+	end_element( buffer, controls_position );
+	end_element( buffer, position );
+}
+
+/**
+ * Finds the paged results control of a request.
+ *
+ * @param page_size Output parameter for the requested page size
+ * @param offset Output parameter for the number of entries which have been
+ * returned by the previous pages; the cookie is this number in decimal
+ * @param is_critical Output parameter for the criticality of the control
+ * @return Non-zero, if the request has a well-formed paged results control
+ */
+static int find_paged_results( struct ber_cursor_t controls, long* const page_size, long* const offset, int* const is_critical ) {
+	struct ber_cursor_t list;
+	if( controls.len == 0 || read_expected( &controls, TAG_CONTROLS, &list ) != 0 )
+		return 0;
+	while( list.len != 0 ) {
+		struct ber_cursor_t control, oid, field;
+		int tag = 0;
+		if( read_expected( &list, TAG_SEQUENCE, &control ) != 0 || read_expected( &control, TAG_OCTET_STRING, &oid ) != 0 )
+			return 0;
+		if( !is_equal( &oid, PAGED_RESULTS_OID ) )
+			continue;
+		*is_critical = 0;
+		while( control.len != 0 && read_element( &control, &tag, &field ) == 0 ) {
+			if( tag == TAG_BOOLEAN ) {
+				*is_critical = ( field.len != 0 && field.data[0] != 0 );
+				continue;
+			}
+			struct ber_cursor_t page, size, cookie;
+			if(
+				tag != TAG_OCTET_STRING ||
+				read_expected( &field, TAG_SEQUENCE, &page ) != 0 ||
+				read_expected( &page, TAG_INTEGER, &size ) != 0 ||
+				read_expected( &page, TAG_OCTET_STRING, &cookie ) != 0
+			)
+				return 0;
+			*page_size = decode_integer( &size );
+			*offset = 0;
+			for( size_t i = 0; i != cookie.len && cookie.data[i] >= '0' && cookie.data[i] <= '9'; ++i )
+				*offset = *offset * 10 + ( cookie.data[i] - '0' );
+			return 1;
+		}
+		return 0;
+	}
+	return 0;
+}
+
+/**
+ * Appends an entry with the requested attributes.
+ *
+ * @param requested The list of requested attributes; all attributes, if it
+ * is empty or contains `*`
+ */
+static void put_entry( struct ber_buffer_t* const buffer, int const message_id, struct entry_t const * const entry, struct ber_cursor_t const * const requested ) {
+	int is_all = ( requested->len == 0 );
+	struct ber_cursor_t list = *requested;
+	while( list.len != 0 && !is_all ) {
+		struct ber_cursor_t name;
+		if( read_expected( &list, TAG_OCTET_STRING, &name ) != 0 )
+			break;
+		is_all = is_equal( &name, "*" );
+	}
+
+	size_t op_position = 0;
+	size_t const position = begin_message( buffer, message_id, TAG_SEARCH_ENTRY, &op_position );
+	put_string( buffer, entry->dn );
+	size_t const attributes_position = begin_element( buffer, TAG_SEQUENCE );
+	for( size_t i = 0; i != entry->attribute_count; ++i ) {
+		char const * const name = entry->attributes[i].name;
+		// Values of the same attribute are grouped by the first occurrence
+		int is_first = 1;
+		for( size_t j = 0; j != i && is_first; ++j )
+			is_first = ( strcasecmp( entry->attributes[j].name, name ) != 0 );
+		if( !is_first )
+			continue;
+		int is_requested = is_all;
+		list = *requested;
+		while( list.len != 0 && !is_requested ) {
+			struct ber_cursor_t requested_name;
+			if( read_expected( &list, TAG_OCTET_STRING, &requested_name ) != 0 )
+				break;
+			is_requested = is_equal( &requested_name, name );
+		}
+		if( !is_requested )
+			continue;
+		size_t const attribute_position = begin_element( buffer, TAG_SEQUENCE );
+		put_string( buffer, name );
+		size_t const values_position = begin_element( buffer, TAG_SET );
+		for( size_t j = i; j != entry->attribute_count; ++j ) {
+			if( strcasecmp( entry->attributes[j].name, name ) == 0 )
+				put_string( buffer, entry->attributes[j].value );
+		}
+		end_element( buffer, values_position );
+		end_element( buffer, attribute_position );
+	}
+	end_element( buffer, attributes_position );
+	end_message( buffer, position, op_position );
+}
+
+/**
+ * Builds the response to a search.
+ *
+ * @param delay The injected delay in milliseconds; it is shortened to the
+ * time limit of the request, which then fails
+ */
+static void search(
+	struct ber_buffer_t* const buffer,
+	int const message_id,
+	struct ber_cursor_t request,
+	struct ber_cursor_t const controls,
+	double* const delay
+) {
+	struct ber_cursor_t base, scope, deref, size_limit, time_limit, types_only, filter, attributes;
+	int filter_tag = 0;
+	if(
+		read_expected( &request, TAG_OCTET_STRING, &base ) != 0 ||
+		read_expected( &request, TAG_ENUMERATED, &scope ) != 0 ||
+		read_expected( &request, TAG_ENUMERATED, &deref ) != 0 ||
+		read_expected( &request, TAG_INTEGER, &size_limit ) != 0 ||
+		read_expected( &request, TAG_INTEGER, &time_limit ) != 0 ||
+		read_expected( &request, TAG_BOOLEAN, &types_only ) != 0 ||
+		read_element( &request, &filter_tag, &filter ) != 0 ||
+		read_expected( &request, TAG_SEQUENCE, &attributes ) != 0
+	) {
+		put_result( buffer, message_id, TAG_SEARCH_DONE, LDAP_PROTOCOL_ERROR, "malformed search request" );
+		return;
+	}
+
+	long const time_limit_msec = decode_integer( &time_limit ) * 1000;
+	if( time_limit_msec > 0 && *delay >= (double)time_limit_msec ) {
+		*delay = (double)time_limit_msec;
+		put_result( buffer, message_id, TAG_SEARCH_DONE, LDAP_TIMELIMIT_EXCEEDED, "injected latency exceeds time limit" );
+		return;
+	}
+	if( setting.error_rate > 0 && get_random() < setting.error_rate ) {
+		atomic_fetch_add( &stat_errors, 1 );
+		put_result( buffer, message_id, TAG_SEARCH_DONE, setting.error_code, "injected error" );
+		return;
+	}
+
+	long page_size = 0;
+	long offset = 0;
+	int is_critical = 0;
+	int const is_paged = find_paged_results( controls, &page_size, &offset, &is_critical );
+	if( is_paged && is_critical && setting.is_paging_disabled ) {
+		put_result( buffer, message_id, TAG_SEARCH_DONE, LDAP_UNAVAILABLE_CRITICAL_EXTENSION, "paged results are not supported" );
+		return;
+	}
+
+	long max_entries = decode_integer( &size_limit );
+	if( setting.size_limit > 0 && ( max_entries <= 0 || max_entries > setting.size_limit ) )
+		max_entries = setting.size_limit;
+	if( is_paged && !setting.is_paging_disabled && page_size > 0 && ( max_entries <= 0 || max_entries > page_size ) )
+		max_entries = page_size;
+	long found = 0;
+	long skipped = 0;
+	int is_truncated = 0;
+	for( size_t i = 0; i != entry_count; ++i ) {
+		if( !is_in_subtree( &entries[i], &base ) || !match_filter( &entries[i], filter_tag, filter ) )
+			continue;
+		if( is_paged && !setting.is_paging_disabled && skipped != offset ) {
+			++skipped;
+			continue;
+		}
+		if( max_entries > 0 && found == max_entries ) {
+			is_truncated = 1;
+			break;
+		}
+		put_entry( buffer, message_id, &entries[i], &attributes );
+		++found;
+	}
+	if( is_paged && !setting.is_paging_disabled ) {
+		char cookie[32] = "";
+		if( is_truncated )
+			snprintf( cookie, sizeof( cookie ), "%ld", offset + found );
+		put_paged_result( buffer, message_id, cookie );
+		return;
+	}
+	put_result( buffer, message_id, TAG_SEARCH_DONE, is_truncated ? LDAP_SIZELIMIT_EXCEEDED : LDAP_SUCCESS, "" );
+}
+
+static void release_connection( struct connection_t* const connection ) {
+	if( atomic_fetch_sub( &connection->ref_count, 1 ) != 1 )
+		return;
+	close( connection->fd );
+	pthread_mutex_destroy( &connection->write_mutex );
+	free( connection );
+}
+
+static int write_all( int const fd, uint8_t const * buf, size_t len ) {
+	while( len != 0 ) {
+		ssize_t const written = send( fd, buf, len, MSG_NOSIGNAL );
+		if( written == -1 && errno == EINTR )
+			continue;
+		if( written <= 0 )
+			return -1;
+		buf += written;
+		len -= (size_t)written;
+	}
+	return 0;
+}
+
+/**
+ * Answers a request after the injected delay.
+ */
+static void* answer_request( void* arg ) {
+	struct request_t* const request = (struct request_t*)arg;
+	struct connection_t* const connection = request->connection;
+	double delay = draw_latency();
+	struct ber_buffer_t buffer = { NULL, 0, 0, 0 };
+	struct ber_cursor_t const operation = { request->data, request->len };
+	struct ber_cursor_t const controls = { request->data + request->len, request->controls_len };
+
+	if( setting.drop_rate > 0 && get_random() < setting.drop_rate ) {
+		atomic_fetch_add( &stat_drops, 1 );
+		sleep_msec( delay );
+		// The reader notices the shutdown and releases the connection
+		shutdown( connection->fd, SHUT_RDWR );
+	} else if( setting.withhold_rate > 0 && get_random() < setting.withhold_rate ) {
+		atomic_fetch_add( &stat_withheld, 1 );
+	} else {
+		if( request->tag == TAG_BIND_REQUEST )
+			put_result( &buffer, request->message_id, TAG_BIND_RESPONSE, LDAP_SUCCESS, "" );
+		else if( request->tag == TAG_SEARCH_REQUEST )
+			search( &buffer, request->message_id, operation, controls, &delay );
+		else
+			put_result( &buffer, request->message_id, TAG_EXTENDED_RESPONSE, LDAP_PROTOCOL_ERROR, "unsupported operation" );
+		sleep_msec( delay );
+		if( !buffer.is_failed ) {
+			pthread_mutex_lock( &connection->write_mutex );
+			write_all( connection->fd, buffer.data, buffer.size );
+			pthread_mutex_unlock( &connection->write_mutex );
+		}
+	}
+
+	free( buffer.data );
+	free( request->data );
+	free( request );
+	release_connection( connection );
+	return NULL;
+}
+
+static int read_all( int const fd, uint8_t* buf, size_t len ) {
+	while( len != 0 ) {
+		ssize_t const received = recv( fd, buf, len, 0 );
+		if( received == -1 && errno == EINTR )
+			continue;
+		if( received <= 0 )
+			return -1;
+		buf += received;
+		len -= (size_t)received;
+	}
+	return 0;
+}
+
+/**
+ * Reads the next LDAP message of a connection.
+ *
+ * @param message Output parameter for the message in newly allocated
+ * memory
+ * @param len Output parameter for the length of the message contents
+ * @return Zero on success, non-zero if the connection has been closed or
+ * the message is malformed
+ */
+static int read_message( int const fd, uint8_t** const message, size_t* const len ) {
+	uint8_t header[6];
+	if( read_all( fd, header, 2 ) != 0 || header[0] != TAG_SEQUENCE )
+		return -1;
+	size_t message_len = header[1];
+	if( message_len & 0x80 ) {
+		size_t const len_bytes = message_len & 0x7F;
+		if( len_bytes == 0 || len_bytes > 4 || read_all( fd, header + 2, len_bytes ) != 0 )
+			return -1;
+		message_len = 0;
+		for( size_t i = 0; i != len_bytes; ++i )
+			message_len = ( message_len << 8 ) | header[2 + i];
+	}
+	if( message_len > MAX_REQUEST_SIZE )
+		return -1;
+	*message = malloc( message_len != 0 ? message_len : 1 );
+	if( *message == NULL )
+		return -1;
+	if( read_all( fd, *message, message_len ) != 0 ) {
+		free( *message );
+		return -1;
+	}
+	*len = message_len;
+	return 0;
+}
+
+/**
+ * Reads the requests of a connection and dispatches them to their own
+ * threads.
+ */
+static void* serve_connection( void* arg ) {
+	struct connection_t* const connection = (struct connection_t*)arg;
+	uint8_t* message = NULL;
+	size_t len = 0;
+	while( read_message( connection->fd, &message, &len ) == 0 ) {
+		struct ber_cursor_t cursor = { message, len };
+		struct ber_cursor_t message_id;
+		struct ber_cursor_t operation;
+		int tag = 0;
+		if( read_expected( &cursor, TAG_INTEGER, &message_id ) != 0 || read_element( &cursor, &tag, &operation ) != 0 ) {
+			free( message );
+			break;
+		}
+		atomic_fetch_add( &stat_requests, 1 );
+		if( tag == TAG_UNBIND_REQUEST ) {
+			free( message );
+			break;
+		}
+		if( tag == TAG_ABANDON_REQUEST ) {
+			// Late responses to abandoned requests are discarded by the client
+			free( message );
+			continue;
+		}
+
+		struct request_t* const request = malloc( sizeof( struct request_t ) );
+		// The controls follow the operation
+		uint8_t* const data = malloc( operation.len + cursor.len != 0 ? operation.len + cursor.len : 1 );
+		if( request == NULL || data == NULL ) {
+			free( request );
+			free( data );
+			free( message );
+			break;
+		}
+		memcpy( data, operation.data, operation.len + cursor.len );
+		request->connection = connection;
+		request->message_id = (int)decode_integer( &message_id );
+		request->tag = tag;
+		request->data = data;
+		request->len = operation.len;
+		request->controls_len = cursor.len;
+		free( message );
+
+		atomic_fetch_add( &connection->ref_count, 1 );
+		pthread_t thread;
+		if( pthread_create( &thread, NULL, answer_request, request ) != 0 ) {
+			free( request->data );
+			free( request );
+			atomic_fetch_sub( &connection->ref_count, 1 );
+			break;
+		}
+		pthread_detach( thread );
+	}
+	// Wake up threads which are still writing to a half-closed connection
+	shutdown( connection->fd, SHUT_RDWR );
+	release_connection( connection );
+	return NULL;
+}
+
+/**
+ * Accepts connections until the process is terminated.
+ */
+static void* accept_connections( void* arg ) {
+	int const listen_fd = *(int*)arg;
+	for( ;; ) {
+		int const fd = accept4( listen_fd, NULL, NULL, SOCK_CLOEXEC );
+		if( fd == -1 ) {
+			if( errno == EINTR || errno == ECONNABORTED || errno == EMFILE || errno == ENFILE )
+				continue;
+			break;
+		}
+		struct connection_t* const connection = malloc( sizeof( struct connection_t ) );
+		if( connection == NULL ) {
+			close( fd );
+			continue;
+		}
+		connection->fd = fd;
+		pthread_mutex_init( &connection->write_mutex, NULL );
+		atomic_init( &connection->ref_count, 1 );
+		atomic_fetch_add( &stat_connections, 1 );
+		pthread_t thread;
+		if( pthread_create( &thread, NULL, serve_connection, connection ) != 0 ) {
+			release_connection( connection );
+			continue;
+		}
+		pthread_detach( thread );
+	}
+	return NULL;
+}
+
+static int open_listener( void ) {
+	int fd = -1;
+	if( setting.unix_socket != NULL ) {
+		struct sockaddr_un address;
+		memset( &address, 0, sizeof( address ) );
+		if( strlen( setting.unix_socket ) >= sizeof( address.sun_path ) )
+			return -1;
+		address.sun_family = AF_UNIX;
+		strcpy( address.sun_path, setting.unix_socket );
+		unlink( setting.unix_socket );
+		fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+		if( fd != -1 && bind( fd, (struct sockaddr*)&address, sizeof( address ) ) != 0 ) {
+			close( fd );
+			return -1;
+		}
+	} else {
+		struct sockaddr_in address;
+		memset( &address, 0, sizeof( address ) );
+		address.sin_family = AF_INET;
+		address.sin_port = htons( (uint16_t)setting.port );
+		address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+		fd = socket( AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+		int const reuse = 1;
+		if( fd != -1 && (
+			setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof( reuse ) ) != 0 ||
+			bind( fd, (struct sockaddr*)&address, sizeof( address ) ) != 0
+		) ) {
+			close( fd );
+			return -1;
+		}
+	}
+	if( fd != -1 && listen( fd, SOMAXCONN ) != 0 ) {
+		close( fd );
+		return -1;
+	}
+	return fd;
+}
+
+int main( int argc, char* argv[] ) {
+	setting.error_code = LDAP_BUSY;
+	setting.seed = 1;
+
+	int opt;
+	while( ( opt = getopt( argc, argv, CLI_OPTS ) ) != -1 ) {
+		int is_valid = 1;
+		char* end = NULL;
+		switch( opt ) {
+		case 'd':
+			is_valid = ( parse_distribution( optarg ) == 0 );
+			break;
+		case 'e':
+			is_valid = ( parse_rate( optarg, &setting.error_rate ) == 0 );
+			break;
+		case 'E':
+			setting.error_code = (int)strtol( optarg, &end, 10 );
+			is_valid = ( *optarg != '\0' && *end == '\0' && setting.error_code > 0 );
+			break;
+		case 'f':
+			setting.fixture_file = optarg;
+			break;
+		case 'h':
+			print_usage( argv[0] );
+			return EX_OK;
+		case 'j':
+			setting.jitter = strtod( optarg, &end );
+			is_valid = ( *optarg != '\0' && *end == '\0' && setting.jitter >= 0 );
+			break;
+		case 'n':
+			setting.is_paging_disabled = 1;
+			break;
+		case 'p':
+			setting.port = (unsigned int)strtoul( optarg, &end, 10 );
+			is_valid = ( *optarg != '\0' && *end == '\0' && setting.port != 0 && setting.port <= 65535 );
+			break;
+		case 'r':
+			setting.seed = strtoull( optarg, &end, 10 );
+			is_valid = ( *optarg != '\0' && *end == '\0' );
+			break;
+		case 's':
+			setting.size_limit = strtol( optarg, &end, 10 );
+			is_valid = ( *optarg != '\0' && *end == '\0' && setting.size_limit >= 0 );
+			break;
+		case 'u':
+			setting.unix_socket = optarg;
+			break;
+		case 'w':
+			is_valid = ( parse_rate( optarg, &setting.withhold_rate ) == 0 );
+			break;
+		case 'x':
+			is_valid = ( parse_rate( optarg, &setting.drop_rate ) == 0 );
+			break;
+		default:
+			is_valid = 0;
+		}
+		if( !is_valid ) {
+			print_usage( argv[0] );
+			return EX_USAGE;
+		}
+	}
+	if( setting.fixture_file == NULL || ( setting.unix_socket == NULL ) == ( setting.port == 0 ) ) {
+		print_usage( argv[0] );
+		return EX_USAGE;
+	}
+
+	int const result = load_fixture( setting.fixture_file );
+	if( result != EX_OK )
+		return result;
+
+	// Termination signals are only received by sigwait()
+	sigset_t signals;
+	sigemptyset( &signals );
+	sigaddset( &signals, SIGINT );
+	sigaddset( &signals, SIGTERM );
+	pthread_sigmask( SIG_BLOCK, &signals, NULL );
+
+	int listen_fd = open_listener();
+	if( listen_fd == -1 ) {
+		fprintf( stderr, "could not listen: %s\n", strerror( errno ) );
+		return EX_UNAVAILABLE;
+	}
+	pthread_t thread;
+	if( pthread_create( &thread, NULL, accept_connections, &listen_fd ) != 0 ) {
+		close( listen_fd );
+		return EX_OSERR;
+	}
+	fprintf( stderr, "serving %zu entries\n", entry_count );
+
+	int signal_no = 0;
+	sigwait( &signals, &signal_no );
+	if( setting.unix_socket != NULL )
+		unlink( setting.unix_socket );
+	fprintf(
+		stderr, "connections=%llu requests=%llu errors=%llu withheld=%llu drops=%llu\n",
+		(unsigned long long)atomic_load( &stat_connections ),
+		(unsigned long long)atomic_load( &stat_requests ),
+		(unsigned long long)atomic_load( &stat_errors ),
+		(unsigned long long)atomic_load( &stat_withheld ),
+		(unsigned long long)atomic_load( &stat_drops )
+	);
+	// Connections are torn down by the exit of the process
+	return EX_OK;
+}
@@ -0,0 +1,820 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @file
+ * @brief Load generator which speaks the milter protocol like an MTA.
+ *
+ * The generator opens concurrent sessions to the milter, sends the
+ * `{auth_authen}` macro, `MAIL FROM`, one `RCPT TO` and the end of message
+ * for each message, and measures the latency of the replies.
+ * Throughput and latency percentiles are printed as CSV or JSON.
+ */
+
+static char const * const CONFIG_FILE_DEFAULT = "/etc/milter-alias.conf";
+
+static char const * const SOCKET_FILE_DEFAULT = "/run/milter-alias/milter-alias.sock";
+
+static char const * const CLI_OPTS = "a:c:f:hm:n:r:s:S:t:";
+
+/**
+ * The maximum number of senders and accounts given on the command line.
+ */
+#define MAX_ADDRESSES 64
+
+/**
+ * The maximum length of a packet which is accepted from the milter.
+ */
+#define MAX_PACKET_SIZE ( 1024 * 1024 )
+
+/**
+ * The version of the milter protocol which is offered.
+ */
+static uint32_t const SMFI_PROT_VERSION = 6;
+
+/**
+ * All actions which are offered to the milter.
+ */
+static uint32_t const SMFI_OFFERED_ACTIONS = 0x1FF;
+
+/**
+ * All protocol flags which are offered to the milter up to and including
+ * `SMFIP_HDR_LEADSPC`.
+ */
+static uint32_t const SMFI_OFFERED_PROTOCOL = 0x1FFFFF;
+
+/* Commands of the MTA */
+static char const SMFIC_ABORT = 'A';
+static char const SMFIC_BODY = 'B';
+static char const SMFIC_CONNECT = 'C';
+static char const SMFIC_MACRO = 'D';
+static char const SMFIC_BODYEOB = 'E';
+static char const SMFIC_HELO = 'H';
+static char const SMFIC_MAIL = 'M';
+static char const SMFIC_EOH = 'N';
+static char const SMFIC_OPTNEG = 'O';
+static char const SMFIC_QUIT = 'Q';
+static char const SMFIC_RCPT = 'R';
+
+/* Replies of the milter */
+static char const SMFIR_ADDRCPT = '+';
+static char const SMFIR_ADDRCPT_PAR = '2';
+static char const SMFIR_ACCEPT = 'a';
+static char const SMFIR_CONTINUE = 'c';
+static char const SMFIR_REJECT = 'r';
+static char const SMFIR_TEMPFAIL = 't';
+static char const SMFIR_REPLYCODE = 'y';
+
+/* Protocol flags which are returned by the milter */
+static uint32_t const SMFIP_NOCONNECT = 0x1;
+static uint32_t const SMFIP_NOHELO = 0x2;
+static uint32_t const SMFIP_NOMAIL = 0x4;
+static uint32_t const SMFIP_NORCPT = 0x8;
+static uint32_t const SMFIP_NOBODY = 0x10;
+static uint32_t const SMFIP_NOEOH = 0x40;
+static uint32_t const SMFIP_NR_CONN = 0x1000;
+static uint32_t const SMFIP_NR_HELO = 0x2000;
+static uint32_t const SMFIP_NR_MAIL = 0x4000;
+static uint32_t const SMFIP_NR_RCPT = 0x8000;
+static uint32_t const SMFIP_NR_EOH = 0x40000;
+static uint32_t const SMFIP_NR_BODY = 0x80000;
+
+static char const BODY[] = "Subject: load test\r\n\r\nThis is a load test.\r\n";
+
+/**
+ * The settings of a run.
+ */
+struct loadgen_setting_t {
+	char const * socket_spec; /**< `[unix:|local:]<path>` or `inet:<port>@<host>`. */
+	unsigned int concurrency; /**< The number of concurrent sessions. */
+	unsigned int messages; /**< The total number of messages. */
+	unsigned int messages_per_session; /**< The number of messages before a session is re-opened; zero means never. */
+	unsigned int timeout; /**< The time in seconds to wait for a reply. */
+	int is_json; /**< Non-zero for JSON output, zero for CSV. */
+	char const * senders[MAX_ADDRESSES]; /**< The envelope senders; messages use them in turn. */
+	size_t sender_count; /**< The number of senders. */
+	char const * accounts[MAX_ADDRESSES]; /**< The authenticated accounts; messages use them in turn. */
+	size_t account_count; /**< The number of accounts. */
+	char const * recipient; /**< The recipient of each message. */
+};
+
+/* The stages whose latency is measured */
+#define STAGE_SESSION 0 /**< Connecting and negotiating a session. */
+#define STAGE_MAIL 1 /**< `MAIL FROM` until its reply, i.e. the envelope sender callback. */
+#define STAGE_EOM 2 /**< End of message until the final reply, i.e. the end of message callback. */
+#define STAGE_MESSAGE 3 /**< A complete message. */
+#define STAGE_COUNT 4
+
+static char const * const STAGE_NAMES[STAGE_COUNT] = { "session", "mail", "eom", "message" };
+
+/**
+ * Latency samples of one stage.
+ */
+struct samples_t {
+	uint32_t* values; /**< The latencies in microseconds. */
+	size_t size; /**< The number of samples. */
+	size_t capacity; /**< The capacity of `values`. */
+};
+
+/**
+ * The state and results of a worker thread.
+ */
+struct worker_t {
+	pthread_t thread; /**< The thread. */
+	struct loadgen_setting_t const * setting; /**< The settings of the run. */
+	unsigned int first_message; /**< The index of the first message of this worker. */
+	unsigned int message_count; /**< The number of messages of this worker. */
+	int fd; /**< The socket of the current session or `-1`. */
+	uint32_t protocol; /**< The protocol flags of the current session. */
+	char* buf; /**< The buffer for received packets. */
+	size_t buf_capacity; /**< The capacity of `buf`. */
+	struct samples_t samples[STAGE_COUNT]; /**< The latency samples. */
+	uint64_t recipients; /**< The number of recipients added by the milter. */
+	uint64_t accepted; /**< The number of messages which have been accepted or continued. */
+	uint64_t rejected; /**< The number of messages which have been rejected permanently. */
+	uint64_t tempfailed; /**< The number of messages which have been rejected temporarily. */
+	uint64_t errors; /**< The number of messages which failed due to protocol or I/O errors. */
+};
+
+static void print_usage( char const * const prog ) {
+	fprintf( stdout, "Usage: %s [options]\n", prog );
+	fprintf( stdout, "    -a account      Authenticated account; may be repeated; default: none\n" );
+	fprintf( stdout, "    -c config_file  Read the socket from the option \"socket file\" of this file; default: %s\n", CONFIG_FILE_DEFAULT );
+	fprintf( stdout, "    -f format       Output format, either \"csv\" or \"json\"; default: csv\n" );
+	fprintf( stdout, "    -h              Print this help and exit\n" );
+	fprintf( stdout, "    -m messages     Messages per session before it is re-opened; 0 for never; default: 0\n" );
+	fprintf( stdout, "    -n messages     Total number of messages; default: 1000\n" );
+	fprintf( stdout, "    -r recipient    Recipient of each message; default: rcpt@example.org\n" );
+	fprintf( stdout, "    -s socket       Socket of the milter, [unix:]path or inet:port@host; overrides -c\n" );
+	fprintf( stdout, "    -S sender       Envelope sender; may be repeated; default: list@example.org\n" );
+	fprintf( stdout, "    -t concurrency  Number of concurrent sessions; default: 8\n" );
+}
+
+/**
+ * Returns the current time of the monotonic clock in microseconds.
+ */
+static uint64_t now_usec( void ) {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/**
+ * Removes leading and trailing white space in place.
+ */
+static char* trim( char* str ) {
+	while( *str == ' ' || *str == '\t' )
+		++str;
+	size_t len = strlen( str );
+	while( len != 0 && ( str[len - 1] == ' ' || str[len - 1] == '\t' || str[len - 1] == '\n' || str[len - 1] == '\r' ) )
+		str[--len] = '\0';
+	return str;
+}
+
+/**
+ * Reads the option `socket file` of the section `General` of the
+ * configuration file of the milter.
+ *
+ * @return The socket in newly allocated memory or `NULL`, if the file or
+ * the option does not exist
+ */
+static char* read_socket_file( char const * const config_file ) {
+	FILE* const file = fopen( config_file, "r" );
+	if( file == NULL )
+		return NULL;
+	char line[1024];
+	int is_general = 0;
+	char* result = NULL;
+	while( result == NULL && fgets( line, sizeof( line ), file ) != NULL ) {
+		char* const entry = trim( line );
+		if( *entry == '[' ) {
+			is_general = ( strcasecmp( entry, "[General]" ) == 0 );
+			continue;
+		}
+		char* const equal_sign = strchr( entry, '=' );
+		if( !is_general || equal_sign == NULL )
+			continue;
+		*equal_sign = '\0';
+		if( strcasecmp( trim( entry ), "socket file" ) == 0 )
+			result = strdup( trim( equal_sign + 1 ) );
+	}
+	fclose( file );
+	return result;
+}
+
+/**
+ * Opens a connection to the milter.
+ *
+ * @return The socket or `-1` in case of an error
+ */
+static int open_connection( char const * const socket_spec ) {
+	if( strncmp( socket_spec, "inet:", 5 ) == 0 ) {
+		char const * const port = socket_spec + 5;
+		char const * const at = strchr( port, '@' );
+		if( at == NULL )
+			return -1;
+		char service[16];
+		snprintf( service, sizeof( service ), "%.*s", (int)( at - port ), port );
+		struct addrinfo hints;
+		memset( &hints, 0, sizeof( hints ) );
+		hints.ai_socktype = SOCK_STREAM;
+		struct addrinfo* addresses = NULL;
+		if( getaddrinfo( at + 1, service, &hints, &addresses ) != 0 )
+			return -1;
+		int fd = -1;
+		for( struct addrinfo* address = addresses; address != NULL && fd == -1; address = address->ai_next ) {
+			fd = socket( address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol );
+			if( fd != -1 && connect( fd, address->ai_addr, address->ai_addrlen ) != 0 ) {
+				close( fd );
+				fd = -1;
+			}
+		}
+		freeaddrinfo( addresses );
+		return fd;
+	}
+
+	char const * path = socket_spec;
+	if( strncmp( path, "unix:", 5 ) == 0 )
+		path += 5;
+	else if( strncmp( path, "local:", 6 ) == 0 )
+		path += 6;
+	struct sockaddr_un address;
+	memset( &address, 0, sizeof( address ) );
+	if( strlen( path ) >= sizeof( address.sun_path ) )
+		return -1;
+	address.sun_family = AF_UNIX;
+	strcpy( address.sun_path, path );
+	int const fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+	if( fd != -1 && connect( fd, (struct sockaddr*)&address, sizeof( address ) ) != 0 ) {
+		close( fd );
+		return -1;
+	}
+	return fd;
+}
+
+static int write_all( int const fd, char const * buf, size_t len ) {
+	while( len != 0 ) {
+		ssize_t const written = send( fd, buf, len, MSG_NOSIGNAL );
+		if( written == -1 && errno == EINTR )
+			continue;
+		if( written <= 0 )
+			return -1;
+		buf += written;
+		len -= (size_t)written;
+	}
+	return 0;
+}
+
+static int read_all( int const fd, char* buf, size_t len ) {
+	while( len != 0 ) {
+		ssize_t const received = recv( fd, buf, len, 0 );
+		if( received == -1 && errno == EINTR )
+			continue;
+		if( received <= 0 )
+			return -1;
+		buf += received;
+		len -= (size_t)received;
+	}
+	return 0;
+}
+
+/**
+ * Sends a command whose data consists of several parts.
+ *
+ * @param parts The parts, each with its terminating null byte
+ * @param count The number of parts
+ * @return Zero on success, non-zero in case of an error
+ */
+static int send_command( struct worker_t* const worker, char const cmd, char const * const * const parts, size_t const count ) {
+	size_t len = 1;
+	for( size_t i = 0; i != count; ++i )
+		len += strlen( parts[i] ) + 1;
+	char* const packet = malloc( len + 4 );
+	if( packet == NULL )
+		return -1;
+	uint32_t const net_len = htonl( (uint32_t)len );
+	memcpy( packet, &net_len, 4 );
+	packet[4] = cmd;
+	size_t pos = 5;
+	for( size_t i = 0; i != count; ++i ) {
+		size_t const part_len = strlen( parts[i] ) + 1;
+		memcpy( packet + pos, parts[i], part_len );
+		pos += part_len;
+	}
+	int const result = write_all( worker->fd, packet, pos );
+	free( packet );
+	return result;
+}
+
+/**
+ * Sends a command with binary data.
+ */
+static int send_raw_command( struct worker_t* const worker, char const cmd, void const * const data, size_t const len ) {
+	char header[5];
+	uint32_t const net_len = htonl( (uint32_t)( len + 1 ) );
+	memcpy( header, &net_len, 4 );
+	header[4] = cmd;
+	if( write_all( worker->fd, header, sizeof( header ) ) != 0 )
+		return -1;
+	return len != 0 ? write_all( worker->fd, data, len ) : 0;
+}
+
+/**
+ * Receives a packet into the buffer of the worker.
+ *
+ * @param cmd Output parameter for the command of the packet
+ * @param len Output parameter for the length of the data
+ * @return Zero on success, non-zero in case of an error
+ */
+static int receive_packet( struct worker_t* const worker, char* const cmd, size_t* const len ) {
+	uint32_t net_len = 0;
+	if( read_all( worker->fd, (char*)&net_len, 4 ) != 0 )
+		return -1;
+	size_t const packet_len = ntohl( net_len );
+	if( packet_len == 0 || packet_len > MAX_PACKET_SIZE )
+		return -1;
+	if( packet_len + 1 > worker->buf_capacity ) {
+		char* const buf = realloc( worker->buf, packet_len + 1 );
+		if( buf == NULL )
+			return -1;
+		worker->buf = buf;
+		worker->buf_capacity = packet_len + 1;
+	}
+	if( read_all( worker->fd, cmd, 1 ) != 0 || read_all( worker->fd, worker->buf, packet_len - 1 ) != 0 )
+		return -1;
+	worker->buf[packet_len - 1] = '\0';
+	*len = packet_len - 1;
+	return 0;
+}
+
+/**
+ * Receives replies until the final reply of a command.
+ *
+ * Added recipients are counted, progress and other modifications are
+ * skipped.
+ *
+ * @param reply Output parameter for the final reply; for
+ * `SMFIR_REPLYCODE`, the reply is mapped to `SMFIR_REJECT` or
+ * `SMFIR_TEMPFAIL`
+ * @return Zero on success, non-zero in case of an error
+ */
+static int receive_reply( struct worker_t* const worker, char* const reply ) {
+	for( ;; ) {
+		char cmd = 0;
+		size_t len = 0;
+		if( receive_packet( worker, &cmd, &len ) != 0 )
+			return -1;
+		if( cmd == SMFIR_ADDRCPT || cmd == SMFIR_ADDRCPT_PAR ) {
+			++worker->recipients;
+		} else if( cmd == SMFIR_REPLYCODE ) {
+			*reply = worker->buf[0] == '4' ? SMFIR_TEMPFAIL : SMFIR_REJECT;
+			return 0;
+		} else if(
+			cmd == SMFIR_CONTINUE || cmd == SMFIR_ACCEPT ||
+			cmd == SMFIR_REJECT || cmd == SMFIR_TEMPFAIL ||
+			cmd == 'd' || cmd == 's' || cmd == 'f' || cmd == '4'
+		) {
+			*reply = cmd;
+			return 0;
+		}
+		// Progress and other modifications precede the final reply
+	}
+}
+
+/**
+ * Sends a command and receives its reply unless the milter has requested
+ * that no reply is sent.
+ *
+ * @param skip_flag The protocol flag with which the milter declines the
+ * command
+ * @param no_reply_flag The protocol flag with which the milter declines to
+ * reply to the command
+ * @param reply Output parameter for the reply; `SMFIR_CONTINUE`, if the
+ * command has been skipped or has no reply
+ * @return Zero on success, non-zero in case of an error
+ */
+static int exchange_command(
+	struct worker_t* const worker,
+	char const cmd,
+	char const * const * const parts,
+	size_t const count,
+	uint32_t const skip_flag,
+	uint32_t const no_reply_flag,
+	char* const reply
+) {
+	*reply = SMFIR_CONTINUE;
+	if( worker->protocol & skip_flag )
+		return 0;
+	if( send_command( worker, cmd, parts, count ) != 0 )
+		return -1;
+	if( worker->protocol & no_reply_flag )
+		return 0;
+	return receive_reply( worker, reply );
+}
+
+static void add_sample( struct samples_t* const samples, uint64_t const value ) {
+	if( samples->size == samples->capacity ) {
+		size_t const capacity = samples->capacity != 0 ? 2 * samples->capacity : 1024;
+		uint32_t* const values = realloc( samples->values, capacity * sizeof( uint32_t ) );
+		if( values == NULL )
+			return;
+		samples->values = values;
+		samples->capacity = capacity;
+	}
+	samples->values[samples->size++] = value < UINT32_MAX ? (uint32_t)value : UINT32_MAX;
+}
+
+static void close_session( struct worker_t* const worker ) {
+	if( worker->fd == -1 )
+		return;
+	send_raw_command( worker, SMFIC_QUIT, NULL, 0 );
+	close( worker->fd );
+	worker->fd = -1;
+}
+
+/**
+ * Connects to the milter, negotiates the options and sends the connect and
+ * HELO commands.
+ *
+ * @return Zero on success, non-zero in case of an error
+ */
+static int open_session( struct worker_t* const worker ) {
+	uint64_t const start = now_usec();
+	worker->fd = open_connection( worker->setting->socket_spec );
+	if( worker->fd == -1 )
+		return -1;
+	struct timeval const timeout = { (time_t)worker->setting->timeout, 0 };
+	setsockopt( worker->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+
+	uint32_t const offer[3] = { htonl( SMFI_PROT_VERSION ), htonl( SMFI_OFFERED_ACTIONS ), htonl( SMFI_OFFERED_PROTOCOL ) };
+	char cmd = 0;
+	size_t len = 0;
+	if(
+		send_raw_command( worker, SMFIC_OPTNEG, offer, sizeof( offer ) ) != 0 ||
+		receive_packet( worker, &cmd, &len ) != 0 ||
+		cmd != SMFIC_OPTNEG || len < 12
+	) {
+		close_session( worker );
+		return -1;
+	}
+	uint32_t negotiated[3];
+	memcpy( negotiated, worker->buf, sizeof( negotiated ) );
+	worker->protocol = ntohl( negotiated[2] );
+
+	// Connection from an unknown protocol family, which has no address
+	char const * const connect_parts[] = { "loadgen.example.org", "U" };
+	char const * const helo_parts[] = { "loadgen.example.org" };
+	char reply = 0;
+	if(
+		exchange_command( worker, SMFIC_CONNECT, connect_parts, 1, SMFIP_NOCONNECT, SMFIP_NR_CONN, &reply ) != 0 ||
+		reply != SMFIR_CONTINUE ||
+		exchange_command( worker, SMFIC_HELO, helo_parts, 1, SMFIP_NOHELO, SMFIP_NR_HELO, &reply ) != 0 ||
+		reply != SMFIR_CONTINUE
+	) {
+		close_session( worker );
+		return -1;
+	}
+	add_sample( &worker->samples[STAGE_SESSION], now_usec() - start );
+	return 0;
+}
+
+/**
+ * Sends a complete message.
+ *
+ * @return Zero, if the session may be used for the next message, non-zero
+ * if the session must be re-opened
+ */
+static int send_message( struct worker_t* const worker, unsigned int const index ) {
+	struct loadgen_setting_t const * const setting = worker->setting;
+	char const * const sender = setting->senders[ index % setting->sender_count ];
+	char const * const account = setting->account_count != 0 ? setting->accounts[ index % setting->account_count ] : NULL;
+	char sender_arg[512];
+	char rcpt_arg[512];
+	snprintf( sender_arg, sizeof( sender_arg ), "<%s>", sender );
+	snprintf( rcpt_arg, sizeof( rcpt_arg ), "<%s>", setting->recipient );
+
+	uint64_t const start = now_usec();
+	char reply = 0;
+	if( account != NULL ) {
+		// The macro command consists of the command it precedes and pairs of
+		// name and value
+		char const * const macro_parts[] = { "M{auth_authen}", account };
+		if( send_command( worker, SMFIC_MACRO, macro_parts, 2 ) != 0 )
+			goto error;
+	}
+	char const * const mail_parts[] = { sender_arg };
+	if( exchange_command( worker, SMFIC_MAIL, mail_parts, 1, SMFIP_NOMAIL, SMFIP_NR_MAIL, &reply ) != 0 )
+		goto error;
+	uint64_t const mail_done = now_usec();
+	add_sample( &worker->samples[STAGE_MAIL], mail_done - start );
+	if( reply != SMFIR_CONTINUE )
+		goto rejected;
+
+	char const * const rcpt_parts[] = { rcpt_arg };
+	if( exchange_command( worker, SMFIC_RCPT, rcpt_parts, 1, SMFIP_NORCPT, SMFIP_NR_RCPT, &reply ) != 0 )
+		goto error;
+	if( reply != SMFIR_CONTINUE )
+		goto rejected;
+	if( exchange_command( worker, SMFIC_EOH, NULL, 0, SMFIP_NOEOH, SMFIP_NR_EOH, &reply ) != 0 )
+		goto error;
+	if( reply != SMFIR_CONTINUE )
+		goto rejected;
+	if( !( worker->protocol & SMFIP_NOBODY ) ) {
+		if( send_raw_command( worker, SMFIC_BODY, BODY, sizeof( BODY ) - 1 ) != 0 )
+			goto error;
+		if( !( worker->protocol & SMFIP_NR_BODY ) && receive_reply( worker, &reply ) != 0 )
+			goto error;
+		if( reply != SMFIR_CONTINUE )
+			goto rejected;
+	}
+
+	uint64_t const eom_start = now_usec();
+	if( send_raw_command( worker, SMFIC_BODYEOB, NULL, 0 ) != 0 || receive_reply( worker, &reply ) != 0 )
+		goto error;
+	uint64_t const end = now_usec();
+	add_sample( &worker->samples[STAGE_EOM], end - eom_start );
+	add_sample( &worker->samples[STAGE_MESSAGE], end - start );
+	if( reply == SMFIR_CONTINUE || reply == SMFIR_ACCEPT ) {
+		++worker->accepted;
+		return 0;
+	}
+	// The final reply of the end of message ends the transaction anyway
+	if( reply == SMFIR_TEMPFAIL )
+		++worker->tempfailed;
+	else
+		++worker->rejected;
+	return 0;
+
+rejected:
+	if( reply == SMFIR_TEMPFAIL )
+		++worker->tempfailed;
+	else
+		++worker->rejected;
+	return send_raw_command( worker, SMFIC_ABORT, NULL, 0 );
+
+error:
+	++worker->errors;
+	return -1;
+}
+
+static void* run_worker( void* arg ) {
+	struct worker_t* const worker = (struct worker_t*)arg;
+	unsigned int const per_session = worker->setting->messages_per_session;
+	unsigned int in_session = 0;
+	for( unsigned int i = 0; i != worker->message_count; ++i ) {
+		if( worker->fd != -1 && per_session != 0 && in_session == per_session )
+			close_session( worker );
+		if( worker->fd == -1 ) {
+			in_session = 0;
+			if( open_session( worker ) != 0 ) {
+				++worker->errors;
+				continue;
+			}
+		}
+		++in_session;
+		if( send_message( worker, worker->first_message + i ) != 0 )
+			close_session( worker );
+	}
+	close_session( worker );
+	return NULL;
+}
+
+static int compare_uint32( void const * a, void const * b ) {
+	uint32_t const x = *(uint32_t const *)a;
+	uint32_t const y = *(uint32_t const *)b;
+	return ( x > y ) - ( x < y );
+}
+
+/**
+ * Returns the value below or at which a fraction of the sorted samples lie.
+ */
+static uint32_t get_percentile( struct samples_t const * const samples, double const quantile ) {
+	if( samples->size == 0 )
+		return 0;
+	size_t rank = (size_t)( quantile * (double)samples->size + 0.999999 );
+	if( rank == 0 )
+		rank = 1;
+	if( rank > samples->size )
+		rank = samples->size;
+	return samples->values[rank - 1];
+}
+
+/**
+ * Merges the samples of all workers into the samples of the first worker
+ * and sorts them.
+ */
+static void merge_samples( struct worker_t* const workers, unsigned int const count ) {
+	for( int stage = 0; stage != STAGE_COUNT; ++stage ) {
+		struct samples_t* const merged = &workers[0].samples[stage];
+		for( unsigned int w = 1; w != count; ++w ) {
+			struct samples_t const * const samples = &workers[w].samples[stage];
+			for( size_t i = 0; i != samples->size; ++i )
+				add_sample( merged, samples->values[i] );
+		}
+		if( merged->size != 0 )
+			qsort( merged->values, merged->size, sizeof( uint32_t ), compare_uint32 );
+	}
+	for( unsigned int w = 1; w != count; ++w ) {
+		workers[0].recipients += workers[w].recipients;
+		workers[0].accepted += workers[w].accepted;
+		workers[0].rejected += workers[w].rejected;
+		workers[0].tempfailed += workers[w].tempfailed;
+		workers[0].errors += workers[w].errors;
+	}
+}
+
+static double get_mean( struct samples_t const * const samples ) {
+	double sum = 0;
+	for( size_t i = 0; i != samples->size; ++i )
+		sum += samples->values[i];
+	return samples->size != 0 ? sum / (double)samples->size : 0;
+}
+
+static void print_csv( struct worker_t const * const total, double const duration ) {
+	fprintf( stdout, "stage,count,throughput_per_s,mean_us,p50_us,p90_us,p99_us,p999_us,max_us\n" );
+	for( int stage = 0; stage != STAGE_COUNT; ++stage ) {
+		struct samples_t const * const samples = &total->samples[stage];
+		fprintf(
+			stdout, "%s,%zu,%.1f,%.1f,%u,%u,%u,%u,%u\n",
+			STAGE_NAMES[stage], samples->size, samples->size / duration, get_mean( samples ),
+			get_percentile( samples, 0.5 ), get_percentile( samples, 0.9 ), get_percentile( samples, 0.99 ),
+			get_percentile( samples, 0.999 ), get_percentile( samples, 1.0 )
+		);
+	}
+	fprintf(
+		stdout, "# duration_s=%.3f accepted=%llu rejected=%llu tempfailed=%llu errors=%llu recipients_added=%llu\n",
+		duration,
+		(unsigned long long)total->accepted, (unsigned long long)total->rejected,
+		(unsigned long long)total->tempfailed, (unsigned long long)total->errors,
+		(unsigned long long)total->recipients
+	);
+}
+
+static void print_json( struct worker_t const * const total, double const duration ) {
+	fprintf( stdout, "{\n" );
+	fprintf( stdout, "  \"duration_s\": %.3f,\n", duration );
+	fprintf( stdout, "  \"throughput_per_s\": %.1f,\n", total->samples[STAGE_MESSAGE].size / duration );
+	fprintf( stdout, "  \"accepted\": %llu,\n", (unsigned long long)total->accepted );
+	fprintf( stdout, "  \"rejected\": %llu,\n", (unsigned long long)total->rejected );
+	fprintf( stdout, "  \"tempfailed\": %llu,\n", (unsigned long long)total->tempfailed );
+	fprintf( stdout, "  \"errors\": %llu,\n", (unsigned long long)total->errors );
+	fprintf( stdout, "  \"recipients_added\": %llu,\n", (unsigned long long)total->recipients );
+	fprintf( stdout, "  \"stages\": {\n" );
+	for( int stage = 0; stage != STAGE_COUNT; ++stage ) {
+		struct samples_t const * const samples = &total->samples[stage];
+		fprintf(
+			stdout,
+			"    \"%s\": { \"count\": %zu, \"mean_us\": %.1f, \"p50_us\": %u, \"p90_us\": %u, \"p99_us\": %u, \"p999_us\": %u, \"max_us\": %u }%s\n",
+			STAGE_NAMES[stage], samples->size, get_mean( samples ),
+			get_percentile( samples, 0.5 ), get_percentile( samples, 0.9 ), get_percentile( samples, 0.99 ),
+			get_percentile( samples, 0.999 ), get_percentile( samples, 1.0 ),
+			stage + 1 != STAGE_COUNT ? "," : ""
+		);
+	}
+	fprintf( stdout, "  }\n}\n" );
+}
+
+/**
+ * Parses an unsigned number of a command line option.
+ *
+ * @return Zero on success, non-zero in case of an error
+ */
+static int parse_uint( char const * const value, unsigned int const min_value, unsigned int* const result ) {
+	char* end = NULL;
+	errno = 0;
+	unsigned long const parsed = strtoul( value, &end, 10 );
+	if( *value == '\0' || *end != '\0' || errno != 0 || parsed < min_value || parsed > UINT32_MAX )
+		return -1;
+	*result = (unsigned int)parsed;
+	return 0;
+}
+
+int main( int argc, char* argv[] ) {
+	struct loadgen_setting_t setting;
+	memset( &setting, 0, sizeof( setting ) );
+	setting.concurrency = 8;
+	setting.messages = 1000;
+	setting.timeout = 10;
+	setting.recipient = "rcpt@example.org";
+	char const * config_file = CONFIG_FILE_DEFAULT;
+
+	int opt;
+	while( ( opt = getopt( argc, argv, CLI_OPTS ) ) != -1 ) {
+		int is_valid = 1;
+		switch( opt ) {
+		case 'a':
+			if( setting.account_count == MAX_ADDRESSES )
+				is_valid = 0;
+			else
+				setting.accounts[setting.account_count++] = optarg;
+			break;
+		case 'c':
+			config_file = optarg;
+			break;
+		case 'f':
+			is_valid = ( strcmp( optarg, "csv" ) == 0 || strcmp( optarg, "json" ) == 0 );
+			setting.is_json = ( strcmp( optarg, "json" ) == 0 );
+			break;
+		case 'h':
+			print_usage( argv[0] );
+			return EX_OK;
+		case 'm':
+			is_valid = ( parse_uint( optarg, 0, &setting.messages_per_session ) == 0 );
+			break;
+		case 'n':
+			is_valid = ( parse_uint( optarg, 1, &setting.messages ) == 0 );
+			break;
+		case 'r':
+			setting.recipient = optarg;
+			break;
+		case 's':
+			setting.socket_spec = optarg;
+			break;
+		case 'S':
+			if( setting.sender_count == MAX_ADDRESSES )
+				is_valid = 0;
+			else
+				setting.senders[setting.sender_count++] = optarg;
+			break;
+		case 't':
+			is_valid = ( parse_uint( optarg, 1, &setting.concurrency ) == 0 );
+			break;
+		default:
+			is_valid = 0;
+		}
+		if( !is_valid ) {
+			print_usage( argv[0] );
+			return EX_USAGE;
+		}
+	}
+	if( setting.sender_count == 0 )
+		setting.senders[setting.sender_count++] = "list@example.org";
+
+	char* socket_file = NULL;
+	if( setting.socket_spec == NULL ) {
+		socket_file = read_socket_file( config_file );
+		setting.socket_spec = socket_file != NULL ? socket_file : SOCKET_FILE_DEFAULT;
+	}
+	if( setting.concurrency > setting.messages )
+		setting.concurrency = setting.messages;
+
+	struct worker_t* const workers = calloc( setting.concurrency, sizeof( struct worker_t ) );
+	if( workers == NULL ) {
+		free( socket_file );
+		return EX_OSERR;
+	}
+	unsigned int first = 0;
+	unsigned int started = 0;
+	uint64_t const start = now_usec();
+	for( unsigned int w = 0; w != setting.concurrency; ++w ) {
+		workers[w].setting = &setting;
+		workers[w].fd = -1;
+		workers[w].first_message = first;
+		workers[w].message_count = setting.messages / setting.concurrency + ( w < setting.messages % setting.concurrency );
+		first += workers[w].message_count;
+		if( pthread_create( &workers[w].thread, NULL, run_worker, &workers[w] ) != 0 ) {
+			fprintf( stderr, "could not create thread\n" );
+			break;
+		}
+		++started;
+	}
+	for( unsigned int w = 0; w != started; ++w )
+		pthread_join( workers[w].thread, NULL );
+	double const duration = ( now_usec() - start ) / 1e6;
+
+	int result_code = EX_OK;
+	if( started == 0 ) {
+		result_code = EX_OSERR;
+	} else {
+		merge_samples( workers, started );
+		if( setting.is_json )
+			print_json( &workers[0], duration );
+		else
+			print_csv( &workers[0], duration );
+		if( workers[0].samples[STAGE_MESSAGE].size == 0 ) {
+			fprintf( stderr, "no message could be sent to %s\n", setting.socket_spec );
+			result_code = EX_UNAVAILABLE;
+		}
+	}
+
+	for( unsigned int w = 0; w != setting.concurrency; ++w ) {
+		for( int stage = 0; stage != STAGE_COUNT; ++stage )
+			free( workers[w].samples[stage].values );
+		free( workers[w].buf );
+	}
+	free( workers );
+	free( socket_file );
+	return result_code;
+}
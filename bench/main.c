@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+void run_extstring_benchmarks( void );
+void run_log_benchmarks( void );
+void run_mail_address_benchmarks( void );
+void run_string_array_benchmarks( void );
+void run_template_benchmarks( void );
+
+static char const * const CLI_OPTS = "b:f:ht:";
+
+static void print_usage( char const * const prog ) {
+	fprintf( stdout, "Usage: %s [options]\n", prog );
+	fprintf( stdout, "    -b filter  Only run benchmarks whose name contains this string\n" );
+	fprintf( stdout, "    -f format  Output format, either \"table\" or \"csv\"; default: table\n" );
+	fprintf( stdout, "    -h         Print this help and exit\n" );
+	fprintf( stdout, "    -t ms      Minimal measured time of each benchmark; default: 200\n" );
+}
+
+int main( int argc, char* argv[] ) {
+	int opt;
+	while( ( opt = getopt( argc, argv, CLI_OPTS ) ) != -1 ) {
+		int is_valid = 1;
+		char* end = NULL;
+		switch( opt ) {
+		case 'b':
+			bench_filter = optarg;
+			break;
+		case 'f':
+			is_valid = ( strcmp( optarg, "table" ) == 0 || strcmp( optarg, "csv" ) == 0 );
+			bench_is_csv = ( strcmp( optarg, "csv" ) == 0 );
+			break;
+		case 'h':
+			print_usage( argv[0] );
+			return EX_OK;
+		case 't':
+			bench_min_time = strtoull( optarg, &end, 10 ) * 1000000;
+			is_valid = ( *optarg != '\0' && *end == '\0' && bench_min_time != 0 );
+			break;
+		default:
+			is_valid = 0;
+		}
+		if( !is_valid ) {
+			print_usage( argv[0] );
+			return EX_USAGE;
+		}
+	}
+
+	if( bench_is_csv )
+		fprintf( stdout, "benchmark,size,ns_per_op,allocs_per_op,bytes_per_op\n" );
+	else
+		fprintf( stdout, "%-44s %8s %12s %10s %12s\n", "benchmark", "size", "ns/op", "allocs/op", "bytes/op" );
+	run_extstring_benchmarks();
+	run_log_benchmarks();
+	run_mail_address_benchmarks();
+	run_string_array_benchmarks();
+	run_template_benchmarks();
+	return EX_OK;
+}
@@ -0,0 +1,81 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "milter_shim.h"
+
+void init_milter_shim_context( SMFICTX* const ctx ) {
+	memset( ctx, 0, sizeof( SMFICTX ) );
+	ctx->addrcpt_result = MI_SUCCESS;
+}
+
+int set_milter_shim_macro( SMFICTX* const ctx, char const * const name, char const * const value ) {
+	for( size_t i = 0; i != ctx->macro_count; ++i ) {
+		if( strcmp( ctx->macro_names[i], name ) != 0 )
+			continue;
+		if( value != NULL ) {
+			ctx->macro_values[i] = value;
+		} else {
+			--ctx->macro_count;
+			ctx->macro_names[i] = ctx->macro_names[ctx->macro_count];
+			ctx->macro_values[i] = ctx->macro_values[ctx->macro_count];
+		}
+		return MI_SUCCESS;
+	}
+	if( value == NULL )
+		return MI_SUCCESS;
+	if( ctx->macro_count == MILTER_SHIM_MAX_MACROS )
+		return MI_FAILURE;
+	ctx->macro_names[ctx->macro_count] = name;
+	ctx->macro_values[ctx->macro_count] = value;
+	++ctx->macro_count;
+	return MI_SUCCESS;
+}
+
+void* smfi_getpriv( SMFICTX* ctx ) {
+	return ctx != NULL ? ctx->priv : NULL;
+}
+
+int smfi_setpriv( SMFICTX* ctx, void* priv ) {
+	if( ctx == NULL )
+		return MI_FAILURE;
+	ctx->priv = priv;
+	return MI_SUCCESS;
+}
+
+char* smfi_getsymval( SMFICTX* ctx, char* name ) {
+	for( size_t i = 0; ctx != NULL && name != NULL && i != ctx->macro_count; ++i ) {
+		if( strcmp( ctx->macro_names[i], name ) == 0 )
+			return (char*)ctx->macro_values[i];
+	}
+	return NULL;
+}
+
+int smfi_addrcpt( SMFICTX* ctx, char* rcpt ) {
+	if( ctx == NULL || rcpt == NULL )
+		return MI_FAILURE;
+	if( ctx->addrcpt_result == MI_SUCCESS )
+		++ctx->recipients_added;
+	return ctx->addrcpt_result;
+}
+
+int smfi_addrcpt_par( SMFICTX* ctx, char* rcpt, char* args ) {
+	(void)args;
+	return smfi_addrcpt( ctx, rcpt );
+}
+
+int smfi_delrcpt( SMFICTX* ctx, char* rcpt ) {
+	if( ctx == NULL || rcpt == NULL )
+		return MI_FAILURE;
+	++ctx->recipients_deleted;
+	return MI_SUCCESS;
+}
+
+int smfi_setreply( SMFICTX* ctx, char* rcode, char* xcode, char* message ) {
+	(void)xcode;
+	(void)message;
+	if( ctx == NULL || rcode == NULL )
+		return MI_FAILURE;
+	++ctx->replies_set;
+	ctx->last_rcode = rcode;
+	return MI_SUCCESS;
+}
@@ -0,0 +1,59 @@
+#ifndef _MILTER_SHIM_H_
+#define _MILTER_SHIM_H_
+
+/**
+ * @file
+ * @brief An in-process replacement of the parts of libmilter which are used
+ * by the callbacks.
+ *
+ * Linking against this shim instead of libmilter allows to call the
+ * callbacks of ::smfi_cb.h directly, i.e. without `smfi_main()`, a socket
+ * and an MTA.
+ * Each thread of a harness owns its own context; a context must not be
+ * used by several threads concurrently, just like in libmilter.
+ */
+
+#include <stddef.h>
+#include <libmilter/mfapi.h>
+
+/**
+ * The maximum number of macros of a context.
+ */
+#define MILTER_SHIM_MAX_MACROS 8
+
+/**
+ * The fake context which is passed to the callbacks.
+ */
+struct smfi_str {
+	void* priv; /**< The private data, see `smfi_setpriv()`. */
+	char const * macro_names[MILTER_SHIM_MAX_MACROS]; /**< The names of the macros including braces, e.g. `{auth_authen}`. */
+	char const * macro_values[MILTER_SHIM_MAX_MACROS]; /**< The values of the macros. */
+	size_t macro_count; /**< The number of macros. */
+	int addrcpt_result; /**< The result of `smfi_addrcpt()`; set it to `MI_FAILURE` to inject errors. */
+	size_t recipients_added; /**< The number of successful calls of `smfi_addrcpt()` and `smfi_addrcpt_par()`. */
+	size_t recipients_deleted; /**< The number of calls of `smfi_delrcpt()`. */
+	size_t replies_set; /**< The number of calls of `smfi_setreply()`. */
+	char const * last_rcode; /**< The SMTP reply code of the last call of `smfi_setreply()`. */
+};
+
+/**
+ * Initializes a context without macros and private data.
+ *
+ * @param ctx The context
+ */
+void init_milter_shim_context( SMFICTX* ctx );
+
+/**
+ * Sets a macro of a context.
+ *
+ * The strings are not copied and must outlive the context.
+ *
+ * @param ctx The context
+ * @param name The name of the macro including braces, e.g. `{auth_authen}`
+ * @param value The value or `NULL` to remove the macro
+ * @return `MI_SUCCESS` on success, `MI_FAILURE` if the context has no room
+ * for another macro
+ */
+int set_milter_shim_macro( SMFICTX* ctx, char const * name, char const * value );
+
+#endif
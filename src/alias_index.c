@@ -0,0 +1,284 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "alias_index.h"
+
+/**
+ * The header of the serialized index.
+ *
+ * The serialized index is a single contiguous block of memory which only
+ * contains offsets, but no pointers, such that it can be written to a file
+ * and mapped into memory again.
+ * The header is followed by these arrays of `uint64_t`:
+ *
+ *  - `key_offsets[key_count]`: offset of the i-th key into `strings`
+ *  - `value_offsets[key_count + 1]`: the values of the i-th key are the
+ *    values `value_offsets[i]` up to (excluding) `value_offsets[i+1]`
+ *  - `value_string_offsets[value_count]`: offset of the i-th value into
+ *    `strings`
+ *  - `slots[slot_count]`: open-addressing hash table; each slot holds the
+ *    index of a key plus one or zero, if the slot is empty
+ *
+ * and finally by `strings[string_size]`, all null-terminated keys and
+ * values; `string_size` is padded to a multiple of 8.
+ * Keys are stored in lower case and sorted; the values of each key are
+ * sorted.
+ */
+struct alias_index_header_t {
+	uint64_t key_count; /**< Number of distinct keys. */
+	uint64_t value_count; /**< Number of values of all keys. */
+	uint64_t slot_count; /**< Number of hash slots; a power of two. */
+	uint64_t string_size; /**< Size of the string area in bytes. */
+};
+
+struct alias_index_t {
+	void* buffer; /**< The serialized index, if it is owned by this index, or `NULL`. */
+	size_t size; /**< The size of the serialized index in bytes. */
+	struct alias_index_header_t const * header; /**< The beginning of the serialized index. */
+	uint64_t const * key_offsets; /**< See ::alias_index_header_t. */
+	uint64_t const * value_offsets; /**< See ::alias_index_header_t. */
+	uint64_t const * value_string_offsets; /**< See ::alias_index_header_t. */
+	uint64_t const * slots; /**< See ::alias_index_header_t. */
+	char const * strings; /**< See ::alias_index_header_t. */
+};
+
+/**
+ * A key/value pair while the index is being built.
+ */
+struct alias_pair_t {
+	char const * key;
+	char const * value;
+};
+
+/**
+ * Compares two strings case-insensitively (ASCII only).
+ */
+static int compare_keys( char const * a, char const * b ) {
+	for( ; *a != '\0' && tolower( (unsigned char)*a ) == tolower( (unsigned char)*b ); ++a, ++b );
+	return tolower( (unsigned char)*a ) - tolower( (unsigned char)*b );
+}
+
+static int compare_pairs( void const * a, void const * b ) {
+	struct alias_pair_t const * const pa = a;
+	struct alias_pair_t const * const pb = b;
+	int const result = compare_keys( pa->key, pb->key );
+	return result != 0 ? result : strcmp( pa->value, pb->value );
+}
+
+/**
+ * Computes the 64-bit FNV-1a hash of the lower-cased string.
+ */
+static uint64_t hash_key( char const * key ) {
+	uint64_t hash = UINT64_C( 14695981039346656037 );
+	for( ; *key != '\0'; ++key ) {
+		hash ^= (unsigned char)tolower( (unsigned char)*key );
+		hash *= UINT64_C( 1099511628211 );
+	}
+	return hash;
+}
+
+/**
+ * Computes the size of a serialized index.
+ *
+ * @return The size in bytes or zero, if the size overflows
+ */
+static size_t compute_alias_index_size( struct alias_index_header_t const * const header ) {
+	uint64_t const max_count = SIZE_MAX / 64;
+	if(
+		header->key_count > max_count || header->value_count > max_count ||
+		header->slot_count > max_count || header->string_size > SIZE_MAX / 2
+	) {
+		return 0;
+	}
+	return sizeof( struct alias_index_header_t ) +
+		sizeof( uint64_t ) * ( 2 * header->key_count + 1 + header->value_count + header->slot_count ) +
+		header->string_size;
+}
+
+/**
+ * Sets the array pointers of an index to the serialized index.
+ */
+static void attach_alias_index( struct alias_index_t* const index, void const * const data, size_t const size ) {
+	index->size = size;
+	index->header = data;
+	index->key_offsets = (uint64_t const *)( index->header + 1 );
+	index->value_offsets = index->key_offsets + index->header->key_count;
+	index->value_string_offsets = index->value_offsets + index->header->key_count + 1;
+	index->slots = index->value_string_offsets + index->header->value_count;
+	index->strings = (char const *)( index->slots + index->header->slot_count );
+}
+
+/**
+ * Copies a string into the string area and advances the position.
+ */
+static uint64_t store_string( char* const strings, size_t* const pos, char const * const str, int const lower_case ) {
+	uint64_t const offset = *pos;
+	size_t i = 0;
+	for( ; str[i] != '\0'; ++i )
+		strings[ *pos + i ] = lower_case ? (char)tolower( (unsigned char)str[i] ) : str[i];
+	strings[ *pos + i ] = '\0';
+	*pos += i + 1;
+	return offset;
+}
+
+struct alias_index_t* create_alias_index( struct string_array_t const * keys, struct string_array_t const * values ) {
+	size_t const pair_count = get_string_array_size( keys );
+	if( get_string_array_size( values ) != pair_count )
+		return NULL;
+
+	struct alias_pair_t* const pairs = malloc( ( pair_count != 0 ? pair_count : 1 ) * sizeof( struct alias_pair_t ) );
+	struct alias_index_t* const index = malloc( sizeof( struct alias_index_t ) );
+	if( pairs == NULL || index == NULL ) {
+		free( pairs );
+		free( index );
+		return NULL;
+	}
+	for( size_t i = 0; i != pair_count; ++i ) {
+		pairs[i].key = get_string_array_at( keys, i );
+		pairs[i].value = get_string_array_at( values, i );
+	}
+	qsort( pairs, pair_count, sizeof( struct alias_pair_t ), compare_pairs );
+
+	// Count distinct keys and pairs and the required space for the strings
+	struct alias_index_header_t header = { 0, 0, 8, 0 };
+	for( size_t i = 0; i != pair_count; ++i ) {
+		if( i != 0 && compare_pairs( &pairs[i - 1], &pairs[i] ) == 0 )
+			continue;
+		if( i == 0 || compare_keys( pairs[i - 1].key, pairs[i].key ) != 0 ) {
+			++header.key_count;
+			header.string_size += strlen( pairs[i].key ) + 1;
+		}
+		++header.value_count;
+		header.string_size += strlen( pairs[i].value ) + 1;
+	}
+	header.string_size = ( header.string_size + 7 ) & ~UINT64_C( 7 );
+	// Aim at a load factor of at most 1/2
+	while( header.slot_count < 2 * header.key_count )
+		header.slot_count *= 2;
+
+	size_t const size = compute_alias_index_size( &header );
+	index->buffer = size != 0 ? calloc( 1, size ) : NULL;
+	if( index->buffer == NULL ) {
+		free( pairs );
+		free( index );
+		return NULL;
+	}
+	memcpy( index->buffer, &header, sizeof( header ) );
+	attach_alias_index( index, index->buffer, size );
+
+	// The arrays are only written while the index is being built
+	uint64_t* const key_offsets = (uint64_t*)index->key_offsets;
+	uint64_t* const value_offsets = (uint64_t*)index->value_offsets;
+	uint64_t* const value_string_offsets = (uint64_t*)index->value_string_offsets;
+	uint64_t* const slots = (uint64_t*)index->slots;
+	char* const strings = (char*)index->strings;
+	size_t string_pos = 0;
+	size_t key_pos = 0;
+	size_t value_pos = 0;
+	for( size_t i = 0; i != pair_count; ++i ) {
+		if( i != 0 && compare_pairs( &pairs[i - 1], &pairs[i] ) == 0 )
+			continue;
+		if( i == 0 || compare_keys( pairs[i - 1].key, pairs[i].key ) != 0 ) {
+			key_offsets[ key_pos ] = store_string( strings, &string_pos, pairs[i].key, 1 );
+			value_offsets[ key_pos ] = value_pos;
+			uint64_t slot = hash_key( pairs[i].key ) & ( header.slot_count - 1 );
+			while( slots[ slot ] != 0 )
+				slot = ( slot + 1 ) & ( header.slot_count - 1 );
+			slots[ slot ] = key_pos + 1;
+			++key_pos;
+		}
+		value_string_offsets[ value_pos++ ] = store_string( strings, &string_pos, pairs[i].value, 0 );
+	}
+	value_offsets[ header.key_count ] = header.value_count;
+
+	free( pairs );
+	return index;
+}
+
+struct alias_index_t* open_alias_index( void const * data, size_t size ) {
+	struct alias_index_header_t header;
+	if( data == NULL || size < sizeof( header ) || ( (uintptr_t)data & 7 ) != 0 )
+		return NULL;
+	memcpy( &header, data, sizeof( header ) );
+	if(
+		compute_alias_index_size( &header ) != size ||
+		header.slot_count == 0 || ( header.slot_count & ( header.slot_count - 1 ) ) != 0 ||
+		header.slot_count <= header.key_count ||
+		( header.string_size != 0 && ( (char const *)data )[ size - 1 ] != '\0' )
+	) {
+		return NULL;
+	}
+
+	struct alias_index_t* const index = malloc( sizeof( struct alias_index_t ) );
+	if( index == NULL )
+		return NULL;
+	index->buffer = NULL;
+	attach_alias_index( index, data, size );
+
+	// Validate all offsets such that a corrupt file cannot cause reads
+	// beyond the end of the data
+	int is_valid = ( index->value_offsets[0] == 0 && index->value_offsets[ header.key_count ] == header.value_count );
+	for( uint64_t i = 0; i != header.key_count && is_valid; ++i ) {
+		is_valid = index->key_offsets[i] < header.string_size &&
+			index->value_offsets[i] < index->value_offsets[i + 1];
+	}
+	for( uint64_t i = 0; i != header.value_count && is_valid; ++i )
+		is_valid = index->value_string_offsets[i] < header.string_size;
+	// Each key must occupy exactly one slot, such that at least one slot
+	// is empty and every probe sequence terminates
+	uint64_t used_slots = 0;
+	for( uint64_t i = 0; i != header.slot_count && is_valid; ++i ) {
+		is_valid = index->slots[i] <= header.key_count;
+		used_slots += ( index->slots[i] != 0 );
+	}
+	if( !is_valid || used_slots != header.key_count ) {
+		free( index );
+		return NULL;
+	}
+	return index;
+}
+
+void free_alias_index( struct alias_index_t* index ) {
+	if( index == NULL ) return;
+	free( index->buffer );
+	free( index );
+}
+
+void const * get_alias_index_data( struct alias_index_t const * index, size_t* size ) {
+	*size = index->size;
+	return index->header;
+}
+
+struct string_array_t* lookup_alias_index( struct alias_index_t const * index, char const * key ) {
+	if( index == NULL || key == NULL )
+		return NULL;
+	uint64_t const slot_mask = index->header->slot_count - 1;
+	for(
+		uint64_t slot = hash_key( key ) & slot_mask;
+		index->slots[ slot ] != 0;
+		slot = ( slot + 1 ) & slot_mask
+	) {
+		uint64_t const key_pos = index->slots[ slot ] - 1;
+		if( compare_keys( index->strings + index->key_offsets[ key_pos ], key ) != 0 )
+			continue;
+		uint64_t const begin = index->value_offsets[ key_pos ];
+		uint64_t const end = index->value_offsets[ key_pos + 1 ];
+		struct string_array_t* const result = create_string_array( end - begin );
+		if( result == NULL )
+			return NULL;
+		for( uint64_t i = begin; i != end; ++i ) {
+			if( push_onto_string_array( result, index->strings + index->value_string_offsets[i] ) == NULL ) {
+				free_string_array( result );
+				return NULL;
+			}
+		}
+		return result;
+	}
+	return NULL;
+}
+
+size_t get_alias_index_size( struct alias_index_t const * index ) {
+	return index->header->key_count;
+}
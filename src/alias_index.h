@@ -0,0 +1,103 @@
+#ifndef _ALIAS_INDEX_H_
+#define _ALIAS_INDEX_H_
+
+/**
+ * @file
+ * @brief Compounds and functions for an immutable index of mail aliases.
+ */
+
+#include <stddef.h>
+
+#include "string_array.h"
+
+/**
+ * An immutable map from keys (e.g. mailing list addresses) to string arrays
+ * (e.g. the members of the mailing list).
+ *
+ * The index is built at once from a complete set of key/value pairs and
+ * never modified afterwards.
+ * Hence, it can be read by any number of threads concurrently without
+ * locking.
+ * Keys are matched case-insensitively (ASCII only), like the LDAP matching
+ * rule `caseIgnoreIA5Match`; values are returned unmodified.
+ *
+ * The index is stored in a single contiguous block of memory without
+ * pointers, such that it can be written to a file as is and used directly
+ * from a read-only memory mapping of that file.
+ */
+struct alias_index_t;
+
+/**
+ * Creates an index from a set of key/value pairs.
+ *
+ * The i-th element of `keys` is mapped to the i-th element of `values`.
+ * A key which occurs several times is mapped to all of its values;
+ * duplicate pairs are stored once.
+ * The index stores copies, i.e. the caller keeps ownership of the arrays.
+ *
+ * @param keys The keys
+ * @param values The values; must have the same size as `keys`
+ * @return The pointer to the allocated index or `NULL` in case of an error.
+ */
+struct alias_index_t* create_alias_index( struct string_array_t const * keys, struct string_array_t const * values );
+
+/**
+ * Opens an index on a block of memory which has previously been obtained
+ * by ::get_alias_index_data().
+ *
+ * The data is not copied and must remain valid and unmodified until the
+ * index is freed.
+ * The data is validated such that corrupt data cannot cause reads beyond
+ * `size`.
+ *
+ * @param data The serialized index; must be aligned to 8 bytes
+ * @param size The size of the data in bytes
+ * @return The pointer to the allocated index or `NULL`, if the data is
+ * invalid or in case of an error.
+ */
+struct alias_index_t* open_alias_index( void const * data, size_t size );
+
+/**
+ * Frees an index which has previously been allocated with
+ * ::create_alias_index() or ::open_alias_index().
+ *
+ * The data passed to ::open_alias_index() is not freed.
+ *
+ * Note, the function is NULL-pointer safe.
+ *
+ * @param index The index to be freed.
+ */
+void free_alias_index( struct alias_index_t* index );
+
+/**
+ * Returns the serialized index.
+ *
+ * The size is always a multiple of 8.
+ *
+ * @param index The index
+ * @param size Output parameter for the size of the data in bytes
+ * @return The serialized index which is owned by `index`
+ */
+void const * get_alias_index_data( struct alias_index_t const * index, size_t* size );
+
+/**
+ * Looks up the values of a key.
+ *
+ * The function returns a copy which must be freed by the caller.
+ *
+ * @param index The index
+ * @param key The null-terminated key
+ * @return A copy of the values in sorted order or `NULL`, if the key is not
+ * contained in the index or in case of an error
+ */
+struct string_array_t* lookup_alias_index( struct alias_index_t const * index, char const * key );
+
+/**
+ * Returns the number of distinct keys of the index.
+ *
+ * @param index The index
+ * @return The number of keys
+ */
+size_t get_alias_index_size( struct alias_index_t const * index );
+
+#endif
@@ -0,0 +1,116 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "arena.h"
+
+/**
+ * The alignment of all allocations.
+ */
+#define ARENA_ALIGNMENT _Alignof( max_align_t )
+
+/**
+ * A block of memory from which allocations are carved.
+ *
+ * The usable memory follows the header immediately; the header is padded
+ * such that the memory is aligned.
+ */
+struct arena_block_t {
+	struct arena_block_t* next; /**< The previously allocated block. */
+	size_t size; /**< The usable size of the block in bytes. */
+	size_t used; /**< The number of bytes which have been handed out. */
+};
+
+struct arena_t {
+	size_t block_size; /**< The usable size of regular blocks in bytes. */
+	struct arena_block_t* current; /**< The block from which small allocations are served; the head of the list of blocks. */
+};
+
+/**
+ * The size of a block header including padding.
+ */
+static size_t const BLOCK_HEADER_SIZE =
+	( sizeof( struct arena_block_t ) + ARENA_ALIGNMENT - 1 ) & ~( (size_t)ARENA_ALIGNMENT - 1 );
+
+static char* get_block_data( struct arena_block_t* const block ) {
+	return (char*)block + BLOCK_HEADER_SIZE;
+}
+
+static struct arena_block_t* create_arena_block( size_t const size ) {
+	if( size > SIZE_MAX - BLOCK_HEADER_SIZE )
+		return NULL;
+	struct arena_block_t* const block = malloc( BLOCK_HEADER_SIZE + size );
+	if( block == NULL )
+		return NULL;
+	block->next = NULL;
+	block->size = size;
+	block->used = 0;
+	return block;
+}
+
+struct arena_t* create_arena( size_t block_size ) {
+	struct arena_t* const arena = malloc( sizeof( struct arena_t ) );
+	if( arena == NULL )
+		return NULL;
+	arena->block_size = block_size;
+	arena->current = NULL;
+	return arena;
+}
+
+void free_arena( struct arena_t* arena ) {
+	if( arena == NULL ) return;
+	struct arena_block_t* block = arena->current;
+	while( block != NULL ) {
+		struct arena_block_t* const next = block->next;
+		free( block );
+		block = next;
+	}
+	free( arena );
+}
+
+void* alloc_from_arena( struct arena_t* arena, size_t size ) {
+	if( size > SIZE_MAX - ARENA_ALIGNMENT )
+		return NULL;
+	size = ( size + ARENA_ALIGNMENT - 1 ) & ~( (size_t)ARENA_ALIGNMENT - 1 );
+	struct arena_block_t* block = arena->current;
+	if( block != NULL && block->size - block->used >= size ) {
+		void* const result = get_block_data( block ) + block->used;
+		block->used += size;
+		return result;
+	}
+
+	if( size > arena->block_size / 2 ) {
+		// A large allocation gets a block of its own which is linked behind
+		// the current block, such that the remaining space of the current
+		// block is not wasted
+		block = create_arena_block( size );
+		if( block == NULL )
+			return NULL;
+		block->used = size;
+		if( arena->current != NULL ) {
+			block->next = arena->current->next;
+			arena->current->next = block;
+		} else {
+			arena->current = block;
+		}
+		return get_block_data( block );
+	}
+
+	block = create_arena_block( arena->block_size );
+	if( block == NULL )
+		return NULL;
+	block->next = arena->current;
+	arena->current = block;
+	block->used = size;
+	return get_block_data( block );
+}
+
+char* copy_string_to_arena( struct arena_t* arena, char const * str, size_t len ) {
+	char* const result = alloc_from_arena( arena, len + 1 );
+	if( result == NULL )
+		return NULL;
+	memcpy( result, str, len );
+	result[len] = '\0';
+	return result;
+}
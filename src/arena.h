@@ -0,0 +1,66 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+/**
+ * @file
+ * @brief Compounds and functions for a region-based memory allocator.
+ */
+
+#include <stddef.h>
+
+/**
+ * A bump allocator for many small, short-lived allocations.
+ *
+ * Memory is handed out from large blocks by advancing a pointer; individual
+ * allocations cannot be freed, but all of them are released at once by
+ * ::free_arena().
+ * An arena is meant to be owned by a single SMTP session, i.e. it is not
+ * thread-safe, but different arenas do not share any state and hence do
+ * not contend with each other.
+ */
+struct arena_t;
+
+/**
+ * Creates an arena.
+ *
+ * @param block_size The size of the blocks in bytes which are requested
+ * from `malloc`; allocations larger than half of the block size get a
+ * block of their own
+ * @return The pointer to the allocated arena or `NULL` in case of an error.
+ */
+struct arena_t* create_arena( size_t block_size );
+
+/**
+ * Frees an arena including all memory which has been allocated from it.
+ *
+ * Note, the function is NULL-pointer safe.
+ *
+ * @param arena The arena to be freed.
+ */
+void free_arena( struct arena_t* arena );
+
+/**
+ * Allocates memory from an arena.
+ *
+ * The memory is suitably aligned for any type and remains valid until the
+ * arena is freed.
+ *
+ * @param arena The arena
+ * @param size The number of bytes
+ * @return The pointer to the memory or `NULL` in case of an error.
+ */
+void* alloc_from_arena( struct arena_t* arena, size_t size );
+
+/**
+ * Copies a string into an arena.
+ *
+ * The passed string does not need to be null-terminated, but the copy is.
+ *
+ * @param arena The arena
+ * @param str The string
+ * @param len The length of `str`
+ * @return The null-terminated copy or `NULL` in case of an error.
+ */
+char* copy_string_to_arena( struct arena_t* arena, char const * str, size_t len );
+
+#endif
@@ -0,0 +1,287 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "cache.h"
+
+/**
+ * Maximum number of independently locked shards; must be a power of two.
+ */
+#define CACHE_MAX_SHARD_COUNT 16
+
+/**
+ * Minimum number of entries per shard.
+ *
+ * Small caches use fewer shards such that the LRU order is not diluted
+ * across many tiny shards.
+ */
+static size_t const CACHE_MIN_SHARD_CAPACITY = 64;
+
+/**
+ * A single entry of the cache.
+ *
+ * Each entry is linked into two lists: the collision chain of its hash
+ * bucket and the LRU list of its shard.
+ */
+struct cache_entry_t {
+	char* key; /**< The null-terminated key owned by the entry. */
+	uint64_t hash; /**< The cached hash value of `key`. */
+	time_t expires; /**< The monotonic time in seconds after which the entry is stale. */
+	struct string_array_t* value; /**< The cached value owned by the entry. */
+	struct cache_entry_t* next_in_bucket; /**< Next entry in the same hash bucket. */
+	struct cache_entry_t* older; /**< Next less recently used entry of the shard. */
+	struct cache_entry_t* newer; /**< Next more recently used entry of the shard. */
+};
+
+/**
+ * A shard of the cache with its own lock.
+ */
+struct cache_shard_t {
+	pthread_mutex_t mutex; /**< Protects all members below and all entries of the shard. */
+	size_t capacity; /**< The maximum number of entries of this shard. */
+	size_t size; /**< The current number of entries of this shard. */
+	size_t bucket_mask; /**< Number of buckets minus one; number of buckets is a power of two. */
+	struct cache_entry_t** buckets; /**< The hash buckets. */
+	struct cache_entry_t* oldest; /**< The least recently used entry which is evicted first. */
+	struct cache_entry_t* newest; /**< The most recently used entry. */
+};
+
+struct cache_t {
+	unsigned int ttl; /**< The time-to-live of entries in seconds. */
+	size_t shard_mask; /**< Number of used shards minus one; number of shards is a power of two. */
+	struct cache_shard_t shards[CACHE_MAX_SHARD_COUNT]; /**< The shards; only the first `shard_mask + 1` are used. */
+};
+
+/**
+ * Computes the 64-bit FNV-1a hash of a null-terminated string.
+ */
+static uint64_t hash_key( char const * key ) {
+	uint64_t hash = UINT64_C( 14695981039346656037 );
+	for( ; *key != '\0'; ++key ) {
+		hash ^= (unsigned char)*key;
+		hash *= UINT64_C( 1099511628211 );
+	}
+	return hash;
+}
+
+static time_t now_monotonic( void ) {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec;
+}
+
+static struct cache_shard_t* select_shard( struct cache_t* const cache, uint64_t const hash ) {
+	// Use the upper bits for the shard and the lower bits for the bucket
+	// such that both are independent of each other.
+	return &( cache->shards[ ( hash >> 56 ) & cache->shard_mask ] );
+}
+
+static void free_cache_entry( struct cache_entry_t* const entry ) {
+	free( entry->key );
+	free_string_array( entry->value );
+	free( entry );
+}
+
+/**
+ * Unlinks an entry from the LRU list.
+ *
+ * The caller must hold the shard lock.
+ */
+static void unlink_lru_entry( struct cache_shard_t* const shard, struct cache_entry_t* const entry ) {
+	if( entry->older != NULL )
+		entry->older->newer = entry->newer;
+	else
+		shard->oldest = entry->newer;
+	if( entry->newer != NULL )
+		entry->newer->older = entry->older;
+	else
+		shard->newest = entry->older;
+}
+
+/**
+ * Links an entry into the LRU list as the most recently used entry.
+ *
+ * The caller must hold the shard lock.
+ */
+static void link_lru_entry( struct cache_shard_t* const shard, struct cache_entry_t* const entry ) {
+	entry->older = shard->newest;
+	entry->newer = NULL;
+	if( shard->newest != NULL )
+		shard->newest->newer = entry;
+	else
+		shard->oldest = entry;
+	shard->newest = entry;
+}
+
+/**
+ * Unlinks an entry from the LRU list and its bucket chain and frees it.
+ *
+ * The caller must hold the shard lock.
+ */
+static void remove_cache_entry( struct cache_shard_t* const shard, struct cache_entry_t* const entry ) {
+	struct cache_entry_t** link = &( shard->buckets[ entry->hash & shard->bucket_mask ] );
+	while( *link != entry )
+		link = &( (*link)->next_in_bucket );
+	*link = entry->next_in_bucket;
+	unlink_lru_entry( shard, entry );
+	--shard->size;
+	free_cache_entry( entry );
+}
+
+/**
+ * Finds the entry for the given key.
+ *
+ * The caller must hold the shard lock.
+ */
+static struct cache_entry_t* find_cache_entry( struct cache_shard_t const * const shard, char const * const key, uint64_t const hash ) {
+	for(
+		struct cache_entry_t* entry = shard->buckets[ hash & shard->bucket_mask ];
+		entry != NULL;
+		entry = entry->next_in_bucket
+	) {
+		if( entry->hash == hash && strcmp( entry->key, key ) == 0 )
+			return entry;
+	}
+	return NULL;
+}
+
+struct cache_t* create_cache( size_t capacity, unsigned int ttl ) {
+	if( capacity == 0 || ttl == 0 )
+		return NULL;
+	struct cache_t* const cache = malloc( sizeof( struct cache_t ) );
+	if( cache == NULL )
+		return NULL;
+	cache->ttl = ttl;
+
+	size_t shard_count = 1;
+	while( shard_count < CACHE_MAX_SHARD_COUNT && 2 * shard_count * CACHE_MIN_SHARD_CAPACITY <= capacity )
+		shard_count *= 2;
+	cache->shard_mask = shard_count - 1;
+
+	size_t const shard_capacity = ( capacity + shard_count - 1 ) / shard_count;
+	// Aim at a load factor of at most 1/2
+	size_t bucket_count = 8;
+	while( bucket_count < 2 * shard_capacity )
+		bucket_count *= 2;
+
+	for( size_t i = 0; i != shard_count; ++i ) {
+		struct cache_shard_t* const shard = &( cache->shards[i] );
+		pthread_mutex_init( &shard->mutex, NULL );
+		shard->capacity = shard_capacity;
+		shard->size = 0;
+		shard->bucket_mask = bucket_count - 1;
+		shard->oldest = NULL;
+		shard->newest = NULL;
+		shard->buckets = calloc( bucket_count, sizeof( struct cache_entry_t* ) );
+		if( shard->buckets == NULL ) {
+			for( size_t j = 0; j <= i; ++j ) {
+				free( cache->shards[j].buckets );
+				pthread_mutex_destroy( &( cache->shards[j].mutex ) );
+			}
+			free( cache );
+			return NULL;
+		}
+	}
+	return cache;
+}
+
+void free_cache( struct cache_t* cache ) {
+	if( cache == NULL ) return;
+	for( size_t i = 0; i <= cache->shard_mask; ++i ) {
+		struct cache_shard_t* const shard = &( cache->shards[i] );
+		struct cache_entry_t* entry = shard->oldest;
+		while( entry != NULL ) {
+			struct cache_entry_t* const next = entry->newer;
+			free_cache_entry( entry );
+			entry = next;
+		}
+		free( shard->buckets );
+		pthread_mutex_destroy( &shard->mutex );
+	}
+	free( cache );
+}
+
+/**
+ * Looks up an entry and returns a copy of its value.
+ *
+ * Expired entries are kept, such that they can still be served by
+ * ::lookup_stale_cache() if the LDAP server fails; they are eventually
+ * replaced or evicted.
+ */
+static struct string_array_t* lookup_cache_entry( struct cache_t* const cache, char const * const key, int const allow_stale ) {
+	if( cache == NULL || key == NULL )
+		return NULL;
+	uint64_t const hash = hash_key( key );
+	struct cache_shard_t* const shard = select_shard( cache, hash );
+	struct string_array_t* result = NULL;
+
+	pthread_mutex_lock( &shard->mutex );
+	struct cache_entry_t* const entry = find_cache_entry( shard, key, hash );
+	if( entry != NULL && ( allow_stale || entry->expires >= now_monotonic() ) ) {
+		result = copy_string_array( entry->value );
+		unlink_lru_entry( shard, entry );
+		link_lru_entry( shard, entry );
+	}
+	pthread_mutex_unlock( &shard->mutex );
+	return result;
+}
+
+struct string_array_t* lookup_cache( struct cache_t* cache, char const * key ) {
+	return lookup_cache_entry( cache, key, 0 );
+}
+
+struct string_array_t* lookup_stale_cache( struct cache_t* cache, char const * key ) {
+	return lookup_cache_entry( cache, key, 1 );
+}
+
+int insert_cache( struct cache_t* cache, char const * key, struct string_array_t const * value ) {
+	if( cache == NULL || key == NULL || value == NULL )
+		return 0;
+	uint64_t const hash = hash_key( key );
+	struct cache_shard_t* const shard = select_shard( cache, hash );
+
+	// Prepare the new entry outside of the lock to keep the critical
+	// section short.
+	struct cache_entry_t* const entry = malloc( sizeof( struct cache_entry_t ) );
+	if( entry == NULL )
+		return 1;
+	entry->key = malloc( strlen( key ) + 1 );
+	entry->value = copy_string_array( value );
+	if( entry->key == NULL || entry->value == NULL ) {
+		free( entry->key );
+		if( entry->value != NULL )
+			free_string_array( entry->value );
+		free( entry );
+		return 1;
+	}
+	strcpy( entry->key, key );
+	entry->hash = hash;
+	entry->expires = now_monotonic() + cache->ttl;
+
+	pthread_mutex_lock( &shard->mutex );
+	struct cache_entry_t* const old = find_cache_entry( shard, key, hash );
+	if( old != NULL ) {
+		remove_cache_entry( shard, old );
+	} else if( shard->size == shard->capacity ) {
+		remove_cache_entry( shard, shard->oldest );
+	}
+	struct cache_entry_t** const bucket = &( shard->buckets[ hash & shard->bucket_mask ] );
+	entry->next_in_bucket = *bucket;
+	*bucket = entry;
+	link_lru_entry( shard, entry );
+	++shard->size;
+	pthread_mutex_unlock( &shard->mutex );
+	return 0;
+}
+
+size_t get_cache_size( struct cache_t* cache ) {
+	size_t size = 0;
+	for( size_t i = 0; i <= cache->shard_mask; ++i ) {
+		pthread_mutex_lock( &( cache->shards[i].mutex ) );
+		size += cache->shards[i].size;
+		pthread_mutex_unlock( &( cache->shards[i].mutex ) );
+	}
+	return size;
+}
@@ -0,0 +1,98 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+/**
+ * @file
+ * @brief Compounds and functions for a thread-safe cache of LDAP results.
+ */
+
+#include <stddef.h>
+
+#include "string_array.h"
+
+/**
+ * A thread-safe map from strings (e.g. mail addresses) to string arrays
+ * whose entries expire after a fixed time-to-live.
+ *
+ * Large caches are split into independent shards, each protected by its
+ * own lock, such that concurrent milter threads rarely contend.
+ * The number of entries is bounded; if a shard is full, inserting a new
+ * entry evicts the least recently used entry of that shard.
+ * Expired entries are not served by ::lookup_cache(), but are kept until
+ * they are evicted, such that ::lookup_stale_cache() can serve them as a
+ * fallback.
+ *
+ * An empty string array is a valid value and represents a negative result,
+ * e.g. "the address is not a mailing list".
+ */
+struct cache_t;
+
+/**
+ * Creates a cache.
+ *
+ * @param capacity The maximum number of entries; must be positive
+ * @param ttl The time-to-live of entries in seconds; must be positive
+ * @return The pointer to the allocated cache or `NULL` in case of an error.
+ */
+struct cache_t* create_cache( size_t capacity, unsigned int ttl );
+
+/**
+ * Frees a cache which has previously been allocated with
+ * ::create_cache(size_t, unsigned int) including all of its entries.
+ *
+ * Note, the function is NULL-pointer safe.
+ *
+ * @param cache The cache to be freed.
+ */
+void free_cache( struct cache_t* cache );
+
+/**
+ * Looks up an entry.
+ *
+ * On a hit, the function returns a deep copy of the cached string array
+ * which must be freed by the caller, and the entry becomes the most
+ * recently used entry.
+ * Expired entries are treated as a miss.
+ *
+ * @param cache The cache; may be `NULL` in which case the result is always a miss
+ * @param key The null-terminated key
+ * @return A copy of the cached string array or `NULL` on a miss
+ */
+struct string_array_t* lookup_cache( struct cache_t* cache, char const * key );
+
+/**
+ * Looks up an entry including expired entries.
+ *
+ * Same as ::lookup_cache(), but expired entries are treated as a hit.
+ * This is meant as a fallback, if the LDAP server is unavailable.
+ *
+ * @param cache The cache; may be `NULL` in which case the result is always a miss
+ * @param key The null-terminated key
+ * @return A copy of the cached string array or `NULL` on a miss
+ */
+struct string_array_t* lookup_stale_cache( struct cache_t* cache, char const * key );
+
+/**
+ * Inserts or replaces an entry.
+ *
+ * The cache stores a deep copy of `value`, i.e. the caller keeps ownership
+ * of `value`.
+ *
+ * @param cache The cache; may be `NULL` in which case this is a no-op
+ * @param key The null-terminated key
+ * @param value The string array to be stored; use an empty array to cache
+ * a negative result
+ * @return Zero on success, non-zero in case of an error
+ */
+int insert_cache( struct cache_t* cache, char const * key, struct string_array_t const * value );
+
+/**
+ * Returns the number of entries currently held by the cache, including
+ * expired entries which have not yet been evicted.
+ *
+ * @param cache The cache
+ * @return The number of entries
+ */
+size_t get_cache_size( struct cache_t* cache );
+
+#endif
@@ -1,147 +1,278 @@
 #define _GNU_SOURCE
 #include <ldap.h>
+#include <poll.h>
 #include <sysexits.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 
+#include "extldap.h"
 #include "runtime_setting.h"
 #include "log.h"
 #include "extstring.h"
 #include "string_array.h"
+#include "arena.h"
+#include "template.h"
+#include "cache.h"
+#include "ldap_pool.h"
+#include "ldap_sync.h"
+#include "metrics.h"
+#include "nested_list.h"
 
-static LDAP* ldap_handle = NULL;
+/**
+ * Cache for the members of mailing lists keyed by the mailing list address.
+ *
+ * Addresses which are not a mailing list are cached as an empty array.
+ * `NULL`, if caching is disabled.
+ */
+static struct cache_t* mail_list_cache = NULL;
 
-static int const LDAP_PROTOCOL_VERSION = LDAP_VERSION3;
+/**
+ * Cache for the own mail addresses of user accounts keyed by the account.
+ *
+ * `NULL`, if caching is disabled.
+ */
+static struct cache_t* mail_acct_cache = NULL;
 
 int connect_ldap( void ) {
-	int result = LDAP_SUCCESS;
-	result = ldap_initialize( &ldap_handle, rt_setting.ldap_bind.host );
-	if ( result != LDAP_SUCCESS ) {
-		log_msg( LOG_ERR, "ldap_initialize failed: %s (%d)\n", ldap_err2string( result ), result );
-		return EX_SOFTWARE;
-	}
+	int result = open_ldap_pool();
+	if( result != EX_OK )
+		return result;
 
-	result = ldap_set_option( ldap_handle, LDAP_OPT_PROTOCOL_VERSION, &LDAP_PROTOCOL_VERSION );
-	if ( result != LDAP_OPT_SUCCESS ) {
-		log_msg( LOG_ERR, "ldap_set_option failed: %s (%d)\n", ldap_err2string( result ), result );
-		return EX_SOFTWARE;
+	if( rt_setting.mail_list_cache.ttl != 0 ) {
+		mail_list_cache = create_cache( rt_setting.mail_list_cache.size, rt_setting.mail_list_cache.ttl );
+		if( mail_list_cache == NULL ) {
+			log_msg( LOG_ERR, "connect_ldap: could not allocate mailing list cache\n" );
+			disconnect_ldap();
+			return EX_OSERR;
+		}
+	}
+	if( rt_setting.mail_acct_cache.ttl != 0 ) {
+		mail_acct_cache = create_cache( rt_setting.mail_acct_cache.size, rt_setting.mail_acct_cache.ttl );
+		if( mail_acct_cache == NULL ) {
+			log_msg( LOG_ERR, "connect_ldap: could not allocate account cache\n" );
+			disconnect_ldap();
+			return EX_OSERR;
+		}
 	}
 
-	if( rt_setting.ldap_bind.dn == NULL ) {
-		// Anonymous simple bind
-		result = ldap_sasl_bind_s( ldap_handle, NULL, LDAP_SASL_SIMPLE, NULL, NULL, NULL, NULL );
-	} else {
-		// Simple bind with DN
-		struct berval passwd = { 0, NULL };
-		passwd.bv_val = ber_strdup( rt_setting.ldap_bind.passwd );
-		passwd.bv_len = strlen( passwd.bv_val );
-		result = ldap_sasl_bind_s( ldap_handle, rt_setting.ldap_bind.dn, LDAP_SASL_SIMPLE, &passwd, NULL, NULL, NULL );
-		ber_memfree( passwd.bv_val );
-	}
-	if ( result != LDAP_SUCCESS ) {
-		log_msg( LOG_ERR, "ldap_sasl_bind_s (simple) failed: %s (%d)\n", ldap_err2string( result ), result );
-		return EX_IOERR;
+	result = start_ldap_sync();
+	if( result != EX_OK ) {
+		disconnect_ldap();
+		return result;
 	}
 
 	log_msg(
 		LOG_INFO,
-		"connect_ldap: succeeded (host = \"%s\", user = \"%s\")\n",
+		"connect_ldap: succeeded (host = \"%s\", user = \"%s\", connections = %u)\n",
 		rt_setting.ldap_bind.host,
-		rt_setting.ldap_bind.passwd
+		str_or_null( rt_setting.ldap_bind.dn ),
+		rt_setting.ldap_pool_size
 	);
 
 	return EX_OK;
 }
 
 int disconnect_ldap( void ) {
-	int result = ldap_unbind_ext_s( ldap_handle, NULL, NULL );
-	ldap_handle = NULL;
-	if ( result != LDAP_SUCCESS ) {
-		log_msg( LOG_ERR, "ldap_unbind_ext_s failed: %s (%d)\n", ldap_err2string( result ), result );
-		return EX_IOERR;
+	stop_ldap_sync();
+	int const return_code = close_ldap_pool();
+	free_cache( mail_list_cache );
+	mail_list_cache = NULL;
+	free_cache( mail_acct_cache );
+	mail_acct_cache = NULL;
+	return return_code;
+}
+
+/**
+ * The size of the buffers on the stack into which templates are expanded.
+ *
+ * Filters and DNs are only needed until they have been handed over to
+ * libldap, hence the buffers are provided by the caller; only longer
+ * expansions are allocated from the arena.
+ */
+#define EXPANSION_BUFFER_SIZE 512
+
+/**
+ * Substitutes the placeholders in a compiled template with parts of the
+ * provided mail address.
+ *
+ * See ::template_t for the supported placeholders; the substituted parts
+ * are escaped as specified by ::compile_template().
+ *
+ * @param arena The arena from which the result is allocated, if it does
+ * not fit into `buf`
+ * @param template The compiled template or `NULL`
+ * @param mail_address The mail address to use to substitute the place holders
+ * @param buf A buffer of ::EXPANSION_BUFFER_SIZE bytes
+ * @return The expansion either in `buf` or in `arena`, or `NULL` if
+ * `template` is `NULL` or in case of an error
+ */
+static char* expand_placeholders(
+	struct arena_t* const arena,
+	struct template_t const * const template,
+	char const * const mail_address,
+	char* const buf
+) {
+	if( template == NULL )
+		return NULL;
+	size_t const len = expand_template( template, mail_address, buf, EXPANSION_BUFFER_SIZE );
+	if( len < EXPANSION_BUFFER_SIZE )
+		return buf;
+	char* const result = alloc_from_arena( arena, len + 1 );
+	if( result != NULL )
+		expand_template( template, mail_address, result, len + 1 );
+	return result;
+}
+
+/**
+ * Returns the current time of the monotonic clock.
+ */
+static struct timespec now_monotonic( void ) {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts;
+}
+
+/**
+ * Adds milliseconds to a point in time.
+ */
+static void add_milliseconds( struct timespec* const ts, unsigned int const ms ) {
+	ts->tv_sec += ms / 1000;
+	ts->tv_nsec += ( ms % 1000 ) * 1000000L;
+	if( ts->tv_nsec >= 1000000000L ) {
+		ts->tv_sec += 1;
+		ts->tv_nsec -= 1000000000L;
 	}
-	return EX_OK;
 }
 
-static void decompose_mail_address( char const * const addr, char** local, char** domain ) {
-	char const * at = strchrnul( addr, '@' );
-	*local = malloc( at - addr + 1 );
-	*( stpncpy( *local, addr, at - addr ) ) = '\0';
-	if( *at == '@' ) ++at;
-	*domain = malloc( strlen( at ) + 1 );
-	strcpy( *domain, at );
+/**
+ * Returns non-zero, if `a` is before `b`.
+ */
+static int is_before( struct timespec const * const a, struct timespec const * const b ) {
+	return a->tv_sec < b->tv_sec || ( a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec );
 }
 
 /**
- * Substitutes the placeholders in a template with parts of the provided mail
- * address.
- *
- * The following placeholders are supported:
+ * Computes the time which remains until the deadline.
  *
- *  - `%u` is replaced by the entire mail address
- *  - `%d` is replaced by the domain part
- *  - `%n` is replaced by the local part
+ * @param deadline The deadline on the monotonic clock
+ * @param remaining Output parameter for the remaining time; zero if the
+ * deadline has already passed
+ * @return Zero if the deadline has passed, non-zero otherwise
+ */
+static int get_remaining_time( struct timespec const * const deadline, struct timeval* const remaining ) {
+	struct timespec const now = now_monotonic();
+	long long const remaining_us =
+		( (long long)( deadline->tv_sec - now.tv_sec ) ) * 1000000LL +
+		( deadline->tv_nsec - now.tv_nsec ) / 1000;
+	if( remaining_us <= 0 ) {
+		remaining->tv_sec = 0;
+		remaining->tv_usec = 0;
+		return 0;
+	}
+	remaining->tv_sec = remaining_us / 1000000LL;
+	remaining->tv_usec = remaining_us % 1000000LL;
+	return 1;
+}
+
+/**
+ * Sends a search request to the LDAP server without waiting for the result.
  *
- * @param template The template which with place holders
- * @param mail_address The mail address to use to substitute the place holders
- * @return The constructed filter; the caller must free the result
- */
-static char* replace_placeholders( char const * const template, char const * const mail_address ) {
-	// TODO: Make this code safe against injection attacks.
-	// We replace the place holders by user-supplied data without escaping.
-	// TODO: Escape the following special LDAP symbols as follows
-	//  - ( --> \28  (left paranthese)
-	//  - ) --> \29  (right paranthese)
-	//  - & --> \26  (AND operator)
-	//  - * --> \2a  (wildcard match)
-	//  - / --> \2f  (slash)
-	//  - \ --> \5c  (backslash)
-	//  - | --> \7c  (OR operator)
-	//  - < --> \3c  (SMALLER THAN operator)
-	//  - = --> \3d  (EQUALITY operator)
-	//  - > --> \3e  (GREATER THAN operator)
-	//  - ~ --> \7e  (SIMILARITY operator)
-	char* local = NULL;
-	char* domain = NULL;
-	decompose_mail_address( mail_address, &local, &domain );
-	char * const buf1 = str_replace( template, "%u", mail_address );
-	char * const buf2 = str_replace( buf1, "%d", domain );
-	char* filter = str_replace( buf2, "%n", local );
-	free( buf1 );
-	free( buf2 );
-	free( local );
-	free( domain );
-	return filter;
-}
-
-static struct string_array_t* search_mail_addresses(
-	char const * const filter,
-	char const * const base,
-	char** const result_attributes
+ * @param arena The arena for the filter and the base DN, if they are long
+ * @param ldap_handle The connection to use
+ * @param query The query whose placeholders are substituted by `key`
+ * @param key The mail address or account to search for
+ * @param msgid Output parameter for the message ID of the search
+ * @return `EX_OK` on success, `EX_UNAVAILABLE` if the connection has been
+ * lost, `EX_OSERR` if the filter could not be allocated or `EX_IOERR` in
+ * case of another error
+ */
+static int send_search(
+	struct arena_t* const arena,
+	LDAP* const ldap_handle,
+	struct ldap_query_parms_t const * const query,
+	char const * const key,
+	int* const msgid
 ) {
-	log_msg( LOG_DEBUG, "search_mail_addresses: LDAP base: %s\n", base );
-	log_msg( LOG_DEBUG, "search_mail_addresses: LDAP filter: %s\n", filter );
+	*msgid = -1;
+	char filter_buf[EXPANSION_BUFFER_SIZE];
+	char base_dn_buf[EXPANSION_BUFFER_SIZE];
+	uint64_t const observation = start_metric_observation();
+	char const * const filter = expand_placeholders( arena, query->compiled_filter, key, filter_buf );
+	char const * const base_dn = expand_placeholders( arena, query->compiled_base_dn, key, base_dn_buf );
+	observe_metric( METRIC_EXPAND_LATENCY, observation );
+	if(
+		( filter == NULL && query->compiled_filter != NULL ) ||
+		( base_dn == NULL && query->compiled_base_dn != NULL )
+	) {
+		log_msg( LOG_ERR, "send_search: could not allocate filter\n" );
+		return EX_OSERR;
+	}
+	log_msg( LOG_DEBUG, "send_search: LDAP base: %s\n", base_dn );
+	log_msg( LOG_DEBUG, "send_search: LDAP filter: %s\n", filter );
 
-	LDAPMessage* ldap_result_msg = NULL;
-	int result_code = ldap_search_ext_s(
+	// The time limit is transmitted to the server in whole seconds, hence
+	// round up.
+	struct timeval time_limit = { ( query->timeout + 999 ) / 1000, 0 };
+
+	int const result_code = ldap_search_ext(
 		ldap_handle,
-		base,
+		base_dn,
 		LDAP_SCOPE_SUBTREE,
 		filter,
-		result_attributes,
+		(char**)query->result_attributes,
 		0,    // attrsonly: include values in response as well
 		NULL, // serverctrls: no special server controls
 		NULL, // clientctrls: no special client controls
-		NULL, // timeout: unlimited
-		0,    // sizelimit: unlimited
-		&ldap_result_msg
+		query->timeout != 0 ? &time_limit : NULL, // server-side time limit; client-side deadline is enforced by ::receive_search()
+		(int)query->size_limit, // zero means unlimited
+		msgid
 	);
 
 	if ( result_code != LDAP_SUCCESS ) {
-		log_msg( LOG_ERR, "search_mail_addresses: ldap_search_ext_s failed: %s (%d)\n", ldap_err2string( result_code ), result_code );
-		ldap_msgfree( ldap_result_msg );
-		return NULL;
+		log_msg( LOG_ERR, "send_search: ldap_search_ext failed: %s (%d)\n", ldap_err2string( result_code ), result_code );
+		*msgid = -1;
+		return is_ldap_connection_error( result_code ) ? EX_UNAVAILABLE : EX_IOERR;
 	}
+	return EX_OK;
+}
+
+/**
+ * Checks the result code of a complete search result.
+ *
+ * A result which has been truncated by the size limit counts as failed,
+ * because list members would be silently lost otherwise.
+ *
+ * @return Zero, if the search succeeded, non-zero otherwise
+ */
+static int check_search_result( LDAP* const ldap_handle, LDAPMessage* const ldap_result_msg ) {
+	int result_code = LDAP_SUCCESS;
+	int const parse_code = ldap_parse_result( ldap_handle, ldap_result_msg, &result_code, NULL, NULL, NULL, NULL, 0 );
+	if ( parse_code == LDAP_SUCCESS && result_code == LDAP_SIZELIMIT_EXCEEDED ) {
+		log_msg( LOG_ERR, "check_search_result: size limit exceeded\n" );
+		return -1;
+	}
+	if ( parse_code != LDAP_SUCCESS || result_code != LDAP_SUCCESS ) {
+		if( parse_code != LDAP_SUCCESS )
+			result_code = parse_code;
+		log_msg( LOG_ERR, "check_search_result: search failed: %s (%d)\n", ldap_err2string( result_code ), result_code );
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Collects all mail addresses of a complete search result.
+ *
+ * @param arena The arena for the result
+ * @param ldap_handle The connection on which the result has been received
+ * @param ldap_result_msg The chain of messages of a search result as
+ * returned by `ldap_result` with `LDAP_MSG_ALL`
+ * @return String array with mail addresses or `NULL` in case of an error
+ */
+static struct string_array_t* parse_mail_addresses( struct arena_t* const arena, LDAP* const ldap_handle, LDAPMessage* const ldap_result_msg ) {
+	if( check_search_result( ldap_handle, ldap_result_msg ) != 0 )
+		return NULL;
 
 	// Collect all mail addresses in a dynamic array
 	// As an estimate we assume that there are approx. 3 mail addresses
@@ -149,13 +280,17 @@ static struct string_array_t* search_mail_addresses(
 	// If the array turns out to be too small, it will be re-allocated.
 	int const result_size = ldap_count_entries( ldap_handle, ldap_result_msg );
 	if ( result_size == -1 ) {
-		log_msg( LOG_ERR, "search_mail_addresses: ldap_count_entries failed\n" );
-		ldap_msgfree( ldap_result_msg );
+		log_msg( LOG_ERR, "parse_mail_addresses: ldap_count_entries failed\n" );
 		return NULL;
 	}
-	log_msg( LOG_DEBUG, "search_mail_addresses: LDAP result size: %d\n", result_size );
-	struct string_array_t* result = create_string_array( 3 * result_size );
-	if ( result_size == 0 ) {
+	log_msg( LOG_DEBUG, "parse_mail_addresses: LDAP result size: %d\n", result_size );
+	struct string_array_t* result = create_string_array_arena( arena, result_size != 0 ? 3 * result_size : 1 );
+	// The keys of the addresses are computed as they are pushed
+	if ( result != NULL && set_mail_address_normalization( result, rt_setting.mail_address_normalization ) != EX_OK ) {
+		log_msg( LOG_ERR, "parse_mail_addresses: could not allocate memory\n" );
+		return NULL;
+	}
+	if ( result == NULL || result_size == 0 ) {
 		// short-cut in case of an empty result set
 		// return a list with zero elements
 		return result;
@@ -174,9 +309,9 @@ static struct string_array_t* search_mail_addresses(
 			ldap_attr = ldap_next_attribute( ldap_handle, ldap_entry_msg, berptr )
 		) {
 			struct berval** values = ldap_get_values_len( ldap_handle, ldap_entry_msg, ldap_attr );
-			for( int i = 0; values[i] != NULL; ++i ) {
+			for( int i = 0; values != NULL && values[i] != NULL; ++i ) {
 				value = push_onto_string_array_l( result, values[i]->bv_val, values[i]->bv_len );
-				log_msg( LOG_DEBUG, "search_mail_addresses: found mail address: %s\n", value );
+				log_msg( LOG_DEBUG, "parse_mail_addresses: found mail address: %s\n", value );
 			}
 			ldap_value_free_len( values );
 			ldap_memfree( ldap_attr );
@@ -184,41 +319,931 @@ static struct string_array_t* search_mail_addresses(
 		ber_free( berptr, 0 );
 		berptr = NULL;
 	}
+
+	return result;
+}
+
+/**
+ * Waits for the complete result of a previously sent search.
+ *
+ * If the deadline passes before the result has been received, the search
+ * is abandoned.
+ *
+ * @param ldap_handle The connection on which the search has been sent
+ * @param msgid The message ID of the search as returned by ::send_search()
+ * @param deadline The deadline on the monotonic clock
+ * @param ldap_result_msg Output parameter for the chain of messages of the
+ * result; must be freed with `ldap_msgfree`
+ * @return `EX_OK` on success, `EX_TEMPFAIL` if the deadline passed,
+ * `EX_UNAVAILABLE` if the connection has been lost or `EX_IOERR` in case of
+ * another error
+ */
+static int wait_for_search(
+	LDAP* const ldap_handle,
+	int const msgid,
+	struct timespec const * const deadline,
+	LDAPMessage** const ldap_result_msg
+) {
+	*ldap_result_msg = NULL;
+	struct timeval remaining;
+	get_remaining_time( deadline, &remaining );
+
+	int const msg_type = ldap_result( ldap_handle, msgid, LDAP_MSG_ALL, &remaining, ldap_result_msg );
+	if( msg_type == 0 ) {
+		log_msg( LOG_WARNING, "wait_for_search: deadline exceeded for search %d\n", msgid );
+		ldap_abandon_ext( ldap_handle, msgid, NULL, NULL );
+		return EX_TEMPFAIL;
+	}
+	if( msg_type == -1 ) {
+		int result_code = LDAP_SUCCESS;
+		ldap_get_option( ldap_handle, LDAP_OPT_RESULT_CODE, &result_code );
+		log_msg( LOG_ERR, "wait_for_search: ldap_result failed: %s (%d)\n", ldap_err2string( result_code ), result_code );
+		return is_ldap_connection_error( result_code ) ? EX_UNAVAILABLE : EX_IOERR;
+	}
+	return EX_OK;
+}
+
+/**
+ * Waits for the complete result of a previously sent search and collects
+ * the mail addresses.
+ *
+ * @param arena The arena for the result
+ * @param ldap_handle The connection on which the search has been sent
+ * @param msgid The message ID of the search as returned by ::send_search()
+ * @param deadline The deadline on the monotonic clock
+ * @param result Output parameter for the found mail addresses
+ * @return `EX_OK` on success, an error code of ::wait_for_search() or
+ * `EX_IOERR` if the search failed
+ */
+static int receive_search(
+	struct arena_t* const arena,
+	LDAP* const ldap_handle,
+	int const msgid,
+	struct timespec const * const deadline,
+	struct string_array_t** const result
+) {
+	*result = NULL;
+	LDAPMessage* ldap_result_msg = NULL;
+	int const result_code = wait_for_search( ldap_handle, msgid, deadline, &ldap_result_msg );
+	if( result_code != EX_OK )
+		return result_code;
+
+	uint64_t const observation = start_metric_observation();
+	*result = parse_mail_addresses( arena, ldap_handle, ldap_result_msg );
+	observe_metric( METRIC_PARSE_LATENCY, observation );
 	ldap_msgfree( ldap_result_msg );
+	return *result != NULL ? EX_OK : EX_IOERR;
+}
 
+/**
+ * A single search of an alias lookup.
+ */
+struct alias_search_t {
+	/**
+	 * The message ID of the search, if the search has been sent to the
+	 * LDAP server and its result is still outstanding, `-1` otherwise.
+	 */
+	int msgid;
+	/**
+	 * The point in time on the monotonic clock at which the search times out
+	 * according to its per-query timeout; only valid if `msgid != -1` and
+	 * the query has a timeout.
+	 */
+	struct timespec deadline;
+	struct timespec waiting_since; /**< The point in time on the monotonic clock at which the milter started to wait for the result; only valid if `msgid != -1`. */
+	char* key; /**< The mail address or account which is searched for. */
+	struct cache_t* cache; /**< The cache for results of this kind of search or `NULL`. */
+	struct string_array_t* result; /**< The result, if already known (e.g. from cache), or `NULL`. */
+	int is_list; /**< Non-zero for the search for a mailing list, zero for the search for an account. */
+	/**
+	 * The start of the latency observation, i.e. the point in time at which
+	 * the milter started to wait for the result; only valid if
+	 * `msgid != -1`.
+	 */
+	uint64_t observation;
+};
+
+struct alias_lookup_t {
+	struct arena_t* arena; /**< The arena which holds the lookup, its keys and the results received from LDAP server. */
+	/**
+	 * The connection which has been checked out for this lookup.
+	 *
+	 * Both searches are sent on the same connection such that they are
+	 * processed by the LDAP server concurrently.
+	 * `NULL`, if both searches have been answered from cache.
+	 */
+	LDAP* ldap_handle;
+	int is_broken; /**< Non-zero, if `ldap_handle` has been lost and must not be used anymore. */
+	struct alias_search_t list_search; /**< Search for the members of the mailing list. */
+	struct alias_search_t acct_search; /**< Search for the own addresses of the account. */
+	long long ldap_latency; /**< The longest time in microseconds the milter waited for the result of a search or `-1`. */
+};
+
+/**
+ * Initializes a search and looks up its result in the cache.
+ *
+ * @param is_list Non-zero for the search for a mailing list
+ * @param result The result, if already known from elsewhere, or `NULL`;
+ * the search takes ownership
+ */
+static void init_alias_search(
+	struct arena_t* const arena,
+	struct alias_search_t* const search,
+	int const is_list,
+	struct cache_t* const cache,
+	char const * const key,
+	struct string_array_t* const result
+) {
+	search->msgid = -1;
+	search->cache = cache;
+	search->key = NULL;
+	search->result = result;
+	search->is_list = is_list;
+	search->observation = 0;
+	if( key == NULL )
+		return;
+	search->key = copy_string_to_arena( arena, key, strlen( key ) );
+	if( search->result == NULL && cache != NULL ) {
+		search->result = lookup_cache( cache, key );
+		if( search->result != NULL )
+			count_metric( is_list ? METRIC_LIST_CACHE_HITS : METRIC_ACCT_CACHE_HITS, 1 );
+		else
+			count_metric( is_list ? METRIC_LIST_CACHE_MISSES : METRIC_ACCT_CACHE_MISSES, 1 );
+	}
+}
+
+/**
+ * Looks up a search key in the local snapshot.
+ *
+ * @param arena The arena for the mapped key, if it is long
+ * @param sync The parameters of the snapshot of this kind
+ * @param lookup_snapshot Either ::lookup_mail_list_snapshot() or
+ * ::lookup_mail_acct_snapshot()
+ * @param key The envelope sender or the authenticated account
+ * @return The result, an empty array if the key is unknown, or `NULL` if the
+ * snapshot is disabled or not loaded yet
+ */
+static struct string_array_t* lookup_snapshot(
+	struct arena_t* const arena,
+	struct ldap_sync_parms_t const * const sync,
+	int (*lookup_snapshot)( char const *, struct string_array_t** ),
+	char const * const key
+) {
+	if( rt_setting.sync_interval == 0 || sync->filter == NULL || key == NULL )
+		return NULL;
+	char buf[EXPANSION_BUFFER_SIZE];
+	char const * const snapshot_key = expand_placeholders( arena, sync->compiled_key_template, key, buf );
+	struct string_array_t* result = NULL;
+	if( snapshot_key != NULL )
+		lookup_snapshot( snapshot_key, &result );
 	return result;
 }
 
-struct string_array_t* search_mail_addresses_of_list( const char* const sender ) {
-	char * const filter = replace_placeholders(
-		rt_setting.ldap_mail_list_query.filter_template,
-		sender
-	);
-	char * const base_dn = replace_placeholders(
-		rt_setting.ldap_mail_list_query.base_dn,
-		sender
+static void cleanup_alias_search( struct alias_lookup_t const * const lookup, struct alias_search_t* const search ) {
+	// Abandoning a search on a lost connection would only fail
+	if( search->msgid != -1 && !lookup->is_broken )
+		ldap_abandon_ext( lookup->ldap_handle, search->msgid, NULL, NULL );
+	search->msgid = -1;
+	search->key = NULL;
+	if( search->result != NULL )
+		free_string_array( search->result );
+	search->result = NULL;
+}
+
+/**
+ * Returns a lost connection to the pool.
+ *
+ * Outstanding searches are lost with the connection; they are sent again
+ * on a new connection by ::finish_alias_search().
+ */
+static void drop_broken_connection( struct alias_lookup_t* const lookup ) {
+	release_ldap_connection( lookup->ldap_handle, 1 );
+	lookup->ldap_handle = NULL;
+	lookup->is_broken = 0;
+	lookup->list_search.msgid = -1;
+	lookup->acct_search.msgid = -1;
+}
+
+/**
+ * Sends the search, unless its result is already known or it has already
+ * been sent.
+ *
+ * @param deadline If `NULL` and all connections are busy, the search is
+ * not sent and the function returns successfully; the search is sent later
+ * by ::finish_alias_search().
+ * Otherwise, the function waits for an idle connection until the deadline.
+ * @return `EX_OK` on success, `EX_UNAVAILABLE` if no connection is
+ * available or the connection has been lost, another error code from
+ * `sysexits.h` otherwise
+ */
+static int start_alias_search(
+	struct alias_lookup_t* const lookup,
+	struct alias_search_t* const search,
+	struct ldap_query_parms_t const * const query,
+	struct timespec const * const deadline
+) {
+	if( search->result != NULL || search->key == NULL || search->msgid != -1 )
+		return EX_OK;
+	if( lookup->ldap_handle == NULL ) {
+		lookup->ldap_handle = acquire_ldap_connection( deadline );
+		if( lookup->ldap_handle == NULL ) {
+			if( deadline == NULL ) {
+				log_msg( LOG_DEBUG, "start_alias_search: no idle LDAP connection, deferring search for %s\n", search->key );
+				return EX_OK;
+			}
+			log_msg( LOG_ERR, "start_alias_search: no LDAP connection available (pool is %s)\n", convert_ldap_health_2_str( get_ldap_health() ) );
+			return EX_UNAVAILABLE;
+		}
+	}
+	search->waiting_since = now_monotonic();
+	search->deadline = search->waiting_since;
+	add_milliseconds( &search->deadline, query->timeout );
+	search->observation = start_metric_observation();
+	int const result_code = send_search( lookup->arena, lookup->ldap_handle, query, search->key, &search->msgid );
+	if( result_code == EX_UNAVAILABLE )
+		lookup->is_broken = 1;
+	return result_code;
+}
+
+/**
+ * Inserts the result of a search into its cache.
+ */
+static void cache_alias_search( struct alias_search_t const * const search ) {
+	if( insert_cache( search->cache, search->key, search->result ) != 0 ) {
+		log_msg( LOG_WARNING, "cache_alias_search: could not cache result for %s\n", search->key );
+	}
+}
+
+/**
+ * Waits for the result of the search, unless its result is already known,
+ * and caches it.
+ *
+ * If the search has not been sent yet, it is sent first.
+ * The function waits until the earlier of `deadline` and the timeout of the
+ * query.
+ *
+ * @return `EX_OK` on success, an error code of ::start_alias_search() or
+ * ::receive_search() otherwise
+ */
+static int finish_alias_search(
+	struct alias_lookup_t* const lookup,
+	struct alias_search_t* const search,
+	struct ldap_query_parms_t const * const query,
+	struct timespec const * const deadline
+) {
+	if( search->result != NULL )
+		return EX_OK;
+	if( search->key == NULL )
+		return EX_IOERR;
+	int result_code = start_alias_search( lookup, search, query, deadline );
+	if( result_code != EX_OK )
+		return result_code;
+	struct timespec const * const effective_deadline =
+		( query->timeout != 0 && is_before( &search->deadline, deadline ) ) ? &search->deadline : deadline;
+	result_code = receive_search( lookup->arena, lookup->ldap_handle, search->msgid, effective_deadline, &search->result );
+	search->msgid = -1;
+	observe_metric( search->is_list ? METRIC_LDAP_LIST_LATENCY : METRIC_LDAP_ACCT_LATENCY, search->observation );
+	struct timespec const received = now_monotonic();
+	long long const latency =
+		(long long)( received.tv_sec - search->waiting_since.tv_sec ) * 1000000 + ( received.tv_nsec - search->waiting_since.tv_nsec ) / 1000;
+	if( latency > lookup->ldap_latency )
+		lookup->ldap_latency = latency;
+	if( result_code == EX_UNAVAILABLE ) {
+		lookup->is_broken = 1;
+	} else if( result_code == EX_OK ) {
+		cache_alias_search( search );
+	}
+	return result_code;
+}
+
+/**
+ * Checks whether data has been received on a connection which libldap has
+ * not processed yet, either in the buffer of libldap or in the socket.
+ *
+ * @return Non-zero, if data is pending, zero otherwise
+ */
+static int has_pending_ldap_data( LDAP* const ldap_handle ) {
+	Sockbuf* sockbuf = NULL;
+	if(
+		ldap_get_option( ldap_handle, LDAP_OPT_SOCKBUF, &sockbuf ) == LDAP_OPT_SUCCESS &&
+		sockbuf != NULL &&
+		ber_sockbuf_ctrl( sockbuf, LBER_SB_OPT_DATA_READY, NULL ) != 0
+	) {
+		return 1;
+	}
+	int fd = -1;
+	if( ldap_get_option( ldap_handle, LDAP_OPT_DESC, &fd ) != LDAP_OPT_SUCCESS || fd < 0 )
+		return 0;
+	struct pollfd pfd = { fd, POLLIN, 0 };
+	return poll( &pfd, 1, 0 ) > 0;
+}
+
+/**
+ * Collects the result of the search, if it has already been received,
+ * without waiting for it, and caches it.
+ *
+ * If the search failed, it is sent again by ::finish_alias_search().
+ */
+static void poll_alias_search( struct alias_lookup_t* const lookup, struct alias_search_t* const search ) {
+	if( search->msgid == -1 || lookup->is_broken )
+		return;
+	// With a zero timeout, `ldap_result` returns at once, but reads at most
+	// one message from the connection, hence read until the result is
+	// complete or nothing more has been received.
+	int msg_type = 0;
+	LDAPMessage* ldap_result_msg = NULL;
+	do {
+		struct timeval timeout = { 0, 0 };
+		msg_type = ldap_result( lookup->ldap_handle, search->msgid, LDAP_MSG_ALL, &timeout, &ldap_result_msg );
+	} while( msg_type == 0 && has_pending_ldap_data( lookup->ldap_handle ) );
+	if( msg_type == 0 )
+		return;
+	search->msgid = -1;
+	if( msg_type == -1 ) {
+		int result_code = LDAP_SUCCESS;
+		ldap_get_option( lookup->ldap_handle, LDAP_OPT_RESULT_CODE, &result_code );
+		log_msg( LOG_ERR, "poll_alias_search: ldap_result failed: %s (%d)\n", ldap_err2string( result_code ), result_code );
+		lookup->is_broken = is_ldap_connection_error( result_code );
+		return;
+	}
+	uint64_t const observation = start_metric_observation();
+	search->result = parse_mail_addresses( lookup->arena, lookup->ldap_handle, ldap_result_msg );
+	observe_metric( METRIC_PARSE_LATENCY, observation );
+	ldap_msgfree( ldap_result_msg );
+	if( search->result != NULL )
+		cache_alias_search( search );
+}
+
+/**
+ * Restarts the latency observation and the latency of a search which is
+ * still in flight.
+ *
+ * Searches which have been sent by ::start_alias_lookup() have been on the
+ * wire since the envelope sender; without a restart their latency would
+ * include the transfer of the message, although the milter only waits for
+ * them from the end of the message on.
+ * The per-query deadline still counts from sending the search.
+ */
+static void restart_alias_search_timing( struct alias_search_t* const search ) {
+	if( search->msgid == -1 )
+		return;
+	search->waiting_since = now_monotonic();
+	search->observation = start_metric_observation();
+}
+
+/**
+ * Uses a stale cache entry as the result of a search which failed.
+ *
+ * @return Zero, if the search has a result now, non-zero otherwise
+ */
+static int use_stale_alias_search( struct alias_search_t* const search ) {
+	if( search->result != NULL )
+		return 0;
+	search->result = lookup_stale_cache( search->cache, search->key );
+	if( search->result == NULL )
+		return 1;
+	log_msg( LOG_WARNING, "use_stale_alias_search: serving stale cache entry for %s\n", search->key );
+	return 0;
+}
+
+/**
+ * Sends all outstanding searches of the lookup and waits for their results.
+ *
+ * The own addresses of the account are only awaited, if the sender is a
+ * mailing list.
+ *
+ * @return `EX_OK` on success, an error code of ::finish_alias_search()
+ * otherwise
+ */
+static int resolve_alias_lookup( struct alias_lookup_t* const lookup, struct timespec const * const deadline ) {
+	// Make sure the account search is on the wire before we wait for the
+	// list search, in case the searches have been deferred by
+	// ::start_alias_lookup().
+	int result_code = start_alias_search( lookup, &lookup->list_search, &rt_setting.ldap_mail_list_query, deadline );
+	if( result_code == EX_OK )
+		result_code = start_alias_search( lookup, &lookup->acct_search, &rt_setting.ldap_mail_acct_query, deadline );
+	if( result_code != EX_OK )
+		return result_code;
+
+	result_code = finish_alias_search( lookup, &lookup->list_search, &rt_setting.ldap_mail_list_query, deadline );
+	if(
+		result_code == EX_OK &&
+		get_string_array_size( lookup->list_search.result ) != 0
+	) {
+		result_code = finish_alias_search( lookup, &lookup->acct_search, &rt_setting.ldap_mail_acct_query, deadline );
+	}
+	return result_code;
+}
+
+struct alias_lookup_t* start_alias_lookup( struct arena_t* const arena, char const * const sender, char const * const acct ) {
+	struct alias_lookup_t* const lookup = alloc_from_arena( arena, sizeof( struct alias_lookup_t ) );
+	if( lookup == NULL )
+		return NULL;
+	lookup->arena = arena;
+	lookup->ldap_handle = NULL;
+	lookup->is_broken = 0;
+	lookup->ldap_latency = -1;
+	init_alias_search(
+		arena, &lookup->list_search, 1, mail_list_cache, sender,
+		lookup_snapshot( arena, &rt_setting.mail_list_sync, lookup_mail_list_snapshot, sender )
 	);
-	struct string_array_t* result = search_mail_addresses(
-		filter, base_dn, rt_setting.ldap_mail_list_query.result_attributes
+	init_alias_search(
+		arena, &lookup->acct_search, 0, mail_acct_cache, acct,
+		lookup_snapshot( arena, &rt_setting.mail_acct_sync, lookup_mail_acct_snapshot, acct )
 	);
-	free( filter );
-	free( base_dn );
+
+	if(
+		lookup->list_search.result != NULL &&
+		get_string_array_size( lookup->list_search.result ) == 0
+	) {
+		// The sender is known not to be a mailing list, hence the own
+		// addresses of the account are not needed.
+		cleanup_alias_search( lookup, &lookup->acct_search );
+		return lookup;
+	}
+
+	// Send both searches before waiting for either of them
+	if( start_alias_search( lookup, &lookup->list_search, &rt_setting.ldap_mail_list_query, NULL ) == EX_OK )
+		start_alias_search( lookup, &lookup->acct_search, &rt_setting.ldap_mail_acct_query, NULL );
+	return lookup;
+}
+
+void poll_alias_lookup( struct alias_lookup_t* const lookup ) {
+	if( lookup == NULL || lookup->ldap_handle == NULL )
+		return;
+	poll_alias_search( lookup, &lookup->list_search );
+	if(
+		lookup->list_search.result != NULL &&
+		get_string_array_size( lookup->list_search.result ) == 0
+	) {
+		// The sender is not a mailing list, hence the own addresses of the
+		// account are not needed.
+		cleanup_alias_search( lookup, &lookup->acct_search );
+	}
+	poll_alias_search( lookup, &lookup->acct_search );
+	if( lookup->is_broken ) {
+		drop_broken_connection( lookup );
+	} else if( lookup->list_search.msgid == -1 && lookup->acct_search.msgid == -1 ) {
+		// Nothing is outstanding on the connection anymore, hence return it
+		// to the pool instead of holding it until the end of message.
+		release_ldap_connection( lookup->ldap_handle, 0 );
+		lookup->ldap_handle = NULL;
+	}
+}
+
+/**
+ * The maximum number of nested mailing lists which are resolved by a
+ * single search with an OR-filter.
+ */
+#define NESTED_LIST_BATCH_SIZE 32
+
+/**
+ * A search for the members of one or more nested mailing lists.
+ */
+struct nested_list_batch_t {
+	int msgid; /**< The message ID of the search or `-1`, if there is no outstanding search. */
+	uint64_t observation; /**< The start of the latency observation. */
+	size_t first; /**< The position of the first list of the batch in the array of pending lists. */
+	size_t count; /**< The number of lists of the batch. */
+};
+
+/**
+ * Expands a template into memory from the arena.
+ *
+ * @return The expansion or `NULL` in case of an error
+ */
+static char* expand_placeholders_to_arena(
+	struct arena_t* const arena,
+	struct template_t const * const template,
+	char const * const mail_address
+) {
+	size_t const len = expand_template( template, mail_address, NULL, 0 );
+	char* const result = alloc_from_arena( arena, len + 1 );
+	if( result != NULL )
+		expand_template( template, mail_address, result, len + 1 );
 	return result;
 }
 
-struct string_array_t* search_mail_addresses_by_account( char const * const acct ) {
-	char * const filter = replace_placeholders(
-		rt_setting.ldap_mail_acct_query.filter_template,
-		acct
-	);
-	char * const base_dn = replace_placeholders(
-		rt_setting.ldap_mail_acct_query.base_dn,
-		acct
-	);
-	struct string_array_t* result = search_mail_addresses(
-		filter, base_dn, rt_setting.ldap_mail_acct_query.result_attributes
+/**
+ * Sends a single search for the members of several nested mailing lists.
+ *
+ * The filter is the disjunction of the filter of the mailing list query
+ * for each list.
+ * Additionally to the members, the key attribute of the snapshot of
+ * mailing lists is requested, such that each found entry can be attributed
+ * to the list it belongs to.
+ *
+ * @param lookup The lookup whose connection is used
+ * @param lists The mail addresses of the lists
+ * @param count The number of lists; at least two
+ * @param msgid Output parameter for the message ID of the search
+ * @return `EX_OK` on success, an error code like ::send_search() otherwise
+ */
+static int send_nested_list_search(
+	struct alias_lookup_t* const lookup,
+	char const * const * const lists,
+	size_t const count,
+	int* const msgid
+) {
+	struct ldap_query_parms_t const * const query = &rt_setting.ldap_mail_list_query;
+	*msgid = -1;
+	uint64_t const observation = start_metric_observation();
+	size_t filter_len = 3;
+	for( size_t i = 0; i != count; ++i )
+		filter_len += expand_template( query->compiled_filter, lists[i], NULL, 0 );
+	char* const filter = alloc_from_arena( lookup->arena, filter_len + 1 );
+	if( filter == NULL ) {
+		log_msg( LOG_ERR, "send_nested_list_search: could not allocate filter\n" );
+		return EX_OSERR;
+	}
+	size_t pos = 0;
+	filter[pos++] = '(';
+	filter[pos++] = '|';
+	for( size_t i = 0; i != count; ++i )
+		pos += expand_template( query->compiled_filter, lists[i], filter + pos, filter_len + 1 - pos );
+	filter[pos++] = ')';
+	filter[pos] = '\0';
+	// All lists share the base DN, see ::resolve_nested_lists()
+	char base_dn_buf[EXPANSION_BUFFER_SIZE];
+	char const * const base_dn = expand_placeholders( lookup->arena, query->compiled_base_dn, lists[0], base_dn_buf );
+	observe_metric( METRIC_EXPAND_LATENCY, observation );
+	log_msg( LOG_DEBUG, "send_nested_list_search: LDAP filter: %s\n", filter );
+
+	char* attributes[3] = { query->result_attributes[0], rt_setting.mail_list_sync.key_attribute, NULL };
+	struct timeval time_limit = { ( query->timeout + 999 ) / 1000, 0 };
+	int const result_code = ldap_search_ext(
+		lookup->ldap_handle,
+		base_dn,
+		LDAP_SCOPE_SUBTREE,
+		filter,
+		attributes,
+		0,    // attrsonly: include values in response as well
+		NULL, // serverctrls: no special server controls
+		NULL, // clientctrls: no special client controls
+		query->timeout != 0 ? &time_limit : NULL,
+		(int)query->size_limit,
+		msgid
 	);
-	free( filter );
-	free( base_dn );
+	if ( result_code != LDAP_SUCCESS ) {
+		log_msg( LOG_ERR, "send_nested_list_search: ldap_search_ext failed: %s (%d)\n", ldap_err2string( result_code ), result_code );
+		*msgid = -1;
+		return is_ldap_connection_error( result_code ) ? EX_UNAVAILABLE : EX_IOERR;
+	}
+	return EX_OK;
+}
+
+/**
+ * Distributes the entries of the result of ::send_nested_list_search() to
+ * the lists they belong to.
+ *
+ * An entry belongs to a list, if one of the values of its key attribute
+ * equals the snapshot key of the list (case-insensitively), see
+ * ::match_nested_list_key().
+ *
+ * @param keys The snapshot keys of the lists
+ * @param results The arrays to which the members of each list are added
+ * @param is_matched Output array of `count` flags; non-zero for each list
+ * to which at least one entry belongs
+ * @param count The number of lists
+ * @return Zero on success, non-zero in case of an error
+ */
+static int parse_nested_list_members(
+	LDAP* const ldap_handle,
+	LDAPMessage* const ldap_result_msg,
+	char const * const * const keys,
+	struct string_array_t* const * const results,
+	int* const is_matched,
+	size_t const count
+) {
+	for( size_t j = 0; j != count; ++j )
+		is_matched[j] = 0;
+	if( check_search_result( ldap_handle, ldap_result_msg ) != 0 )
+		return -1;
+	char const * const member_attribute = rt_setting.ldap_mail_list_query.result_attributes[0];
+	char const * const key_attribute = rt_setting.mail_list_sync.key_attribute;
+	int result = 0;
+	for(
+		LDAPMessage* ldap_entry_msg = ldap_first_entry( ldap_handle, ldap_result_msg );
+		ldap_entry_msg != NULL && result == 0;
+		ldap_entry_msg = ldap_next_entry( ldap_handle, ldap_entry_msg )
+	) {
+		struct berval** const key_values = ldap_get_values_len( ldap_handle, ldap_entry_msg, key_attribute );
+		struct berval** const values = ldap_get_values_len( ldap_handle, ldap_entry_msg, member_attribute );
+		int is_match[NESTED_LIST_BATCH_SIZE] = { 0 };
+		for( int k = 0; key_values != NULL && key_values[k] != NULL; ++k )
+			match_nested_list_key( keys, count, key_values[k]->bv_val, key_values[k]->bv_len, is_match );
+		for( size_t j = 0; j != count && values != NULL; ++j ) {
+			if( !is_match[j] )
+				continue;
+			is_matched[j] = 1;
+			for( int k = 0; values[k] != NULL; ++k ) {
+				if( push_onto_string_array_l( results[j], values[k]->bv_val, values[k]->bv_len ) == NULL )
+					result = -1;
+			}
+		}
+		ldap_value_free_len( key_values );
+		ldap_value_free_len( values );
+	}
 	return result;
 }
+
+/**
+ * Determines for each of a set of mail addresses, whether it is a mailing
+ * list, and its members.
+ *
+ * Results are taken from the cache and the local snapshot first.
+ * The remaining addresses are searched on the LDAP server in batches of
+ * ::NESTED_LIST_BATCH_SIZE, all of which are sent before the first result
+ * is awaited.
+ * Batches require the key attribute of the snapshot of mailing lists to
+ * attribute the found entries and a base DN without placeholders;
+ * otherwise, each address is searched on its own.
+ * Results of searches for a single address are cached.
+ * Of the results of batches, only lists to which an entry has been
+ * attributed are cached: an empty result of a batch may also stem from a
+ * key attribute which does not match what the filter of the mailing list
+ * query matched, and must not shadow the result of a top-level lookup.
+ *
+ * @param lookup The lookup
+ * @param addresses The mail addresses
+ * @param results Output array with one element per address; the members
+ * of the list or an empty array, if the address is not a list.
+ * The caller must free the elements, even in case of an error.
+ * @param deadline The deadline on the monotonic clock
+ * @return `EX_OK` on success, an error code of ::receive_search() or
+ * ::start_alias_search() otherwise
+ */
+static int resolve_nested_lists(
+	struct alias_lookup_t* const lookup,
+	struct string_array_t const * const addresses,
+	struct string_array_t** const results,
+	struct timespec const * const deadline
+) {
+	struct arena_t* const arena = lookup->arena;
+	size_t const size = get_string_array_size( addresses );
+	char const ** const lists = alloc_from_arena( arena, size * sizeof( char const * ) );
+	char const ** const keys = alloc_from_arena( arena, size * sizeof( char const * ) );
+	size_t* const pending = alloc_from_arena( arena, size * sizeof( size_t ) );
+	int* const is_cacheable = alloc_from_arena( arena, size * sizeof( int ) );
+	if( lists == NULL || keys == NULL || pending == NULL || is_cacheable == NULL )
+		return EX_OSERR;
+
+	// `get_string_array_at` is stable from here on, as nothing is pushed
+	// onto `addresses`
+	size_t pending_count = 0;
+	for( size_t i = 0; i != size; ++i ) {
+		lists[i] = get_string_array_at( addresses, i );
+		results[i] = lookup_cache( mail_list_cache, lists[i] );
+		if( mail_list_cache != NULL )
+			count_metric( results[i] != NULL ? METRIC_LIST_CACHE_HITS : METRIC_LIST_CACHE_MISSES, 1 );
+		if( results[i] == NULL )
+			results[i] = lookup_snapshot( arena, &rt_setting.mail_list_sync, lookup_mail_list_snapshot, lists[i] );
+		if( results[i] == NULL )
+			pending[pending_count++] = i;
+	}
+	if( pending_count == 0 )
+		return EX_OK;
+
+	struct ldap_query_parms_t const * const query = &rt_setting.ldap_mail_list_query;
+	size_t const batch_size = (
+		rt_setting.mail_list_sync.key_attribute != NULL &&
+		query->compiled_filter != NULL &&
+		( query->compiled_base_dn == NULL || !has_template_placeholders( query->compiled_base_dn ) )
+	) ? NESTED_LIST_BATCH_SIZE : 1;
+	size_t const batch_count = ( pending_count + batch_size - 1 ) / batch_size;
+	struct nested_list_batch_t* const batches = alloc_from_arena( arena, batch_count * sizeof( struct nested_list_batch_t ) );
+	char const ** const pending_lists = alloc_from_arena( arena, pending_count * sizeof( char const * ) );
+	if( batches == NULL || pending_lists == NULL )
+		return EX_OSERR;
+	for( size_t i = 0; i != pending_count; ++i ) {
+		size_t const pos = pending[i];
+		pending_lists[i] = lists[pos];
+		results[pos] = create_string_array_arena( arena, 1 );
+		if(
+			results[pos] == NULL ||
+			set_mail_address_normalization( results[pos], rt_setting.mail_address_normalization ) != EX_OK
+		) {
+			log_msg( LOG_ERR, "resolve_nested_lists: could not allocate memory\n" );
+			return EX_OSERR;
+		}
+		is_cacheable[pos] = 1;
+		if( batch_size != 1 ) {
+			keys[pos] = expand_placeholders_to_arena( arena, rt_setting.mail_list_sync.compiled_key_template, lists[pos] );
+			if( keys[pos] == NULL )
+				return EX_OSERR;
+		}
+	}
+
+	if( lookup->ldap_handle == NULL ) {
+		lookup->ldap_handle = acquire_ldap_connection( deadline );
+		if( lookup->ldap_handle == NULL ) {
+			log_msg( LOG_ERR, "resolve_nested_lists: no LDAP connection available (pool is %s)\n", convert_ldap_health_2_str( get_ldap_health() ) );
+			return EX_UNAVAILABLE;
+		}
+	}
+
+	// Send all batches before waiting for any of them
+	int result_code = EX_OK;
+	for( size_t b = 0; b != batch_count; ++b ) {
+		batches[b].msgid = -1;
+		batches[b].first = b * batch_size;
+		batches[b].count = pending_count - batches[b].first < batch_size ? pending_count - batches[b].first : batch_size;
+		if( result_code != EX_OK )
+			continue;
+		batches[b].observation = start_metric_observation();
+		if( batches[b].count == 1 )
+			result_code = send_search( arena, lookup->ldap_handle, query, pending_lists[ batches[b].first ], &batches[b].msgid );
+		else
+			result_code = send_nested_list_search( lookup, pending_lists + batches[b].first, batches[b].count, &batches[b].msgid );
+	}
+
+	for( size_t b = 0; b != batch_count && result_code == EX_OK; ++b ) {
+		LDAPMessage* ldap_result_msg = NULL;
+		result_code = wait_for_search( lookup->ldap_handle, batches[b].msgid, deadline, &ldap_result_msg );
+		batches[b].msgid = -1;
+		observe_metric( METRIC_LDAP_NESTED_LATENCY, batches[b].observation );
+		if( result_code != EX_OK )
+			break;
+		uint64_t const observation = start_metric_observation();
+		if( batches[b].count == 1 ) {
+			struct string_array_t* const members = parse_mail_addresses( arena, lookup->ldap_handle, ldap_result_msg );
+			if( members != NULL )
+				results[ pending[ batches[b].first ] ] = members;
+			else
+				result_code = EX_IOERR;
+		} else {
+			char const * batch_keys[NESTED_LIST_BATCH_SIZE];
+			struct string_array_t* batch_results[NESTED_LIST_BATCH_SIZE];
+			int batch_is_matched[NESTED_LIST_BATCH_SIZE];
+			for( size_t i = 0; i != batches[b].count; ++i ) {
+				batch_keys[i] = keys[ pending[ batches[b].first + i ] ];
+				batch_results[i] = results[ pending[ batches[b].first + i ] ];
+			}
+			if( parse_nested_list_members( lookup->ldap_handle, ldap_result_msg, batch_keys, batch_results, batch_is_matched, batches[b].count ) != 0 )
+				result_code = EX_IOERR;
+			for( size_t i = 0; i != batches[b].count; ++i )
+				is_cacheable[ pending[ batches[b].first + i ] ] = batch_is_matched[i];
+		}
+		observe_metric( METRIC_PARSE_LATENCY, observation );
+		ldap_msgfree( ldap_result_msg );
+		for( size_t i = 0; i != batches[b].count && result_code == EX_OK; ++i ) {
+			size_t const pos = pending[ batches[b].first + i ];
+			if( is_cacheable[pos] && insert_cache( mail_list_cache, lists[pos], results[pos] ) != 0 )
+				log_msg( LOG_WARNING, "resolve_nested_lists: could not cache result for %s\n", lists[pos] );
+		}
+	}
+
+	if( result_code == EX_UNAVAILABLE ) {
+		lookup->is_broken = 1;
+	} else {
+		for( size_t b = 0; b != batch_count; ++b ) {
+			if( batches[b].msgid != -1 )
+				ldap_abandon_ext( lookup->ldap_handle, batches[b].msgid, NULL, NULL );
+		}
+	}
+	return result_code;
+}
+
+/**
+ * The context of ::resolve_nested_list_level().
+ */
+struct nested_list_context_t {
+	struct alias_lookup_t* lookup; /**< The lookup. */
+	struct timespec const * deadline; /**< The deadline on the monotonic clock. */
+};
+
+/**
+ * Adapts ::resolve_nested_lists() to ::nested_list_resolver_t and logs the
+ * nested lists which are expanded.
+ */
+static int resolve_nested_list_level(
+	void* const context,
+	struct string_array_t const * const addresses,
+	unsigned int const level,
+	struct string_array_t** const results
+) {
+	struct nested_list_context_t const * const nested = (struct nested_list_context_t const *)context;
+	int const result_code = resolve_nested_lists( nested->lookup, addresses, results, nested->deadline );
+	size_t const size = get_string_array_size( addresses );
+	for( size_t i = 0; i != size && result_code == EX_OK; ++i ) {
+		if( get_string_array_size( results[i] ) != 0 ) {
+			log_msg(
+				LOG_DEBUG,
+				"resolve_nested_list_level: expanding nested list %s at level %u\n",
+				get_string_array_at( addresses, i ),
+				level
+			);
+		}
+	}
+	return result_code;
+}
+
+/**
+ * Replaces members of the mailing list which are mailing lists themselves
+ * by their members up to ::rt_setting_t::ldap_mail_list_depth levels.
+ *
+ * See ::expand_nested_lists() for the handling of cycles.
+ *
+ * @return `EX_OK` on success, an error code of ::resolve_nested_lists()
+ * otherwise
+ */
+static int expand_alias_lookup( struct alias_lookup_t* const lookup, struct timespec const * const deadline ) {
+	struct nested_list_context_t context = { lookup, deadline };
+	struct string_array_t* members = NULL;
+	int const result_code = expand_nested_lists(
+		lookup->arena,
+		lookup->list_search.key,
+		lookup->list_search.result,
+		rt_setting.ldap_mail_list_depth,
+		rt_setting.mail_address_normalization,
+		resolve_nested_list_level,
+		&context,
+		&members
+	);
+	if( result_code == EX_OK ) {
+		free_string_array( lookup->list_search.result );
+		lookup->list_search.result = members;
+	}
+	return result_code;
+}
+
+int finish_alias_lookup(
+	struct alias_lookup_t* const lookup,
+	struct string_array_t** const list_addresses,
+	struct string_array_t** const own_addresses
+) {
+	*list_addresses = NULL;
+	*own_addresses = NULL;
+	if( lookup == NULL )
+		return EX_OSERR;
+
+	struct timespec deadline = now_monotonic();
+	add_milliseconds( &deadline, rt_setting.ldap_search_deadline );
+
+	int result_code = EX_OK;
+	if( lookup->is_broken ) {
+		// The connection has already been lost by ::start_alias_lookup()
+		drop_broken_connection( lookup );
+	}
+	restart_alias_search_timing( &lookup->list_search );
+	restart_alias_search_timing( &lookup->acct_search );
+	result_code = resolve_alias_lookup( lookup, &deadline );
+	if( result_code == EX_UNAVAILABLE && lookup->is_broken ) {
+		// The LDAP server has probably been restarted since the connection
+		// was used last; retry once on a new connection within the same
+		// deadline.
+		log_msg( LOG_WARNING, "finish_alias_lookup: LDAP connection lost, retrying\n" );
+		drop_broken_connection( lookup );
+		result_code = resolve_alias_lookup( lookup, &deadline );
+	}
+
+	if( result_code != EX_OK && rt_setting.ldap_failure_policy == FAILURE_POLICY_CACHE ) {
+		if(
+			use_stale_alias_search( &lookup->list_search ) == 0 && (
+				get_string_array_size( lookup->list_search.result ) == 0 ||
+				use_stale_alias_search( &lookup->acct_search ) == 0
+			)
+		) {
+			result_code = EX_OK;
+		}
+	}
+
+	if(
+		result_code == EX_OK &&
+		rt_setting.ldap_mail_list_depth > 1 &&
+		get_string_array_size( lookup->list_search.result ) != 0
+	) {
+		if( lookup->is_broken )
+			drop_broken_connection( lookup );
+		result_code = expand_alias_lookup( lookup, &deadline );
+		if( result_code == EX_UNAVAILABLE && lookup->is_broken ) {
+			log_msg( LOG_WARNING, "finish_alias_lookup: LDAP connection lost, retrying\n" );
+			drop_broken_connection( lookup );
+			result_code = expand_alias_lookup( lookup, &deadline );
+		}
+	}
+
+	if( result_code == EX_OK ) {
+		*list_addresses = lookup->list_search.result;
+		lookup->list_search.result = NULL;
+		if( get_string_array_size( *list_addresses ) != 0 ) {
+			*own_addresses = lookup->acct_search.result;
+			lookup->acct_search.result = NULL;
+		}
+	}
+
+	abandon_alias_lookup( lookup );
+	return result_code;
+}
+
+void abandon_alias_lookup( struct alias_lookup_t* const lookup ) {
+	if( lookup == NULL )
+		return;
+	cleanup_alias_search( lookup, &lookup->list_search );
+	cleanup_alias_search( lookup, &lookup->acct_search );
+	release_ldap_connection( lookup->ldap_handle, lookup->is_broken );
+}
+
+long long get_alias_lookup_latency( struct alias_lookup_t const * const lookup ) {
+	return lookup != NULL ? lookup->ldap_latency : -1;
+}
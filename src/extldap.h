@@ -8,33 +8,121 @@
 
 #include "string_array.h"
 
+struct arena_t;
+
 /**
- * Opens connection to LDAP server.
+ * Opens the pool of connections to LDAP server.
+ *
+ * The number of connections is given by ::rt_setting_t::ldap_pool_size.
+ * Each connection is used by at most one milter thread at a time.
  */
 int connect_ldap( void );
 
 /**
- * Closes connection to LDAP server.
+ * Closes all connections of the pool to LDAP server.
  */
 int disconnect_ldap( void );
 
 /**
- * Gets mail address members of mailing list by mailing list address.
+ * The pending LDAP searches for a single message.
  *
- * @param sender The mail address of the mailing list
- * @return String array with mail addresses
+ * A lookup consists of up to two searches: the members of the mailing list
+ * identified by the envelope sender and the own mail addresses of the
+ * authenticated account.
+ * Both searches are sent to the LDAP server at once and their results are
+ * collected later, such that the LDAP server processes them concurrently.
+ * Results which are available from cache are not sent to the LDAP server
+ * at all.
  */
-struct string_array_t* search_mail_addresses_of_list( const char* const sender );
+struct alias_lookup_t;
 
 /**
- * Gets all mail addresses associated to the authenticated user account.
+ * Starts the searches for the members of a mailing list and for the own
+ * mail addresses of the authenticated account.
  *
- * The mail addresses are those which the account may use as its sender
- * identity.
+ * The function neither waits for the results nor for an idle connection.
+ * If all connections of the pool are busy, the searches are deferred and
+ * sent by ::finish_alias_lookup().
+ * The returned lookup must be passed to either ::finish_alias_lookup() or
+ * ::abandon_alias_lookup() exactly once.
  *
+ * @param arena The arena from which the lookup, its intermediate strings
+ * and its results are allocated; it must outlive the lookup and the
+ * results returned by ::finish_alias_lookup()
+ * @param sender The envelope sender, i.e. the potential mailing list address
  * @param acct The authenticated account name (i.e. the "uid")
- * @return String array with mail addresses
+ * @return The pending lookup or `NULL` in case of an error
+ */
+struct alias_lookup_t* start_alias_lookup( struct arena_t* const arena, char const * const sender, char const * const acct );
+
+/**
+ * Collects the results of a lookup which have already been received
+ * without waiting for outstanding results.
+ *
+ * Once no search of the lookup is outstanding anymore, the connection of
+ * the lookup is returned to the pool, such that a lookup started at
+ * `MAIL FROM` does not hold a connection during the transfer of the
+ * message.
+ * The lookup must still be passed to either ::finish_alias_lookup() or
+ * ::abandon_alias_lookup().
+ *
+ * Note, the function is NULL-pointer safe.
+ *
+ * @param lookup The lookup as returned by ::start_alias_lookup()
+ */
+void poll_alias_lookup( struct alias_lookup_t* const lookup );
+
+/**
+ * Waits for the results of a lookup and releases the lookup.
+ *
+ * The function waits at most ::rt_setting_t::ldap_search_deadline
+ * milliseconds for both results together, including the time to wait for
+ * an idle connection, if the searches have not been sent yet.
+ * The own addresses of the account are only returned, if the sender is a
+ * mailing list.
+ * The caller must free the returned string arrays.
+ *
+ * @param lookup The lookup as returned by ::start_alias_lookup()
+ * @param list_addresses Output parameter for the members of the mailing
+ * list; an empty array, if the sender is not a mailing list
+ * @param own_addresses Output parameter for the own mail addresses of the
+ * account; `NULL`, if the sender is not a mailing list
+ * @return `EX_OK` on success, `EX_TEMPFAIL` if the deadline has passed,
+ * another error code from `sysexits.h` otherwise
+ */
+int finish_alias_lookup(
+	struct alias_lookup_t* const lookup,
+	struct string_array_t** const list_addresses,
+	struct string_array_t** const own_addresses
+);
+
+/**
+ * Abandons all outstanding searches of a lookup and releases the lookup.
+ *
+ * The memory of the lookup is released with its arena.
+ *
+ * Note, the function is NULL-pointer safe.
+ *
+ * @param lookup The lookup as returned by ::start_alias_lookup()
+ */
+void abandon_alias_lookup( struct alias_lookup_t* const lookup );
+
+/**
+ * Returns the latency of the LDAP searches of a lookup.
+ *
+ * The latency is the longest time the milter waited for the result of a
+ * search, i.e. from sending the search or, for a search which has been sent
+ * by ::start_alias_lookup(), from the call of ::finish_alias_lookup() to
+ * receiving its result.
+ * The function may be called after ::finish_alias_lookup(), as long as the
+ * arena of the lookup exists.
+ *
+ * Note, the function is NULL-pointer safe.
+ *
+ * @param lookup The lookup as returned by ::start_alias_lookup()
+ * @return The latency in microseconds or `-1`, if no result has been
+ * received from the LDAP server, e.g. because all results were cached
  */
-struct string_array_t* search_mail_addresses_by_account( char const * const acct );
+long long get_alias_lookup_latency( struct alias_lookup_t const * const lookup );
 
 #endif
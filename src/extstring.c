@@ -2,8 +2,19 @@
 #include <string.h>
 
 #include "extstring.h"
+#include "arena.h"
 
-char* str_replace( char const * orig, char const * old, char const * new ) {
+/**
+ * Allocates memory from an arena or by `malloc`, if `arena` is `NULL`.
+ */
+static char* alloc_string( struct arena_t* const arena, size_t const size ) {
+	return arena != NULL ? alloc_from_arena( arena, size ) : malloc( size );
+}
+
+/**
+ * Common implementation of ::str_replace() and ::str_replace_arena().
+ */
+static char* str_replace_impl( struct arena_t* arena, char const * orig, char const * old, char const * new ) {
 	char *result; // the return string
 	char const * ins;    // the next insert point
 	char * tmp;
@@ -15,14 +26,16 @@ char* str_replace( char const * orig, char const * old, char const * new ) {
 	if ( orig == NULL )
 		return NULL;
 	if( old == NULL ) {
-		result = malloc( strlen(orig) + 1 );
-		strcpy( result, orig );
+		result = alloc_string( arena, strlen(orig) + 1 );
+		if ( result != NULL )
+			strcpy( result, orig );
 		return result;
 	}
 	len_old = strlen( old );
 	if ( len_old == 0 ) {
-		result = malloc( strlen(orig) + 1 );
-		strcpy( result, orig );
+		result = alloc_string( arena, strlen(orig) + 1 );
+		if ( result != NULL )
+			strcpy( result, orig );
 		return result;
 	}
 	if ( new == NULL )
@@ -35,7 +48,7 @@ char* str_replace( char const * orig, char const * old, char const * new ) {
 		ins = tmp + len_old;
 	}
 
-	tmp = result = malloc( strlen( orig ) + (len_new - len_old) * count + 1 );
+	tmp = result = alloc_string( arena, strlen( orig ) + (len_new - len_old) * count + 1 );
 
 	if ( result == NULL )
 		return NULL;
@@ -56,6 +69,14 @@ char* str_replace( char const * orig, char const * old, char const * new ) {
 	return result;
 }
 
+char* str_replace( char const * orig, char const * old, char const * new ) {
+	return str_replace_impl( NULL, orig, old, new );
+}
+
+char* str_replace_arena( struct arena_t* arena, char const * orig, char const * old, char const * new ) {
+	return str_replace_impl( arena, orig, old, new );
+}
+
 char const * str_or_null( char const * const str ) {
 	return str ? str : "(null)";
 }
@@ -6,6 +6,8 @@
  * @brief Functions for extended string processing.
  */
 
+struct arena_t;
+
 /**
  * Replaces a all occurences of a substring with another substring.
  *
@@ -27,6 +29,21 @@
  */
 char* str_replace( char const * orig, char const * old, char const * new );
 
+/**
+ * Replaces a all occurences of a substring with another substring.
+ *
+ * Same as ::str_replace(), but the result is allocated from `arena` and
+ * must not be freed by the caller.
+ *
+ * @param arena The arena
+ * @param orig The original string
+ * @param old  The substring to be replaced
+ * @param new  The substring for replacedment
+ * @return A buffer in `arena` containing the result string or `NULL` in
+ * case of an error.
+ */
+char* str_replace_arena( struct arena_t* arena, char const * orig, char const * old, char const * new );
+
 /**
  * Returns the passed string or the literal `"(null)"`, if argument equals `NUL`.
  *
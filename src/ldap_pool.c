@@ -0,0 +1,516 @@
+#define _GNU_SOURCE
+#include <ldap.h>
+#include <pthread.h>
+#include <sysexits.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ldap_pool.h"
+#include "runtime_setting.h"
+#include "log.h"
+#include "extstring.h"
+#include "metrics.h"
+
+int const HEALTH_UP = 0;
+
+int const HEALTH_DEGRADED = 1;
+
+int const HEALTH_DOWN = 2;
+
+/**
+ * A bounded pool of bound LDAP connections.
+ *
+ * libmilter invokes the callbacks on multiple threads concurrently.
+ * A connection is used by at most one thread at a time; threads check out
+ * an idle connection with ::acquire_ldap_connection() and return it with
+ * ::release_ldap_connection().
+ *
+ * The pool has a fixed number of slots.
+ * A slot is either connected (idle or checked out), being reconnected by
+ * some thread or dead.
+ * A connection which has been lost is closed by
+ * ::release_ldap_connection() and its slot becomes dead.
+ * Dead slots are reconnected lazily by ::acquire_ldap_connection(), at most
+ * one attempt at a time, with a jittered, exponentially growing delay
+ * between failed attempts.
+ */
+struct ldap_pool_t {
+	pthread_mutex_t mutex; /**< Protects all members below. */
+	pthread_cond_t available; /**< Signalled whenever a connection is returned to the pool or a slot changes its state. */
+	size_t size; /**< Total number of slots of the pool; zero, if the pool is closed. */
+	size_t connected_count; /**< Number of bound connections, i.e. idle or checked out. */
+	size_t connecting_count; /**< Number of slots which are currently being reconnected. */
+	size_t idle_count; /**< Number of connections which are currently not checked out. */
+	LDAP** idle; /**< Stack of idle connections; the first `idle_count` entries are valid. */
+	char** uris; /**< The LDAP URIs of the servers; array of length `uri_count`. */
+	size_t uri_count; /**< Number of LDAP URIs. */
+	size_t preferred_uri; /**< Index of the URI which has been connected to most recently. */
+	unsigned int backoff; /**< Current reconnect delay in milliseconds before jitter is applied. */
+	struct timespec next_attempt; /**< Point in time on the monotonic clock before which no reconnect is attempted. */
+	unsigned int seed; /**< Seed for the jitter of the reconnect delay. */
+	int health; /**< Either ::HEALTH_UP, ::HEALTH_DEGRADED or ::HEALTH_DOWN. */
+};
+
+static struct ldap_pool_t ldap_pool = {
+	PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_COND_INITIALIZER,
+	0,
+	0,
+	0,
+	0,
+	NULL,
+	NULL,
+	0,
+	0,
+	0,
+	{ 0, 0 },
+	0,
+	2 /* HEALTH_DOWN */
+};
+
+static int const LDAP_PROTOCOL_VERSION = LDAP_VERSION3;
+
+static char const * const HEALTH_STRINGS[3] = {
+	"up",
+	"degraded",
+	"down"
+};
+
+char const * convert_ldap_health_2_str( int const health ) {
+	if ( HEALTH_UP <= health && health <= HEALTH_DOWN )
+		return HEALTH_STRINGS[health];
+	return NULL;
+}
+
+/**
+ * Returns the current time of the monotonic clock.
+ */
+static struct timespec now_monotonic( void ) {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts;
+}
+
+/**
+ * Adds milliseconds to a point in time.
+ */
+static void add_milliseconds( struct timespec* const ts, unsigned int const ms ) {
+	ts->tv_sec += ms / 1000;
+	ts->tv_nsec += ( ms % 1000 ) * 1000000L;
+	if( ts->tv_nsec >= 1000000000L ) {
+		ts->tv_sec += 1;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+/**
+ * Returns non-zero, if `a` is before `b`.
+ */
+static int is_before( struct timespec const * const a, struct timespec const * const b ) {
+	return a->tv_sec < b->tv_sec || ( a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec );
+}
+
+/**
+ * Splits ::rt_setting_t::ldap_bind_t::host into the list of URIs.
+ *
+ * @return `EX_OK` on success, an error code from `sysexits.h` otherwise
+ */
+static int parse_ldap_uris( void ) {
+	static char const * const SEPARATORS = " \t,";
+	char const * const host = rt_setting.ldap_bind.host;
+	if( host == NULL ) {
+		log_msg( LOG_ERR, "parse_ldap_uris: no LDAP host configured\n" );
+		return EX_CONFIG;
+	}
+	// The number of URIs is bounded by the number of separators plus one
+	size_t max_count = 1;
+	for( char const * c = host; *c != '\0'; ++c ) {
+		if( strchr( SEPARATORS, *c ) != NULL )
+			++max_count;
+	}
+	char* const buffer = malloc( strlen( host ) + 1 );
+	ldap_pool.uris = calloc( max_count, sizeof( char* ) );
+	if( buffer == NULL || ldap_pool.uris == NULL ) {
+		free( buffer );
+		return EX_OSERR;
+	}
+	strcpy( buffer, host );
+
+	char* save_ptr = NULL;
+	for(
+		char* token = strtok_r( buffer, SEPARATORS, &save_ptr );
+		token != NULL;
+		token = strtok_r( NULL, SEPARATORS, &save_ptr )
+	) {
+		char* const uri = malloc( strlen( token ) + 1 );
+		if( uri == NULL ) {
+			free( buffer );
+			return EX_OSERR;
+		}
+		strcpy( uri, token );
+		ldap_pool.uris[ ldap_pool.uri_count++ ] = uri;
+	}
+	free( buffer );
+
+	if( ldap_pool.uri_count == 0 ) {
+		log_msg( LOG_ERR, "parse_ldap_uris: no LDAP host configured\n" );
+		return EX_CONFIG;
+	}
+	return EX_OK;
+}
+
+/**
+ * Frees an array of URIs.
+ */
+static void free_uri_array( char** const uris, size_t const count ) {
+	if( uris == NULL )
+		return;
+	for( size_t i = 0; i != count; ++i )
+		free( uris[i] );
+	free( uris );
+}
+
+/**
+ * Copies the URIs, such that a connection can be opened without holding the
+ * lock while ::close_ldap_pool() may free them.
+ *
+ * The caller must hold the lock.
+ *
+ * @return An array of length ::ldap_pool_t::uri_count or `NULL`, if out of
+ * memory
+ */
+static char** copy_ldap_uris( void ) {
+	char** const uris = calloc( ldap_pool.uri_count, sizeof( char* ) );
+	if( uris == NULL )
+		return NULL;
+	for( size_t i = 0; i != ldap_pool.uri_count; ++i ) {
+		uris[i] = malloc( strlen( ldap_pool.uris[i] ) + 1 );
+		if( uris[i] == NULL ) {
+			free_uri_array( uris, i );
+			return NULL;
+		}
+		strcpy( uris[i], ldap_pool.uris[i] );
+	}
+	return uris;
+}
+
+static void free_ldap_uris( void ) {
+	free_uri_array( ldap_pool.uris, ldap_pool.uri_count );
+	ldap_pool.uris = NULL;
+	ldap_pool.uri_count = 0;
+	ldap_pool.preferred_uri = 0;
+}
+
+/**
+ * Opens and binds a single connection to an LDAP server.
+ *
+ * @param uri The LDAP URI of the server
+ * @param handle Output parameter for the bound connection
+ * @return `EX_OK` on success, an error code from `sysexits.h` otherwise
+ */
+static int open_ldap_connection( char const * const uri, LDAP** const handle ) {
+	int result = LDAP_SUCCESS;
+	result = ldap_initialize( handle, uri );
+	if ( result != LDAP_SUCCESS ) {
+		log_msg( LOG_ERR, "ldap_initialize failed for %s: %s (%d)\n", uri, ldap_err2string( result ), result );
+		return EX_SOFTWARE;
+	}
+
+	result = ldap_set_option( *handle, LDAP_OPT_PROTOCOL_VERSION, &LDAP_PROTOCOL_VERSION );
+	if ( result != LDAP_OPT_SUCCESS ) {
+		log_msg( LOG_ERR, "ldap_set_option failed: %s (%d)\n", ldap_err2string( result ), result );
+		ldap_unbind_ext_s( *handle, NULL, NULL );
+		*handle = NULL;
+		return EX_SOFTWARE;
+	}
+
+	if( rt_setting.ldap_network_timeout != 0 ) {
+		// Bounds connection establishment as well as synchronous operations
+		// such as the bind below.
+		struct timeval const network_timeout = {
+			rt_setting.ldap_network_timeout / 1000,
+			( rt_setting.ldap_network_timeout % 1000 ) * 1000
+		};
+		if(
+			ldap_set_option( *handle, LDAP_OPT_NETWORK_TIMEOUT, &network_timeout ) != LDAP_OPT_SUCCESS ||
+			ldap_set_option( *handle, LDAP_OPT_TIMEOUT, &network_timeout ) != LDAP_OPT_SUCCESS
+		) {
+			log_msg( LOG_ERR, "ldap_set_option failed for network timeout\n" );
+			ldap_unbind_ext_s( *handle, NULL, NULL );
+			*handle = NULL;
+			return EX_SOFTWARE;
+		}
+	}
+
+	if( rt_setting.ldap_bind.dn == NULL ) {
+		// Anonymous simple bind
+		result = ldap_sasl_bind_s( *handle, NULL, LDAP_SASL_SIMPLE, NULL, NULL, NULL, NULL );
+	} else {
+		// Simple bind with DN
+		struct berval passwd = { 0, NULL };
+		passwd.bv_val = ber_strdup( rt_setting.ldap_bind.passwd );
+		passwd.bv_len = strlen( passwd.bv_val );
+		result = ldap_sasl_bind_s( *handle, rt_setting.ldap_bind.dn, LDAP_SASL_SIMPLE, &passwd, NULL, NULL, NULL );
+		ber_memfree( passwd.bv_val );
+	}
+	if ( result != LDAP_SUCCESS ) {
+		log_msg( LOG_ERR, "ldap_sasl_bind_s (simple) failed for %s: %s (%d)\n", uri, ldap_err2string( result ), result );
+		ldap_unbind_ext_s( *handle, NULL, NULL );
+		*handle = NULL;
+		return is_ldap_connection_error( result ) ? EX_UNAVAILABLE : EX_IOERR;
+	}
+
+	return EX_OK;
+}
+
+/**
+ * Opens a connection to any of the configured servers.
+ *
+ * The servers are tried in turn, starting with the one which has been
+ * connected to most recently.
+ *
+ * @param uris The LDAP URIs of the servers
+ * @param uri_count The number of URIs
+ * @param first_uri Index of the URI which is tried first
+ * @param handle Output parameter for the bound connection
+ * @param uri_index Output parameter for the index of the connected URI
+ * @return `EX_OK` on success, an error code from `sysexits.h` otherwise
+ */
+static int open_any_ldap_connection(
+	char* const * const uris,
+	size_t const uri_count,
+	size_t const first_uri,
+	LDAP** const handle,
+	size_t* const uri_index
+) {
+	int result = EX_UNAVAILABLE;
+	for( size_t i = 0; i != uri_count; ++i ) {
+		*uri_index = ( first_uri + i ) % uri_count;
+		result = open_ldap_connection( uris[ *uri_index ], handle );
+		if( result == EX_OK )
+			return EX_OK;
+	}
+	return result;
+}
+
+/**
+ * Recomputes the health state and logs its transitions.
+ *
+ * The caller must hold the lock.
+ */
+static void update_ldap_health( void ) {
+	int health = HEALTH_DEGRADED;
+	if( ldap_pool.connected_count == ldap_pool.size )
+		health = HEALTH_UP;
+	else if( ldap_pool.connected_count == 0 )
+		health = HEALTH_DOWN;
+	if( health == ldap_pool.health )
+		return;
+	log_msg(
+		health == HEALTH_UP ? LOG_NOTICE : LOG_WARNING,
+		"update_ldap_health: LDAP connection pool is %s (%zu of %zu connections bound)\n",
+		convert_ldap_health_2_str( health ),
+		ldap_pool.connected_count,
+		ldap_pool.size
+	);
+	ldap_pool.health = health;
+}
+
+/**
+ * Schedules the next reconnect attempt after a failed attempt.
+ *
+ * The delay is drawn uniformly from [0.5, 1.5] times the current backoff
+ * such that many milter instances do not hammer a recovering server in
+ * lock step; the backoff doubles up to ::rt_setting_t::ldap_reconnect_max.
+ *
+ * The caller must hold the lock.
+ */
+static void schedule_ldap_reconnect( void ) {
+	unsigned int const delay = ldap_pool.backoff / 2 +
+		(unsigned int)( (double)ldap_pool.backoff * rand_r( &ldap_pool.seed ) / RAND_MAX );
+	ldap_pool.next_attempt = now_monotonic();
+	add_milliseconds( &ldap_pool.next_attempt, delay );
+	log_msg( LOG_WARNING, "schedule_ldap_reconnect: next attempt in %u ms\n", delay );
+
+	unsigned int const max_backoff = rt_setting.ldap_reconnect_max > rt_setting.ldap_reconnect_min ?
+		rt_setting.ldap_reconnect_max : rt_setting.ldap_reconnect_min;
+	ldap_pool.backoff = ldap_pool.backoff > max_backoff / 2 ? max_backoff : 2 * ldap_pool.backoff;
+}
+
+int open_ldap_pool( void ) {
+	size_t const size = rt_setting.ldap_pool_size;
+	pthread_condattr_t cond_attr;
+	pthread_condattr_init( &cond_attr );
+	pthread_condattr_setclock( &cond_attr, CLOCK_MONOTONIC );
+	pthread_cond_destroy( &ldap_pool.available );
+	pthread_cond_init( &ldap_pool.available, &cond_attr );
+	pthread_condattr_destroy( &cond_attr );
+
+	ldap_pool.idle = calloc( size, sizeof( LDAP* ) );
+	if( ldap_pool.idle == NULL ) {
+		log_msg( LOG_ERR, "open_ldap_pool: could not allocate connection pool\n" );
+		return EX_OSERR;
+	}
+	int result = parse_ldap_uris();
+	if( result != EX_OK ) {
+		close_ldap_pool();
+		return result;
+	}
+
+	ldap_pool.size = size;
+	ldap_pool.backoff = rt_setting.ldap_reconnect_min;
+	ldap_pool.next_attempt = now_monotonic();
+	ldap_pool.seed = (unsigned int)ldap_pool.next_attempt.tv_nsec;
+	for( size_t i = 0; i != size; ++i ) {
+		size_t uri_index = 0;
+		result = open_any_ldap_connection(
+			ldap_pool.uris, ldap_pool.uri_count, ldap_pool.preferred_uri, &( ldap_pool.idle[i] ), &uri_index
+		);
+		if( result != EX_OK ) {
+			close_ldap_pool();
+			return result;
+		}
+		ldap_pool.preferred_uri = uri_index;
+		++ldap_pool.idle_count;
+		++ldap_pool.connected_count;
+	}
+	update_ldap_health();
+	return EX_OK;
+}
+
+int close_ldap_pool( void ) {
+	int return_code = EX_OK;
+	pthread_mutex_lock( &ldap_pool.mutex );
+	for( size_t i = 0; i != ldap_pool.idle_count; ++i ) {
+		int const result = ldap_unbind_ext_s( ldap_pool.idle[i], NULL, NULL );
+		ldap_pool.idle[i] = NULL;
+		if ( result != LDAP_SUCCESS ) {
+			log_msg( LOG_ERR, "ldap_unbind_ext_s failed: %s (%d)\n", ldap_err2string( result ), result );
+			return_code = EX_IOERR;
+		}
+	}
+	if( ldap_pool.idle_count != ldap_pool.connected_count ) {
+		log_msg( LOG_ERR, "close_ldap_pool: %zu connections still in use\n", ldap_pool.connected_count - ldap_pool.idle_count );
+		return_code = EX_SOFTWARE;
+	}
+	free( ldap_pool.idle );
+	ldap_pool.idle = NULL;
+	free_ldap_uris();
+	ldap_pool.size = 0;
+	ldap_pool.connected_count = 0;
+	ldap_pool.idle_count = 0;
+	ldap_pool.health = HEALTH_DOWN;
+	pthread_cond_broadcast( &ldap_pool.available );
+	pthread_mutex_unlock( &ldap_pool.mutex );
+	return return_code;
+}
+
+LDAP* acquire_ldap_connection( struct timespec const * const deadline ) {
+	LDAP* handle = NULL;
+	LDAP* orphan = NULL;
+	pthread_mutex_lock( &ldap_pool.mutex );
+	while( ldap_pool.size != 0 ) {
+		if( ldap_pool.idle_count != 0 ) {
+			handle = ldap_pool.idle[ --ldap_pool.idle_count ];
+			break;
+		}
+
+		size_t const dead_count = ldap_pool.size - ldap_pool.connected_count - ldap_pool.connecting_count;
+		struct timespec const now = now_monotonic();
+		if( dead_count != 0 && ldap_pool.connecting_count == 0 && !is_before( &now, &ldap_pool.next_attempt ) ) {
+			// Reserve the slot and reconnect without holding the lock, as
+			// binding takes a network round-trip.
+			// Other threads wait for the outcome instead of attempting in
+			// parallel, as each attempt may block for the network timeout
+			// and each failure doubles the backoff.
+			++ldap_pool.connecting_count;
+			size_t const first_uri = ldap_pool.preferred_uri;
+			size_t const uri_count = ldap_pool.uri_count;
+			char** const uris = copy_ldap_uris();
+			pthread_mutex_unlock( &ldap_pool.mutex );
+			size_t uri_index = 0;
+			int const result = uris != NULL ?
+				open_any_ldap_connection( uris, uri_count, first_uri, &handle, &uri_index ) : EX_OSERR;
+			pthread_mutex_lock( &ldap_pool.mutex );
+			--ldap_pool.connecting_count;
+			if( ldap_pool.size == 0 ) {
+				// The pool has been closed during the attempt
+				orphan = ( result == EX_OK ) ? handle : NULL;
+				handle = NULL;
+				free_uri_array( uris, uri_count );
+				break;
+			}
+			if( result == EX_OK ) {
+				++ldap_pool.connected_count;
+				ldap_pool.preferred_uri = uri_index;
+				ldap_pool.backoff = rt_setting.ldap_reconnect_min;
+				log_msg( LOG_INFO, "acquire_ldap_connection: reconnected to %s\n", uris[ uri_index ] );
+				count_metric( METRIC_LDAP_RECONNECTS, 1 );
+				update_ldap_health();
+			} else {
+				schedule_ldap_reconnect();
+			}
+			free_uri_array( uris, uri_count );
+			// Wake up threads which wait for this attempt; after a success
+			// they may reconnect the remaining dead slots
+			pthread_cond_broadcast( &ldap_pool.available );
+			if( result == EX_OK )
+				break;
+			continue;
+		}
+
+		// Only wait, if some other thread is going to return or reconnect a
+		// connection before the deadline; otherwise fail fast and let the
+		// caller apply the failure policy.
+		size_t const busy_count = ldap_pool.connected_count - ldap_pool.idle_count + ldap_pool.connecting_count;
+		if( deadline == NULL || busy_count == 0 || !is_before( &now, deadline ) )
+			break;
+		// A pending attempt broadcasts its outcome
+		struct timespec const * const wakeup = (
+			dead_count != 0 && ldap_pool.connecting_count == 0 && is_before( &ldap_pool.next_attempt, deadline )
+		) ? &ldap_pool.next_attempt : deadline;
+		pthread_cond_timedwait( &ldap_pool.available, &ldap_pool.mutex, wakeup );
+	}
+	pthread_mutex_unlock( &ldap_pool.mutex );
+	if( orphan != NULL )
+		ldap_unbind_ext_s( orphan, NULL, NULL );
+	return handle;
+}
+
+void release_ldap_connection( LDAP* const handle, int const is_broken ) {
+	if( handle == NULL ) return;
+	pthread_mutex_lock( &ldap_pool.mutex );
+	if( ldap_pool.size == 0 ) {
+		// The pool has been closed while the connection was checked out
+		pthread_mutex_unlock( &ldap_pool.mutex );
+		ldap_unbind_ext_s( handle, NULL, NULL );
+		return;
+	}
+	if( is_broken ) {
+		--ldap_pool.connected_count;
+		update_ldap_health();
+	} else {
+		ldap_pool.idle[ ldap_pool.idle_count++ ] = handle;
+	}
+	// A dead slot may be reconnected by a waiting thread, too
+	pthread_cond_broadcast( &ldap_pool.available );
+	pthread_mutex_unlock( &ldap_pool.mutex );
+	// Unbinding may block, hence it is done without holding the lock
+	if( is_broken )
+		ldap_unbind_ext_s( handle, NULL, NULL );
+}
+
+int is_ldap_connection_error( int const result_code ) {
+	return
+		result_code == LDAP_SERVER_DOWN ||
+		result_code == LDAP_CONNECT_ERROR ||
+		result_code == LDAP_UNAVAILABLE;
+}
+
+int get_ldap_health( void ) {
+	pthread_mutex_lock( &ldap_pool.mutex );
+	int const health = ldap_pool.health;
+	pthread_mutex_unlock( &ldap_pool.mutex );
+	return health;
+}
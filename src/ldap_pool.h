@@ -0,0 +1,111 @@
+#ifndef _LDAP_POOL_H_
+#define _LDAP_POOL_H_
+
+/**
+ * @file
+ * @brief Compounds and functions for a pool of LDAP connections with
+ * automatic reconnect.
+ */
+
+#include <ldap.h>
+#include <time.h>
+
+/**
+ * Constant to indicate that all connections of the pool are bound.
+ *
+ * @see get_ldap_health()
+ */
+extern int const HEALTH_UP;
+
+/**
+ * Constant to indicate that some, but not all connections of the pool are
+ * bound.
+ *
+ * @see get_ldap_health()
+ */
+extern int const HEALTH_DEGRADED;
+
+/**
+ * Constant to indicate that no connection of the pool is bound.
+ *
+ * @see get_ldap_health()
+ */
+extern int const HEALTH_DOWN;
+
+/**
+ * Opens the pool of connections to LDAP server.
+ *
+ * The number of connections is given by ::rt_setting_t::ldap_pool_size.
+ * ::rt_setting_t::ldap_bind_t::host may contain several whitespace- or
+ * comma-separated URIs which are tried in turn (failover).
+ *
+ * @return `EX_OK` on success, an error code from `sysexits.h` otherwise
+ */
+int open_ldap_pool( void );
+
+/**
+ * Closes all connections of the pool.
+ *
+ * All connections should have been returned to the pool; connections which
+ * are returned later are closed by ::release_ldap_connection().
+ *
+ * @return `EX_OK` on success, an error code from `sysexits.h` otherwise
+ */
+int close_ldap_pool( void );
+
+/**
+ * Checks out a connection from the pool.
+ *
+ * Each connection is used by at most one thread at a time.
+ * If the pool holds connections which have been lost, the function
+ * reconnects one of them, unless the reconnect backoff has not elapsed yet.
+ * In that case, the function fails fast instead of waiting for the backoff.
+ * Only one thread reconnects at a time; others wait for its attempt like
+ * for a returned connection.
+ *
+ * The connection must be returned by ::release_ldap_connection().
+ *
+ * @param deadline If all connections are in use, the function waits for
+ * another thread to return a connection until this point in time on the
+ * monotonic clock.
+ * If `NULL`, the function returns `NULL` at once in that case.
+ * @return A bound LDAP connection or `NULL`
+ */
+LDAP* acquire_ldap_connection( struct timespec const * const deadline );
+
+/**
+ * Returns a connection to the pool.
+ *
+ * Note, the function is NULL-pointer safe.
+ *
+ * @param handle A connection previously obtained by ::acquire_ldap_connection()
+ * @param is_broken Non-zero, if the connection has been lost; the
+ * connection is closed and re-established later.
+ * If the pool has already been closed, the connection is closed in any case.
+ */
+void release_ldap_connection( LDAP* const handle, int const is_broken );
+
+/**
+ * Checks whether an LDAP result code indicates a lost connection.
+ *
+ * @param result_code An LDAP result code
+ * @return Non-zero, if the connection should be re-established
+ */
+int is_ldap_connection_error( int const result_code );
+
+/**
+ * Returns the current health state of the connection pool.
+ *
+ * @return Either ::HEALTH_UP, ::HEALTH_DEGRADED or ::HEALTH_DOWN
+ */
+int get_ldap_health( void );
+
+/**
+ * Converts a health state to its name.
+ *
+ * @param health Either ::HEALTH_UP, ::HEALTH_DEGRADED or ::HEALTH_DOWN
+ * @return The name of the health state or `NULL`
+ */
+char const * convert_ldap_health_2_str( int const health );
+
+#endif
@@ -0,0 +1,508 @@
+#define _GNU_SOURCE
+#include <ldap.h>
+#include <pthread.h>
+#include <sysexits.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+
+#include "ldap_sync.h"
+#include "ldap_pool.h"
+#include "alias_index.h"
+#include "snapshot.h"
+#include "runtime_setting.h"
+#include "log.h"
+#include "metrics.h"
+
+/**
+ * The name of the snapshot file, if it is placed next to the PID file.
+ */
+static char const * const SNAPSHOT_FILE_NAME = "milter-alias.snapshot";
+
+/**
+ * The number of entries which are requested per page of a load.
+ *
+ * It does not exceed the default size limit of slapd.
+ */
+#define SYNC_PAGE_SIZE 500
+
+/**
+ * The state of the snapshot and of the background thread which refreshes it.
+ *
+ * Readers only hold the read lock of `snapshot_lock` while they look up a
+ * single key.
+ * The background thread builds a new snapshot without holding any lock and
+ * only takes the write lock to swap the pointer; the previous snapshot is
+ * freed after the swap, when no reader can hold it anymore.
+ */
+struct ldap_sync_t {
+	pthread_rwlock_t snapshot_lock; /**< Protects `snapshot`. */
+	struct snapshot_t* snapshot; /**< The current snapshot or `NULL`, if none has been loaded yet. */
+	char* snapshot_file; /**< The path of the snapshot file or `NULL`, if disabled. */
+	pthread_mutex_t mutex; /**< Protects the members below. */
+	pthread_cond_t wakeup; /**< Signalled, if the background thread shall stop. */
+	int shall_stop; /**< Non-zero, if the background thread shall stop. */
+	int is_running; /**< Non-zero, if the background thread has been started. */
+	pthread_t thread; /**< The background thread. */
+};
+
+static struct ldap_sync_t ldap_sync = {
+	PTHREAD_RWLOCK_INITIALIZER,
+	NULL,
+	NULL,
+	PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_COND_INITIALIZER,
+	0,
+	0,
+	0
+};
+
+/**
+ * Pushes a pair for each combination of a key and a value of an entry.
+ *
+ * @return Zero on success, non-zero in case of an error
+ */
+static int push_entry(
+	LDAP* const ldap_handle,
+	LDAPMessage* const ldap_entry_msg,
+	char* const key_attribute,
+	char* const value_attribute,
+	struct string_array_t* const keys,
+	struct string_array_t* const values
+) {
+	int result = 0;
+	struct berval** const key_values = ldap_get_values_len( ldap_handle, ldap_entry_msg, key_attribute );
+	struct berval** const value_values = ldap_get_values_len( ldap_handle, ldap_entry_msg, value_attribute );
+	for( int i = 0; key_values != NULL && key_values[i] != NULL && result == 0; ++i ) {
+		for( int j = 0; value_values != NULL && value_values[j] != NULL && result == 0; ++j ) {
+			if(
+				push_onto_string_array_l( keys, key_values[i]->bv_val, key_values[i]->bv_len ) == NULL ||
+				push_onto_string_array_l( values, value_values[j]->bv_val, value_values[j]->bv_len ) == NULL
+			) {
+				result = 1;
+			}
+		}
+	}
+	ldap_value_free_len( key_values );
+	ldap_value_free_len( value_values );
+	return result;
+}
+
+/**
+ * Loads one page of entries of a kind with the paged results control
+ * (RFC 2696).
+ *
+ * @param ldap_handle The connection to use
+ * @param query The query whose base DN and result attribute are used
+ * @param sync The parameters of this kind
+ * @param deadline The time at which the complete load must be finished
+ * @param cookie The cookie of the previous page, empty for the first page;
+ * replaced by the cookie of the next page, which is empty after the last page
+ * @param keys The array to which the keys of the page are appended
+ * @param values The array to which the values of the page are appended
+ * @return `EX_OK` on success, `EX_UNAVAILABLE` if the connection has been
+ * lost, another error code from `sysexits.h` otherwise
+ */
+static int load_alias_page(
+	LDAP* const ldap_handle,
+	struct ldap_query_parms_t const * const query,
+	struct ldap_sync_parms_t const * const sync,
+	struct timespec const * const deadline,
+	struct berval* const cookie,
+	struct string_array_t* const keys,
+	struct string_array_t* const values
+) {
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	long const remaining_usec =
+		( deadline->tv_sec - now.tv_sec ) * 1000000L + ( deadline->tv_nsec - now.tv_nsec ) / 1000L;
+	if( remaining_usec <= 0 ) {
+		log_msg( LOG_ERR, "load_alias_index: could not load all entries within the sync interval\n" );
+		return EX_TEMPFAIL;
+	}
+	// The server rejects the search, if it does not support paging, instead
+	// of silently returning a truncated result
+	LDAPControl* page_control = NULL;
+	int result_code = ldap_create_page_control( ldap_handle, SYNC_PAGE_SIZE, cookie, 1, &page_control );
+	if( result_code != LDAP_SUCCESS ) {
+		log_msg( LOG_ERR, "load_alias_index: ldap_create_page_control failed: %s (%d)\n", ldap_err2string( result_code ), result_code );
+		return EX_OSERR;
+	}
+	char* attributes[3] = { sync->key_attribute, query->result_attributes[0], NULL };
+	LDAPControl* server_controls[2] = { page_control, NULL };
+	struct timeval timeout = { remaining_usec / 1000000L, remaining_usec % 1000000L };
+	LDAPMessage* ldap_result_msg = NULL;
+	result_code = ldap_search_ext_s(
+		ldap_handle,
+		query->base_dn,
+		LDAP_SCOPE_SUBTREE,
+		sync->filter,
+		attributes,
+		0,    // attrsonly: include values in response as well
+		server_controls,
+		NULL, // clientctrls: no special client controls
+		&timeout,
+		LDAP_NO_LIMIT,
+		&ldap_result_msg
+	);
+	ldap_control_free( page_control );
+	if( result_code != LDAP_SUCCESS ) {
+		if( result_code == LDAP_UNAVAILABLE_CRITICAL_EXTENSION ) {
+			log_msg( LOG_ERR, "load_alias_index: the LDAP server does not support the paged results control (RFC 2696), which is required by the sync\n" );
+		} else if( result_code == LDAP_SIZELIMIT_EXCEEDED ) {
+			log_msg( LOG_ERR, "load_alias_index: ldap_search_ext_s failed: %s (%d); raise the paged results limit of the bind DN\n", ldap_err2string( result_code ), result_code );
+		} else {
+			log_msg( LOG_ERR, "load_alias_index: ldap_search_ext_s failed: %s (%d)\n", ldap_err2string( result_code ), result_code );
+		}
+		ldap_msgfree( ldap_result_msg );
+		return is_ldap_connection_error( result_code ) ? EX_UNAVAILABLE : EX_IOERR;
+	}
+
+	int is_complete = 1;
+	for(
+		LDAPMessage* ldap_entry_msg = ldap_first_entry( ldap_handle, ldap_result_msg );
+		ldap_entry_msg != NULL && is_complete;
+		ldap_entry_msg = ldap_next_entry( ldap_handle, ldap_entry_msg )
+	) {
+		if( push_entry( ldap_handle, ldap_entry_msg, sync->key_attribute, query->result_attributes[0], keys, values ) != 0 )
+			is_complete = 0;
+	}
+
+	// Without a response control the server has returned everything at once
+	ber_memfree( cookie->bv_val );
+	cookie->bv_val = NULL;
+	cookie->bv_len = 0;
+	LDAPControl** response_controls = NULL;
+	result_code = ldap_parse_result( ldap_handle, ldap_result_msg, NULL, NULL, NULL, NULL, &response_controls, 1 );
+	if( result_code == LDAP_SUCCESS && response_controls != NULL ) {
+		LDAPControl* const page_response = ldap_control_find( LDAP_CONTROL_PAGEDRESULTS, response_controls, NULL );
+		ber_int_t estimated_count = 0;
+		if( page_response != NULL )
+			result_code = ldap_parse_pageresponse_control( ldap_handle, page_response, &estimated_count, cookie );
+	}
+	ldap_controls_free( response_controls );
+	if( result_code != LDAP_SUCCESS ) {
+		log_msg( LOG_ERR, "load_alias_index: could not parse the paged results: %s (%d)\n", ldap_err2string( result_code ), result_code );
+		return EX_IOERR;
+	}
+	if( !is_complete ) {
+		log_msg( LOG_ERR, "load_alias_index: could not allocate entries\n" );
+		return EX_OSERR;
+	}
+	return EX_OK;
+}
+
+/**
+ * Loads all entries of a kind into a new index.
+ *
+ * The entries are loaded in pages, as servers limit the number of entries of
+ * a single search, e.g. slapd to 500 by default.
+ *
+ * @param ldap_handle The connection to use
+ * @param query The query whose base DN and result attribute are used
+ * @param sync The parameters of this kind
+ * @param index Output parameter for the index
+ * @return `EX_OK` on success, `EX_UNAVAILABLE` if the connection has been
+ * lost, another error code from `sysexits.h` otherwise
+ */
+static int load_alias_index(
+	LDAP* const ldap_handle,
+	struct ldap_query_parms_t const * const query,
+	struct ldap_sync_parms_t const * const sync,
+	struct alias_index_t** const index
+) {
+	*index = NULL;
+	struct string_array_t* const keys = create_string_array( 1024 );
+	struct string_array_t* const values = create_string_array( 1024 );
+	int result_code = ( keys != NULL && values != NULL ) ? EX_OK : EX_OSERR;
+
+	// A complete load may take longer than an individual search, but it
+	// must not take longer than the refresh interval
+	struct timespec deadline;
+	clock_gettime( CLOCK_MONOTONIC, &deadline );
+	deadline.tv_sec += rt_setting.sync_interval;
+	struct berval cookie = { 0, NULL };
+	unsigned int page_count = 0;
+	while( result_code == EX_OK ) {
+		result_code = load_alias_page( ldap_handle, query, sync, &deadline, &cookie, keys, values );
+		++page_count;
+		if( cookie.bv_len == 0 )
+			break;
+	}
+	ber_memfree( cookie.bv_val );
+
+	if( result_code == EX_OK ) {
+		*index = create_alias_index( keys, values );
+		if( *index == NULL ) {
+			log_msg( LOG_ERR, "load_alias_index: could not allocate index\n" );
+			result_code = EX_OSERR;
+		} else {
+			log_msg( LOG_DEBUG, "load_alias_index: loaded %zu pairs in %u pages\n", get_string_array_size( keys ), page_count );
+		}
+	} else if( keys == NULL || values == NULL ) {
+		log_msg( LOG_ERR, "load_alias_index: could not allocate index\n" );
+	}
+	if( keys != NULL )
+		free_string_array( keys );
+	if( values != NULL )
+		free_string_array( values );
+	return result_code;
+}
+
+/**
+ * Replaces the current snapshot and frees the previous one.
+ */
+static void install_snapshot( struct snapshot_t* const snapshot ) {
+	pthread_rwlock_wrlock( &ldap_sync.snapshot_lock );
+	struct snapshot_t* const old_snapshot = ldap_sync.snapshot;
+	ldap_sync.snapshot = snapshot;
+	pthread_rwlock_unlock( &ldap_sync.snapshot_lock );
+	free_snapshot( old_snapshot );
+}
+
+/**
+ * Loads all mailing lists and accounts, writes them to the snapshot file
+ * and replaces the current snapshot.
+ *
+ * @return `EX_OK` on success, an error code from `sysexits.h` otherwise
+ */
+static int sync_snapshot( void ) {
+	uint64_t const observation = start_metric_observation();
+	// Like the load itself, waiting for a connection must not take longer
+	// than the refresh interval
+	struct timespec deadline;
+	clock_gettime( CLOCK_MONOTONIC, &deadline );
+	deadline.tv_sec += rt_setting.sync_interval;
+	LDAP* const ldap_handle = acquire_ldap_connection( &deadline );
+	if( ldap_handle == NULL ) {
+		log_msg( LOG_ERR, "sync_snapshot: no LDAP connection available\n" );
+		return EX_UNAVAILABLE;
+	}
+	struct alias_index_t* mail_lists = NULL;
+	struct alias_index_t* mail_accts = NULL;
+	int result_code = load_alias_index( ldap_handle, &rt_setting.ldap_mail_list_query, &rt_setting.mail_list_sync, &mail_lists );
+	if( result_code == EX_OK && rt_setting.mail_acct_sync.filter != NULL )
+		result_code = load_alias_index( ldap_handle, &rt_setting.ldap_mail_acct_query, &rt_setting.mail_acct_sync, &mail_accts );
+	release_ldap_connection( ldap_handle, result_code == EX_UNAVAILABLE );
+	observe_metric( METRIC_LDAP_SYNC_LATENCY, observation );
+	if( result_code != EX_OK ) {
+		free_alias_index( mail_lists );
+		free_alias_index( mail_accts );
+		return result_code;
+	}
+
+	struct snapshot_t* const snapshot = create_snapshot( mail_lists, mail_accts );
+	if( snapshot == NULL ) {
+		log_msg( LOG_ERR, "sync_snapshot: could not allocate snapshot\n" );
+		return EX_OSERR;
+	}
+	log_msg(
+		LOG_INFO,
+		"sync_snapshot: loaded %zu mailing lists and %zu accounts\n",
+		get_alias_index_size( mail_lists ),
+		mail_accts != NULL ? get_alias_index_size( mail_accts ) : (size_t)0
+	);
+	if( ldap_sync.snapshot_file != NULL && write_snapshot( snapshot, ldap_sync.snapshot_file ) != 0 ) {
+		log_msg( LOG_WARNING, "sync_snapshot: could not write %s: %s\n", ldap_sync.snapshot_file, strerror( errno ) );
+	}
+	install_snapshot( snapshot );
+	return EX_OK;
+}
+
+/**
+ * Maps the snapshot file, if it exists, and installs it as the current
+ * snapshot.
+ *
+ * @return Zero, if a snapshot has been installed, non-zero otherwise
+ */
+static int restore_snapshot( void ) {
+	if( ldap_sync.snapshot_file == NULL )
+		return 1;
+	struct snapshot_t* const snapshot = map_snapshot( ldap_sync.snapshot_file );
+	if( snapshot == NULL ) {
+		if( errno != ENOENT )
+			log_msg( LOG_WARNING, "restore_snapshot: ignoring %s: %s\n", ldap_sync.snapshot_file, strerror( errno ) );
+		return 1;
+	}
+	struct alias_index_t const * const mail_accts = get_snapshot_mail_accts( snapshot );
+	log_msg(
+		LOG_INFO,
+		"restore_snapshot: mapped %s with %zu mailing lists and %zu accounts, %ld seconds old\n",
+		ldap_sync.snapshot_file,
+		get_alias_index_size( get_snapshot_mail_lists( snapshot ) ),
+		mail_accts != NULL ? get_alias_index_size( mail_accts ) : (size_t)0,
+		(long)( time( NULL ) - get_snapshot_time( snapshot ) )
+	);
+	install_snapshot( snapshot );
+	return 0;
+}
+
+/**
+ * The background thread.
+ *
+ * @param arg Non-NULL, if the first sync shall start at once
+ */
+static void* run_ldap_sync( void* arg ) {
+	int sync_now = ( arg != NULL );
+	pthread_mutex_lock( &ldap_sync.mutex );
+	while( !ldap_sync.shall_stop ) {
+		if( !sync_now ) {
+			struct timespec next_sync;
+			clock_gettime( CLOCK_MONOTONIC, &next_sync );
+			next_sync.tv_sec += rt_setting.sync_interval;
+			while( !ldap_sync.shall_stop ) {
+				if( pthread_cond_timedwait( &ldap_sync.wakeup, &ldap_sync.mutex, &next_sync ) != 0 )
+					break;
+			}
+			if( ldap_sync.shall_stop )
+				break;
+		}
+		sync_now = 0;
+		pthread_mutex_unlock( &ldap_sync.mutex );
+		sync_snapshot();
+		pthread_mutex_lock( &ldap_sync.mutex );
+	}
+	pthread_mutex_unlock( &ldap_sync.mutex );
+	return NULL;
+}
+
+/**
+ * Checks the parameters of a kind of entries.
+ */
+static int check_sync_parms( struct ldap_query_parms_t const * const query, struct ldap_sync_parms_t const * const sync ) {
+	if(
+		sync->filter == NULL || sync->key_attribute == NULL ||
+		query->base_dn == NULL || query->result_attributes[0] == NULL
+	) {
+		log_msg( LOG_ERR, "check_sync_parms: filter, key attribute, base and result must be set\n" );
+		return EX_CONFIG;
+	}
+	if( strchr( query->base_dn, '%' ) != NULL || strchr( sync->filter, '%' ) != NULL ) {
+		log_msg( LOG_ERR, "check_sync_parms: base and filter must not contain placeholders\n" );
+		return EX_CONFIG;
+	}
+	return EX_OK;
+}
+
+/**
+ * Determines the path of the snapshot file.
+ *
+ * @return `EX_OK` on success, an error code from `sysexits.h` otherwise
+ */
+static int init_snapshot_file( void ) {
+	char const * const configured = rt_setting.sync_snapshot_file;
+	if( configured != NULL ) {
+		if( *configured == '\0' )
+			return EX_OK;
+		ldap_sync.snapshot_file = malloc( strlen( configured ) + 1 );
+		if( ldap_sync.snapshot_file == NULL )
+			return EX_OSERR;
+		strcpy( ldap_sync.snapshot_file, configured );
+		return EX_OK;
+	}
+	if( rt_setting.pid_file == NULL )
+		return EX_OK;
+	// Place the file next to the PID file
+	char const * const separator = strrchr( rt_setting.pid_file, '/' );
+	size_t const dir_len = separator != NULL ? (size_t)( separator - rt_setting.pid_file ) + 1 : 0;
+	ldap_sync.snapshot_file = malloc( dir_len + strlen( SNAPSHOT_FILE_NAME ) + 1 );
+	if( ldap_sync.snapshot_file == NULL )
+		return EX_OSERR;
+	memcpy( ldap_sync.snapshot_file, rt_setting.pid_file, dir_len );
+	strcpy( ldap_sync.snapshot_file + dir_len, SNAPSHOT_FILE_NAME );
+	return EX_OK;
+}
+
+int start_ldap_sync( void ) {
+	if( rt_setting.sync_interval == 0 )
+		return EX_OK;
+	int result = check_sync_parms( &rt_setting.ldap_mail_list_query, &rt_setting.mail_list_sync );
+	if( result == EX_OK && rt_setting.mail_acct_sync.filter != NULL )
+		result = check_sync_parms( &rt_setting.ldap_mail_acct_query, &rt_setting.mail_acct_sync );
+	if( result == EX_OK )
+		result = init_snapshot_file();
+	if( result != EX_OK ) {
+		stop_ldap_sync();
+		return result;
+	}
+
+	pthread_condattr_t cond_attr;
+	pthread_condattr_init( &cond_attr );
+	pthread_condattr_setclock( &cond_attr, CLOCK_MONOTONIC );
+	pthread_cond_destroy( &ldap_sync.wakeup );
+	pthread_cond_init( &ldap_sync.wakeup, &cond_attr );
+	pthread_condattr_destroy( &cond_attr );
+
+	// Serve from the snapshot file at once and refresh it in background;
+	// without a file, load synchronously such that the first messages
+	// are already served locally.
+	int const is_restored = ( restore_snapshot() == 0 );
+	if( !is_restored && sync_snapshot() != EX_OK ) {
+		log_msg( LOG_WARNING, "start_ldap_sync: initial load failed, falling back to individual searches\n" );
+	}
+
+	ldap_sync.shall_stop = 0;
+	if( pthread_create( &ldap_sync.thread, NULL, run_ldap_sync, is_restored ? &ldap_sync : NULL ) != 0 ) {
+		log_msg( LOG_ERR, "start_ldap_sync: could not create thread\n" );
+		stop_ldap_sync();
+		return EX_OSERR;
+	}
+	ldap_sync.is_running = 1;
+	return EX_OK;
+}
+
+void stop_ldap_sync( void ) {
+	if( ldap_sync.is_running ) {
+		pthread_mutex_lock( &ldap_sync.mutex );
+		ldap_sync.shall_stop = 1;
+		pthread_cond_signal( &ldap_sync.wakeup );
+		pthread_mutex_unlock( &ldap_sync.mutex );
+		pthread_join( ldap_sync.thread, NULL );
+		ldap_sync.is_running = 0;
+	}
+	install_snapshot( NULL );
+	free( ldap_sync.snapshot_file );
+	ldap_sync.snapshot_file = NULL;
+}
+
+/**
+ * Looks up a key in one of the indices of the current snapshot.
+ *
+ * @param use_accts Non-zero to use the index of accounts, zero to use the
+ * index of mailing lists
+ */
+static int lookup_snapshot_index( int const use_accts, char const * const key, struct string_array_t** const values ) {
+	*values = NULL;
+	pthread_rwlock_rdlock( &ldap_sync.snapshot_lock );
+	struct alias_index_t const * const index = ldap_sync.snapshot == NULL ? NULL : (
+		use_accts ? get_snapshot_mail_accts( ldap_sync.snapshot ) : get_snapshot_mail_lists( ldap_sync.snapshot )
+	);
+	if( index == NULL ) {
+		pthread_rwlock_unlock( &ldap_sync.snapshot_lock );
+		return EX_UNAVAILABLE;
+	}
+	*values = lookup_alias_index( index, key );
+	pthread_rwlock_unlock( &ldap_sync.snapshot_lock );
+
+	if( *values == NULL ) {
+		// The key is not contained in the snapshot
+		*values = create_string_array( 1 );
+		if( *values == NULL )
+			return EX_OSERR;
+	}
+	if( set_mail_address_normalization( *values, rt_setting.mail_address_normalization ) != EX_OK ) {
+		free_string_array( *values );
+		*values = NULL;
+		return EX_OSERR;
+	}
+	return EX_OK;
+}
+
+int lookup_mail_list_snapshot( char const * const key, struct string_array_t** const members ) {
+	return lookup_snapshot_index( 0, key, members );
+}
+
+int lookup_mail_acct_snapshot( char const * const key, struct string_array_t** const addresses ) {
+	return lookup_snapshot_index( 1, key, addresses );
+}
@@ -0,0 +1,67 @@
+#ifndef _LDAP_SYNC_H_
+#define _LDAP_SYNC_H_
+
+/**
+ * @file
+ * @brief Functions for keeping a complete local snapshot of all mailing
+ * lists and accounts.
+ */
+
+#include "string_array.h"
+
+/**
+ * Loads all mailing lists and their members (and optionally all accounts
+ * and their own addresses) from LDAP server and starts a background thread
+ * which reloads them periodically.
+ *
+ * The function is a no-op, if ::rt_setting_t::sync_interval is zero.
+ * Each reload builds a new immutable snapshot which replaces the previous
+ * one at once; concurrent lookups are never blocked by a reload.
+ * Each snapshot is also written to the snapshot file.
+ * If the snapshot file exists at start, it is mapped and served at once
+ * while the first reload runs in background.
+ * Otherwise the first load happens synchronously; if it fails, the
+ * function logs a warning and succeeds anyway and lookups fall back to
+ * individual LDAP searches until a reload succeeds.
+ *
+ * The LDAP connection pool must have been opened.
+ *
+ * @return `EX_OK` on success, an error code from `sysexits.h` otherwise
+ */
+int start_ldap_sync( void );
+
+/**
+ * Stops the background thread and frees the snapshot.
+ *
+ * Note, the function is safe to be called, even if ::start_ldap_sync() has
+ * not been called or has failed.
+ */
+void stop_ldap_sync( void );
+
+/**
+ * Looks up the members of a mailing list in the current snapshot.
+ *
+ * @param key The address of the mailing list as stored in the attribute
+ * ::rt_setting_t::ldap_sync_parms_t::key_attribute
+ * @param members Output parameter for the members; an empty array, if the
+ * key is not a mailing list.
+ * The caller must free the result.
+ * @return `EX_OK` on success, `EX_UNAVAILABLE` if there is no snapshot,
+ * another error code from `sysexits.h` otherwise
+ */
+int lookup_mail_list_snapshot( char const * const key, struct string_array_t** const members );
+
+/**
+ * Looks up the own mail addresses of an account in the current snapshot.
+ *
+ * @param key The account as stored in the attribute
+ * ::rt_setting_t::ldap_sync_parms_t::key_attribute
+ * @param addresses Output parameter for the addresses; an empty array, if
+ * the account is unknown.
+ * The caller must free the result.
+ * @return `EX_OK` on success, `EX_UNAVAILABLE` if there is no snapshot of
+ * accounts, another error code from `sysexits.h` otherwise
+ */
+int lookup_mail_acct_snapshot( char const * const key, struct string_array_t** const addresses );
+
+#endif
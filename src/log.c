@@ -1,12 +1,48 @@
-#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <systemd/sd-journal.h>
 
 #include "log.h"
+#include "extstring.h"
+#include "metrics.h"
 #include "runtime_setting.h"
 
+/**
+ * The maximum size of a queued message including the terminating null byte;
+ * longer messages are truncated.
+ */
+#define LOG_RECORD_SIZE 1024
+
+/**
+ * The maximum size of a message which is written synchronously with fields
+ * or to the journal.
+ */
+#define LOG_SYNC_RECORD_SIZE 4096
+
+/**
+ * The maximum number of fields of a journal entry.
+ */
+#define LOG_JOURNAL_MAX_FIELDS 9
+
+/**
+ * The time in milliseconds after which the writer reports dropped messages,
+ * even if no new message arrives.
+ */
+static int const LOG_WRITER_IDLE_TIMEOUT = 1000;
+
+static char const LOG_TRUNCATION_MARK[] = "...\n";
+
 static char const * const LOG_LEVEL_EMERG_STRINGS[] = { "EMERGENCY", "emergency", "EMERG", "emerg", "0", NULL };
 static char const * const LOG_LEVEL_ALERT_STRINGS[] = { "ALERT", "alert", "1", NULL };
 static char const * const LOG_LEVEL_CRITICAL_STRINGS[] = { "CRITICAL", "critical", "CRIT", "crit", "2", NULL };
@@ -66,28 +102,453 @@ static char const * const * const LOG_FACILITY_2_STRINGS[] = {
 	LOG_FACILITY_LOCAL7_STRINGS
 };
 
+/**
+ * A slot of the queue.
+ */
+struct log_record_t {
+	/**
+	 * The position for which the slot is free (`pos`) or filled (`pos + 1`).
+	 */
+	_Atomic size_t sequence;
+	int priority; /**< The priority of the message. */
+	int field_count; /**< The number of journal fields in `text` or zero, if `text` is a line of text. */
+	char text[LOG_RECORD_SIZE]; /**< The formatted message, see ::format_log_record(). */
+};
+
+/**
+ * A bounded multi-producer single-consumer queue of formatted messages and
+ * the thread which writes them.
+ *
+ * Producers claim a slot by a compare-and-swap on `enqueue_pos` and never
+ * wait; if the queue is full, the message is dropped and counted.
+ */
+struct log_queue_t {
+	struct log_record_t* records; /**< The slots; their number is a power of two. */
+	size_t mask; /**< The number of slots minus one. */
+	_Atomic size_t enqueue_pos; /**< The position of the next message to be enqueued. */
+	size_t dequeue_pos; /**< The position of the next message to be written; only used by the writer. */
+	_Atomic uint64_t dropped; /**< The number of dropped messages which have not been reported yet. */
+	atomic_int is_running; /**< Non-zero, if messages are queued. */
+	atomic_int is_stopping; /**< Non-zero, if the writer shall terminate after the queue has been drained. */
+	atomic_int is_writer_sleeping; /**< Non-zero, if producers must wake up the writer. */
+	int wakeup_pipe[2]; /**< A non-blocking pipe which wakes up the writer. */
+	pthread_t writer; /**< The writer thread. */
+};
+
+static struct log_queue_t log_queue = { NULL, 0, 0, 0, 0, 0, 0, 0, { -1, -1 }, 0 };
+
+/**
+ * Returns non-zero, if messages are written to the journal.
+ *
+ * Until the program has daemonized, messages are written as text, such
+ * that they appear on standard output as well.
+ */
+static int is_journal_target( void ) {
+	return rt_setting.log_journal && (
+		rt_setting.is_daemonized || rt_setting.daemon_mode == DAEMON_MODE_FOREGROUND
+	);
+}
+
+/**
+ * A buffer into which a record is formatted.
+ */
+struct log_buffer_t {
+	char* buf; /**< The buffer. */
+	size_t size; /**< The size of `buf`; at least one. */
+	size_t pos; /**< The position of the terminating null byte of the current string. */
+	int is_full; /**< Non-zero, if text has been truncated. */
+};
+
+static void append_log_vformat( struct log_buffer_t* const buffer, char const * const format, va_list args ) {
+	if( buffer->is_full )
+		return;
+	size_t const available = buffer->size - buffer->pos;
+	int const len = vsnprintf( buffer->buf + buffer->pos, available, format, args );
+	if( len < 0 )
+		return;
+	if( (size_t)len >= available ) {
+		buffer->pos = buffer->size - 1;
+		buffer->is_full = 1;
+	} else {
+		buffer->pos += (size_t)len;
+	}
+}
+
+static void append_log_format( struct log_buffer_t* const buffer, char const * const format, ... ) {
+	va_list args;
+	va_start( args, format );
+	append_log_vformat( buffer, format, args );
+	va_end( args );
+}
+
+/**
+ * Removes a trailing newline from the current string.
+ */
+static void strip_log_newline( struct log_buffer_t* const buffer, size_t const start ) {
+	if( buffer->pos > start && buffer->buf[ buffer->pos - 1 ] == '\n' )
+		buffer->buf[ --buffer->pos ] = '\0';
+}
+
+/**
+ * Completes a `FIELD=value` string of a journal record.
+ *
+ * @return One, if the field has been completed, zero if the buffer is full
+ */
+static int end_journal_field( struct log_buffer_t* const buffer ) {
+	if( buffer->is_full || buffer->pos + 1 >= buffer->size ) {
+		buffer->is_full = 1;
+		return 0;
+	}
+	++buffer->pos;
+	buffer->buf[ buffer->pos ] = '\0';
+	return 1;
+}
+
+/**
+ * Appends a complete `FIELD=value` string to a journal record.
+ *
+ * A field which does not fit is omitted instead of being truncated.
+ *
+ * @return One, if the field has been appended, zero otherwise
+ */
+static int append_journal_field( struct log_buffer_t* const buffer, char const * const format, ... ) {
+	size_t const start = buffer->pos;
+	va_list args;
+	va_start( args, format );
+	append_log_vformat( buffer, format, args );
+	va_end( args );
+	if( end_journal_field( buffer ) )
+		return 1;
+	buffer->pos = start;
+	buffer->buf[start] = '\0';
+	buffer->is_full = 0;
+	return 0;
+}
+
+/**
+ * Formats a message into a record.
+ *
+ * For the journal, the record is a sequence of null-terminated `FIELD=value`
+ * strings with the message last; a quarter of the record is reserved for the
+ * message, fields which do not fit into the rest are omitted and the message
+ * is truncated.
+ * Otherwise, the record is a single line of text, in which the fields
+ * follow the message; a truncated line ends with ::LOG_TRUNCATION_MARK.
+ *
+ * @param buf The buffer
+ * @param size The size of `buf`; must be larger than ::LOG_TRUNCATION_MARK
+ * @param priority The priority of the message
+ * @param fields The fields or `NULL`
+ * @param format A `printf`-like format string containing the message
+ * @param args The arguments of `format`
+ * @return The number of fields for the journal or zero for a line of text
+ */
+static int format_log_record(
+	char* const buf,
+	size_t const size,
+	int const priority,
+	struct log_fields_t const * const fields,
+	char const * const format,
+	va_list args
+) {
+	struct log_buffer_t buffer = { buf, size, 0, 0 };
+	buf[0] = '\0';
+	if( !is_journal_target() ) {
+		if( fields != NULL )
+			append_log_format( &buffer, "%s (%p): ", str_or_null( fields->stage ), fields->session );
+		size_t const start = buffer.pos;
+		append_log_vformat( &buffer, format, args );
+		if( fields != NULL ) {
+			strip_log_newline( &buffer, start );
+			if( fields->sender != NULL )
+				append_log_format( &buffer, " sender=%s", fields->sender );
+			if( fields->auth_acct != NULL )
+				append_log_format( &buffer, " auth_acct=%s", fields->auth_acct );
+			if( fields->ldap_latency >= 0 )
+				append_log_format( &buffer, " ldap_latency=%lldus", fields->ldap_latency );
+			append_log_format( &buffer, "\n" );
+		}
+		if( buffer.is_full )
+			strcpy( buf + size - sizeof( LOG_TRUNCATION_MARK ), LOG_TRUNCATION_MARK );
+		return 0;
+	}
+
+	// Long field values, e.g. a sender address, must not crowd out the
+	// message
+	buffer.size = size - size / 4;
+	int count = 0;
+	count += append_journal_field( &buffer, "PRIORITY=%d", priority );
+	count += append_journal_field( &buffer, "SYSLOG_FACILITY=%d", rt_setting.log_facility >> 3 );
+	if( rt_setting.log_ident != NULL )
+		count += append_journal_field( &buffer, "SYSLOG_IDENTIFIER=%s", rt_setting.log_ident );
+	if( fields != NULL ) {
+		count += append_journal_field( &buffer, "MILTER_SESSION=%p", fields->session );
+		if( fields->stage != NULL )
+			count += append_journal_field( &buffer, "MILTER_STAGE=%s", fields->stage );
+		if( fields->sender != NULL )
+			count += append_journal_field( &buffer, "MILTER_SENDER=%s", fields->sender );
+		if( fields->auth_acct != NULL )
+			count += append_journal_field( &buffer, "MILTER_AUTH_ACCT=%s", fields->auth_acct );
+		if( fields->ldap_latency >= 0 )
+			count += append_journal_field( &buffer, "MILTER_LDAP_LATENCY_USEC=%lld", fields->ldap_latency );
+	}
+	buffer.size = size;
+	append_log_format( &buffer, "MESSAGE=" );
+	size_t const start = buffer.pos;
+	append_log_vformat( &buffer, format, args );
+	strip_log_newline( &buffer, start );
+	// The last field needs no room for another string
+	return count + 1;
+}
+
+/**
+ * Writes a formatted record synchronously.
+ *
+ * If the program is about to daemonize, a line of text is written to both
+ * the system log and standard output.
+ */
+static void write_log_record( int const priority, char const * const text, int const field_count ) {
+	if( field_count != 0 ) {
+		struct iovec iov[LOG_JOURNAL_MAX_FIELDS];
+		char const * field = text;
+		for( int i = 0; i != field_count; ++i ) {
+			size_t const len = strlen( field );
+			iov[i].iov_base = (void*)field;
+			iov[i].iov_len = len;
+			field += len + 1;
+		}
+		sd_journal_sendv( iov, field_count );
+	} else if( rt_setting.is_daemonized ) {
+		syslog( priority | rt_setting.log_facility, "%s", text );
+	} else if( rt_setting.daemon_mode != DAEMON_MODE_FOREGROUND ) {
+		syslog( priority | rt_setting.log_facility, "%s", text );
+		fputs( text, stdout );
+	} else {
+		fputs( text, stdout );
+	}
+}
+
+/**
+ * Writes a message synchronously.
+ */
+static void write_log_msg(
+	int const priority,
+	struct log_fields_t const * const fields,
+	char const * const format,
+	va_list args
+) {
+	if( fields == NULL && !is_journal_target() ) {
+		// Plain messages are not limited in length
+		if( rt_setting.is_daemonized ) {
+			vsyslog( priority | rt_setting.log_facility, format, args );
+		} else if( rt_setting.daemon_mode != DAEMON_MODE_FOREGROUND ) {
+			va_list args_copy;
+			va_copy( args_copy, args );
+			vsyslog( priority | rt_setting.log_facility, format, args_copy );
+			va_end( args_copy );
+			vfprintf( stdout, format, args );
+		} else {
+			vfprintf( stdout, format, args );
+		}
+		return;
+	}
+	char text[LOG_SYNC_RECORD_SIZE];
+	int const field_count = format_log_record( text, sizeof( text ), priority, fields, format, args );
+	write_log_record( priority, text, field_count );
+}
+
+/**
+ * Writes a message without fields synchronously.
+ */
+static void write_log_msgf( int const priority, char const * const format, ... ) {
+	va_list args;
+	va_start( args, format );
+	write_log_msg( priority, NULL, format, args );
+	va_end( args );
+}
+
+/**
+ * Formats a message into a free slot of the queue.
+ *
+ * The function never blocks: if the queue is full, the message is dropped.
+ */
+static void enqueue_log_msg(
+	int const priority,
+	struct log_fields_t const * const fields,
+	char const * const format,
+	va_list args
+) {
+	struct log_record_t* record = NULL;
+	size_t pos = atomic_load_explicit( &log_queue.enqueue_pos, memory_order_relaxed );
+	for( ;; ) {
+		record = &log_queue.records[ pos & log_queue.mask ];
+		size_t const sequence = atomic_load_explicit( &record->sequence, memory_order_acquire );
+		if( sequence == pos ) {
+			if( atomic_compare_exchange_weak_explicit( &log_queue.enqueue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed ) )
+				break;
+		} else if( sequence < pos ) {
+			// The slot still holds the message from the previous round
+			atomic_fetch_add_explicit( &log_queue.dropped, 1, memory_order_relaxed );
+			count_metric( METRIC_LOG_DROPS, 1 );
+			return;
+		} else {
+			// Another producer has claimed the slot in between
+			pos = atomic_load_explicit( &log_queue.enqueue_pos, memory_order_relaxed );
+		}
+	}
+
+	record->priority = priority;
+	record->field_count = format_log_record( record->text, LOG_RECORD_SIZE, priority, fields, format, args );
+	atomic_store_explicit( &record->sequence, pos + 1, memory_order_release );
+
+	// Pairs with the fence in ::run_log_writer(), such that either the
+	// writer sees the message or we see the writer sleeping
+	atomic_thread_fence( memory_order_seq_cst );
+	if( atomic_load_explicit( &log_queue.is_writer_sleeping, memory_order_relaxed ) ) {
+		// If the pipe is full, the writer is going to wake up anyway
+		char const wakeup = 1;
+		ssize_t const written = write( log_queue.wakeup_pipe[1], &wakeup, 1 );
+		(void)written;
+	}
+}
+
+/**
+ * Returns non-zero, if the next message of the queue is complete.
+ */
+static int has_log_record( void ) {
+	struct log_record_t const * const record = &log_queue.records[ log_queue.dequeue_pos & log_queue.mask ];
+	return atomic_load_explicit( &record->sequence, memory_order_acquire ) == log_queue.dequeue_pos + 1;
+}
+
+/**
+ * Writes all complete messages of the queue and reports dropped messages.
+ */
+static void drain_log_queue( void ) {
+	while( has_log_record() ) {
+		struct log_record_t* const record = &log_queue.records[ log_queue.dequeue_pos & log_queue.mask ];
+		write_log_record( record->priority, record->text, record->field_count );
+		atomic_store_explicit( &record->sequence, log_queue.dequeue_pos + log_queue.mask + 1, memory_order_release );
+		++log_queue.dequeue_pos;
+	}
+	uint64_t const dropped = atomic_exchange_explicit( &log_queue.dropped, 0, memory_order_relaxed );
+	if( dropped != 0 && rt_setting.log_level >= LOG_WARNING )
+		write_log_msgf( LOG_WARNING, "log_msg: dropped %llu messages, because the queue was full\n", (unsigned long long)dropped );
+}
+
+static void* run_log_writer( void* arg ) {
+	(void)arg;
+	struct pollfd pfd = { log_queue.wakeup_pipe[0], POLLIN, 0 };
+	for( ;; ) {
+		// Read the flag before draining, such that all messages which have
+		// been enqueued before ::close_log() are written
+		int const is_stopping = atomic_load( &log_queue.is_stopping );
+		drain_log_queue();
+		if( is_stopping )
+			break;
+		atomic_store( &log_queue.is_writer_sleeping, 1 );
+		atomic_thread_fence( memory_order_seq_cst );
+		if( !has_log_record() && !atomic_load( &log_queue.is_stopping ) )
+			poll( &pfd, 1, LOG_WRITER_IDLE_TIMEOUT );
+		atomic_store( &log_queue.is_writer_sleeping, 0 );
+		char buf[64];
+		while( read( log_queue.wakeup_pipe[0], buf, sizeof( buf ) ) > 0 )
+			;
+	}
+	return NULL;
+}
+
+/**
+ * Frees the queue; the writer must not be running.
+ */
+static void free_log_queue( void ) {
+	for( int i = 0; i != 2; ++i ) {
+		if( log_queue.wakeup_pipe[i] != -1 )
+			close( log_queue.wakeup_pipe[i] );
+		log_queue.wakeup_pipe[i] = -1;
+	}
+	free( log_queue.records );
+	log_queue.records = NULL;
+}
+
+/**
+ * Allocates the queue and starts the writer.
+ *
+ * @return Zero on success, non-zero in case of an error
+ */
+static int start_log_writer( void ) {
+	size_t capacity = 1;
+	while( capacity < rt_setting.log_queue_size )
+		capacity <<= 1;
+	log_queue.records = malloc( capacity * sizeof( struct log_record_t ) );
+	if( log_queue.records == NULL )
+		return -1;
+	for( size_t i = 0; i != capacity; ++i )
+		atomic_init( &log_queue.records[i].sequence, i );
+	log_queue.mask = capacity - 1;
+	atomic_init( &log_queue.enqueue_pos, 0 );
+	log_queue.dequeue_pos = 0;
+	atomic_init( &log_queue.dropped, 0 );
+	atomic_init( &log_queue.is_stopping, 0 );
+	atomic_init( &log_queue.is_writer_sleeping, 0 );
+	if(
+		pipe2( log_queue.wakeup_pipe, O_CLOEXEC | O_NONBLOCK ) != 0 ||
+		pthread_create( &log_queue.writer, NULL, run_log_writer, NULL ) != 0
+	) {
+		free_log_queue();
+		return -1;
+	}
+	atomic_store( &log_queue.is_running, 1 );
+	return 0;
+}
+
 void open_log( void ) {
 	if( rt_setting.daemon_mode != DAEMON_MODE_FOREGROUND )
 		openlog( rt_setting.log_ident, LOG_NDELAY, rt_setting.log_facility );
+	if( rt_setting.log_queue_size != 0 && start_log_writer() != 0 )
+		log_msg( LOG_ERR, "open_log: could not start log writer, logging synchronously\n" );
 }
 
 void close_log(void) {
+	if( atomic_load( &log_queue.is_running ) ) {
+		atomic_store( &log_queue.is_running, 0 );
+		atomic_store( &log_queue.is_stopping, 1 );
+		char const wakeup = 1;
+		ssize_t const written = write( log_queue.wakeup_pipe[1], &wakeup, 1 );
+		(void)written;
+		pthread_join( log_queue.writer, NULL );
+		free_log_queue();
+	}
 	closelog();
 }
 
-void log_msg( int const priority, char const * const format, ... ) {
+/**
+ * Queues or writes a message.
+ */
+static void log_vmsg(
+	int const priority,
+	struct log_fields_t const * const fields,
+	char const * const format,
+	va_list args
+) {
 	if( rt_setting.log_level < priority )
 		return;
+	if( atomic_load_explicit( &log_queue.is_running, memory_order_acquire ) )
+		enqueue_log_msg( priority, fields, format, args );
+	else
+		write_log_msg( priority, fields, format, args );
+}
+
+void log_msg( int const priority, char const * const format, ... ) {
 	va_list args;
 	va_start( args, format );
-	if( rt_setting.is_daemonized ) {
-		vsyslog( priority | rt_setting.log_facility, format, args );
-	} else if( rt_setting.daemon_mode != DAEMON_MODE_FOREGROUND ) {
-		vsyslog( priority | rt_setting.log_facility, format, args );
-		vfprintf( stdout, format, args );
-	} else {
-		vfprintf( stdout, format, args );
-	}
+	log_vmsg( priority, NULL, format, args );
+	va_end( args );
+}
+
+void log_session_msg( int const priority, struct log_fields_t const * const fields, char const * const format, ... ) {
+	va_list args;
+	va_start( args, format );
+	log_vmsg( priority, fields, format, args );
 	va_end( args );
 }
 
@@ -17,12 +17,19 @@
  * as specified by `runtime_config` (e.g. log facility, log ID, log level,
  * etc.).
  * If the runtime settings indicate, that the program shall not daemonize,
- * then this method is a no-op.
+ * then no connection is opened.
+ *
+ * Unless ::rt_setting_t::log_queue_size is zero, this method also starts a
+ * thread which writes all subsequent messages in the background.
+ * Hence, the method must be called after the program has daemonized.
  */
 void open_log( void );
 
 /**
  * Closes the connection to the system logger.
+ *
+ * If messages are queued, all queued messages are written and the writer
+ * thread is stopped first; no other thread must log concurrently.
  */
 void close_log( void );
 
@@ -41,11 +48,58 @@ void close_log( void );
  * If the program runs in foreground mode (and will never daemonize), then
  * the log message is written to standard error output only.
  *
+ * If ::rt_setting_t::log_journal is set, the system log is replaced by the
+ * systemd journal, once the program has daemonized or, in foreground
+ * mode, right away.
+ *
+ * While the writer thread is running (see ::open_log()), the message is
+ * only formatted into a queue and never blocks the calling thread.
+ * If the queue is full, the message is dropped; the number of dropped
+ * messages is logged later and counted by ::METRIC_LOG_DROPS.
+ * Queued messages are truncated to 1023 bytes (::LOG_RECORD_SIZE), which
+ * includes the fields of ::log_session_msg().
+ * Messages which are written synchronously are truncated to 4095 bytes
+ * (::LOG_SYNC_RECORD_SIZE), if they have fields or go to the journal, and
+ * are not limited otherwise.
+ * A truncated line of text ends with `...`.
+ * In a journal record, the fields take at most three quarters of these
+ * sizes and fields which do not fit are omitted; the message takes the rest
+ * and is truncated without a mark.
+ *
  * @param priority The priority level of the log message.
  * @param format A `printf`-like format string containing the log message.
  */
 void log_msg( int const priority, char const * const format, ... );
 
+/**
+ * Fields which correlate the log messages of a single mail transaction.
+ */
+struct log_fields_t {
+	void const * session; /**< The private data of the SMTP session. */
+	char const * stage; /**< The stage of the milter protocol, e.g. `envfrom` or `eom`. */
+	char const * sender; /**< The envelope sender or `NULL`. */
+	char const * auth_acct; /**< The authenticated account or `NULL`. */
+	long long ldap_latency; /**< The time waited for the LDAP searches in microseconds or `-1`, if not known (yet). */
+};
+
+/**
+ * Logs a message of a mail transaction together with fields which
+ * correlate it.
+ *
+ * Like ::log_msg(), except for the fields.
+ * If ::rt_setting_t::log_journal is set, each field is sent to the systemd
+ * journal as a field of its own (`MILTER_SESSION`, `MILTER_STAGE`,
+ * `MILTER_SENDER`, `MILTER_AUTH_ACCT` and `MILTER_LDAP_LATENCY_USEC`),
+ * such that transactions can be selected by `journalctl`.
+ * Otherwise, the stage and session prefix the message and the other fields
+ * are appended to it as `name=value` pairs.
+ *
+ * @param priority The priority level of the log message.
+ * @param fields The fields.
+ * @param format A `printf`-like format string containing the log message.
+ */
+void log_session_msg( int const priority, struct log_fields_t const * const fields, char const * const format, ... );
+
 /**
  * Converts a numeric log level (0..7) to its name.
  *
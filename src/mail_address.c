@@ -0,0 +1,51 @@
+#include <string.h>
+#include <ctype.h>
+
+#include "mail_address.h"
+
+int const MAIL_ADDRESS_FOLD_LOCAL_PART = 1;
+
+int const MAIL_ADDRESS_STRIP_TAG = 2;
+
+/**
+ * The separator of the sub-address within the local part.
+ */
+static char const MAIL_ADDRESS_TAG_SEPARATOR = '+';
+
+size_t normalize_mail_address( char const * address, size_t len, int options, char* key ) {
+	// Find the last `@`; an address without domain is all local part
+	size_t local_len = len;
+	for( size_t i = len; i != 0; --i ) {
+		if( address[i - 1] == '@' ) {
+			local_len = i - 1;
+			break;
+		}
+	}
+
+	size_t copy_len = local_len;
+	if( options & MAIL_ADDRESS_STRIP_TAG ) {
+		char const * const tag = local_len > 1 ? memchr( address + 1, MAIL_ADDRESS_TAG_SEPARATOR, local_len - 1 ) : NULL;
+		if( tag != NULL )
+			copy_len = (size_t)( tag - address );
+	}
+	size_t key_len = 0;
+	if( options & MAIL_ADDRESS_FOLD_LOCAL_PART ) {
+		for( size_t i = 0; i != copy_len; ++i )
+			key[key_len++] = (char)tolower( (unsigned char)address[i] );
+	} else {
+		memcpy( key, address, copy_len );
+		key_len = copy_len;
+	}
+	for( size_t i = local_len; i != len; ++i )
+		key[key_len++] = (char)tolower( (unsigned char)address[i] );
+	return key_len;
+}
+
+uint64_t hash_mail_address_key( char const * key, size_t len ) {
+	uint64_t hash = UINT64_C( 14695981039346656037 );
+	for( size_t i = 0; i != len; ++i ) {
+		hash ^= (unsigned char)key[i];
+		hash *= UINT64_C( 1099511628211 );
+	}
+	return hash;
+}
@@ -0,0 +1,57 @@
+#ifndef _MAIL_ADDRESS_H_
+#define _MAIL_ADDRESS_H_
+
+/**
+ * @file
+ * @brief Functions for the normalization of mail addresses.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Lower-case the local part, too.
+ *
+ * Strictly speaking, the local part is case-sensitive, but almost all
+ * mail servers treat it case-insensitively.
+ */
+extern int const MAIL_ADDRESS_FOLD_LOCAL_PART;
+
+/**
+ * Strip a sub-address, i.e. the part of the local part from the first `+`
+ * up to the `@`, such that `alice+lists@example.org` becomes
+ * `alice@example.org`.
+ *
+ * A `+` at the beginning of the local part is kept.
+ */
+extern int const MAIL_ADDRESS_STRIP_TAG;
+
+/**
+ * Computes the normalized key of a mail address.
+ *
+ * The domain part (after the last `@`) is always lower-cased; the
+ * local part is transformed as requested by `options`.
+ * Two mail addresses refer to the same mailbox, if their keys are equal
+ * byte by byte.
+ * The key is never longer than the address.
+ *
+ * @param address The mail address; it need not be null-terminated
+ * @param len The length of `address`
+ * @param options A bitwise or of ::MAIL_ADDRESS_FOLD_LOCAL_PART and
+ * ::MAIL_ADDRESS_STRIP_TAG or zero
+ * @param key The buffer for the key with at least `len` bytes; the key is
+ * not null-terminated
+ * @return The length of the key
+ */
+size_t normalize_mail_address( char const * address, size_t len, int options, char* key );
+
+/**
+ * Computes the hash of a normalized key.
+ *
+ * @param key The key
+ * @param len The length of `key`
+ * @return The 64-bit FNV-1a hash of the key
+ */
+uint64_t hash_mail_address_key( char const * key, size_t len );
+
+#endif
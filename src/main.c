@@ -8,6 +8,7 @@
 #include "daemon.h"
 #include "service_manager.h"
 #include "extldap.h"
+#include "metrics_server.h"
 
 int main( int argc, char* argv[] ) {
 	int result_code = init_rt_setting();
@@ -73,6 +74,16 @@ int main( int argc, char* argv[] ) {
 		return result_code;
 	}
 
+	result_code = start_metrics_server();
+	if( result_code != EX_OK ) {
+		log_msg( LOG_NOTICE, "%s terminating ...\n", argv[0] );
+		notify_sm_failed( result_code, "initialization failed" );
+		disconnect_ldap();
+		close_log();
+		cleanup_rt_setting();
+		return result_code;
+	}
+
 	result_code = smfi_main();
 	if( result_code != MI_SUCCESS ) {
 		result_code = EX_SOFTWARE;
@@ -86,6 +97,9 @@ int main( int argc, char* argv[] ) {
 		notify_sm_failed( result_code, "disconnecting from LDAP failed" );
 	}
 
+	// After LDAP, as the background sync updates metrics as well
+	stop_metrics_server();
+
 	result_code = cleanup_smfi();
 	if( result_code != EX_OK ) {
 		result_code = EX_SOFTWARE;
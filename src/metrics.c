@@ -0,0 +1,452 @@
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "metrics.h"
+
+int const METRIC_ENVFROM_CALLBACKS = 0;
+int const METRIC_EOM_CALLBACKS = 1;
+int const METRIC_ABORT_CALLBACKS = 2;
+int const METRIC_CLOSE_CALLBACKS = 3;
+int const METRIC_LIST_CACHE_HITS = 4;
+int const METRIC_ACCT_CACHE_HITS = 5;
+int const METRIC_LIST_CACHE_MISSES = 6;
+int const METRIC_ACCT_CACHE_MISSES = 7;
+int const METRIC_BCCS_ADDED = 8;
+int const METRIC_LOOKUP_ERRORS = 9;
+int const METRIC_RECIPIENT_ERRORS = 10;
+int const METRIC_LDAP_RECONNECTS = 11;
+int const METRIC_LOG_DROPS = 12;
+
+/**
+ * The number of counters.
+ */
+#define COUNTER_COUNT 13
+
+int const METRIC_LDAP_LIST_LATENCY = 0;
+int const METRIC_LDAP_ACCT_LATENCY = 1;
+int const METRIC_LDAP_NESTED_LATENCY = 2;
+int const METRIC_LDAP_SYNC_LATENCY = 3;
+int const METRIC_ENVFROM_LATENCY = 4;
+int const METRIC_EOM_LATENCY = 5;
+int const METRIC_EXPAND_LATENCY = 6;
+int const METRIC_PARSE_LATENCY = 7;
+int const METRIC_SUBSTRACT_LATENCY = 8;
+int const METRIC_ADDRCPT_LATENCY = 9;
+
+/**
+ * The number of histograms.
+ */
+#define HISTOGRAM_COUNT 10
+
+int const METRIC_HISTOGRAM_COUNT = HISTOGRAM_COUNT;
+
+/**
+ * The number of bits below the most significant bit of a value which
+ * select its sub-bucket.
+ *
+ * Each power of two is split into `2^SUB_BUCKET_BITS` buckets of equal
+ * width, hence the relative error of a bucket is at most 12.5%.
+ */
+#define SUB_BUCKET_BITS 3
+
+#define SUB_BUCKET_COUNT ( 1 << SUB_BUCKET_BITS )
+
+/**
+ * The number of bits of the largest value which is recorded exactly; larger
+ * values are recorded in the last bucket.
+ *
+ * 2^36 microseconds are about 19 hours.
+ */
+#define VALUE_BITS 36
+
+/**
+ * The number of buckets of a histogram.
+ *
+ * Values below `SUB_BUCKET_COUNT` have a bucket each, every higher power of
+ * two has `SUB_BUCKET_COUNT` buckets.
+ */
+#define BUCKET_COUNT ( SUB_BUCKET_COUNT + ( VALUE_BITS - SUB_BUCKET_BITS ) * SUB_BUCKET_COUNT )
+
+/**
+ * The number of buckets which are exposed to Prometheus excluding the
+ * implicit `+Inf` bucket.
+ *
+ * The exposed buckets are the powers of four from 1µs to about 16.8s, which
+ * coincide with boundaries of the internal buckets.
+ */
+#define EXPOSED_BUCKET_COUNT 13
+
+/**
+ * The quantiles which are exposed and logged.
+ */
+static double const QUANTILES[] = { 0.5, 0.99, 0.999 };
+
+#define QUANTILE_COUNT ( sizeof( QUANTILES ) / sizeof( QUANTILES[0] ) )
+
+/**
+ * The description of a single time series.
+ *
+ * Time series of the same family must be adjacent.
+ */
+struct metric_descriptor_t {
+	char const * family; /**< The name of the metric family. */
+	char const * labels; /**< The labels which distinguish the series within the family or `NULL`. */
+	char const * help; /**< The help text of the family. */
+	char const * quantile_family; /**< The name of the gauge family for the quantiles of a histogram or `NULL`. */
+};
+
+static struct metric_descriptor_t const COUNTERS[COUNTER_COUNT] = {
+	{ "milter_alias_callbacks_total", "callback=\"envfrom\"", "Number of calls of milter callbacks.", NULL },
+	{ "milter_alias_callbacks_total", "callback=\"eom\"", NULL, NULL },
+	{ "milter_alias_callbacks_total", "callback=\"abort\"", NULL, NULL },
+	{ "milter_alias_callbacks_total", "callback=\"close\"", NULL, NULL },
+	{ "milter_alias_cache_hits_total", "cache=\"list\"", "Number of lookups which have been served from cache.", NULL },
+	{ "milter_alias_cache_hits_total", "cache=\"acct\"", NULL, NULL },
+	{ "milter_alias_cache_misses_total", "cache=\"list\"", "Number of lookups which have not been found in cache.", NULL },
+	{ "milter_alias_cache_misses_total", "cache=\"acct\"", NULL, NULL },
+	{ "milter_alias_bccs_added_total", NULL, "Number of recipients which have been added to messages.", NULL },
+	{ "milter_alias_errors_total", "type=\"lookup\"", "Number of errors.", NULL },
+	{ "milter_alias_errors_total", "type=\"recipient\"", NULL, NULL },
+	{ "milter_alias_ldap_reconnects_total", NULL, "Number of re-established LDAP connections.", NULL },
+	{ "milter_alias_log_drops_total", NULL, "Number of log messages which have been dropped, because the queue was full.", NULL }
+};
+
+static struct metric_descriptor_t const HISTOGRAMS[HISTOGRAM_COUNT] = {
+	{ "milter_alias_ldap_query_duration_seconds", "query=\"list\"", "Time the milter waited for the results of LDAP searches; searches sent with the envelope sender are timed from the end of the message on.", "milter_alias_ldap_query_duration_quantile_seconds" },
+	{ "milter_alias_ldap_query_duration_seconds", "query=\"acct\"", NULL, "milter_alias_ldap_query_duration_quantile_seconds" },
+	{ "milter_alias_ldap_query_duration_seconds", "query=\"nested\"", NULL, "milter_alias_ldap_query_duration_quantile_seconds" },
+	{ "milter_alias_ldap_query_duration_seconds", "query=\"sync\"", NULL, "milter_alias_ldap_query_duration_quantile_seconds" },
+	{ "milter_alias_phase_duration_seconds", "phase=\"envfrom\"", "Latency of processing phases of the milter.", "milter_alias_phase_duration_quantile_seconds" },
+	{ "milter_alias_phase_duration_seconds", "phase=\"eom\"", NULL, "milter_alias_phase_duration_quantile_seconds" },
+	{ "milter_alias_phase_duration_seconds", "phase=\"expand\"", NULL, "milter_alias_phase_duration_quantile_seconds" },
+	{ "milter_alias_phase_duration_seconds", "phase=\"parse\"", NULL, "milter_alias_phase_duration_quantile_seconds" },
+	{ "milter_alias_phase_duration_seconds", "phase=\"substract\"", NULL, "milter_alias_phase_duration_quantile_seconds" },
+	{ "milter_alias_phase_duration_seconds", "phase=\"addrcpt\"", NULL, "milter_alias_phase_duration_quantile_seconds" }
+};
+
+/**
+ * The metrics of a single thread.
+ *
+ * Only the owning thread writes to a shard, hence updates need not be
+ * read-modify-write operations; they are atomic only such that
+ * ::format_metrics() reads consistent values.
+ * A shard outlives its thread and is handed over to the next new thread,
+ * such that the number of shards is bounded by the maximum number of
+ * concurrent threads and no counts get lost.
+ */
+struct metrics_shard_t {
+	struct metrics_shard_t* next; /**< The next shard; immutable after the shard has been published. */
+	atomic_int is_used; /**< Non-zero, if the shard is owned by a thread. */
+	_Atomic uint64_t counters[COUNTER_COUNT]; /**< The counters. */
+	_Atomic uint64_t buckets[HISTOGRAM_COUNT][BUCKET_COUNT]; /**< The non-cumulative bucket counts. */
+	_Atomic uint64_t sums[HISTOGRAM_COUNT]; /**< The sums of all observations in microseconds. */
+};
+
+/**
+ * The list of all shards; shards are only prepended.
+ */
+static struct metrics_shard_t* _Atomic shards = NULL;
+
+static atomic_int is_enabled = 0;
+
+static pthread_once_t shard_key_once = PTHREAD_ONCE_INIT;
+
+/**
+ * The key whose destructor releases the shard of an exiting thread.
+ */
+static pthread_key_t shard_key;
+
+static _Thread_local struct metrics_shard_t* local_shard = NULL;
+
+/**
+ * The merged bucket counts at the time of the previous summary.
+ *
+ * Only used by ::format_metric_summary().
+ */
+static uint64_t summary_baselines[HISTOGRAM_COUNT][BUCKET_COUNT];
+
+static void release_shard( void* shard ) {
+	atomic_store_explicit( &( (struct metrics_shard_t*)shard )->is_used, 0, memory_order_release );
+}
+
+static void create_shard_key( void ) {
+	pthread_key_create( &shard_key, release_shard );
+}
+
+/**
+ * Returns the shard of the calling thread.
+ *
+ * On first use, the thread takes over a shard of an exited thread or
+ * publishes a new shard.
+ *
+ * @return The shard or `NULL`, if it could not be allocated
+ */
+static struct metrics_shard_t* get_local_shard( void ) {
+	if( local_shard != NULL )
+		return local_shard;
+	pthread_once( &shard_key_once, create_shard_key );
+	struct metrics_shard_t* shard = atomic_load_explicit( &shards, memory_order_acquire );
+	for( ; shard != NULL; shard = shard->next ) {
+		int expected = 0;
+		if( atomic_compare_exchange_strong_explicit( &shard->is_used, &expected, 1, memory_order_acquire, memory_order_relaxed ) )
+			break;
+	}
+	if( shard == NULL ) {
+		shard = calloc( 1, sizeof( struct metrics_shard_t ) );
+		if( shard == NULL )
+			return NULL;
+		atomic_init( &shard->is_used, 1 );
+		shard->next = atomic_load_explicit( &shards, memory_order_relaxed );
+		while( !atomic_compare_exchange_weak_explicit( &shards, &shard->next, shard, memory_order_release, memory_order_relaxed ) )
+			;
+	}
+	pthread_setspecific( shard_key, shard );
+	local_shard = shard;
+	return shard;
+}
+
+/**
+ * Adds a value to a metric of the own shard.
+ */
+static void add_relaxed( _Atomic uint64_t* const metric, uint64_t const value ) {
+	atomic_store_explicit( metric, atomic_load_explicit( metric, memory_order_relaxed ) + value, memory_order_relaxed );
+}
+
+void enable_metrics( void ) {
+	atomic_store( &is_enabled, 1 );
+}
+
+int are_metrics_enabled( void ) {
+	return atomic_load_explicit( &is_enabled, memory_order_relaxed );
+}
+
+void count_metric( int counter, uint64_t value ) {
+	if( !are_metrics_enabled() )
+		return;
+	struct metrics_shard_t* const shard = get_local_shard();
+	if( shard != NULL )
+		add_relaxed( &shard->counters[counter], value );
+}
+
+uint64_t start_metric_observation( void ) {
+	if( !are_metrics_enabled() )
+		return 0;
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+/**
+ * Returns the index of the bucket of a value.
+ */
+static size_t get_bucket_index( uint64_t const value ) {
+	if( value < SUB_BUCKET_COUNT )
+		return (size_t)value;
+	int const msb = 63 - __builtin_clzll( value );
+	if( msb >= VALUE_BITS )
+		return BUCKET_COUNT - 1;
+	size_t const sub_bucket = (size_t)( value >> ( msb - SUB_BUCKET_BITS ) ) & ( SUB_BUCKET_COUNT - 1 );
+	return SUB_BUCKET_COUNT + (size_t)( msb - SUB_BUCKET_BITS ) * SUB_BUCKET_COUNT + sub_bucket;
+}
+
+/**
+ * Returns the largest value of a bucket.
+ */
+static uint64_t get_bucket_upper_bound( size_t const bucket ) {
+	if( bucket < SUB_BUCKET_COUNT )
+		return bucket;
+	size_t const shift = ( bucket - SUB_BUCKET_COUNT ) / SUB_BUCKET_COUNT;
+	uint64_t const sub_bucket = ( bucket - SUB_BUCKET_COUNT ) % SUB_BUCKET_COUNT;
+	return ( ( SUB_BUCKET_COUNT + sub_bucket + 1 ) << shift ) - 1;
+}
+
+void observe_metric( int histogram, uint64_t start ) {
+	if( !are_metrics_enabled() || start == 0 )
+		return;
+	uint64_t const now = start_metric_observation();
+	uint64_t const duration = now > start ? now - start : 0;
+	struct metrics_shard_t* const shard = get_local_shard();
+	if( shard == NULL )
+		return;
+	add_relaxed( &shard->buckets[histogram][get_bucket_index( duration )], 1 );
+	add_relaxed( &shard->sums[histogram], duration );
+}
+
+/**
+ * Sums up the buckets of a histogram over all shards.
+ *
+ * @param buckets Receives the non-cumulative bucket counts
+ * @return The sum of all observations in microseconds
+ */
+static uint64_t merge_histogram( int const histogram, uint64_t buckets[BUCKET_COUNT] ) {
+	uint64_t sum = 0;
+	for( size_t j = 0; j != BUCKET_COUNT; ++j )
+		buckets[j] = 0;
+	struct metrics_shard_t* shard = atomic_load_explicit( &shards, memory_order_acquire );
+	for( ; shard != NULL; shard = shard->next ) {
+		for( size_t j = 0; j != BUCKET_COUNT; ++j )
+			buckets[j] += atomic_load_explicit( &shard->buckets[histogram][j], memory_order_relaxed );
+		sum += atomic_load_explicit( &shard->sums[histogram], memory_order_relaxed );
+	}
+	return sum;
+}
+
+/**
+ * Returns the value below or at which a fraction of the observations lie.
+ *
+ * Like HDR histograms, the result is the largest value of the bucket which
+ * contains the quantile.
+ *
+ * @param buckets The non-cumulative bucket counts
+ * @param count The total count of all buckets
+ * @param quantile The quantile between 0 and 1
+ * @return The value in microseconds or zero, if `count` is zero
+ */
+static uint64_t get_quantile( uint64_t const buckets[BUCKET_COUNT], uint64_t const count, double const quantile ) {
+	if( count == 0 )
+		return 0;
+	uint64_t rank = (uint64_t)( quantile * (double)count + 0.999999 );
+	if( rank == 0 )
+		rank = 1;
+	uint64_t cumulative = 0;
+	for( size_t j = 0; j != BUCKET_COUNT; ++j ) {
+		cumulative += buckets[j];
+		if( cumulative >= rank )
+			return get_bucket_upper_bound( j );
+	}
+	return get_bucket_upper_bound( BUCKET_COUNT - 1 );
+}
+
+/**
+ * Appends formatted text to the buffer as far as it fits, but always
+ * advances the position by the full length.
+ */
+static void append_format( char* const buf, size_t const size, size_t* const pos, char const * const format, ... ) {
+	va_list args;
+	va_start( args, format );
+	int const len = vsnprintf( *pos < size ? buf + *pos : NULL, *pos < size ? size - *pos : 0, format, args );
+	va_end( args );
+	if( len > 0 )
+		*pos += (size_t)len;
+}
+
+/**
+ * Appends the `HELP` and `TYPE` lines, if a new family starts.
+ */
+static void append_family_header(
+	char* const buf,
+	size_t const size,
+	size_t* const pos,
+	struct metric_descriptor_t const * const descriptor,
+	char const * const type
+) {
+	if( descriptor->help == NULL )
+		return;
+	append_format( buf, size, pos, "# HELP %s %s\n", descriptor->family, descriptor->help );
+	append_format( buf, size, pos, "# TYPE %s %s\n", descriptor->family, type );
+}
+
+size_t format_metrics( char* buf, size_t size ) {
+	struct metrics_shard_t* const first = atomic_load_explicit( &shards, memory_order_acquire );
+	size_t pos = 0;
+	for( int i = 0; i != COUNTER_COUNT; ++i ) {
+		uint64_t value = 0;
+		for( struct metrics_shard_t* shard = first; shard != NULL; shard = shard->next )
+			value += atomic_load_explicit( &shard->counters[i], memory_order_relaxed );
+		append_family_header( buf, size, &pos, &COUNTERS[i], "counter" );
+		if( COUNTERS[i].labels != NULL )
+			append_format( buf, size, &pos, "%s{%s} %llu\n", COUNTERS[i].family, COUNTERS[i].labels, (unsigned long long)value );
+		else
+			append_format( buf, size, &pos, "%s %llu\n", COUNTERS[i].family, (unsigned long long)value );
+	}
+	uint64_t quantiles[HISTOGRAM_COUNT][QUANTILE_COUNT];
+	for( int i = 0; i != HISTOGRAM_COUNT; ++i ) {
+		uint64_t buckets[BUCKET_COUNT];
+		uint64_t const sum = merge_histogram( i, buckets );
+		struct metric_descriptor_t const * const descriptor = &HISTOGRAMS[i];
+		append_family_header( buf, size, &pos, descriptor, "histogram" );
+		uint64_t count = 0;
+		size_t j = 0;
+		for( int k = 0; k != EXPOSED_BUCKET_COUNT; ++k ) {
+			// Durations are truncated to microseconds, hence a duration of
+			// at most `bound` has been recorded as a value below `bound`
+			uint64_t const bound = UINT64_C( 1 ) << ( 2 * k );
+			for( ; get_bucket_upper_bound( j ) < bound; ++j )
+				count += buckets[j];
+			append_format(
+				buf, size, &pos, "%s_bucket{%s,le=\"%.6f\"} %llu\n",
+				descriptor->family, descriptor->labels, bound / 1e6, (unsigned long long)count
+			);
+		}
+		for( ; j != BUCKET_COUNT; ++j )
+			count += buckets[j];
+		append_format(
+			buf, size, &pos, "%s_bucket{%s,le=\"+Inf\"} %llu\n",
+			descriptor->family, descriptor->labels, (unsigned long long)count
+		);
+		append_format( buf, size, &pos, "%s_sum{%s} %.6f\n", descriptor->family, descriptor->labels, sum / 1e6 );
+		append_format( buf, size, &pos, "%s_count{%s} %llu\n", descriptor->family, descriptor->labels, (unsigned long long)count );
+		for( size_t q = 0; q != QUANTILE_COUNT; ++q )
+			quantiles[i][q] = get_quantile( buckets, count, QUANTILES[q] );
+	}
+	for( int i = 0; i != HISTOGRAM_COUNT; ++i ) {
+		struct metric_descriptor_t const * const descriptor = &HISTOGRAMS[i];
+		if( descriptor->help != NULL ) {
+			append_format( buf, size, &pos, "# HELP %s Quantiles of %s\n", descriptor->quantile_family, descriptor->family );
+			append_format( buf, size, &pos, "# TYPE %s gauge\n", descriptor->quantile_family );
+		}
+		for( size_t q = 0; q != QUANTILE_COUNT; ++q ) {
+			append_format(
+				buf, size, &pos, "%s{%s,quantile=\"%g\"} %.6f\n",
+				descriptor->quantile_family, descriptor->labels, QUANTILES[q], quantiles[i][q] / 1e6
+			);
+		}
+	}
+	if( size != 0 )
+		buf[ pos < size ? pos : size - 1 ] = '\0';
+	return pos;
+}
+
+size_t format_metric_summary( int histogram, char* buf, size_t size ) {
+	uint64_t buckets[BUCKET_COUNT];
+	merge_histogram( histogram, buckets );
+	uint64_t count = 0;
+	for( size_t j = 0; j != BUCKET_COUNT; ++j ) {
+		uint64_t const total = buckets[j];
+		buckets[j] = total - summary_baselines[histogram][j];
+		summary_baselines[histogram][j] = total;
+		count += buckets[j];
+	}
+	size_t pos = 0;
+	if( count != 0 ) {
+		append_format( buf, size, &pos, "%s count=%llu", HISTOGRAMS[histogram].labels, (unsigned long long)count );
+		for( size_t q = 0; q != QUANTILE_COUNT; ++q ) {
+			append_format(
+				buf, size, &pos, " p%g=%.3fms",
+				QUANTILES[q] * 100, get_quantile( buckets, count, QUANTILES[q] ) / 1e3
+			);
+		}
+	}
+	if( size != 0 )
+		buf[ pos < size ? pos : size - 1 ] = '\0';
+	return pos;
+}
+
+void free_metrics( void ) {
+	atomic_store( &is_enabled, 0 );
+	struct metrics_shard_t* shard = atomic_exchange( &shards, NULL );
+	memset( summary_baselines, 0, sizeof( summary_baselines ) );
+	while( shard != NULL ) {
+		struct metrics_shard_t* const next = shard->next;
+		free( shard );
+		shard = next;
+	}
+	local_shard = NULL;
+	pthread_once( &shard_key_once, create_shard_key );
+	pthread_setspecific( shard_key, NULL );
+}
@@ -0,0 +1,125 @@
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+/**
+ * @file
+ * @brief Counters and histograms which are exposed in the text format of
+ * Prometheus.
+ *
+ * Each thread updates its own copy of all metrics without any locks or
+ * atomic read-modify-write operations; the copies are only summed up
+ * when the metrics are formatted.
+ * Unless ::enable_metrics() has been called, updating a metric is a no-op.
+ *
+ * Histograms record durations in microseconds in log-bucketed buckets
+ * with a relative error of at most 12.5%, similar to HDR histograms.
+ * Besides the buckets, their quantiles are exposed as gauges.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+extern int const METRIC_ENVFROM_CALLBACKS; /**< Counter of calls of the envelope sender callback. */
+extern int const METRIC_EOM_CALLBACKS; /**< Counter of calls of the end of message callback. */
+extern int const METRIC_ABORT_CALLBACKS; /**< Counter of calls of the abort callback. */
+extern int const METRIC_CLOSE_CALLBACKS; /**< Counter of calls of the close callback. */
+extern int const METRIC_LIST_CACHE_HITS; /**< Counter of hits of the mailing list cache. */
+extern int const METRIC_LIST_CACHE_MISSES; /**< Counter of misses of the mailing list cache. */
+extern int const METRIC_ACCT_CACHE_HITS; /**< Counter of hits of the account cache. */
+extern int const METRIC_ACCT_CACHE_MISSES; /**< Counter of misses of the account cache. */
+extern int const METRIC_BCCS_ADDED; /**< Counter of recipients added to messages. */
+extern int const METRIC_LOOKUP_ERRORS; /**< Counter of messages whose aliases could not be resolved. */
+extern int const METRIC_RECIPIENT_ERRORS; /**< Counter of recipients which could not be added. */
+extern int const METRIC_LDAP_RECONNECTS; /**< Counter of re-established LDAP connections. */
+extern int const METRIC_LOG_DROPS; /**< Counter of log messages dropped due to a full queue. */
+
+extern int const METRIC_LDAP_LIST_LATENCY; /**< Histogram of the time waited for searches for mailing lists at the end of the message. */
+extern int const METRIC_LDAP_ACCT_LATENCY; /**< Histogram of the time waited for searches for accounts at the end of the message. */
+extern int const METRIC_LDAP_NESTED_LATENCY; /**< Histogram of the latency of searches for nested mailing lists. */
+extern int const METRIC_LDAP_SYNC_LATENCY; /**< Histogram of the duration of loading the local snapshot. */
+extern int const METRIC_ENVFROM_LATENCY; /**< Histogram of the duration of the envelope sender callback. */
+extern int const METRIC_EOM_LATENCY; /**< Histogram of the duration of the end of message callback. */
+extern int const METRIC_EXPAND_LATENCY; /**< Histogram of the duration of expanding search filter templates. */
+extern int const METRIC_PARSE_LATENCY; /**< Histogram of the duration of parsing search results. */
+extern int const METRIC_SUBSTRACT_LATENCY; /**< Histogram of the duration of removing the own addresses from the list members. */
+extern int const METRIC_ADDRCPT_LATENCY; /**< Histogram of the duration of adding all recipients of a message. */
+
+extern int const METRIC_HISTOGRAM_COUNT; /**< The number of histograms; the histogram constants range from zero to this number exclusive. */
+
+/**
+ * Enables the metrics.
+ *
+ * Metrics are disabled initially, such that the hot paths do not pay for
+ * them, if nobody scrapes them.
+ * The function must be called before any milter thread is started.
+ */
+void enable_metrics( void );
+
+/**
+ * Returns non-zero, if the metrics are enabled.
+ */
+int are_metrics_enabled( void );
+
+/**
+ * Increases a counter.
+ *
+ * @param counter One of the counter constants `METRIC_...`
+ * @param value The amount by which the counter is increased
+ */
+void count_metric( int counter, uint64_t value );
+
+/**
+ * Returns the current time on the monotonic clock in microseconds as the
+ * start of an observation for ::observe_metric().
+ *
+ * @return The current time or zero, if the metrics are disabled
+ */
+uint64_t start_metric_observation( void );
+
+/**
+ * Records the time which has passed since the start of an observation in
+ * a histogram.
+ *
+ * @param histogram One of the histogram constants `METRIC_...`
+ * @param start The value returned by ::start_metric_observation()
+ */
+void observe_metric( int histogram, uint64_t start );
+
+/**
+ * Formats the sum of all metrics of all threads in the text format of
+ * Prometheus.
+ *
+ * Like `snprintf`, the function writes at most `size` bytes including the
+ * terminating null byte and returns the length of the complete text.
+ *
+ * @param buf The buffer; may be `NULL`, if `size` is zero
+ * @param size The size of `buf` in bytes
+ * @return The length of the complete text excluding the terminating null
+ * byte
+ */
+size_t format_metrics( char* buf, size_t size );
+
+/**
+ * Formats the count and the quantiles of the observations of a histogram
+ * since the previous summary of the same histogram into a line for the log.
+ *
+ * Like `snprintf`, the function writes at most `size` bytes including the
+ * terminating null byte and returns the length of the complete text.
+ * The function must not be called concurrently.
+ *
+ * @param histogram One of the histogram constants `METRIC_...`
+ * @param buf The buffer; may be `NULL`, if `size` is zero
+ * @param size The size of `buf` in bytes
+ * @return The length of the complete text excluding the terminating null
+ * byte; zero, if there have been no observations
+ */
+size_t format_metric_summary( int histogram, char* buf, size_t size );
+
+/**
+ * Frees the memory of all threads and disables the metrics.
+ *
+ * No thread must update a metric concurrently.
+ */
+void free_metrics( void );
+
+#endif
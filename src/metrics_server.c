@@ -0,0 +1,298 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+#include "metrics_server.h"
+#include "metrics.h"
+#include "extfile.h"
+#include "runtime_setting.h"
+#include "log.h"
+
+/**
+ * The maximum number of bytes of a request which are read; the request is
+ * ignored anyway.
+ */
+#define REQUEST_BUFFER_SIZE 4096
+
+/**
+ * The time in seconds a client may take to send its request and, while it
+ * receives the response, to accept more data.
+ */
+static int const REQUEST_TIMEOUT = 1;
+
+static char const * const INET_PREFIX = "inet:";
+
+static char const * const UNIX_PREFIX = "unix:";
+
+/**
+ * The state of the metrics server.
+ */
+struct metrics_server_t {
+	int listen_fd; /**< The listening socket or `-1`. */
+	int stop_pipe[2]; /**< A pipe which becomes readable, if the thread shall stop. */
+	int is_running; /**< Non-zero, if the thread has been started. */
+	pthread_t thread; /**< The thread. */
+	char* unix_path; /**< The path of the Unix socket which is removed on stop or `NULL`. */
+};
+
+static struct metrics_server_t metrics_server = { -1, { -1, -1 }, 0, 0, NULL };
+
+/**
+ * Opens a TCP socket on the loopback interface.
+ *
+ * @param port The port as a string
+ * @return The listening socket or `-1` in case of an error
+ */
+static int open_inet_socket( char const * const port ) {
+	char* end = NULL;
+	unsigned long const parsed = strtoul( port, &end, 10 );
+	if( *port == '\0' || *end != '\0' || parsed == 0 || parsed > 65535 ) {
+		log_msg( LOG_ERR, "open_inet_socket: invalid port: %s\n", port );
+		errno = EINVAL;
+		return -1;
+	}
+	int const fd = socket( AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+	if( fd == -1 )
+		return -1;
+	int const reuse = 1;
+	setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof( reuse ) );
+	struct sockaddr_in addr;
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons( (uint16_t)parsed );
+	addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	if( bind( fd, (struct sockaddr*)&addr, sizeof( addr ) ) != 0 ) {
+		close( fd );
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * Opens a Unix socket and remembers its path for removal.
+ *
+ * @return The listening socket or `-1` in case of an error
+ */
+static int open_unix_socket( char const * const path ) {
+	struct sockaddr_un addr;
+	memset( &addr, 0, sizeof( addr ) );
+	if( strlen( path ) >= sizeof( addr.sun_path ) ) {
+		log_msg( LOG_ERR, "open_unix_socket: path too long: %s\n", path );
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	if( mkpdir( path, 0755 ) != 0 && errno != EEXIST )
+		return -1;
+	// Remove a stale socket of a previous run
+	unlink( path );
+	int const fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+	if( fd == -1 )
+		return -1;
+	addr.sun_family = AF_UNIX;
+	strcpy( addr.sun_path, path );
+	if( bind( fd, (struct sockaddr*)&addr, sizeof( addr ) ) != 0 ) {
+		close( fd );
+		return -1;
+	}
+	metrics_server.unix_path = malloc( strlen( path ) + 1 );
+	if( metrics_server.unix_path != NULL )
+		strcpy( metrics_server.unix_path, path );
+	return fd;
+}
+
+/**
+ * Writes the entire buffer to a socket.
+ *
+ * @return Zero on success, non-zero in case of an error
+ */
+static int send_all( int const fd, char const * buf, size_t len ) {
+	while( len != 0 ) {
+		ssize_t const sent = send( fd, buf, len, MSG_NOSIGNAL );
+		if( sent == -1 && errno == EINTR )
+			continue;
+		if( sent <= 0 )
+			return -1;
+		buf += sent;
+		len -= (size_t)sent;
+	}
+	return 0;
+}
+
+/**
+ * Reads the request of a client and answers it with the metrics.
+ */
+static void serve_metrics_request( int const fd ) {
+	struct timeval const timeout = { REQUEST_TIMEOUT, 0 };
+	setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+	// The server thread answers one client at a time, hence a client which
+	// does not read the response must not block it either
+	setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof( timeout ) );
+	char request[REQUEST_BUFFER_SIZE];
+	size_t request_len = 0;
+	while( request_len < sizeof( request ) - 1 ) {
+		ssize_t const received = recv( fd, request + request_len, sizeof( request ) - 1 - request_len, 0 );
+		if( received <= 0 )
+			break;
+		request_len += (size_t)received;
+		request[request_len] = '\0';
+		if( strstr( request, "\r\n\r\n" ) != NULL || strstr( request, "\n\n" ) != NULL )
+			break;
+	}
+
+	size_t const body_len = format_metrics( NULL, 0 );
+	char* const body = malloc( body_len + 1 );
+	if( body == NULL ) {
+		static char const error[] = "HTTP/1.0 500 Internal Server Error\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+		send_all( fd, error, sizeof( error ) - 1 );
+		return;
+	}
+	// Counters may have grown in between, but never shrink; the second
+	// call is bounded by the buffer anyway
+	size_t const len = format_metrics( body, body_len + 1 );
+	size_t const used_len = len < body_len ? len : body_len;
+	char header[256];
+	int const header_len = snprintf(
+		header, sizeof( header ),
+		"HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+		used_len
+	);
+	if( send_all( fd, header, (size_t)header_len ) == 0 )
+		send_all( fd, body, used_len );
+	free( body );
+}
+
+/**
+ * Logs the quantiles of all histograms which have observations since the
+ * previous call.
+ */
+static void log_metric_summaries( void ) {
+	char summary[256];
+	for( int i = 0; i != METRIC_HISTOGRAM_COUNT; ++i ) {
+		if( format_metric_summary( i, summary, sizeof( summary ) ) != 0 )
+			log_msg( LOG_INFO, "latency: %s\n", summary );
+	}
+}
+
+/**
+ * Returns the current time on the monotonic clock in milliseconds.
+ */
+static long long get_monotonic_msec( void ) {
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void* run_metrics_server( void* arg ) {
+	(void)arg;
+	// poll ignores the listening socket, if it is -1
+	struct pollfd fds[2] = {
+		{ metrics_server.listen_fd, POLLIN, 0 },
+		{ metrics_server.stop_pipe[0], POLLIN, 0 }
+	};
+	long long const log_interval = (long long)rt_setting.latency_log_interval * 1000;
+	long long next_log = get_monotonic_msec() + log_interval;
+	for( ;; ) {
+		int timeout = -1;
+		if( log_interval != 0 ) {
+			long long const now = get_monotonic_msec();
+			if( now >= next_log ) {
+				log_metric_summaries();
+				next_log = now + log_interval;
+			}
+			timeout = (int)( next_log - now < INT_MAX ? next_log - now : INT_MAX );
+		}
+		int const ready = poll( fds, 2, timeout );
+		if( ready == -1 ) {
+			if( errno == EINTR )
+				continue;
+			log_msg( LOG_ERR, "run_metrics_server: poll failed: %s\n", strerror( errno ) );
+			break;
+		}
+		if( fds[1].revents != 0 )
+			break;
+		if( ready == 0 || fds[0].revents == 0 )
+			continue;
+		int const fd = accept4( metrics_server.listen_fd, NULL, NULL, SOCK_CLOEXEC );
+		if( fd == -1 ) {
+			if( errno != EINTR && errno != ECONNABORTED )
+				log_msg( LOG_WARNING, "run_metrics_server: accept failed: %s\n", strerror( errno ) );
+			continue;
+		}
+		serve_metrics_request( fd );
+		close( fd );
+	}
+	return NULL;
+}
+
+int start_metrics_server( void ) {
+	char const * const socket_spec = rt_setting.metrics_socket;
+	if( socket_spec == NULL && rt_setting.latency_log_interval == 0 )
+		return EX_OK;
+
+	if( socket_spec != NULL ) {
+		if( strncmp( socket_spec, INET_PREFIX, strlen( INET_PREFIX ) ) == 0 ) {
+			metrics_server.listen_fd = open_inet_socket( socket_spec + strlen( INET_PREFIX ) );
+		} else {
+			char const * const path = strncmp( socket_spec, UNIX_PREFIX, strlen( UNIX_PREFIX ) ) == 0 ?
+				socket_spec + strlen( UNIX_PREFIX ) : socket_spec;
+			metrics_server.listen_fd = open_unix_socket( path );
+		}
+		if( metrics_server.listen_fd == -1 || listen( metrics_server.listen_fd, 8 ) != 0 ) {
+			log_msg( LOG_ERR, "start_metrics_server: could not listen on %s: %s\n", socket_spec, strerror( errno ) );
+			stop_metrics_server();
+			return EX_UNAVAILABLE;
+		}
+	}
+	if( pipe2( metrics_server.stop_pipe, O_CLOEXEC ) != 0 ) {
+		log_msg( LOG_ERR, "start_metrics_server: could not create pipe: %s\n", strerror( errno ) );
+		stop_metrics_server();
+		return EX_OSERR;
+	}
+
+	enable_metrics();
+	if( pthread_create( &metrics_server.thread, NULL, run_metrics_server, NULL ) != 0 ) {
+		log_msg( LOG_ERR, "start_metrics_server: could not create thread\n" );
+		stop_metrics_server();
+		return EX_OSERR;
+	}
+	metrics_server.is_running = 1;
+	if( socket_spec != NULL )
+		log_msg( LOG_INFO, "start_metrics_server: serving metrics on %s\n", socket_spec );
+	return EX_OK;
+}
+
+void stop_metrics_server( void ) {
+	if( metrics_server.is_running ) {
+		char const stop = 1;
+		ssize_t const written = write( metrics_server.stop_pipe[1], &stop, 1 );
+		(void)written;
+		pthread_join( metrics_server.thread, NULL );
+		metrics_server.is_running = 0;
+	}
+	for( int i = 0; i != 2; ++i ) {
+		if( metrics_server.stop_pipe[i] != -1 )
+			close( metrics_server.stop_pipe[i] );
+		metrics_server.stop_pipe[i] = -1;
+	}
+	if( metrics_server.listen_fd != -1 )
+		close( metrics_server.listen_fd );
+	metrics_server.listen_fd = -1;
+	if( metrics_server.unix_path != NULL )
+		unlink( metrics_server.unix_path );
+	free( metrics_server.unix_path );
+	metrics_server.unix_path = NULL;
+	free_metrics();
+}
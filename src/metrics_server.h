@@ -0,0 +1,32 @@
+#ifndef _METRICS_SERVER_H_
+#define _METRICS_SERVER_H_
+
+/**
+ * @file
+ * @brief Functions for serving the metrics over HTTP and logging them.
+ */
+
+/**
+ * Enables the metrics and starts a thread which serves them to Prometheus
+ * and logs latency quantiles periodically.
+ *
+ * The function is a no-op, if ::rt_setting_t::metrics_socket is `NULL` and
+ * ::rt_setting_t::latency_log_interval is zero.
+ * The thread answers each HTTP request on the socket with the output of
+ * ::format_metrics(), regardless of the method and path of the request.
+ * Every ::rt_setting_t::latency_log_interval seconds, it logs the output of
+ * ::format_metric_summary() for each histogram with new observations.
+ *
+ * @return `EX_OK` on success, an error code from `sysexits.h` otherwise
+ */
+int start_metrics_server( void );
+
+/**
+ * Stops the thread, closes the socket and frees the metrics.
+ *
+ * Note, the function is safe to be called, even if
+ * ::start_metrics_server() has not been called or has failed.
+ */
+void stop_metrics_server( void );
+
+#endif
@@ -0,0 +1,113 @@
+#include <string.h>
+#include <strings.h>
+#include <sysexits.h>
+
+#include "nested_list.h"
+#include "arena.h"
+
+/**
+ * Appends all strings of one array to another array.
+ *
+ * @return Zero on success, non-zero in case of an error
+ */
+static int append_string_array( struct string_array_t* const array, struct string_array_t const * const other ) {
+	size_t const size = get_string_array_size( other );
+	for( size_t i = 0; i != size; ++i ) {
+		if( push_onto_string_array( array, get_string_array_at( other, i ) ) == NULL )
+			return -1;
+	}
+	return 0;
+}
+
+/**
+ * Creates an empty array of mail addresses in an arena.
+ */
+static struct string_array_t* create_address_array( struct arena_t* const arena, size_t const capacity, int const normalization ) {
+	struct string_array_t* const result = create_string_array_arena( arena, capacity != 0 ? capacity : 1 );
+	if( result != NULL && set_mail_address_normalization( result, normalization ) != EX_OK )
+		return NULL;
+	return result;
+}
+
+int expand_nested_lists(
+	struct arena_t* const arena,
+	char const * const list,
+	struct string_array_t* const members,
+	unsigned int const depth,
+	int const normalization,
+	nested_list_resolver_t const resolve,
+	void* const context,
+	struct string_array_t** const expanded
+) {
+	*expanded = NULL;
+	struct string_array_t* frontier = members;
+	size_t const size = get_string_array_size( frontier );
+	struct string_array_t* const visited = create_address_array( arena, 2 * size + 1, normalization );
+	struct string_array_t* const result = create_address_array( arena, size, normalization );
+	if( visited == NULL || result == NULL || push_onto_string_array( visited, list ) == NULL )
+		return EX_OSERR;
+
+	int result_code = EX_OK;
+	for( unsigned int level = 1; result_code == EX_OK; ++level ) {
+		if( substract_mail_addresses( frontier, visited ) != EX_OK ) {
+			result_code = EX_OSERR;
+			break;
+		}
+		size_t const frontier_size = get_string_array_size( frontier );
+		if( frontier_size == 0 )
+			break;
+		if( level >= depth ) {
+			if( append_string_array( result, frontier ) != 0 )
+				result_code = EX_OSERR;
+			break;
+		}
+		struct string_array_t** const results = alloc_from_arena( arena, frontier_size * sizeof( struct string_array_t* ) );
+		struct string_array_t* const next = create_address_array( arena, frontier_size, normalization );
+		if( results == NULL || next == NULL || append_string_array( visited, frontier ) != 0 ) {
+			result_code = EX_OSERR;
+			break;
+		}
+		for( size_t i = 0; i != frontier_size; ++i )
+			results[i] = NULL;
+		result_code = resolve( context, frontier, level, results );
+		for( size_t i = 0; i != frontier_size; ++i ) {
+			if( result_code == EX_OK ) {
+				if( get_string_array_size( results[i] ) == 0 ) {
+					// An address which is not a list is a member itself
+					if( push_onto_string_array( result, get_string_array_at( frontier, i ) ) == NULL )
+						result_code = EX_OSERR;
+				} else {
+					if( append_string_array( next, results[i] ) != 0 )
+						result_code = EX_OSERR;
+				}
+			}
+			if( results[i] != NULL )
+				free_string_array( results[i] );
+		}
+		if( frontier != members )
+			free_string_array( frontier );
+		frontier = next;
+	}
+	if( frontier != members )
+		free_string_array( frontier );
+	if( result_code == EX_OK )
+		*expanded = result;
+	return result_code;
+}
+
+size_t match_nested_list_key(
+	char const * const * const keys,
+	size_t const count,
+	char const * const value,
+	size_t const len,
+	int* const is_match
+) {
+	size_t match_count = 0;
+	for( size_t i = 0; i != count; ++i ) {
+		if( strlen( keys[i] ) == len && strncasecmp( value, keys[i], len ) == 0 ) {
+			is_match[i] = 1;
+			++match_count;
+		}
+	}
+	return match_count;
+}
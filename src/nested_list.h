@@ -0,0 +1,99 @@
+#ifndef _NESTED_LIST_H_
+#define _NESTED_LIST_H_
+
+/**
+ * @file
+ * @brief Functions to expand mailing lists which are members of other
+ * mailing lists.
+ */
+
+#include <stddef.h>
+
+#include "string_array.h"
+
+struct arena_t;
+
+/**
+ * Determines for each of a set of mail addresses, whether it is a mailing
+ * list, and its members.
+ *
+ * @param context The context which has been passed to
+ * ::expand_nested_lists()
+ * @param addresses The mail addresses
+ * @param level The nesting level of the addresses, starting at one for the
+ * members of the top-level list
+ * @param results Output array with one element per address; the members
+ * of the list or an empty array, if the address is not a list.
+ * Elements are `NULL` initially and may remain `NULL` in case of an error.
+ * The caller frees the elements, even in case of an error.
+ * @return `EX_OK` on success, an error code from `sysexits.h` otherwise
+ */
+typedef int (*nested_list_resolver_t)(
+	void* context,
+	struct string_array_t const * addresses,
+	unsigned int level,
+	struct string_array_t** results
+);
+
+/**
+ * Replaces members of a mailing list which are mailing lists themselves
+ * by their members.
+ *
+ * Nested lists are expanded level by level up to `depth` levels; the lists
+ * of one level are resolved together by a single call of `resolve`.
+ * Every address is resolved at most once, which also breaks cycles: an
+ * address which has already been seen, including the mailing list itself,
+ * is dropped.
+ * Members of the last level are kept as they are.
+ *
+ * @param arena The arena from which intermediate arrays and the result are
+ * allocated
+ * @param list The address of the mailing list
+ * @param members The members of the mailing list; may be reordered
+ * @param depth The maximum number of levels; one keeps all members as they
+ * are
+ * @param normalization The normalization options of the arrays, see
+ * ::set_mail_address_normalization()
+ * @param resolve The function which resolves the addresses of a level
+ * @param context The context which is passed to `resolve`
+ * @param expanded Output parameter for the expanded members in `arena`;
+ * the order of the members is unspecified
+ * @return `EX_OK` on success, `EX_OSERR` if memory could not be allocated
+ * or an error code returned by `resolve`
+ */
+int expand_nested_lists(
+	struct arena_t* arena,
+	char const * list,
+	struct string_array_t* members,
+	unsigned int depth,
+	int normalization,
+	nested_list_resolver_t resolve,
+	void* context,
+	struct string_array_t** expanded
+);
+
+/**
+ * Marks the mailing lists to which an entry of a search for several lists
+ * belongs by one of the values of its key attribute.
+ *
+ * A value matches a list, if it equals the key of the list
+ * case-insensitively (ASCII only).
+ *
+ * @param keys The keys of the lists
+ * @param count The number of lists
+ * @param value A value of the key attribute of the entry; need not be
+ * NUL-terminated
+ * @param len The length of `value`
+ * @param is_match Array of `count` flags; the flag of each matching list is
+ * set to one, the other flags are left unchanged
+ * @return The number of matching lists
+ */
+size_t match_nested_list_key(
+	char const * const * keys,
+	size_t count,
+	char const * value,
+	size_t len,
+	int* is_match
+);
+
+#endif
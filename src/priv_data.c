@@ -2,53 +2,64 @@
 #include <string.h>
 
 #include "priv_data.h"
+#include "arena.h"
+#include "extldap.h"
+
+/**
+ * The size of the blocks of the arena of each SMTP session.
+ *
+ * A typical message including the members of a mailing list fits into a
+ * single block.
+ */
+static size_t const PRIV_DATA_ARENA_BLOCK_SIZE = 16384;
 
 struct priv_data_t* create_priv_data( void ) {
-	struct priv_data_t * const result = malloc( sizeof( struct priv_data_t ) );
-	if( result == NULL )
+	struct arena_t * const arena = create_arena( PRIV_DATA_ARENA_BLOCK_SIZE );
+	if( arena == NULL )
+		return NULL;
+	struct priv_data_t * const result = alloc_from_arena( arena, sizeof( struct priv_data_t ) );
+	if( result == NULL ) {
+		free_arena( arena );
 		return NULL;
+	}
+	result->arena = arena;
 	result->envelope_sender = NULL;
 	result->auth_acct = NULL;
+	result->alias_lookup = NULL;
 	return result;
 }
 
 void free_priv_data( struct priv_data_t * const priv_data ) {
 	if( priv_data == NULL ) return;
-	free( priv_data->envelope_sender );
-	priv_data->envelope_sender = NULL;
-	free( priv_data->auth_acct );
-	priv_data->auth_acct = NULL;
-	free( priv_data );
+	abandon_alias_lookup( priv_data->alias_lookup );
+	// The private data itself lives in the arena
+	free_arena( priv_data->arena );
 }
 
 int set_priv_data_envelope_sender( struct priv_data_t * const priv_data, char const * const envelope_sender ) {
 	if( priv_data == NULL )
 		return 1;
-	free( priv_data->envelope_sender );
 	if( envelope_sender == NULL ) {
 		priv_data->envelope_sender = NULL;
 		return 0;
 	}
-	priv_data->envelope_sender = malloc( strlen( envelope_sender ) + 1 );
+	priv_data->envelope_sender = copy_string_to_arena( priv_data->arena, envelope_sender, strlen( envelope_sender ) );
 	if( priv_data->envelope_sender == NULL ) {
 		return 1;
 	}
-	strcpy( priv_data->envelope_sender, envelope_sender );
 	return 0;
 }
 
 int set_priv_data_auth_acct( struct priv_data_t * const priv_data, char const * const auth_acct ) {
 	if( priv_data == NULL )
 		return 1;
-	free( priv_data->auth_acct );
 	if( auth_acct == NULL ) {
 		priv_data->auth_acct = NULL;
 		return 0;
 	}
-	priv_data->auth_acct = malloc( strlen( auth_acct ) + 1 );
+	priv_data->auth_acct = copy_string_to_arena( priv_data->arena, auth_acct, strlen( auth_acct ) );
 	if( priv_data->auth_acct == NULL ) {
 		return 1;
 	}
-	strcpy( priv_data->auth_acct, auth_acct );
 	return 0;
 }
@@ -7,12 +7,25 @@
  * data of the milter.
  */
 
+struct alias_lookup_t;
+struct arena_t;
+
 /**
  * Holds the application-specific data for a single milter invocation, i.e SMTP session.
+ *
+ * The object itself and all per-message allocations (strings, LDAP lookup
+ * and its results) are allocated from `arena` and released at once by
+ * ::free_priv_data().
  */
 struct priv_data_t {
+	struct arena_t* arena; /**< The arena which owns the object and all of its members. */
 	char* envelope_sender; /**< The sender as given by SMTP `MAIL FROM:`. */
 	char* auth_acct; /**< The authenticated user ID of the SMPT session. */
+	/**
+	 * The LDAP lookup which has been started at SMTP `MAIL FROM:` and whose
+	 * results are collected at the end of the message; may be `NULL`.
+	 */
+	struct alias_lookup_t* alias_lookup;
 };
 
 /**
@@ -25,6 +38,10 @@ struct priv_data_t* create_priv_data( void );
 /**
  * @brief Frees an object of type priv_data_t
  *
+ * A pending LDAP lookup is abandoned.
+ * All memory which has been allocated from the arena of the object is
+ * released, too.
+ *
  * @param priv_data Pointer to the object to be freed.
  */
 void free_priv_data( struct priv_data_t * const priv_data );
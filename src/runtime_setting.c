@@ -4,11 +4,15 @@
 #include <getopt.h>
 #include <sysexits.h>
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
 
 #include "runtime_setting.h"
 #include "log.h"
 #include "ini_parser.h"
 #include "extstring.h"
+#include "template.h"
+#include "mail_address.h"
 
 char const * const VERSION = "0.1.0";
 
@@ -22,14 +26,46 @@ int const DAEMON_MODE_SYSTEMD = 2;
 
 static int const DAEMON_MODE_DEFAULT = DAEMON_MODE_FORK;
 
+int const FAILURE_POLICY_TEMPFAIL = 0;
+
+int const FAILURE_POLICY_ACCEPT = 1;
+
+int const FAILURE_POLICY_CACHE = 2;
+
+static int const FAILURE_POLICY_DEFAULT = FAILURE_POLICY_CACHE;
+
 static char const * const PID_FILE_DEFAULT = "/run/milter-alias/milter-alias.pid";
 
 static char const * const SOCKET_FILE_DEFAULT = "/run/milter-alias/milter-alias.sock";
 
+static unsigned int const MTA_TIMEOUT_DEFAULT = 7210;
+
+static unsigned int const LDAP_POOL_SIZE_DEFAULT = 4;
+
+static unsigned int const LDAP_SEARCH_DEADLINE_DEFAULT = 5000;
+
+static unsigned int const LDAP_NETWORK_TIMEOUT_DEFAULT = 3000;
+
+static unsigned int const LDAP_RECONNECT_MIN_DEFAULT = 10;
+
+static unsigned int const LDAP_RECONNECT_MAX_DEFAULT = 30000;
+
+static unsigned int const LDAP_QUERY_TIMEOUT_DEFAULT = 3000;
+
+static unsigned int const LDAP_QUERY_SIZE_LIMIT_DEFAULT = 10000;
+
+static unsigned int const LDAP_MAIL_LIST_DEPTH_DEFAULT = 1;
+
+static unsigned int const CACHE_TTL_DEFAULT = 300;
+
+static unsigned int const CACHE_SIZE_DEFAULT = 10000;
+
 static int const LOG_FACILITY_DEFAULT = LOG_MAIL;
 
 static int const LOG_LEVEL_DEFAULT = LOG_WARNING;
 
+static unsigned int const LOG_QUEUE_SIZE_DEFAULT = 1024;
+
 static char const * const CLI_OPTS = "c:d:fhl:p:s:v";
 
 struct rt_setting_t rt_setting = {
@@ -40,12 +76,34 @@ struct rt_setting_t rt_setting = {
 	NULL,                            /* config_file */
 	NULL,                            /* pid_file */
 	NULL,                            /* socket_file */
+	0,                               /* socket_backlog */
+	MTA_TIMEOUT_DEFAULT,             /* mta_timeout */
+	0,                               /* mail_address_normalization */
+	0,                               /* max_recipients */
+	NULL,                            /* recipient_esmtp_args */
+	NULL,                            /* metrics_socket */
+	0,                               /* latency_log_interval */
 	{ NULL, NULL, NULL },            /* ldap_bind.{host, dn, passwd } */
-	{ NULL, NULL, { NULL, NULL } },  /* ldap_mail_acct_query.{base_dn, filter_template, result_attributes } */
-	{ NULL, NULL, { NULL, NULL } },  /* ldap_mail_list_query.{base_dn, filter_template, result_attributes } */
+	LDAP_POOL_SIZE_DEFAULT,          /* ldap_pool_size */
+	LDAP_SEARCH_DEADLINE_DEFAULT,    /* ldap_search_deadline */
+	LDAP_NETWORK_TIMEOUT_DEFAULT,    /* ldap_network_timeout */
+	LDAP_RECONNECT_MIN_DEFAULT,      /* ldap_reconnect_min */
+	LDAP_RECONNECT_MAX_DEFAULT,      /* ldap_reconnect_max */
+	FAILURE_POLICY_DEFAULT,          /* ldap_failure_policy */
+	{ NULL, NULL, NULL, NULL, LDAP_QUERY_TIMEOUT_DEFAULT, LDAP_QUERY_SIZE_LIMIT_DEFAULT, { NULL, NULL } },  /* ldap_mail_acct_query.{base_dn, filter_template, compiled_base_dn, compiled_filter, timeout, size_limit, result_attributes } */
+	{ NULL, NULL, NULL, NULL, LDAP_QUERY_TIMEOUT_DEFAULT, LDAP_QUERY_SIZE_LIMIT_DEFAULT, { NULL, NULL } },  /* ldap_mail_list_query.{base_dn, filter_template, compiled_base_dn, compiled_filter, timeout, size_limit, result_attributes } */
+	LDAP_MAIL_LIST_DEPTH_DEFAULT,    /* ldap_mail_list_depth */
+	{ CACHE_TTL_DEFAULT, CACHE_SIZE_DEFAULT }, /* mail_list_cache.{ttl, size} */
+	{ CACHE_TTL_DEFAULT, CACHE_SIZE_DEFAULT }, /* mail_acct_cache.{ttl, size} */
+	0,                               /* sync_interval */
+	NULL,                            /* sync_snapshot_file */
+	{ NULL, NULL, NULL, NULL },      /* mail_list_sync.{filter, key_attribute, key_template, compiled_key_template} */
+	{ NULL, NULL, NULL, NULL },      /* mail_acct_sync.{filter, key_attribute, key_template, compiled_key_template} */
 	NULL,                            /* log_ident */
 	LOG_FACILITY_DEFAULT,            /* lof_facility */
-	LOG_LEVEL_DEFAULT                /* log_level */
+	LOG_LEVEL_DEFAULT,               /* log_level */
+	LOG_QUEUE_SIZE_DEFAULT,          /* log_queue_size */
+	0                                /* log_journal */
 };
 
 void print_usage( char const * const prog_name ) {
@@ -93,6 +151,10 @@ void cleanup_rt_setting( void ) {
 	rt_setting.pid_file = NULL;
 	free( rt_setting.socket_file );
 	rt_setting.socket_file = NULL;
+	free( rt_setting.recipient_esmtp_args );
+	rt_setting.recipient_esmtp_args = NULL;
+	free( rt_setting.metrics_socket );
+	rt_setting.metrics_socket = NULL;
 
 	free( rt_setting.ldap_bind.host );
 	rt_setting.ldap_bind.host = NULL;
@@ -107,6 +169,10 @@ void cleanup_rt_setting( void ) {
 	rt_setting.ldap_mail_acct_query.filter_template = NULL;
 	free( rt_setting.ldap_mail_acct_query.result_attributes[0] );
 	rt_setting.ldap_mail_acct_query.result_attributes[0] = NULL;
+	free_template( rt_setting.ldap_mail_acct_query.compiled_base_dn );
+	rt_setting.ldap_mail_acct_query.compiled_base_dn = NULL;
+	free_template( rt_setting.ldap_mail_acct_query.compiled_filter );
+	rt_setting.ldap_mail_acct_query.compiled_filter = NULL;
 
 	free( rt_setting.ldap_mail_list_query.base_dn );
 	rt_setting.ldap_mail_list_query.base_dn = NULL;
@@ -114,6 +180,29 @@ void cleanup_rt_setting( void ) {
 	rt_setting.ldap_mail_list_query.filter_template = NULL;
 	free( rt_setting.ldap_mail_list_query.result_attributes[0] );
 	rt_setting.ldap_mail_list_query.result_attributes[0] = NULL;
+	free_template( rt_setting.ldap_mail_list_query.compiled_base_dn );
+	rt_setting.ldap_mail_list_query.compiled_base_dn = NULL;
+	free_template( rt_setting.ldap_mail_list_query.compiled_filter );
+	rt_setting.ldap_mail_list_query.compiled_filter = NULL;
+
+	free( rt_setting.sync_snapshot_file );
+	rt_setting.sync_snapshot_file = NULL;
+	free( rt_setting.mail_list_sync.filter );
+	rt_setting.mail_list_sync.filter = NULL;
+	free( rt_setting.mail_list_sync.key_attribute );
+	rt_setting.mail_list_sync.key_attribute = NULL;
+	free( rt_setting.mail_list_sync.key_template );
+	rt_setting.mail_list_sync.key_template = NULL;
+	free_template( rt_setting.mail_list_sync.compiled_key_template );
+	rt_setting.mail_list_sync.compiled_key_template = NULL;
+	free( rt_setting.mail_acct_sync.filter );
+	rt_setting.mail_acct_sync.filter = NULL;
+	free( rt_setting.mail_acct_sync.key_attribute );
+	rt_setting.mail_acct_sync.key_attribute = NULL;
+	free( rt_setting.mail_acct_sync.key_template );
+	rt_setting.mail_acct_sync.key_template = NULL;
+	free_template( rt_setting.mail_acct_sync.compiled_key_template );
+	rt_setting.mail_acct_sync.compiled_key_template = NULL;
 }
 
 static int parse_log_level( char const * const value ) {
@@ -156,6 +245,28 @@ int convert_str_2_daemon_mode( char const * const str ) {
 	return -1;
 }
 
+static char const * const FAILURE_POLICY_STRINGS[3][5] = {
+	{ "tempfail", "Tempfail", "TEMPFAIL", "0", NULL },
+	{ "accept",   "Accept",   "ACCEPT",   "1", NULL },
+	{ "cache",    "Cache",    "CACHE",    "2", NULL }
+};
+
+char const * convert_failure_policy_2_str( int const failure_policy ) {
+	if ( FAILURE_POLICY_TEMPFAIL <= failure_policy && failure_policy <= FAILURE_POLICY_CACHE )
+		return FAILURE_POLICY_STRINGS[failure_policy][0];
+	return NULL;
+}
+
+int convert_str_2_failure_policy( char const * const str ) {
+	for( int i = FAILURE_POLICY_TEMPFAIL; i <= FAILURE_POLICY_CACHE; ++i ) {
+		for( int j = 0; FAILURE_POLICY_STRINGS[i][j] != NULL; ++j ) {
+			if ( strcmp( FAILURE_POLICY_STRINGS[i][j], str ) == 0 )
+				return i;
+		}
+	}
+	return -1;
+}
+
 static int parse_daemon_mode( char const * const value ) {
 	rt_setting.daemon_mode = convert_str_2_daemon_mode( value );
 	if ( rt_setting.daemon_mode == -1 ) {
@@ -282,6 +393,60 @@ static int parse_ini_option_with_mandatory_str(
 	return 0;
 }
 
+static int parse_ini_option_with_uint(
+		unsigned int* config_entry,
+		unsigned int const min_value,
+		char const * const section,
+		char const * const name,
+		char const * const value,
+		int const line_no
+) {
+	if ( value == NULL || !isdigit( (unsigned char)*value ) ) {
+		log_msg( LOG_ERR, "Invalid value in section \"%s\" for option \"%s\" at line %d: %s\n", section, name, line_no, str_or_null( value ) );
+		return -1;
+	}
+	char* end = NULL;
+	errno = 0;
+	unsigned long const parsed = strtoul( value, &end, 10 );
+	if ( *end != '\0' || errno != 0 || parsed < min_value || parsed > UINT_MAX ) {
+		log_msg( LOG_ERR, "Invalid value in section \"%s\" for option \"%s\" at line %d: %s\n", section, name, line_no, value );
+		return -1;
+	}
+	*config_entry = (unsigned int)parsed;
+	return 0;
+}
+
+/**
+ * Sets or clears a flag according to a boolean option.
+ *
+ * Accepts `yes`/`no`, `true`/`false`, `on`/`off` and `1`/`0`.
+ */
+static int parse_ini_option_with_flag(
+		int* config_entry,
+		int const flag,
+		char const * const section,
+		char const * const name,
+		char const * const value,
+		int const line_no
+) {
+	if ( value != NULL && (
+		strcmp( "yes", value ) == 0 || strcmp( "true", value ) == 0 ||
+		strcmp( "on", value ) == 0 || strcmp( "1", value ) == 0
+	) ) {
+		*config_entry |= flag;
+		return 0;
+	}
+	if ( value != NULL && (
+		strcmp( "no", value ) == 0 || strcmp( "false", value ) == 0 ||
+		strcmp( "off", value ) == 0 || strcmp( "0", value ) == 0
+	) ) {
+		*config_entry &= ~flag;
+		return 0;
+	}
+	log_msg( LOG_ERR, "Invalid value in section \"%s\" for option \"%s\" at line %d: %s\n", section, name, line_no, str_or_null( value ) );
+	return -1;
+}
+
 static int parse_ini_section_general(
 	char const * const section,
 	char const * const name,
@@ -337,6 +502,96 @@ static int parse_ini_section_general(
 			LOG_DEBUG, "Set socket_file via config file to: %s\n", str_or_null( rt_setting.socket_file )
 		);
 		return ret;
+	} else if (
+		strcmp( "FOLD LOCAL PART", name ) == 0 ||
+		strcmp( "fold local part", name ) == 0
+	) {
+		int const ret = parse_ini_option_with_flag(
+			&(rt_setting.mail_address_normalization),
+			MAIL_ADDRESS_FOLD_LOCAL_PART,
+			section,
+			name,
+			value,
+			line_no
+		);
+		log_msg(
+			LOG_DEBUG, "Set mail_address_normalization via config file to: %d\n", rt_setting.mail_address_normalization
+		);
+		return ret;
+	} else if (
+		strcmp( "STRIP ADDRESS TAG", name ) == 0 ||
+		strcmp( "strip address tag", name ) == 0
+	) {
+		int const ret = parse_ini_option_with_flag(
+			&(rt_setting.mail_address_normalization),
+			MAIL_ADDRESS_STRIP_TAG,
+			section,
+			name,
+			value,
+			line_no
+		);
+		log_msg(
+			LOG_DEBUG, "Set mail_address_normalization via config file to: %d\n", rt_setting.mail_address_normalization
+		);
+		return ret;
+	} else if (
+		strcmp( "SOCKET BACKLOG", name ) == 0 ||
+		strcmp( "socket backlog", name ) == 0
+	) {
+		int const ret = parse_ini_option_with_uint( &(rt_setting.socket_backlog), 0, section, name, value, line_no );
+		log_msg( LOG_DEBUG, "Set socket_backlog via config file to: %u\n", rt_setting.socket_backlog );
+		return ret;
+	} else if (
+		strcmp( "MTA TIMEOUT", name ) == 0 ||
+		strcmp( "mta timeout", name ) == 0
+	) {
+		int const ret = parse_ini_option_with_uint( &(rt_setting.mta_timeout), 1, section, name, value, line_no );
+		log_msg( LOG_DEBUG, "Set mta_timeout via config file to: %u\n", rt_setting.mta_timeout );
+		return ret;
+	} else if (
+		strcmp( "MAX RECIPIENTS", name ) == 0 ||
+		strcmp( "max recipients", name ) == 0
+	) {
+		int const ret = parse_ini_option_with_uint( &(rt_setting.max_recipients), 0, section, name, value, line_no );
+		log_msg( LOG_DEBUG, "Set max_recipients via config file to: %u\n", rt_setting.max_recipients );
+		return ret;
+	} else if (
+		strcmp( "RECIPIENT ARGS", name ) == 0 ||
+		strcmp( "recipient args", name ) == 0
+	) {
+		// An empty value restores plain `smfi_addrcpt`
+		free( rt_setting.recipient_esmtp_args );
+		rt_setting.recipient_esmtp_args = NULL;
+		value_length = strlen( value );
+		if ( value_length != 0 ) {
+			rt_setting.recipient_esmtp_args = malloc( value_length + 1 );
+			strcpy( rt_setting.recipient_esmtp_args, value );
+		}
+		log_msg(
+			LOG_DEBUG, "Set recipient_esmtp_args via config file to: %s\n", str_or_null( rt_setting.recipient_esmtp_args )
+		);
+	} else if (
+		strcmp( "METRICS SOCKET", name ) == 0 ||
+		strcmp( "metrics socket", name ) == 0
+	) {
+		// An empty value disables the metrics
+		free( rt_setting.metrics_socket );
+		rt_setting.metrics_socket = NULL;
+		value_length = strlen( value );
+		if ( value_length != 0 ) {
+			rt_setting.metrics_socket = malloc( value_length + 1 );
+			strcpy( rt_setting.metrics_socket, value );
+		}
+		log_msg(
+			LOG_DEBUG, "Set metrics_socket via config file to: %s\n", str_or_null( rt_setting.metrics_socket )
+		);
+	} else if (
+		strcmp( "LATENCY LOG INTERVAL", name ) == 0 ||
+		strcmp( "latency log interval", name ) == 0
+	) {
+		int const ret = parse_ini_option_with_uint( &(rt_setting.latency_log_interval), 0, section, name, value, line_no );
+		log_msg( LOG_DEBUG, "Set latency_log_interval via config file to: %u\n", rt_setting.latency_log_interval );
+		return ret;
 	}
 	return 0;
 }
@@ -408,6 +663,223 @@ static int parse_ini_section_ldap(
 	) {
 		config_entry = &(rt_setting.ldap_mail_list_query.result_attributes[0]);
 		config_name = "ldap_mail_acct_query.result_attribute";
+	} else if (
+		strcmp( "POOL SIZE", name ) == 0 ||
+		strcmp( "pool size", name ) == 0
+	) {
+		int const ret = parse_ini_option_with_uint( &(rt_setting.ldap_pool_size), 1, section, name, value, line_no );
+		log_msg( LOG_DEBUG, "Set ldap_pool_size via config file to: %u\n", rt_setting.ldap_pool_size );
+		return ret;
+	} else if (
+		strcmp( "SEARCH DEADLINE", name ) == 0 ||
+		strcmp( "search deadline", name ) == 0
+	) {
+		int const ret = parse_ini_option_with_uint( &(rt_setting.ldap_search_deadline), 1, section, name, value, line_no );
+		log_msg( LOG_DEBUG, "Set ldap_search_deadline via config file to: %u\n", rt_setting.ldap_search_deadline );
+		return ret;
+	} else if (
+		strcmp( "NETWORK TIMEOUT", name ) == 0 ||
+		strcmp( "network timeout", name ) == 0
+	) {
+		int const ret = parse_ini_option_with_uint( &(rt_setting.ldap_network_timeout), 0, section, name, value, line_no );
+		log_msg( LOG_DEBUG, "Set ldap_network_timeout via config file to: %u\n", rt_setting.ldap_network_timeout );
+		return ret;
+	} else if (
+		strcmp( "RECONNECT MIN", name ) == 0 ||
+		strcmp( "reconnect min", name ) == 0
+	) {
+		int const ret = parse_ini_option_with_uint( &(rt_setting.ldap_reconnect_min), 1, section, name, value, line_no );
+		log_msg( LOG_DEBUG, "Set ldap_reconnect_min via config file to: %u\n", rt_setting.ldap_reconnect_min );
+		return ret;
+	} else if (
+		strcmp( "RECONNECT MAX", name ) == 0 ||
+		strcmp( "reconnect max", name ) == 0
+	) {
+		int const ret = parse_ini_option_with_uint( &(rt_setting.ldap_reconnect_max), 1, section, name, value, line_no );
+		log_msg( LOG_DEBUG, "Set ldap_reconnect_max via config file to: %u\n", rt_setting.ldap_reconnect_max );
+		return ret;
+	} else if (
+		strcmp( "MAIL ACCT TIMEOUT", name ) == 0 ||
+		strcmp( "mail acct timeout", name ) == 0
+	) {
+		int const ret = parse_ini_option_with_uint( &(rt_setting.ldap_mail_acct_query.timeout), 0, section, name, value, line_no );
+		log_msg( LOG_DEBUG, "Set ldap_mail_acct_query.timeout via config file to: %u\n", rt_setting.ldap_mail_acct_query.timeout );
+		return ret;
+	} else if (
+		strcmp( "MAIL ACCT SIZE LIMIT", name ) == 0 ||
+		strcmp( "mail acct size limit", name ) == 0
+	) {
+		int const ret = parse_ini_option_with_uint( &(rt_setting.ldap_mail_acct_query.size_limit), 0, section, name, value, line_no );
+		log_msg( LOG_DEBUG, "Set ldap_mail_acct_query.size_limit via config file to: %u\n", rt_setting.ldap_mail_acct_query.size_limit );
+		return ret;
+	} else if (
+		strcmp( "MAIL LIST TIMEOUT", name ) == 0 ||
+		strcmp( "mail list timeout", name ) == 0
+	) {
+		int const ret = parse_ini_option_with_uint( &(rt_setting.ldap_mail_list_query.timeout), 0, section, name, value, line_no );
+		log_msg( LOG_DEBUG, "Set ldap_mail_list_query.timeout via config file to: %u\n", rt_setting.ldap_mail_list_query.timeout );
+		return ret;
+	} else if (
+		strcmp( "MAIL LIST SIZE LIMIT", name ) == 0 ||
+		strcmp( "mail list size limit", name ) == 0
+	) {
+		int const ret = parse_ini_option_with_uint( &(rt_setting.ldap_mail_list_query.size_limit), 0, section, name, value, line_no );
+		log_msg( LOG_DEBUG, "Set ldap_mail_list_query.size_limit via config file to: %u\n", rt_setting.ldap_mail_list_query.size_limit );
+		return ret;
+	} else if (
+		strcmp( "MAIL LIST DEPTH", name ) == 0 ||
+		strcmp( "mail list depth", name ) == 0
+	) {
+		int const ret = parse_ini_option_with_uint( &(rt_setting.ldap_mail_list_depth), 1, section, name, value, line_no );
+		log_msg( LOG_DEBUG, "Set ldap_mail_list_depth via config file to: %u\n", rt_setting.ldap_mail_list_depth );
+		return ret;
+	} else if (
+		strcmp( "FAILURE POLICY", name ) == 0 ||
+		strcmp( "failure policy", name ) == 0
+	) {
+		rt_setting.ldap_failure_policy = convert_str_2_failure_policy( value );
+		if ( rt_setting.ldap_failure_policy == -1 ) {
+			rt_setting.ldap_failure_policy = FAILURE_POLICY_DEFAULT;
+			log_msg( LOG_ERR, "Invalid value in section \"%s\" for option \"%s\" at line %d: %s\n", section, name, line_no, value );
+			return -1;
+		}
+		log_msg(
+			LOG_DEBUG,
+			"Set ldap_failure_policy via config file to: %d (%s)\n",
+			rt_setting.ldap_failure_policy,
+			convert_failure_policy_2_str( rt_setting.ldap_failure_policy )
+		);
+		return 0;
+	} else {
+		log_msg( LOG_ERR, "Unknown option in section \"%s\" at line %d: %s\n", section, line_no, name );
+		return -1;
+	}
+
+	int const ret = parse_ini_option_with_mandatory_str( config_entry, section, name, value, line_no );
+	log_msg(
+		LOG_DEBUG,
+		"Set %s via config file to: %s\n",
+		config_name,
+		*config_entry
+	);
+	return ret;
+}
+
+static int parse_ini_section_cache(
+	char const * const section,
+	char const * const name,
+	char const * const value,
+	int const line_no
+) {
+	unsigned int* config_entry = NULL;
+	char const * config_name = NULL;
+	unsigned int min_value = 0;
+
+	if (
+		strcmp( "LIST TTL", name ) == 0 ||
+		strcmp( "list ttl", name ) == 0
+	) {
+		config_entry = &(rt_setting.mail_list_cache.ttl);
+		config_name = "mail_list_cache.ttl";
+	} else if (
+		strcmp( "LIST SIZE", name ) == 0 ||
+		strcmp( "list size", name ) == 0
+	) {
+		config_entry = &(rt_setting.mail_list_cache.size);
+		config_name = "mail_list_cache.size";
+		min_value = 1;
+	} else if (
+		strcmp( "ACCT TTL", name ) == 0 ||
+		strcmp( "acct ttl", name ) == 0
+	) {
+		config_entry = &(rt_setting.mail_acct_cache.ttl);
+		config_name = "mail_acct_cache.ttl";
+	} else if (
+		strcmp( "ACCT SIZE", name ) == 0 ||
+		strcmp( "acct size", name ) == 0
+	) {
+		config_entry = &(rt_setting.mail_acct_cache.size);
+		config_name = "mail_acct_cache.size";
+		min_value = 1;
+	} else {
+		log_msg( LOG_ERR, "Unknown option in section \"%s\" at line %d: %s\n", section, line_no, name );
+		return -1;
+	}
+
+	int const ret = parse_ini_option_with_uint( config_entry, min_value, section, name, value, line_no );
+	log_msg(
+		LOG_DEBUG,
+		"Set %s via config file to: %u\n",
+		config_name,
+		*config_entry
+	);
+	return ret;
+}
+
+static int parse_ini_section_sync(
+	char const * const section,
+	char const * const name,
+	char const * const value,
+	int const line_no
+) {
+	char** config_entry = NULL;
+	char const * config_name = NULL;
+
+	if (
+		strcmp( "INTERVAL", name ) == 0 ||
+		strcmp( "interval", name ) == 0
+	) {
+		int const ret = parse_ini_option_with_uint( &(rt_setting.sync_interval), 0, section, name, value, line_no );
+		log_msg( LOG_DEBUG, "Set sync_interval via config file to: %u\n", rt_setting.sync_interval );
+		return ret;
+	} else if (
+		strcmp( "SNAPSHOT FILE", name ) == 0 ||
+		strcmp( "snapshot file", name ) == 0
+	) {
+		// An empty value is kept to disable the file
+		free( rt_setting.sync_snapshot_file );
+		rt_setting.sync_snapshot_file = malloc( strlen( value ) + 1 );
+		strcpy( rt_setting.sync_snapshot_file, value );
+		log_msg(
+			LOG_DEBUG, "Set sync_snapshot_file via config file to: %s\n", rt_setting.sync_snapshot_file
+		);
+		return 0;
+	} else if (
+		strcmp( "LIST FILTER", name ) == 0 ||
+		strcmp( "list filter", name ) == 0
+	) {
+		config_entry = &(rt_setting.mail_list_sync.filter);
+		config_name = "mail_list_sync.filter";
+	} else if (
+		strcmp( "LIST KEY ATTRIBUTE", name ) == 0 ||
+		strcmp( "list key attribute", name ) == 0
+	) {
+		config_entry = &(rt_setting.mail_list_sync.key_attribute);
+		config_name = "mail_list_sync.key_attribute";
+	} else if (
+		strcmp( "LIST KEY TEMPLATE", name ) == 0 ||
+		strcmp( "list key template", name ) == 0
+	) {
+		config_entry = &(rt_setting.mail_list_sync.key_template);
+		config_name = "mail_list_sync.key_template";
+	} else if (
+		strcmp( "ACCT FILTER", name ) == 0 ||
+		strcmp( "acct filter", name ) == 0
+	) {
+		config_entry = &(rt_setting.mail_acct_sync.filter);
+		config_name = "mail_acct_sync.filter";
+	} else if (
+		strcmp( "ACCT KEY ATTRIBUTE", name ) == 0 ||
+		strcmp( "acct key attribute", name ) == 0
+	) {
+		config_entry = &(rt_setting.mail_acct_sync.key_attribute);
+		config_name = "mail_acct_sync.key_attribute";
+	} else if (
+		strcmp( "ACCT KEY TEMPLATE", name ) == 0 ||
+		strcmp( "acct key template", name ) == 0
+	) {
+		config_entry = &(rt_setting.mail_acct_sync.key_template);
+		config_name = "mail_acct_sync.key_template";
 	} else {
 		log_msg( LOG_ERR, "Unknown option in section \"%s\" at line %d: %s\n", section, line_no, name );
 		return -1;
@@ -473,6 +945,20 @@ static int parse_ini_section_log(
 			rt_setting.log_level,
 			convert_log_level_2_str( rt_setting.log_level )
 		);
+	} else if (
+		strcmp( "QUEUE SIZE", name ) == 0 ||
+		strcmp( "queue size", name ) == 0
+	) {
+		int const ret = parse_ini_option_with_uint( &(rt_setting.log_queue_size), 0, section, name, value, line_no );
+		log_msg( LOG_DEBUG, "Set log queue size via config file to: %u\n", rt_setting.log_queue_size );
+		return ret;
+	} else if (
+		strcmp( "JOURNAL", name ) == 0 ||
+		strcmp( "journal", name ) == 0
+	) {
+		int const ret = parse_ini_option_with_flag( &(rt_setting.log_journal), 1, section, name, value, line_no );
+		log_msg( LOG_DEBUG, "Set log journal via config file to: %d\n", rt_setting.log_journal );
+		return ret;
 	} else {
 		log_msg( LOG_ERR, "Unknown option in section \"%s\" at line %d: %s\n", section, line_no, name );
 		return -1;
@@ -498,6 +984,18 @@ int handle_ini_entry(
 		strcmp( "ldap", section ) == 0
 	) {
 		return parse_ini_section_ldap( section, name, value, line_no );
+	} else if (
+		strcmp( "CACHE", section ) == 0 ||
+		strcmp( "Cache", section ) == 0 ||
+		strcmp( "cache", section ) == 0
+	) {
+		return parse_ini_section_cache( section, name, value, line_no );
+	} else if (
+		strcmp( "SYNC", section ) == 0 ||
+		strcmp( "Sync", section ) == 0 ||
+		strcmp( "sync", section ) == 0
+	) {
+		return parse_ini_section_sync( section, name, value, line_no );
 	} else if (
 		strcmp( "LOG", section ) == 0 ||
 		strcmp( "Log", section ) == 0 ||
@@ -515,9 +1013,47 @@ int handle_ini_entry(
 	return 0;
 }
 
+/**
+ * Compiles the base DN and the filter of a query.
+ *
+ * @return Zero on success, non-zero in case of an error
+ */
+static int compile_query_templates( struct ldap_query_parms_t* const query ) {
+	free_template( query->compiled_base_dn );
+	free_template( query->compiled_filter );
+	query->compiled_base_dn = compile_template( query->base_dn, TEMPLATE_ESCAPE_DN );
+	query->compiled_filter = compile_template( query->filter_template, TEMPLATE_ESCAPE_FILTER );
+	return
+		( query->base_dn != NULL && query->compiled_base_dn == NULL ) ||
+		( query->filter_template != NULL && query->compiled_filter == NULL );
+}
+
+/**
+ * Compiles the key template of a snapshot; a missing template means `%u`.
+ *
+ * @return Zero on success, non-zero in case of an error
+ */
+static int compile_sync_templates( struct ldap_sync_parms_t* const sync ) {
+	free_template( sync->compiled_key_template );
+	// The key is compared to the raw attribute value, hence no escaping
+	sync->compiled_key_template = compile_template(
+		sync->key_template != NULL ? sync->key_template : "%u", TEMPLATE_ESCAPE_NONE
+	);
+	return sync->compiled_key_template == NULL;
+}
+
 int parse_ini( void ) {
 	int const result = parse_ini_file( handle_ini_entry );
 	if( result == 0 ) {
+		if(
+			compile_query_templates( &rt_setting.ldap_mail_acct_query ) != 0 ||
+			compile_query_templates( &rt_setting.ldap_mail_list_query ) != 0 ||
+			compile_sync_templates( &rt_setting.mail_list_sync ) != 0 ||
+			compile_sync_templates( &rt_setting.mail_acct_sync ) != 0
+		) {
+			log_msg( LOG_ERR, "parse_ini: could not compile templates\n" );
+			return EX_OSERR;
+		}
 		return EX_OK;
 	} else if( result == -1 ) {
 		// permission error
@@ -538,16 +1074,48 @@ void log_rt_settings( void ) {
 	log_msg( LOG_INFO, "Runtime setting config_file:                                %s\n", str_or_null( rt_setting.config_file ) );
 	log_msg( LOG_INFO, "Runtime setting pid_file:                                   %s\n", str_or_null( rt_setting.pid_file ) );
 	log_msg( LOG_INFO, "Runtime setting socket_file:                                %s\n", str_or_null( rt_setting.socket_file ) );
+	log_msg( LOG_INFO, "Runtime setting socket_backlog:                             %u\n", rt_setting.socket_backlog );
+	log_msg( LOG_INFO, "Runtime setting mta_timeout:                                %u s\n", rt_setting.mta_timeout );
+	log_msg( LOG_INFO, "Runtime setting mail_address_normalization:                 %d\n", rt_setting.mail_address_normalization );
+	log_msg( LOG_INFO, "Runtime setting max_recipients:                             %u\n", rt_setting.max_recipients );
+	log_msg( LOG_INFO, "Runtime setting recipient_esmtp_args:                       %s\n", str_or_null( rt_setting.recipient_esmtp_args ) );
+	log_msg( LOG_INFO, "Runtime setting metrics_socket:                             %s\n", str_or_null( rt_setting.metrics_socket ) );
+	log_msg( LOG_INFO, "Runtime setting latency_log_interval:                       %u\n", rt_setting.latency_log_interval );
 	log_msg( LOG_INFO, "Runtime setting ldap_bind.host:                             %s\n", str_or_null( rt_setting.ldap_bind.host ) );
 	log_msg( LOG_INFO, "Runtime setting ldap_bind.dn:                               %s\n", str_or_null( rt_setting.ldap_bind.dn ) );
 	log_msg( LOG_INFO, "Runtime setting ldap_bind.passwd:                           %s\n", str_or_null( rt_setting.ldap_bind.passwd ) );
+	log_msg( LOG_INFO, "Runtime setting ldap_pool_size:                             %u\n", rt_setting.ldap_pool_size );
+	log_msg( LOG_INFO, "Runtime setting ldap_search_deadline:                       %u ms\n", rt_setting.ldap_search_deadline );
+	log_msg( LOG_INFO, "Runtime setting ldap_network_timeout:                       %u ms\n", rt_setting.ldap_network_timeout );
+	log_msg( LOG_INFO, "Runtime setting ldap_reconnect_min:                         %u ms\n", rt_setting.ldap_reconnect_min );
+	log_msg( LOG_INFO, "Runtime setting ldap_reconnect_max:                         %u ms\n", rt_setting.ldap_reconnect_max );
+	log_msg( LOG_INFO, "Runtime setting ldap_failure_policy:                        %d (%s)\n", rt_setting.ldap_failure_policy, convert_failure_policy_2_str( rt_setting.ldap_failure_policy ) );
 	log_msg( LOG_INFO, "Runtime setting ldap_mail_acct_query.base_dn:               %s\n", str_or_null( rt_setting.ldap_mail_acct_query.base_dn ) );
 	log_msg( LOG_INFO, "Runtime setting ldap_mail_acct_query.filter_template:       %s\n", str_or_null( rt_setting.ldap_mail_acct_query.filter_template ) );
 	log_msg( LOG_INFO, "Runtime setting ldap_mail_acct_query.result_attributes[0]:  %s\n", str_or_null( rt_setting.ldap_mail_acct_query.result_attributes[0] ) );
+	log_msg( LOG_INFO, "Runtime setting ldap_mail_acct_query.timeout:               %u ms\n", rt_setting.ldap_mail_acct_query.timeout );
+	log_msg( LOG_INFO, "Runtime setting ldap_mail_acct_query.size_limit:            %u\n", rt_setting.ldap_mail_acct_query.size_limit );
 	log_msg( LOG_INFO, "Runtime setting ldap_mail_list_query.base_dn:               %s\n", str_or_null( rt_setting.ldap_mail_list_query.base_dn ) );
 	log_msg( LOG_INFO, "Runtime setting ldap_mail_list_query.filter_template:       %s\n", str_or_null( rt_setting.ldap_mail_list_query.filter_template ) );
 	log_msg( LOG_INFO, "Runtime setting ldap_mail_list_query.result_attributes[0]:  %s\n", str_or_null( rt_setting.ldap_mail_list_query.result_attributes[0] ) );
+	log_msg( LOG_INFO, "Runtime setting ldap_mail_list_query.timeout:               %u ms\n", rt_setting.ldap_mail_list_query.timeout );
+	log_msg( LOG_INFO, "Runtime setting ldap_mail_list_query.size_limit:            %u\n", rt_setting.ldap_mail_list_query.size_limit );
+	log_msg( LOG_INFO, "Runtime setting ldap_mail_list_depth:                       %u\n", rt_setting.ldap_mail_list_depth );
+	log_msg( LOG_INFO, "Runtime setting mail_list_cache.ttl:                        %u\n", rt_setting.mail_list_cache.ttl );
+	log_msg( LOG_INFO, "Runtime setting mail_list_cache.size:                       %u\n", rt_setting.mail_list_cache.size );
+	log_msg( LOG_INFO, "Runtime setting mail_acct_cache.ttl:                        %u\n", rt_setting.mail_acct_cache.ttl );
+	log_msg( LOG_INFO, "Runtime setting mail_acct_cache.size:                       %u\n", rt_setting.mail_acct_cache.size );
+	log_msg( LOG_INFO, "Runtime setting sync_interval:                              %u\n", rt_setting.sync_interval );
+	log_msg( LOG_INFO, "Runtime setting sync_snapshot_file:                         %s\n", str_or_null( rt_setting.sync_snapshot_file ) );
+	log_msg( LOG_INFO, "Runtime setting mail_list_sync.filter:                      %s\n", str_or_null( rt_setting.mail_list_sync.filter ) );
+	log_msg( LOG_INFO, "Runtime setting mail_list_sync.key_attribute:               %s\n", str_or_null( rt_setting.mail_list_sync.key_attribute ) );
+	log_msg( LOG_INFO, "Runtime setting mail_list_sync.key_template:                %s\n", str_or_null( rt_setting.mail_list_sync.key_template ) );
+	log_msg( LOG_INFO, "Runtime setting mail_acct_sync.filter:                      %s\n", str_or_null( rt_setting.mail_acct_sync.filter ) );
+	log_msg( LOG_INFO, "Runtime setting mail_acct_sync.key_attribute:               %s\n", str_or_null( rt_setting.mail_acct_sync.key_attribute ) );
+	log_msg( LOG_INFO, "Runtime setting mail_acct_sync.key_template:                %s\n", str_or_null( rt_setting.mail_acct_sync.key_template ) );
 	log_msg( LOG_INFO, "Runtime setting log_ident:                                  %s\n", str_or_null( rt_setting.log_ident ) );
 	log_msg( LOG_INFO, "Runtime setting log_facility:                               %d (%s)\n", rt_setting.log_facility, convert_log_facility_2_str(rt_setting.log_facility) );
 	log_msg( LOG_INFO, "Runtime setting log_level:                                  %d (%s)\n", rt_setting.log_level, convert_log_level_2_str(rt_setting.log_level) );
+	log_msg( LOG_INFO, "Runtime setting log_queue_size:                             %u\n", rt_setting.log_queue_size );
+	log_msg( LOG_INFO, "Runtime setting log_journal:                                %d\n", rt_setting.log_journal );
 }
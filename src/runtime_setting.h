@@ -35,6 +35,33 @@ extern int const DAEMON_MODE_FORK;
  */
 extern int const DAEMON_MODE_SYSTEMD;
 
+/**
+ * Constant to indicate that a message is temporarily rejected, if its LDAP
+ * searches fail or miss their deadline.
+ *
+ * @see rt_setting_t::ldap_failure_policy
+ */
+extern int const FAILURE_POLICY_TEMPFAIL;
+
+/**
+ * Constant to indicate that a message is accepted unmodified, if its LDAP
+ * searches fail or miss their deadline.
+ *
+ * @see rt_setting_t::ldap_failure_policy
+ */
+extern int const FAILURE_POLICY_ACCEPT;
+
+/**
+ * Constant to indicate that a stale cache entry is used, if LDAP searches
+ * fail or miss their deadline; if there is no cache entry, the message is
+ * temporarily rejected.
+ *
+ * @see rt_setting_t::ldap_failure_policy
+ */
+extern int const FAILURE_POLICY_CACHE;
+
+struct template_t;
+
 /**
  * Keeps information for binding to LDAP server.
  */
@@ -61,8 +88,15 @@ struct ldap_query_parms_t {
 	 * If the user ID does not match the pattern `local-part@domain`, then
 	 * the local part, i.e `%n`, will equal the entire user ID and the domain
 	 * part, i.e. `%d`, will be empty.
+	 * The substituted values are escaped according to RFC 4515; the same
+	 * placeholders may be used in `base_dn` where they are escaped according
+	 * to RFC 4514.
 	 */
 	char* filter_template;
+	struct template_t* compiled_base_dn; /**< `base_dn` compiled by ::parse_ini() with DN escaping or `NULL`. */
+	struct template_t* compiled_filter; /**< `filter_template` compiled by ::parse_ini() with filter escaping or `NULL`. */
+	unsigned int timeout; /**< Time limit of the query in milliseconds; zero means unlimited. */
+	unsigned int size_limit; /**< Maximum number of entries returned by the query; zero means unlimited. */
 	/**
 	 * NULL-terminated array of attributes to be queried
 	 *
@@ -73,6 +107,34 @@ struct ldap_query_parms_t {
 	char* result_attributes[2];
 };
 
+/**
+ * Stores parameters for a cache of LDAP results.
+ */
+struct cache_parms_t {
+	unsigned int ttl; /**< The time-to-live of cache entries in seconds; zero disables the cache. */
+	unsigned int size; /**< The maximum number of cache entries. */
+};
+
+/**
+ * Stores parameters for loading all entries of a kind (e.g. all mailing
+ * lists) into the local snapshot.
+ *
+ * The entries are loaded with the base DN and the result attribute of the
+ * corresponding LDAP query, i.e. ::rt_setting_t::ldap_mail_list_query or
+ * ::rt_setting_t::ldap_mail_acct_query.
+ */
+struct ldap_sync_parms_t {
+	char* filter; /**< The LDAP filter which matches all entries; must not contain placeholders; `NULL` disables the snapshot of this kind. */
+	char* key_attribute; /**< The attribute which holds the key of an entry (e.g. the address of a mailing list). */
+	/**
+	 * Template which maps the envelope sender or the authenticated account
+	 * to the value of `key_attribute`; supports the same placeholders as
+	 * ::ldap_query_parms_t::filter_template; `NULL` means `%u`.
+	 */
+	char* key_template;
+	struct template_t* compiled_key_template; /**< `key_template` compiled by ::parse_ini() without escaping. */
+};
+
 /**
  * Holds the current runtime settings and state of the application.
  */
@@ -84,12 +146,60 @@ struct rt_setting_t {
 	char* config_file; /**< Path to the application's INI-file. */
 	char* pid_file; /**< Path to the application's PID file. */
 	char* socket_file; /**< Path to the application's milter socket. */
+	unsigned int socket_backlog; /**< Length of the listen queue of the milter socket; zero keeps the default of libmilter, i.e. `SOMAXCONN`. */
+	unsigned int mta_timeout; /**< Time in seconds libmilter waits for the MTA to read or write. */
+	int mail_address_normalization; /**< Options of ::normalize_mail_address() to compare mail addresses; zero only lower-cases the domain. */
+	unsigned int max_recipients; /**< Maximum number of recipients which are added to a single message; zero means unlimited. */
+	/**
+	 * ESMTP arguments for added recipients, e.g. `NOTIFY=NEVER`.
+	 *
+	 * If set, recipients are added by `smfi_addrcpt_par`, which the MTA must
+	 * support; `NULL` means plain `smfi_addrcpt`.
+	 */
+	char* recipient_esmtp_args;
+	/**
+	 * The socket on which metrics are served, either `inet:<port>` for a TCP
+	 * port on the loopback interface or `[unix:]<path>`; `NULL` disables
+	 * the metrics unless ::rt_setting_t::latency_log_interval is set.
+	 */
+	char* metrics_socket;
+	unsigned int latency_log_interval; /**< The time between two log lines with latency quantiles in seconds; zero disables them. */
 	struct ldap_bind_t ldap_bind; /**< LDAP binding setting. */
+	unsigned int ldap_pool_size; /**< Number of bound LDAP connections shared by the milter threads. */
+	unsigned int ldap_search_deadline; /**< Time in milliseconds to wait for the results of LDAP searches of a message. */
+	unsigned int ldap_network_timeout; /**< Timeout in milliseconds for establishing LDAP connections and synchronous operations; zero means unlimited. */
+	unsigned int ldap_reconnect_min; /**< Initial delay in milliseconds between attempts to re-establish a lost LDAP connection. */
+	unsigned int ldap_reconnect_max; /**< Maximum delay in milliseconds between attempts to re-establish a lost LDAP connection. */
+	int ldap_failure_policy; /**< Either ::FAILURE_POLICY_TEMPFAIL, ::FAILURE_POLICY_ACCEPT or ::FAILURE_POLICY_CACHE. */
 	struct ldap_query_parms_t ldap_mail_acct_query; /**< Definition of LDAP query to receive mail addresses for a user account. */
 	struct ldap_query_parms_t ldap_mail_list_query; /**< Definition of LDAP query to receive mail members of a mainling list. */
+	/**
+	 * The number of levels of nested mailing lists which are expanded.
+	 *
+	 * One means that only the direct members of a mailing list are added,
+	 * even if they are mailing lists themselves.
+	 */
+	unsigned int ldap_mail_list_depth;
+	struct cache_parms_t mail_list_cache; /**< Parameters of the cache for members of mailing lists. */
+	struct cache_parms_t mail_acct_cache; /**< Parameters of the cache for mail addresses of user accounts. */
+	unsigned int sync_interval; /**< The time between two loads of the local snapshot in seconds; zero disables the snapshot. */
+	/**
+	 * Path to the file which persists the local snapshot across restarts;
+	 * `NULL` means a file next to the PID file and an empty string disables
+	 * the file.
+	 */
+	char* sync_snapshot_file;
+	struct ldap_sync_parms_t mail_list_sync; /**< Parameters of the local snapshot of all mailing lists. */
+	struct ldap_sync_parms_t mail_acct_sync; /**< Parameters of the local snapshot of all accounts. */
 	char* log_ident; /**< Identity to be used for logging. */
 	int log_facility; /**< Facility to be used for logging. */
 	int log_level; /**< Treshold level to be used for logging. */
+	/**
+	 * The number of messages which may wait for the background writer;
+	 * zero writes messages synchronously.
+	 */
+	unsigned int log_queue_size;
+	int log_journal; /**< Non-zero, if messages are sent to the systemd journal with structured fields instead of syslog. */
 };
 
 /**
@@ -132,6 +242,9 @@ int parse_cli( int argc, char* argv[] );
 
 /**
  * Parses the application's INI-file and stores the result in ::rt_setting.
+ *
+ * Afterwards, all templates with placeholders are compiled such that they
+ * can be expanded without re-parsing them for each message.
  */
 int parse_ini( void );
 
@@ -1,7 +1,10 @@
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
 #include <sysexits.h>
 #include <unistd.h>
 
@@ -22,18 +25,87 @@ struct smfiDesc const FILTER_DESC = {
 	NULL,             // connection info callback
 	NULL,             // SMTP HELO command callback
 	mlfi_envfrom_cb,  // envelope sender callback
-	NULL,             // envelope recipient callback
+	mlfi_envrcpt_cb,  // envelope recipient callback
 	NULL,             // header callback
 	NULL,             // end of header callback
 	NULL,             // body block callback
 	mlfi_eom_cb,      // end of message callback
-	NULL,             // message aborted callback
-	NULL,             // connection cleanup callback
+	mlfi_abort_cb,    // message aborted callback
+	mlfi_close_cb,    // connection cleanup callback
 	NULL,             // unknown SMTP commands callback
-	NULL,             // DATA callback
+	mlfi_data_cb,     // DATA callback
 	NULL              // option negotiation callback
 };
 
+/**
+ * The file with the limit of the kernel for the listen queue of sockets.
+ */
+static char const * const KERNEL_BACKLOG_LIMIT_FILE = "/proc/sys/net/core/somaxconn";
+
+/**
+ * Returns the limit of the kernel for the listen queue of sockets.
+ *
+ * @return The value of `net.core.somaxconn` or zero, if it is unknown
+ */
+static unsigned int get_kernel_backlog_limit( void ) {
+	FILE* const file = fopen( KERNEL_BACKLOG_LIMIT_FILE, "r" );
+	if( file == NULL )
+		return 0;
+	unsigned int limit = 0;
+	if( fscanf( file, "%u", &limit ) != 1 )
+		limit = 0;
+	fclose( file );
+	return limit;
+}
+
+/**
+ * Logs the effective limits of libmilter and checks them against the LDAP
+ * settings.
+ *
+ * libmilter serves each SMTP session by a thread of its own, which shares
+ * the LDAP connection pool with all other sessions; connections beyond the
+ * backlog are refused by the kernel.
+ *
+ * @param backlog The backlog which has been requested from libmilter
+ */
+static void check_smfi_limits( unsigned int const backlog ) {
+	unsigned int const kernel_limit = get_kernel_backlog_limit();
+	unsigned int const effective_backlog = ( kernel_limit != 0 && kernel_limit < backlog ) ? kernel_limit : backlog;
+	log_msg(
+		LOG_INFO,
+		"setup_smfi: socket backlog %u (effective %u), MTA timeout %u s, %u LDAP connections, LDAP search deadline %u ms\n",
+		backlog,
+		effective_backlog,
+		rt_setting.mta_timeout,
+		rt_setting.ldap_pool_size,
+		rt_setting.ldap_search_deadline
+	);
+	if( effective_backlog < backlog ) {
+		log_msg(
+			LOG_WARNING,
+			"setup_smfi: socket backlog %u exceeds net.core.somaxconn, the kernel limits it to %u\n",
+			backlog,
+			effective_backlog
+		);
+	}
+	if( effective_backlog < rt_setting.ldap_pool_size ) {
+		log_msg(
+			LOG_WARNING,
+			"setup_smfi: socket backlog %u is smaller than the LDAP pool size %u, bursts are refused before the pool is busy\n",
+			effective_backlog,
+			rt_setting.ldap_pool_size
+		);
+	}
+	if( (unsigned long long)rt_setting.mta_timeout * 1000 <= rt_setting.ldap_search_deadline ) {
+		log_msg(
+			LOG_WARNING,
+			"setup_smfi: MTA timeout of %u s does not exceed the LDAP search deadline of %u ms\n",
+			rt_setting.mta_timeout,
+			rt_setting.ldap_search_deadline
+		);
+	}
+}
+
 int setup_smfi( void ) {
 	if( mkpdir( rt_setting.socket_file, 0755 ) != 0 && errno != EEXIST ) {
 		log_msg( LOG_ERR, "could not create parent directory for socket file %s: %s", rt_setting.socket_file, strerror( errno ) );
@@ -45,7 +117,29 @@ int setup_smfi( void ) {
 		return EX_UNAVAILABLE;
 	}
 
-	if( smfi_register( FILTER_DESC ) != MI_SUCCESS ) {
+	// Without an explicit backlog, libmilter listens with `SOMAXCONN`
+	unsigned int const backlog = rt_setting.socket_backlog != 0 ? rt_setting.socket_backlog : SOMAXCONN;
+	if(
+		rt_setting.socket_backlog != 0 &&
+		smfi_setbacklog( backlog < INT_MAX ? (int)backlog : INT_MAX ) != MI_SUCCESS
+	) {
+		log_msg( LOG_CRIT, "smfi_setup: smfi_setbacklog failed\n" );
+		return EX_CONFIG;
+	}
+
+	if( smfi_settimeout( rt_setting.mta_timeout < INT_MAX ? (int)rt_setting.mta_timeout : INT_MAX ) != MI_SUCCESS ) {
+		log_msg( LOG_CRIT, "smfi_setup: smfi_settimeout failed\n" );
+		return EX_CONFIG;
+	}
+	check_smfi_limits( backlog );
+
+	// Only request the action, if it is used; an MTA which does not offer it
+	// would refuse the filter otherwise
+	struct smfiDesc desc = FILTER_DESC;
+	if( rt_setting.recipient_esmtp_args != NULL )
+		desc.xxfi_flags |= SMFIF_ADDRCPT_PAR;
+
+	if( smfi_register( desc ) != MI_SUCCESS ) {
 		log_msg( LOG_CRIT, "smfi_setup: smfi_register failed\n" );
 		return EX_UNAVAILABLE;
 	}
@@ -1,17 +1,44 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sysexits.h>
 #include <libmilter/mfdef.h>
 
 #include "smfi_cb.h"
 #include "priv_data.h"
+#include "arena.h"
 #include "extldap.h"
 #include "extstring.h"
 #include "log.h"
+#include "metrics.h"
+#include "runtime_setting.h"
 
 static char * const AUTH_ACCT_MACRO = "{auth_authen}";
 
-sfsistat mlfi_envfrom_cb( SMFICTX * ctx, char* envfrom[] ) {
+/**
+ * Initializes the fields which correlate the log messages of a message.
+ */
+static void init_log_fields(
+	struct log_fields_t* const fields,
+	struct priv_data_t const * const priv_data,
+	char const * const stage
+) {
+	fields->session = priv_data;
+	fields->stage = stage;
+	fields->sender = priv_data->envelope_sender;
+	fields->auth_acct = priv_data->auth_acct;
+	fields->ldap_latency = -1;
+}
+
+/**
+ * Implements ::mlfi_envfrom_cb() apart from the metrics.
+ */
+static sfsistat handle_envfrom( SMFICTX * ctx, char* envfrom[] ) {
+	// A previous message of the same SMTP session may have left private
+	// data behind, if it has not reached the end of message stage.
+	free_priv_data( (struct priv_data_t*) smfi_getpriv( ctx ) );
+	smfi_setpriv( ctx, NULL );
+
 	char const * const auth_acct = smfi_getsymval( ctx, AUTH_ACCT_MACRO );
 
 	// Incoming mails from public SMTP servers have no autenticated session.
@@ -24,6 +51,10 @@ sfsistat mlfi_envfrom_cb( SMFICTX * ctx, char* envfrom[] ) {
 	// in the private data area for later use in EOM callback.
 
 	struct priv_data_t* priv_data = create_priv_data();
+	if( priv_data == NULL ) {
+		log_msg( LOG_ERR, "mlfi_env_from_cb: could not allocate private data\n" );
+		return SMFIS_CONTINUE;
+	}
 
 	// envfrom - Null-terminated SMTP command arguments;
 	// argv[0] is guaranteed to be the sender address.
@@ -34,40 +65,88 @@ sfsistat mlfi_envfrom_cb( SMFICTX * ctx, char* envfrom[] ) {
 	// Normalize,envelope from address.
 	// In case it is surrounded by angular brackets , e.g. `<local@domain.tld>`,
 	// remove the brackets.
-	size_t const env_from_addr_len = strlen( envfrom[0] );
-	char* env_from_addr = NULL;
-	if ( envfrom[0][0] == '<' ) {
-		env_from_addr = malloc( env_from_addr_len - 1 );
-		strncpy( env_from_addr, envfrom[0] + 1, env_from_addr_len - 2 );
-		env_from_addr[ env_from_addr_len - 2 ] = '\0';
-	} else {
-		env_from_addr = malloc( env_from_addr_len + 1 );
-		strncpy( env_from_addr, envfrom[0], env_from_addr_len );
-		env_from_addr[ env_from_addr_len ] = '\0';
+	char const * env_from_addr = envfrom[0];
+	size_t env_from_addr_len = strlen( env_from_addr );
+	if ( env_from_addr[0] == '<' && env_from_addr_len >= 2 ) {
+		++env_from_addr;
+		env_from_addr_len -= 2;
 	}
-	set_priv_data_envelope_sender( priv_data, env_from_addr );
-	free( env_from_addr );
+	// Copy the address directly into the arena of the session, there is no
+	// need for an intermediate buffer
+	priv_data->envelope_sender = copy_string_to_arena( priv_data->arena, env_from_addr, env_from_addr_len );
 	set_priv_data_auth_acct( priv_data, auth_acct );
 
-	log_msg(
-		LOG_DEBUG,
-		"mlfi_env_from_cb (%p): envelope sender:       %s\n",
-		(void*)priv_data,
-		str_or_null( priv_data->envelope_sender )
-	);
-	log_msg(
-		LOG_DEBUG,
-		"mlfi_env_from_cb (%p): authenticated account: %s\n",
-		(void*)priv_data,
-		str_or_null( priv_data->auth_acct )
-	);
+	struct log_fields_t log_fields;
+	init_log_fields( &log_fields, priv_data, "envfrom" );
+	log_session_msg( LOG_DEBUG, &log_fields, "starting alias lookup\n" );
+
+	// Start the LDAP searches now, such that their latency is hidden behind
+	// the transfer of the message body; the results are collected in the
+	// EOM callback.
+	priv_data->alias_lookup = start_alias_lookup( priv_data->arena, priv_data->envelope_sender, priv_data->auth_acct );
 
 	// Save pointer to private data in SMFI context
 	smfi_setpriv( ctx, priv_data );
 	return SMFIS_CONTINUE;
 }
 
-sfsistat mlfi_eom_cb( SMFICTX* ctx ) {
+sfsistat mlfi_envfrom_cb( SMFICTX * ctx, char* envfrom[] ) {
+	count_metric( METRIC_ENVFROM_CALLBACKS, 1 );
+	uint64_t const observation = start_metric_observation();
+	sfsistat const result = handle_envfrom( ctx, envfrom );
+	observe_metric( METRIC_ENVFROM_LATENCY, observation );
+	return result;
+}
+
+/**
+ * Collects the results of the LDAP searches which have been started at
+ * `MAIL FROM` and have been received in the meantime, such that their
+ * connection returns to the pool before the message is transferred.
+ */
+static void poll_priv_data( SMFICTX* const ctx ) {
+	struct priv_data_t* const priv_data = (struct priv_data_t*) smfi_getpriv( ctx );
+	if( priv_data != NULL )
+		poll_alias_lookup( priv_data->alias_lookup );
+}
+
+sfsistat mlfi_envrcpt_cb( SMFICTX* ctx, char* envrcpt[] ) {
+	(void)envrcpt;
+	poll_priv_data( ctx );
+	return SMFIS_CONTINUE;
+}
+
+sfsistat mlfi_data_cb( SMFICTX* ctx ) {
+	poll_priv_data( ctx );
+	return SMFIS_CONTINUE;
+}
+
+/**
+ * Adds all addresses of an array as recipients to the current message.
+ *
+ * The addresses are emitted in a single loop without any logging in
+ * between.
+ *
+ * @return The number of addresses which could not be added
+ */
+static size_t add_recipients( SMFICTX* const ctx, struct string_array_t const * const addresses ) {
+	uint64_t const observation = start_metric_observation();
+	size_t const size = get_string_array_size( addresses );
+	char* const args = rt_setting.recipient_esmtp_args;
+	size_t failed = 0;
+	for( size_t i = 0; i != size; ++i ) {
+		char* const rcpt = (char*)get_string_array_at( addresses, i );
+		int const result = args != NULL ? smfi_addrcpt_par( ctx, rcpt, args ) : smfi_addrcpt( ctx, rcpt );
+		if( result != MI_SUCCESS )
+			++failed;
+	}
+	observe_metric( METRIC_ADDRCPT_LATENCY, observation );
+	return failed;
+}
+
+/**
+ * Implements ::mlfi_eom_cb() apart from the metrics.
+ */
+static sfsistat handle_eom( SMFICTX* ctx ) {
 	struct priv_data_t* priv_data = (struct priv_data_t*) smfi_getpriv( ctx );
 
 	// If we do not have any private data, the current mail is likely an
@@ -78,34 +157,75 @@ sfsistat mlfi_eom_cb( SMFICTX* ctx ) {
 		return SMFIS_CONTINUE;
 	}
 
-	struct string_array_t* list_addresses = search_mail_addresses_of_list( priv_data->envelope_sender );
+	struct string_array_t* list_addresses = NULL;
+	struct string_array_t* own_mail_addresses = NULL;
+	struct alias_lookup_t* lookup = priv_data->alias_lookup;
+	priv_data->alias_lookup = NULL;
+	if( lookup == NULL ) {
+		lookup = start_alias_lookup( priv_data->arena, priv_data->envelope_sender, priv_data->auth_acct );
+	}
+	int const lookup_result = finish_alias_lookup( lookup, &list_addresses, &own_mail_addresses );
+	struct log_fields_t log_fields;
+	init_log_fields( &log_fields, priv_data, "eom" );
+	log_fields.ldap_latency = get_alias_lookup_latency( lookup );
+	if( lookup_result != EX_OK ) {
+		count_metric( METRIC_LOOKUP_ERRORS, 1 );
+		int const accept = ( rt_setting.ldap_failure_policy == FAILURE_POLICY_ACCEPT );
+		log_session_msg(
+			LOG_ERR,
+			&log_fields,
+			"could not resolve aliases, %s\n",
+			accept ? "passing mail unmodified" : "rejecting mail temporarily"
+		);
+		free_priv_data( priv_data );
+		smfi_setpriv( ctx, NULL );
+		return accept ? SMFIS_CONTINUE : SMFIS_TEMPFAIL;
+	}
 
 	if( get_string_array_size( list_addresses ) != 0 ) {
-		log_msg(
-			LOG_DEBUG,
-			"mlfi_eom_cb (%p): sender is a mailing list: %s\n",
-			(void*)priv_data,
-			priv_data->envelope_sender
-		);
-		struct string_array_t* own_mail_addresses = search_mail_addresses_by_account( priv_data->auth_acct );
-		sort_string_array( list_addresses );
-		sort_string_array( own_mail_addresses );
-		substract_string_array( list_addresses, own_mail_addresses );
+		log_session_msg( LOG_DEBUG, &log_fields, "sender is a mailing list\n" );
+		uint64_t const observation = start_metric_observation();
+		int const substract_result = substract_mail_addresses( list_addresses, own_mail_addresses );
+		observe_metric( METRIC_SUBSTRACT_LATENCY, observation );
+		if( substract_result != EX_OK ) {
+			// The sender merely receives a copy of their own mail
+			log_session_msg( LOG_ERR, &log_fields, "could not remove own mail addresses\n" );
+		}
 		free_string_array( own_mail_addresses );
 		size_t const size = get_string_array_size( list_addresses );
-		char const * bcc;
-		for( size_t i = 0; i != size; ++i ) {
-			bcc = (char*)get_string_array_at( list_addresses, i );
-			log_msg( LOG_DEBUG, "mlfi_eom_cb (%p): adding bcc to: %s\n", (void*)priv_data, bcc );
-			smfi_addrcpt( ctx, (char*)bcc );
+		if( rt_setting.max_recipients != 0 && size > rt_setting.max_recipients ) {
+			log_session_msg(
+				LOG_ERR,
+				&log_fields,
+				"rejecting mail, %zu recipients exceed limit of %u\n",
+				size,
+				rt_setting.max_recipients
+			);
+			smfi_setreply( ctx, "550", "5.5.3", "Too many recipients" );
+			free_string_array( list_addresses );
+			free_priv_data( priv_data );
+			smfi_setpriv( ctx, NULL );
+			return SMFIS_REJECT;
 		}
-	} else {
-		log_msg(
-			LOG_DEBUG,
-			"mlfi_eom_cb (%p): sender is not a mailing list: %s\n",
-			(void*)priv_data,
-			priv_data->envelope_sender
+		size_t const failed = add_recipients( ctx, list_addresses );
+		count_metric( METRIC_BCCS_ADDED, size - failed );
+		count_metric( METRIC_RECIPIENT_ERRORS, failed );
+		log_session_msg(
+			failed == 0 ? LOG_DEBUG : LOG_ERR,
+			&log_fields,
+			"added %zu of %zu recipients\n",
+			size - failed,
+			size
 		);
+		if( failed != 0 ) {
+			// The MTA discards the recipients which have already been added
+			free_string_array( list_addresses );
+			free_priv_data( priv_data );
+			smfi_setpriv( ctx, NULL );
+			return SMFIS_TEMPFAIL;
+		}
+	} else {
+		log_session_msg( LOG_DEBUG, &log_fields, "sender is not a mailing list\n" );
 	}
 
 	free_string_array( list_addresses );
@@ -114,3 +234,34 @@ sfsistat mlfi_eom_cb( SMFICTX* ctx ) {
 
 	return SMFIS_CONTINUE;
 }
+
+sfsistat mlfi_eom_cb( SMFICTX* ctx ) {
+	count_metric( METRIC_EOM_CALLBACKS, 1 );
+	uint64_t const observation = start_metric_observation();
+	sfsistat const result = handle_eom( ctx );
+	observe_metric( METRIC_EOM_LATENCY, observation );
+	return result;
+}
+
+sfsistat mlfi_abort_cb( SMFICTX* ctx ) {
+	count_metric( METRIC_ABORT_CALLBACKS, 1 );
+	struct priv_data_t* priv_data = (struct priv_data_t*) smfi_getpriv( ctx );
+	if( priv_data != NULL ) {
+		struct log_fields_t log_fields;
+		init_log_fields( &log_fields, priv_data, "abort" );
+		log_session_msg( LOG_DEBUG, &log_fields, "message aborted\n" );
+		free_priv_data( priv_data );
+		smfi_setpriv( ctx, NULL );
+	}
+	return SMFIS_CONTINUE;
+}
+
+sfsistat mlfi_close_cb( SMFICTX* ctx ) {
+	count_metric( METRIC_CLOSE_CALLBACKS, 1 );
+	struct priv_data_t* priv_data = (struct priv_data_t*) smfi_getpriv( ctx );
+	if( priv_data != NULL ) {
+		free_priv_data( priv_data );
+		smfi_setpriv( ctx, NULL );
+	}
+	return SMFIS_CONTINUE;
+}
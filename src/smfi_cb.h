@@ -11,17 +11,43 @@
 /**
  * @brief Saves relevant information of the SMTP `MAIL FROM` stage for later use.
  *
- * This callback does not actually do anything except stashing away relevant
- * information in the private data area of the session context for later use
- * during the `END OF MESSAGE` stage.
+ * This callback stashes away relevant information in the private data area
+ * of the session context for later use during the `END OF MESSAGE` stage
+ * and starts the LDAP searches for the sender in the background.
  * Unless the process runs out of memory, this method does not fail.
  */
 sfsistat mlfi_envfrom_cb( SMFICTX * ctx, char* envfrom[] );
 
+/**
+ * Collects the results of the LDAP searches for the sender, if they have
+ * already been received, and returns their LDAP connection to the pool.
+ *
+ * The callback never waits for LDAP.
+ */
+sfsistat mlfi_envrcpt_cb( SMFICTX* ctx, char* envrcpt[] );
+
+/**
+ * Collects the results of the LDAP searches for the sender like
+ * ::mlfi_envrcpt_cb() before the message is transferred.
+ */
+sfsistat mlfi_data_cb( SMFICTX* ctx );
+
 /**
  * If the sender address is an alias, this method resolves the alias and
  * adds all members of the alias except the current sender as recipients.
  */
 sfsistat mlfi_eom_cb( SMFICTX* ctx );
 
+/**
+ * Releases the private data including pending LDAP searches, if the
+ * current message is aborted.
+ */
+sfsistat mlfi_abort_cb( SMFICTX* ctx );
+
+/**
+ * Releases the private data including pending LDAP searches, if the
+ * SMTP session is closed.
+ */
+sfsistat mlfi_close_cb( SMFICTX* ctx );
+
 #endif
@@ -0,0 +1,220 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "snapshot.h"
+
+/**
+ * Identifies a snapshot file.
+ */
+static char const SNAPSHOT_MAGIC[8] = { 'M', 'L', 'T', 'A', 'L', 'I', 'A', 'S' };
+
+/**
+ * The version of the file format; must be incremented whenever the layout
+ * of the file or of the serialized index changes.
+ */
+static uint32_t const SNAPSHOT_VERSION = 1;
+
+/**
+ * Detects a file which has been written on a machine with a different
+ * byte order.
+ */
+static uint32_t const SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+/**
+ * The header of a snapshot file.
+ *
+ * The header is followed by the serialized index of mailing lists and by
+ * the serialized index of accounts, if `mail_accts_size` is not zero.
+ * All sizes are multiples of 8, hence both indices are aligned.
+ */
+struct snapshot_header_t {
+	char magic[8]; /**< Equals ::SNAPSHOT_MAGIC. */
+	uint32_t version; /**< Equals ::SNAPSHOT_VERSION. */
+	uint32_t byte_order; /**< Equals ::SNAPSHOT_BYTE_ORDER. */
+	uint64_t created; /**< The creation time in seconds since the epoch. */
+	uint64_t mail_lists_size; /**< The size of the index of mailing lists in bytes. */
+	uint64_t mail_accts_size; /**< The size of the index of accounts in bytes or zero. */
+};
+
+struct snapshot_t {
+	struct alias_index_t* mail_lists; /**< The index of mailing lists to members. */
+	struct alias_index_t* mail_accts; /**< The index of accounts to own addresses or `NULL`. */
+	time_t created; /**< The creation time. */
+	void* mapping; /**< The mapped file or `NULL`, if the snapshot is not backed by a file. */
+	size_t mapping_size; /**< The size of the mapping in bytes. */
+};
+
+struct snapshot_t* create_snapshot( struct alias_index_t* mail_lists, struct alias_index_t* mail_accts ) {
+	struct snapshot_t* const snapshot = malloc( sizeof( struct snapshot_t ) );
+	if( snapshot == NULL || mail_lists == NULL ) {
+		free( snapshot );
+		free_alias_index( mail_lists );
+		free_alias_index( mail_accts );
+		return NULL;
+	}
+	snapshot->mail_lists = mail_lists;
+	snapshot->mail_accts = mail_accts;
+	snapshot->created = time( NULL );
+	snapshot->mapping = NULL;
+	snapshot->mapping_size = 0;
+	return snapshot;
+}
+
+struct snapshot_t* map_snapshot( char const * path ) {
+	int const fd = open( path, O_RDONLY | O_CLOEXEC );
+	if( fd == -1 )
+		return NULL;
+	struct stat st;
+	if( fstat( fd, &st ) != 0 ) {
+		close( fd );
+		return NULL;
+	}
+	if( st.st_size < (off_t)sizeof( struct snapshot_header_t ) ) {
+		close( fd );
+		errno = EINVAL;
+		return NULL;
+	}
+	size_t const size = (size_t)st.st_size;
+	void* const mapping = mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if( mapping == MAP_FAILED )
+		return NULL;
+	// The whole file is needed at once, hence read ahead
+	madvise( mapping, size, MADV_WILLNEED );
+
+	struct snapshot_header_t header;
+	memcpy( &header, mapping, sizeof( header ) );
+	size_t const available = size - sizeof( header );
+	if(
+		memcmp( header.magic, SNAPSHOT_MAGIC, sizeof( SNAPSHOT_MAGIC ) ) != 0 ||
+		header.version != SNAPSHOT_VERSION ||
+		header.byte_order != SNAPSHOT_BYTE_ORDER ||
+		header.mail_lists_size > available ||
+		header.mail_accts_size != available - header.mail_lists_size
+	) {
+		munmap( mapping, size );
+		errno = EINVAL;
+		return NULL;
+	}
+
+	char const * const data = (char const *)mapping + sizeof( header );
+	struct alias_index_t* const mail_lists = open_alias_index( data, header.mail_lists_size );
+	struct alias_index_t* const mail_accts = header.mail_accts_size != 0 ?
+		open_alias_index( data + header.mail_lists_size, header.mail_accts_size ) : NULL;
+	if( mail_lists == NULL || ( header.mail_accts_size != 0 && mail_accts == NULL ) ) {
+		free_alias_index( mail_lists );
+		free_alias_index( mail_accts );
+		munmap( mapping, size );
+		errno = EINVAL;
+		return NULL;
+	}
+
+	struct snapshot_t* const snapshot = create_snapshot( mail_lists, mail_accts );
+	if( snapshot == NULL ) {
+		munmap( mapping, size );
+		errno = ENOMEM;
+		return NULL;
+	}
+	snapshot->created = (time_t)header.created;
+	snapshot->mapping = mapping;
+	snapshot->mapping_size = size;
+	return snapshot;
+}
+
+/**
+ * Writes a block of data completely.
+ */
+static int write_all( int const fd, void const * const data, size_t const size ) {
+	char const * pos = data;
+	size_t remaining = size;
+	while( remaining != 0 ) {
+		ssize_t const written = write( fd, pos, remaining );
+		if( written == -1 ) {
+			if( errno == EINTR )
+				continue;
+			return -1;
+		}
+		pos += written;
+		remaining -= (size_t)written;
+	}
+	return 0;
+}
+
+int write_snapshot( struct snapshot_t const * snapshot, char const * path ) {
+	size_t mail_lists_size = 0;
+	size_t mail_accts_size = 0;
+	void const * const mail_lists = get_alias_index_data( snapshot->mail_lists, &mail_lists_size );
+	void const * const mail_accts = snapshot->mail_accts != NULL ?
+		get_alias_index_data( snapshot->mail_accts, &mail_accts_size ) : NULL;
+
+	struct snapshot_header_t header;
+	memset( &header, 0, sizeof( header ) );
+	memcpy( header.magic, SNAPSHOT_MAGIC, sizeof( SNAPSHOT_MAGIC ) );
+	header.version = SNAPSHOT_VERSION;
+	header.byte_order = SNAPSHOT_BYTE_ORDER;
+	header.created = (uint64_t)snapshot->created;
+	header.mail_lists_size = mail_lists_size;
+	header.mail_accts_size = mail_accts_size;
+
+	// Write to a temporary file and rename it, such that the file is never
+	// seen half-written and an existing mapping of the previous file keeps
+	// its content (the old inode lives on until it is unmapped).
+	char* const tmp_path = malloc( strlen( path ) + 5 );
+	if( tmp_path == NULL )
+		return -1;
+	strcpy( tmp_path, path );
+	strcat( tmp_path, ".tmp" );
+
+	int const fd = open( tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640 );
+	if( fd == -1 ) {
+		free( tmp_path );
+		return -1;
+	}
+	int result = write_all( fd, &header, sizeof( header ) );
+	if( result == 0 )
+		result = write_all( fd, mail_lists, mail_lists_size );
+	if( result == 0 && mail_accts != NULL )
+		result = write_all( fd, mail_accts, mail_accts_size );
+	if( result == 0 )
+		result = fsync( fd );
+	if( close( fd ) != 0 )
+		result = -1;
+	if( result == 0 )
+		result = rename( tmp_path, path );
+	if( result != 0 ) {
+		int const saved_errno = errno;
+		unlink( tmp_path );
+		errno = saved_errno;
+	}
+	free( tmp_path );
+	return result;
+}
+
+void free_snapshot( struct snapshot_t* snapshot ) {
+	if( snapshot == NULL ) return;
+	free_alias_index( snapshot->mail_lists );
+	free_alias_index( snapshot->mail_accts );
+	if( snapshot->mapping != NULL )
+		munmap( snapshot->mapping, snapshot->mapping_size );
+	free( snapshot );
+}
+
+struct alias_index_t const * get_snapshot_mail_lists( struct snapshot_t const * snapshot ) {
+	return snapshot->mail_lists;
+}
+
+struct alias_index_t const * get_snapshot_mail_accts( struct snapshot_t const * snapshot ) {
+	return snapshot->mail_accts;
+}
+
+time_t get_snapshot_time( struct snapshot_t const * snapshot ) {
+	return snapshot->created;
+}
@@ -0,0 +1,98 @@
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+/**
+ * @file
+ * @brief Compounds and functions for snapshots of all mailing lists and
+ * accounts and their on-disk representation.
+ */
+
+#include <time.h>
+
+#include "alias_index.h"
+
+/**
+ * An immutable snapshot of all mailing lists and, optionally, of all
+ * accounts.
+ *
+ * A snapshot is either built from LDAP results or mapped read-only from a
+ * snapshot file.
+ * In the latter case, the indices are used directly from the mapping
+ * without copying, such that a snapshot of any size is available
+ * immediately after start.
+ *
+ * The snapshot file is versioned and only valid on machines with the same
+ * byte order; any mismatch is treated like a missing file.
+ */
+struct snapshot_t;
+
+/**
+ * Creates a snapshot from two indices.
+ *
+ * The snapshot takes ownership of the indices.
+ *
+ * @param mail_lists The index of mailing lists to members
+ * @param mail_accts The index of accounts to own addresses or `NULL`
+ * @return The pointer to the allocated snapshot or `NULL` in case of an
+ * error, in which case the indices are freed.
+ */
+struct snapshot_t* create_snapshot( struct alias_index_t* mail_lists, struct alias_index_t* mail_accts );
+
+/**
+ * Maps a snapshot file read-only into memory.
+ *
+ * @param path The path of the snapshot file
+ * @return The pointer to the allocated snapshot or `NULL` in case of an
+ * error, in which case `errno` is set; `errno` equals `ENOENT`, if the file
+ * does not exist, and `EINVAL`, if the file is incompatible or corrupt.
+ */
+struct snapshot_t* map_snapshot( char const * path );
+
+/**
+ * Writes a snapshot to a file.
+ *
+ * The file is replaced atomically, such that a concurrent reader or a
+ * mapping of the previous file is never affected by a partially written
+ * file.
+ *
+ * @param snapshot The snapshot
+ * @param path The path of the snapshot file
+ * @return Zero on success; on error, -1 is returned and `errno` is set to
+ * indicate the error.
+ */
+int write_snapshot( struct snapshot_t const * snapshot, char const * path );
+
+/**
+ * Frees a snapshot including its indices and unmaps its file.
+ *
+ * Note, the function is NULL-pointer safe.
+ *
+ * @param snapshot The snapshot to be freed.
+ */
+void free_snapshot( struct snapshot_t* snapshot );
+
+/**
+ * Returns the index of mailing lists to members.
+ *
+ * @param snapshot The snapshot
+ * @return The index
+ */
+struct alias_index_t const * get_snapshot_mail_lists( struct snapshot_t const * snapshot );
+
+/**
+ * Returns the index of accounts to own addresses.
+ *
+ * @param snapshot The snapshot
+ * @return The index or `NULL`, if the snapshot does not contain accounts
+ */
+struct alias_index_t const * get_snapshot_mail_accts( struct snapshot_t const * snapshot );
+
+/**
+ * Returns the point in time at which the snapshot has been created.
+ *
+ * @param snapshot The snapshot
+ * @return The creation time
+ */
+time_t get_snapshot_time( struct snapshot_t const * snapshot );
+
+#endif
@@ -1,11 +1,41 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
+#include <sysexits.h>
 
 #include "string_array.h"
+#include "arena.h"
+#include "mail_address.h"
+
+/**
+ * The position of a single string in the string pool.
+ */
+struct string_array_entry_t {
+	size_t offset; /**< The offset of the first character into the pool. */
+	size_t len; /**< The length of the string without the terminating null byte. */
+	size_t key_offset; /**< The offset of the normalized key into the pool; equals `offset`, if the key equals the string. */
+	size_t key_len; /**< The length of the normalized key. */
+	uint64_t hash; /**< The hash of the normalized key. */
+};
 
 /**
  * A string array.
+ *
+ * All strings are stored back to back including their terminating null
+ * bytes in a single growable buffer, the string pool.
+ * The array itself only holds the offset and length of each string.
+ * Hence, the number of allocations does not depend on the number of
+ * strings, and sorting and comparing the strings only touches two
+ * contiguous blocks of memory.
+ * As the pool may be moved by a reallocation, entries store offsets rather
+ * than pointers.
+ *
+ * An array of mail addresses additionally stores the normalized key of
+ * each string and its hash, see ::set_mail_address_normalization().
+ * A key which differs from its string follows the string in the pool
+ * without a terminating null byte.
  */
 struct string_array_t {
 	/**
@@ -16,92 +46,302 @@ struct string_array_t {
 	 */
 	size_t capacity;
 	size_t size; /**< The number of actual elements in the array; always smaller than capacity. */
-	char** values; /**< The internal pointer to the beginning of the memory block */
+	struct string_array_entry_t* entries; /**< The positions of the strings in the pool. */
+	char* pool; /**< The string pool. */
+	size_t pool_size; /**< The number of used bytes of the pool. */
+	size_t pool_capacity; /**< The size of the pool in bytes. */
+	struct arena_t* arena; /**< The arena which owns the array and its strings or `NULL`, if they are allocated by `malloc`. */
+	int key_options; /**< The options of ::normalize_mail_address() for the keys or ::KEY_OPTIONS_NONE. */
 };
 
+/**
+ * The value of ::string_array_t::key_options of an array without keys.
+ */
+static int const KEY_OPTIONS_NONE = -1;
+
+/**
+ * The estimated average length of a string including the terminating null
+ * byte which is used to size the initial string pool.
+ */
+static size_t const STRING_ARRAY_AVG_LEN = 32;
+
+/**
+ * Allocates memory from the arena of the array or by `malloc`.
+ */
+static void* alloc_string_array_memory( struct arena_t* const arena, size_t const size ) {
+	return arena != NULL ? alloc_from_arena( arena, size ) : malloc( size );
+}
+
+/**
+ * Grows a block of memory of the array.
+ *
+ * An arena cannot grow a block in place; the old block is abandoned and
+ * released with the arena.
+ */
+static void* grow_string_array_memory( struct arena_t* const arena, void* const old, size_t const old_size, size_t const new_size ) {
+	if( arena == NULL )
+		return realloc( old, new_size );
+	void* const result = alloc_from_arena( arena, new_size );
+	if( result != NULL && old_size != 0 )
+		memcpy( result, old, old_size );
+	return result;
+}
+
 struct string_array_t* create_string_array( size_t capacity ) {
-	struct string_array_t* result = malloc( sizeof( struct string_array_t ) );
+	return create_string_array_arena( NULL, capacity );
+}
+
+struct string_array_t* create_string_array_arena( struct arena_t* arena, size_t capacity ) {
+	struct string_array_t* result = alloc_string_array_memory( arena, sizeof( struct string_array_t ) );
 	if( result == NULL )
 		return NULL;
 	result->capacity = capacity;
 	result->size = 0;
-	result->values = malloc( (capacity + 1) * sizeof( char* ) );
-	if( result->values == NULL ) {
-		free( result );
+	result->arena = arena;
+	result->key_options = KEY_OPTIONS_NONE;
+	result->pool_size = 0;
+	result->pool_capacity = ( capacity != 0 ? capacity : 1 ) * STRING_ARRAY_AVG_LEN;
+	result->entries = alloc_string_array_memory( arena, ( capacity != 0 ? capacity : 1 ) * sizeof( struct string_array_entry_t ) );
+	result->pool = alloc_string_array_memory( arena, result->pool_capacity );
+	if( result->entries == NULL || result->pool == NULL ) {
+		if( arena == NULL ) {
+			free( result->entries );
+			free( result->pool );
+			free( result );
+		}
 		return NULL;
 	}
-	result->values[0] = NULL;
 	return result;
 }
 
 void free_string_array( struct string_array_t* array ) {
-	for( size_t i = 0; i != array->size; ++i ) {
-		free( array->values[i] );
-	}
-	free( array->values );
+	if( array->arena != NULL )
+		return;
+	free( array->entries );
+	free( array->pool );
 	free( array );
 }
 
+struct string_array_t* copy_string_array( struct string_array_t const * array ) {
+	struct string_array_t* result = malloc( sizeof( struct string_array_t ) );
+	if( result == NULL )
+		return NULL;
+	// The copy is exactly as large as required; both blocks are copied at
+	// once without looking at the individual strings or keys.
+	result->capacity = array->size != 0 ? array->size : 1;
+	result->size = array->size;
+	result->arena = NULL;
+	result->key_options = array->key_options;
+	result->pool_size = array->pool_size;
+	result->pool_capacity = array->pool_size != 0 ? array->pool_size : 1;
+	result->entries = malloc( result->capacity * sizeof( struct string_array_entry_t ) );
+	result->pool = malloc( result->pool_capacity );
+	if( result->entries == NULL || result->pool == NULL ) {
+		free( result->entries );
+		free( result->pool );
+		free( result );
+		return NULL;
+	}
+	memcpy( result->entries, array->entries, array->size * sizeof( struct string_array_entry_t ) );
+	memcpy( result->pool, array->pool, array->pool_size );
+	return result;
+}
+
 size_t get_string_array_size( struct string_array_t const * array ) {
 	return array->size;
 }
 
 char const* get_string_array_at( struct string_array_t const * array, size_t const pos ) {
-	return array->values[pos];
+	return array->pool + array->entries[pos].offset;
 }
 
 char const * push_onto_string_array( struct string_array_t* array, char const * str ) {
 	return push_onto_string_array_l( array, str, strlen( str ) );
 }
 
+/**
+ * Ensures that at least `extra` more bytes fit into the string pool.
+ */
+static int reserve_string_array_pool( struct string_array_t* const array, size_t const extra ) {
+	if( array->pool_capacity - array->pool_size >= extra )
+		return EX_OK;
+	size_t new_pool_capacity = 2 * array->pool_capacity;
+	while( new_pool_capacity - array->pool_size < extra )
+		new_pool_capacity *= 2;
+	char* const new_pool = grow_string_array_memory( array->arena, array->pool, array->pool_size, new_pool_capacity );
+	if ( new_pool == NULL ) {
+		return EX_OSERR;
+	}
+	array->pool_capacity = new_pool_capacity;
+	array->pool = new_pool;
+	return EX_OK;
+}
+
+/**
+ * Computes the key of an entry and appends it to the pool, unless it equals
+ * the string.
+ *
+ * The caller must have reserved at least ::string_array_entry_t::len
+ * bytes in the pool.
+ */
+static void set_string_array_entry_key( struct string_array_t* const array, struct string_array_entry_t* const entry ) {
+	char const * const str = array->pool + entry->offset;
+	char* const key = array->pool + array->pool_size;
+	size_t const key_len = normalize_mail_address( str, entry->len, array->key_options, key );
+	if( key_len == entry->len && memcmp( key, str, key_len ) == 0 ) {
+		entry->key_offset = entry->offset;
+	} else {
+		entry->key_offset = array->pool_size;
+		array->pool_size += key_len;
+	}
+	entry->key_len = key_len;
+	entry->hash = hash_mail_address_key( array->pool + entry->key_offset, key_len );
+}
+
 char const * push_onto_string_array_l( struct string_array_t* array, char const * str, size_t len ) {
 	if( array->size == array->capacity ) {
-		array->capacity *= 2;
-		char** new_buf = realloc( array->values, (array->capacity + 1) * sizeof( char* ) );
-		if ( new_buf == NULL ) {
+		size_t const new_capacity = array->capacity != 0 ? 2 * array->capacity : 1;
+		struct string_array_entry_t* const new_entries = grow_string_array_memory(
+			array->arena,
+			array->entries,
+			array->size * sizeof( struct string_array_entry_t ),
+			new_capacity * sizeof( struct string_array_entry_t )
+		);
+		if ( new_entries == NULL ) {
 			// could not increase array, return NULL to indicate error
 			return NULL;
 		}
-		array->values = new_buf;
+		array->capacity = new_capacity;
+		array->entries = new_entries;
 	}
-	array->values[ array->size ] = malloc( len + 1 );
-	if ( array->values[ array->size ] != NULL ) {
-		strncpy( array->values[ array->size ], str, len );
-		array->values[ array->size ][len] = '\0';
+	// A key is never longer than its string
+	if( reserve_string_array_pool( array, array->key_options != KEY_OPTIONS_NONE ? 2 * len + 1 : len + 1 ) != EX_OK ) {
+		return NULL;
 	}
+	char* const copy = array->pool + array->pool_size;
+	memcpy( copy, str, len );
+	copy[len] = '\0';
+	struct string_array_entry_t* const entry = &array->entries[ array->size ];
+	entry->offset = array->pool_size;
+	entry->len = len;
+	entry->key_offset = entry->offset;
+	entry->key_len = len;
+	entry->hash = 0;
+	array->pool_size += len + 1;
+	if( array->key_options != KEY_OPTIONS_NONE )
+		set_string_array_entry_key( array, entry );
 	array->size++;
-	array->values[ array->size ] = NULL;
-	// Note: If we were able to increase the array size, but could allocate
-	// memory to copy the string, the line below returns `NULL` (instead of
-	// a pointer to the newly allocated string) which is actually what we want
-	// to indicate an error.
-	return array->values[ array->size - 1 ];
+	return copy;
+}
+
+int set_mail_address_normalization( struct string_array_t* array, int options ) {
+	if( array->key_options == options )
+		return EX_OK;
+	// Reserve space for all keys up front, such that the array is either
+	// normalized completely or not at all
+	size_t extra = 0;
+	for( size_t i = 0; i != array->size; ++i )
+		extra += array->entries[i].len;
+	int const result = reserve_string_array_pool( array, extra );
+	if( result != EX_OK )
+		return result;
+	// Keys of the previous options are abandoned in the pool
+	array->key_options = options;
+	for( size_t i = 0; i != array->size; ++i )
+		set_string_array_entry_key( array, &array->entries[i] );
+	return EX_OK;
+}
+
+/**
+ * A function which compares two entries like `strcmp`.
+ */
+typedef int (*entry_compare_t)(
+	struct string_array_t const *,
+	struct string_array_entry_t const *,
+	struct string_array_t const *,
+	struct string_array_entry_t const *
+);
+
+/**
+ * Compares the strings of two entries.
+ */
+static int compare_entry_strings(
+	struct string_array_t const * const array_a,
+	struct string_array_entry_t const * const a,
+	struct string_array_t const * const array_b,
+	struct string_array_entry_t const * const b
+) {
+	return strcmp( array_a->pool + a->offset, array_b->pool + b->offset );
 }
 
-static int comp( void const * a, void const * b ) {
-	char const * const * const aa = (char const * const *)a;
-	char const * const * const bb = (char const * const *)b;
-	return strcmp( *aa, *bb );
+/**
+ * Compares the normalized keys of two entries.
+ *
+ * Keys are ordered by their bytes; a key which is a prefix of another key
+ * comes first.
+ */
+static int compare_entry_keys(
+	struct string_array_t const * const array_a,
+	struct string_array_entry_t const * const a,
+	struct string_array_t const * const array_b,
+	struct string_array_entry_t const * const b
+) {
+	size_t const min_len = a->key_len < b->key_len ? a->key_len : b->key_len;
+	int const result = memcmp( array_a->pool + a->key_offset, array_b->pool + b->key_offset, min_len );
+	if( result != 0 || a->key_len == b->key_len )
+		return result;
+	return a->key_len < b->key_len ? -1 : 1;
+}
+
+/**
+ * The context of ::comp() for `qsort_r`.
+ */
+struct string_array_sort_t {
+	struct string_array_t const * array; /**< The array which is sorted. */
+	entry_compare_t compare; /**< The comparison function. */
+};
+
+static int comp( void const * a, void const * b, void* context ) {
+	struct string_array_sort_t const * const sort = context;
+	return sort->compare( sort->array, a, sort->array, b );
+}
+
+static void sort_string_array_by( struct string_array_t* const array, entry_compare_t const compare ) {
+	struct string_array_sort_t sort = { array, compare };
+	qsort_r( array->entries, array->size, sizeof( struct string_array_entry_t ), comp, &sort );
 }
 
 void sort_string_array( struct string_array_t* array ) {
-	qsort( array->values, array->size, sizeof(char*), comp );
+	sort_string_array_by( array, compare_entry_strings );
 }
 
-void substract_string_array( struct string_array_t * const array, struct string_array_t const * const diff ) {
+/**
+ * Common implementation of ::substract_string_array() and the merge-based
+ * path of ::substract_mail_addresses().
+ *
+ * Both arrays must be sorted according to `compare`; `diff` may be `NULL`.
+ */
+static void substract_sorted_string_array(
+	struct string_array_t * const array,
+	struct string_array_t const * const diff,
+	entry_compare_t const compare
+) {
+	size_t const diff_size = diff != NULL ? diff->size : 0;
 	size_t i1 = 0; // the smaller position in `array` where the next element to-be-kept is inserted
 	size_t i2 = 0; // the larger position in `array` of the element to inspect next
 	size_t j = 0; // the position in `diff` of the element to compare to
 	int comp_res = 0;
-	while( i2 != array->size && j != diff->size ) {
-		comp_res = strcmp( array->values[i2], diff->values[j] );
+	// Discarded strings remain in the pool until the array is freed; only
+	// their entries are removed.
+	struct string_array_entry_t* const entries = array->entries;
+	while( i2 != array->size && j != diff_size ) {
+		comp_res = compare( array, &entries[i2], diff, &diff->entries[j] );
 		if ( comp_res == 0 ) {
 			// `array[i2]` is identical to `diff[j]`
 			// advance `i2` as `array[i2]` is discarded from result
 			// do not advance `j` as elements are not required to be unique (only
 			// sorted) and `array[i2+1]` might equal `diff[j]` as well which needs
 			// to be discarded in the next iteration as well
-			free( array->values[i2] );
 			++i2;
 		} else if ( comp_res < 0 ) {
 			// `array[i2]` is smaller than `diff[j]`
@@ -111,11 +351,10 @@ void substract_string_array( struct string_array_t * const array, struct string_
 			// If `array[i2]` is already stored at `array[i1-1]` (note elements of
 			// `array` are not required to be unique), then discard `array[i2]`
 			// because we already have it once and only advance `i2`
-			if( i1 > 0 && strcmp( array->values[i1-1], array->values[i2] ) == 0 ) {
-				free( array->values[i2] );
+			if( i1 > 0 && compare( array, &entries[i1-1], array, &entries[i2] ) == 0 ) {
 				++i2;
 			} else {
-				array->values[i1] = array->values[i2];
+				entries[i1] = entries[i2];
 				++i1;
 				++i2;
 			}
@@ -129,16 +368,105 @@ void substract_string_array( struct string_array_t * const array, struct string_
 	// If we reached the end of `diff` but not of `array` keep the remaining
 	// elements in `array` but skip duplicates
 	while( i2 != array->size ) {
-		if( i1 > 0 && strcmp( array->values[i1-1], array->values[i2] ) == 0 ) {
-			free( array->values[i2] );
+		if( i1 > 0 && compare( array, &entries[i1-1], array, &entries[i2] ) == 0 ) {
 			++i2;
 		} else {
-			array->values[i1] = array->values[i2];
+			entries[i1] = entries[i2];
 			++i1;
 			++i2;
 		}
 	}
-	// terminate list with `NULL` and adjust size
-	array->values[i1] = NULL;
+	// adjust size
 	array->size = i1;
 }
+
+void substract_string_array( struct string_array_t * const array, struct string_array_t const * const diff ) {
+	substract_sorted_string_array( array, diff, compare_entry_strings );
+}
+
+/**
+ * Arrays with fewer elements in total are sorted and merged rather than
+ * hashed, because building the hash set does not pay off.
+ */
+static size_t const STRING_ARRAY_HASH_THRESHOLD = 64;
+
+/**
+ * Looks up an element of `array` or `diff` in the hash set and inserts it,
+ * if it is not found.
+ *
+ * A slot holds zero, if it is empty, the position in `diff` plus one for an
+ * element of `diff` or the size of `diff` plus the position in `array` plus
+ * one for an element of `array` which is kept.
+ *
+ * @return Non-zero, if an equal key has been found, zero if the element
+ * has been inserted
+ */
+static int find_or_insert_mail_address(
+	size_t* const slots,
+	size_t const slot_mask,
+	struct string_array_t const * const array,
+	struct string_array_t const * const diff,
+	size_t const value
+) {
+	size_t const diff_size = diff != NULL ? diff->size : 0;
+	struct string_array_t const * const source = value <= diff_size ? diff : array;
+	struct string_array_entry_t const * const entry = &source->entries[ value <= diff_size ? value - 1 : value - diff_size - 1 ];
+	size_t slot = entry->hash & slot_mask;
+	for( ; slots[slot] != 0; slot = ( slot + 1 ) & slot_mask ) {
+		struct string_array_t const * const other = slots[slot] <= diff_size ? diff : array;
+		struct string_array_entry_t const * const other_entry =
+			&other->entries[ slots[slot] <= diff_size ? slots[slot] - 1 : slots[slot] - diff_size - 1 ];
+		if(
+			other_entry->hash == entry->hash &&
+			compare_entry_keys( other, other_entry, source, entry ) == 0
+		) {
+			return 1;
+		}
+	}
+	slots[slot] = value;
+	return 0;
+}
+
+int substract_mail_addresses( struct string_array_t * const array, struct string_array_t * const diff ) {
+	// Both arrays must be normalized alike; keys which already exist are
+	// reused
+	int options = array->key_options;
+	if( options == KEY_OPTIONS_NONE )
+		options = diff != NULL && diff->key_options != KEY_OPTIONS_NONE ? diff->key_options : 0;
+	int result = set_mail_address_normalization( array, options );
+	if( result == EX_OK && diff != NULL )
+		result = set_mail_address_normalization( diff, options );
+	if( result != EX_OK )
+		return result;
+
+	size_t const diff_size = diff != NULL ? diff->size : 0;
+	size_t slot_count = 16;
+	while( slot_count < 2 * ( array->size + diff_size ) )
+		slot_count *= 2;
+	size_t* const slots = array->size + diff_size >= STRING_ARRAY_HASH_THRESHOLD ?
+		calloc( slot_count, sizeof( size_t ) ) : NULL;
+	if( slots == NULL ) {
+		// Small arrays or out of memory
+		sort_string_array_by( array, compare_entry_keys );
+		if( diff != NULL )
+			sort_string_array_by( diff, compare_entry_keys );
+		substract_sorted_string_array( array, diff, compare_entry_keys );
+		return EX_OK;
+	}
+
+	for( size_t j = 0; j != diff_size; ++j )
+		find_or_insert_mail_address( slots, slot_count - 1, array, diff, j + 1 );
+	// Stream the elements through the set; an element is kept at the front,
+	// if it is neither in `diff` nor has been kept before.
+	// The set only refers to kept elements, hence the entry at `kept` may be
+	// overwritten before it is looked up.
+	size_t kept = 0;
+	for( size_t i = 0; i != array->size; ++i ) {
+		array->entries[kept] = array->entries[i];
+		if( !find_or_insert_mail_address( slots, slot_count - 1, array, diff, diff_size + kept + 1 ) )
+			++kept;
+	}
+	array->size = kept;
+	free( slots );
+	return EX_OK;
+}
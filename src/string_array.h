@@ -6,8 +6,12 @@
  * @brief Compounds and functions for advanced string array handling.
  */
 
+struct arena_t;
+
 /**
  * A string array.
+ *
+ * All strings of an array are stored in a single contiguous string pool.
  */
 struct string_array_t;
 
@@ -20,13 +24,42 @@ struct string_array_t;
 struct string_array_t* create_string_array( size_t capacity );
 
 /**
- * Frees a string array which has previously been allocated with
+ * Creates a string array with the given capacity in an arena.
+ *
+ * The array itself and all strings which are pushed onto it are allocated
+ * from `arena` and released together with the arena.
+ * Apart from that, the array behaves like an array created by
  * ::create_string_array(size_t).
  *
+ * @param arena The arena; the array must not be used after the arena has
+ * been freed
+ * @param capacity The capacity which shall be reserved for array entries
+ * @return The pointer to the allocated string array or `NULL` in case of
+ * an error.
+ */
+struct string_array_t* create_string_array_arena( struct arena_t* arena, size_t capacity );
+
+/**
+ * Frees a string array which has previously been allocated with
+ * ::create_string_array(size_t) or ::create_string_array_arena().
+ *
+ * For an array in an arena this is a no-op; its memory is released with
+ * the arena.
+ *
  * @param array The array to be freed.
  */
 void free_string_array( struct string_array_t* array );
 
+/**
+ * Creates a deep copy of a string array.
+ *
+ * The copy is allocated with `malloc`, even if `array` is in an arena.
+ *
+ * @param array The array to be copied.
+ * @return The pointer to the allocated copy or `NULL` in case of an error.
+ */
+struct string_array_t* copy_string_array( struct string_array_t const * array );
+
 /**
  * Returns the number of actual elements in the given array.
  *
@@ -45,7 +78,8 @@ size_t get_string_array_size( struct string_array_t const * array );
  *
  * @param array The array.
  * @param pos The index of the string to be returned.
- * @return The string at the given position.
+ * @return The string at the given position; the pointer is invalidated
+ * by the next push onto the array, as the string pool may be moved.
  */
 char const* get_string_array_at( struct string_array_t const * array, size_t const pos );
 
@@ -57,12 +91,15 @@ char const* get_string_array_at( struct string_array_t const * array, size_t con
  * reallocated.
  * In that case the runtime of the method is linear in the current size of
  * the array, as the array has to be moved to a new position in memory.
- * The method makes a deep copy of the passed string.
+ * The method makes a deep copy of the passed string, which is allocated
+ * from the arena of the array, if the array has been created by
+ * ::create_string_array_arena().
  *
  * @param array The array.
  * @param str The null-terminated string to be pushed onto the array.
  * @return A pointer to the deep copy of the passed string at the end of
- * the array, or `NULL` in case of an error.
+ * the array, or `NULL` in case of an error; the pointer is only valid until
+ * the next push onto the array.
  */
 char const * push_onto_string_array( struct string_array_t* array, char const * str );
 
@@ -79,7 +116,8 @@ char const * push_onto_string_array( struct string_array_t* array, char const *
  * @param str The string to be pushed onto the array.
  * @param len The length of `str`.
  * @return A pointer to the deep copy of the passed string at the end of
- * the array, or `NULL` in case of an error.
+ * the array, or `NULL` in case of an error; the pointer is only valid until
+ * the next push onto the array.
  * The deep copy is null-terminated, even if the original string was not.
  */
 char const * push_onto_string_array_l( struct string_array_t* array, char const * str, size_t len );
@@ -107,4 +145,45 @@ void sort_string_array( struct string_array_t* array );
  */
 void substract_string_array( struct string_array_t * const array, struct string_array_t const * const diff );
 
+/**
+ * Makes the array an array of mail addresses with normalized keys.
+ *
+ * The key of each string is computed once by ::normalize_mail_address()
+ * with the given options and stored together with its hash next to the
+ * string.
+ * Existing strings get their keys immediately and strings pushed later at
+ * insertion.
+ * Keys are used by ::substract_mail_addresses() and preserved by
+ * ::copy_string_array().
+ *
+ * @param array The array
+ * @param options A bitwise or of ::MAIL_ADDRESS_FOLD_LOCAL_PART and
+ * ::MAIL_ADDRESS_STRIP_TAG or zero; the domain is always lower-cased
+ * @return `EX_OK` on success, `EX_OSERR` if the memory for the keys could
+ * not be allocated; the array is unchanged in that case
+ */
+int set_mail_address_normalization( struct string_array_t* array, int options );
+
+/**
+ * Substracts mail addresses of one array from another array and removes
+ * duplicates.
+ *
+ * Unlike ::substract_string_array(), the arrays need not be sorted and
+ * addresses are equal, if their normalized keys are equal (see
+ * ::set_mail_address_normalization()).
+ * Both arrays are normalized with the options of `array`, or of `diff` if
+ * `array` has no keys yet, or with default options if neither has keys.
+ * Small arrays are sorted and merged; large arrays are processed with a
+ * hash set in linear time.
+ * The order of the remaining elements is unspecified.
+ *
+ * @param array The array from which elements shall be removed; the array
+ * is modified in place and likely smaller afterwards
+ * @param diff The array with elements which shall be removed from `array`;
+ * may be reordered; `NULL` is treated like an empty array
+ * @return `EX_OK` on success, `EX_OSERR` if the keys could not be
+ * computed; `array` is unchanged in that case
+ */
+int substract_mail_addresses( struct string_array_t * const array, struct string_array_t * const diff );
+
 #endif
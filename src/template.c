@@ -0,0 +1,194 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "template.h"
+
+int const TEMPLATE_ESCAPE_NONE = 0;
+
+int const TEMPLATE_ESCAPE_FILTER = 1;
+
+int const TEMPLATE_ESCAPE_DN = 2;
+
+/**
+ * The kinds of tokens of a compiled template.
+ */
+static int const TOKEN_LITERAL = 0;
+static int const TOKEN_ADDRESS = 1;
+static int const TOKEN_DOMAIN = 2;
+static int const TOKEN_LOCAL = 3;
+
+/**
+ * A piece of a compiled template.
+ */
+struct template_token_t {
+	int kind; /**< One of the `TOKEN_...` constants. */
+	size_t offset; /**< The offset of the literal text into ::template_t::text; only used for literals. */
+	size_t len; /**< The length of the literal text; only used for literals. */
+};
+
+struct template_t {
+	int escape; /**< How substituted values are escaped. */
+	size_t token_count; /**< The number of tokens. */
+	struct template_token_t* tokens; /**< The tokens in order of appearance. */
+	char* text; /**< A copy of the source from which literals are taken. */
+};
+
+/**
+ * Returns the kind of the placeholder which starts at `pos` or
+ * `TOKEN_LITERAL`, if there is none.
+ */
+static int get_placeholder_kind( char const * const pos ) {
+	if( pos[0] != '%' )
+		return TOKEN_LITERAL;
+	switch( pos[1] ) {
+		case 'u': return TOKEN_ADDRESS;
+		case 'd': return TOKEN_DOMAIN;
+		case 'n': return TOKEN_LOCAL;
+		default: return TOKEN_LITERAL;
+	}
+}
+
+struct template_t* compile_template( char const * source, int escape ) {
+	if( source == NULL )
+		return NULL;
+	size_t const source_len = strlen( source );
+	struct template_t* const template = malloc( sizeof( struct template_t ) );
+	if( template == NULL )
+		return NULL;
+	// Each placeholder adds at most two tokens, the placeholder itself and
+	// the literal in front of it
+	template->tokens = malloc( ( source_len + 1 ) * sizeof( struct template_token_t ) );
+	template->text = malloc( source_len + 1 );
+	if( template->tokens == NULL || template->text == NULL ) {
+		free_template( template );
+		return NULL;
+	}
+	strcpy( template->text, source );
+	template->escape = escape;
+	template->token_count = 0;
+
+	size_t literal_start = 0;
+	for( size_t i = 0; i < source_len; ) {
+		int const kind = get_placeholder_kind( source + i );
+		if( kind == TOKEN_LITERAL ) {
+			++i;
+			continue;
+		}
+		if( i != literal_start ) {
+			struct template_token_t* const token = &template->tokens[ template->token_count++ ];
+			token->kind = TOKEN_LITERAL;
+			token->offset = literal_start;
+			token->len = i - literal_start;
+		}
+		struct template_token_t* const token = &template->tokens[ template->token_count++ ];
+		token->kind = kind;
+		token->offset = 0;
+		token->len = 0;
+		i += 2;
+		literal_start = i;
+	}
+	if( literal_start != source_len ) {
+		struct template_token_t* const token = &template->tokens[ template->token_count++ ];
+		token->kind = TOKEN_LITERAL;
+		token->offset = literal_start;
+		token->len = source_len - literal_start;
+	}
+	return template;
+}
+
+void free_template( struct template_t* template ) {
+	if( template == NULL ) return;
+	free( template->tokens );
+	free( template->text );
+	free( template );
+}
+
+int has_template_placeholders( struct template_t const * template ) {
+	for( size_t i = 0; i != template->token_count; ++i ) {
+		if( template->tokens[i].kind != TOKEN_LITERAL )
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * Appends a string to the buffer as far as it fits, but always advances
+ * the position by the full length.
+ */
+static void append_raw( char* const buf, size_t const size, size_t* const pos, char const * const str, size_t const len ) {
+	if( *pos < size ) {
+		size_t const avail = size - *pos;
+		memcpy( buf + *pos, str, len < avail ? len : avail );
+	}
+	*pos += len;
+}
+
+static char const HEX_DIGITS[] = "0123456789abcdef";
+
+/**
+ * Appends a substituted value with escaping.
+ */
+static void append_value(
+	char* const buf,
+	size_t const size,
+	size_t* const pos,
+	int const escape,
+	char const * const str,
+	size_t const len
+) {
+	if( escape == TEMPLATE_ESCAPE_NONE ) {
+		append_raw( buf, size, pos, str, len );
+		return;
+	}
+	for( size_t i = 0; i != len; ++i ) {
+		unsigned char const c = (unsigned char)str[i];
+		char escaped[3];
+		size_t escaped_len = 0;
+		if( escape == TEMPLATE_ESCAPE_FILTER ) {
+			if( c == '*' || c == '(' || c == ')' || c == '\\' || c == '\0' ) {
+				escaped[0] = '\\';
+				escaped[1] = HEX_DIGITS[ c >> 4 ];
+				escaped[2] = HEX_DIGITS[ c & 0x0f ];
+				escaped_len = 3;
+			}
+		} else if( c == '\0' ) {
+			escaped[0] = '\\';
+			escaped[1] = '0';
+			escaped[2] = '0';
+			escaped_len = 3;
+		} else if( strchr( "\"+,;<>\\#= ", c ) != NULL ) {
+			escaped[0] = '\\';
+			escaped[1] = (char)c;
+			escaped_len = 2;
+		}
+		if( escaped_len != 0 )
+			append_raw( buf, size, pos, escaped, escaped_len );
+		else
+			append_raw( buf, size, pos, str + i, 1 );
+	}
+}
+
+size_t expand_template( struct template_t const * template, char const * mail_address, char* buf, size_t size ) {
+	size_t const address_len = strlen( mail_address );
+	char const * const at = strchr( mail_address, '@' );
+	size_t const local_len = at != NULL ? (size_t)( at - mail_address ) : address_len;
+	char const * const domain = at != NULL ? at + 1 : mail_address + address_len;
+	size_t const domain_len = address_len - ( domain - mail_address );
+
+	size_t pos = 0;
+	for( size_t i = 0; i != template->token_count; ++i ) {
+		struct template_token_t const * const token = &template->tokens[i];
+		if( token->kind == TOKEN_LITERAL ) {
+			append_raw( buf, size, &pos, template->text + token->offset, token->len );
+		} else if( token->kind == TOKEN_ADDRESS ) {
+			append_value( buf, size, &pos, template->escape, mail_address, address_len );
+		} else if( token->kind == TOKEN_DOMAIN ) {
+			append_value( buf, size, &pos, template->escape, domain, domain_len );
+		} else {
+			append_value( buf, size, &pos, template->escape, mail_address, local_len );
+		}
+	}
+	if( size != 0 )
+		buf[ pos < size ? pos : size - 1 ] = '\0';
+	return pos;
+}
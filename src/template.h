@@ -0,0 +1,98 @@
+#ifndef _TEMPLATE_H_
+#define _TEMPLATE_H_
+
+/**
+ * @file
+ * @brief Compounds and functions for pre-compiled templates with
+ * placeholders for parts of a mail address.
+ */
+
+#include <stddef.h>
+
+/**
+ * Escape substituted values for an LDAP search filter according to
+ * RFC 4515, i.e. `*`, `(`, `)`, `\` and NUL become `\2a`, `\28`, `\29`,
+ * `\5c` and `\00`.
+ */
+extern int const TEMPLATE_ESCAPE_FILTER;
+
+/**
+ * Escape substituted values for a DN according to RFC 4514, i.e. prefix
+ * the special characters `"`, `+`, `,`, `;`, `<`, `>`, `\`, `#`, `=` and
+ * space by a backslash and replace NUL by `\00`.
+ */
+extern int const TEMPLATE_ESCAPE_DN;
+
+/**
+ * Substitute values as they are.
+ */
+extern int const TEMPLATE_ESCAPE_NONE;
+
+/**
+ * A template which has been split into literal text and placeholders.
+ *
+ * The following placeholders are supported:
+ *
+ *  - `%u` is replaced by the entire mail address
+ *  - `%d` is replaced by the domain part
+ *  - `%n` is replaced by the local part
+ *
+ * If the mail address does not match the pattern `local-part@domain`, then
+ * the local part equals the entire mail address and the domain part is
+ * empty.
+ * Any other `%` is literal text.
+ *
+ * A template is compiled once and immutable afterwards, hence it can be
+ * expanded by any number of threads concurrently.
+ */
+struct template_t;
+
+/**
+ * Compiles a template.
+ *
+ * @param source The null-terminated template
+ * @param escape Either ::TEMPLATE_ESCAPE_FILTER, ::TEMPLATE_ESCAPE_DN or
+ * ::TEMPLATE_ESCAPE_NONE; applies to all substituted values
+ * @return The pointer to the allocated template or `NULL` in case of an
+ * error.
+ */
+struct template_t* compile_template( char const * source, int escape );
+
+/**
+ * Frees a template which has previously been allocated with
+ * ::compile_template().
+ *
+ * Note, the function is NULL-pointer safe.
+ *
+ * @param template The template to be freed.
+ */
+void free_template( struct template_t* template );
+
+/**
+ * Returns non-zero, if the template contains at least one placeholder.
+ *
+ * @param template The template
+ * @return Non-zero, if the template contains a placeholder, zero otherwise
+ */
+int has_template_placeholders( struct template_t const * template );
+
+/**
+ * Expands a template into a buffer.
+ *
+ * Like `snprintf`, the function writes at most `size` bytes including the
+ * terminating null byte and returns the length of the complete expansion.
+ * If the return value is `size` or more, the result has been truncated and
+ * the caller must retry with a buffer of at least the returned length plus
+ * one.
+ * `buf` may be `NULL`, if `size` is zero.
+ *
+ * @param template The template
+ * @param mail_address The null-terminated mail address which is
+ * substituted for the placeholders
+ * @param buf The buffer
+ * @param size The size of `buf` in bytes
+ * @return The length of the expansion excluding the terminating null byte
+ */
+size_t expand_template( struct template_t const * template, char const * mail_address, char* buf, size_t size );
+
+#endif
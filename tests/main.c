@@ -1,13 +1,29 @@
 #include <stdlib.h>
 #include <check.h>
 
+Suite* create_alias_index_suite( void );
+Suite* create_arena_suite( void );
+Suite* create_cache_suite( void );
 Suite* create_ext_string_suite( void );
+Suite* create_mail_address_suite( void );
+Suite* create_metrics_suite( void );
+Suite* create_nested_list_suite( void );
+Suite* create_snapshot_suite( void );
 Suite* create_string_array_suite( void );
+Suite* create_template_suite( void );
 
 int main( int argc, char* argv[] ) {
 	SRunner* const sr = srunner_create( NULL );
+	srunner_add_suite( sr, create_alias_index_suite() );
+	srunner_add_suite( sr, create_arena_suite() );
+	srunner_add_suite( sr, create_cache_suite() );
 	srunner_add_suite( sr, create_ext_string_suite() );
+	srunner_add_suite( sr, create_mail_address_suite() );
+	srunner_add_suite( sr, create_metrics_suite() );
+	srunner_add_suite( sr, create_nested_list_suite() );
+	srunner_add_suite( sr, create_snapshot_suite() );
 	srunner_add_suite( sr, create_string_array_suite() );
+	srunner_add_suite( sr, create_template_suite() );
 
 	if( argc == 0 || argc == 1 ) {
 		srunner_set_fork_status( sr, CK_FORK );
@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <check.h>
+
+#include "../src/alias_index.h"
+
+static struct alias_index_t* create_test_index( void ) {
+	struct string_array_t* keys = create_string_array( 4 );
+	struct string_array_t* values = create_string_array( 4 );
+	push_onto_string_array( keys, "List@example.org" );
+	push_onto_string_array( values, "bob@example.org" );
+	push_onto_string_array( keys, "list@example.org" );
+	push_onto_string_array( values, "alice@example.org" );
+	push_onto_string_array( keys, "other@example.org" );
+	push_onto_string_array( values, "carol@example.org" );
+	push_onto_string_array( keys, "list@example.org" );
+	push_onto_string_array( values, "alice@example.org" );
+	struct alias_index_t* index = create_alias_index( keys, values );
+	free_string_array( keys );
+	free_string_array( values );
+	return index;
+}
+
+START_TEST( test_create_alias_index_empty ) {
+	struct string_array_t* keys = create_string_array( 1 );
+	struct string_array_t* values = create_string_array( 1 );
+	struct alias_index_t* index = create_alias_index( keys, values );
+	ck_assert_ptr_nonnull( index );
+	ck_assert_int_eq( get_alias_index_size( index ), 0 );
+	ck_assert_ptr_null( lookup_alias_index( index, "list@example.org" ) );
+	free_alias_index( index );
+	free_string_array( keys );
+	free_string_array( values );
+}
+END_TEST
+
+START_TEST( test_create_alias_index_size_mismatch ) {
+	struct string_array_t* keys = create_string_array( 1 );
+	struct string_array_t* values = create_string_array( 1 );
+	push_onto_string_array( keys, "list@example.org" );
+	ck_assert_ptr_null( create_alias_index( keys, values ) );
+	free_string_array( keys );
+	free_string_array( values );
+}
+END_TEST
+
+START_TEST( test_lookup_alias_index_hit ) {
+	struct alias_index_t* index = create_test_index();
+	ck_assert_ptr_nonnull( index );
+	ck_assert_int_eq( get_alias_index_size( index ), 2 );
+
+	struct string_array_t* result = lookup_alias_index( index, "list@example.org" );
+	ck_assert_ptr_nonnull( result );
+	ck_assert_int_eq( get_string_array_size( result ), 2 );
+	ck_assert_str_eq( get_string_array_at( result, 0 ), "alice@example.org" );
+	ck_assert_str_eq( get_string_array_at( result, 1 ), "bob@example.org" );
+	free_string_array( result );
+
+	result = lookup_alias_index( index, "other@example.org" );
+	ck_assert_ptr_nonnull( result );
+	ck_assert_int_eq( get_string_array_size( result ), 1 );
+	ck_assert_str_eq( get_string_array_at( result, 0 ), "carol@example.org" );
+	free_string_array( result );
+	free_alias_index( index );
+}
+END_TEST
+
+START_TEST( test_lookup_alias_index_ignores_case ) {
+	struct alias_index_t* index = create_test_index();
+	struct string_array_t* result = lookup_alias_index( index, "LIST@Example.ORG" );
+	ck_assert_ptr_nonnull( result );
+	ck_assert_int_eq( get_string_array_size( result ), 2 );
+	free_string_array( result );
+	free_alias_index( index );
+}
+END_TEST
+
+START_TEST( test_lookup_alias_index_miss ) {
+	struct alias_index_t* index = create_test_index();
+	ck_assert_ptr_null( lookup_alias_index( index, "user@example.org" ) );
+	ck_assert_ptr_null( lookup_alias_index( index, "list" ) );
+	free_alias_index( index );
+}
+END_TEST
+
+START_TEST( test_lookup_alias_index_many_keys ) {
+	struct string_array_t* keys = create_string_array( 1 );
+	struct string_array_t* values = create_string_array( 1 );
+	char buf[32];
+	for( int i = 0; i != 1000; ++i ) {
+		snprintf( buf, sizeof( buf ), "list%d@example.org", i );
+		push_onto_string_array( keys, buf );
+		snprintf( buf, sizeof( buf ), "member%d@example.org", i );
+		push_onto_string_array( values, buf );
+	}
+	struct alias_index_t* index = create_alias_index( keys, values );
+	free_string_array( keys );
+	free_string_array( values );
+	ck_assert_int_eq( get_alias_index_size( index ), 1000 );
+	for( int i = 0; i != 1000; ++i ) {
+		snprintf( buf, sizeof( buf ), "list%d@example.org", i );
+		struct string_array_t* result = lookup_alias_index( index, buf );
+		ck_assert_ptr_nonnull( result );
+		ck_assert_int_eq( get_string_array_size( result ), 1 );
+		snprintf( buf, sizeof( buf ), "member%d@example.org", i );
+		ck_assert_str_eq( get_string_array_at( result, 0 ), buf );
+		free_string_array( result );
+	}
+	free_alias_index( index );
+}
+END_TEST
+
+Suite* create_alias_index_suite( void ) {
+	Suite* s = suite_create( "alias_index" );
+	TCase* tc;
+
+	tc = tcase_create( "test_create_alias_index_empty" );
+	tcase_add_test( tc, test_create_alias_index_empty );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_create_alias_index_size_mismatch" );
+	tcase_add_test( tc, test_create_alias_index_size_mismatch );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_lookup_alias_index_hit" );
+	tcase_add_test( tc, test_lookup_alias_index_hit );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_lookup_alias_index_ignores_case" );
+	tcase_add_test( tc, test_lookup_alias_index_ignores_case );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_lookup_alias_index_miss" );
+	tcase_add_test( tc, test_lookup_alias_index_miss );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_lookup_alias_index_many_keys" );
+	tcase_add_test( tc, test_lookup_alias_index_many_keys );
+	suite_add_tcase( s, tc );
+
+	return s;
+}
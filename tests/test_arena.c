@@ -0,0 +1,96 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <check.h>
+
+#include "../src/arena.h"
+
+START_TEST( test_alloc_from_arena_aligned ) {
+	struct arena_t* arena = create_arena( 256 );
+	ck_assert_ptr_nonnull( arena );
+	char* a = alloc_from_arena( arena, 1 );
+	char* b = alloc_from_arena( arena, 3 );
+	ck_assert_ptr_nonnull( a );
+	ck_assert_ptr_nonnull( b );
+	ck_assert_ptr_ne( a, b );
+	ck_assert_int_eq( (uintptr_t)a % _Alignof( max_align_t ), 0 );
+	ck_assert_int_eq( (uintptr_t)b % _Alignof( max_align_t ), 0 );
+	free_arena( arena );
+}
+END_TEST
+
+START_TEST( test_alloc_from_arena_many_blocks ) {
+	struct arena_t* arena = create_arena( 64 );
+	ck_assert_ptr_nonnull( arena );
+	char* values[100];
+	for( int i = 0; i != 100; ++i ) {
+		values[i] = alloc_from_arena( arena, 24 );
+		ck_assert_ptr_nonnull( values[i] );
+		memset( values[i], i, 24 );
+	}
+	// No allocation must have overwritten another one
+	for( int i = 0; i != 100; ++i ) {
+		for( int j = 0; j != 24; ++j )
+			ck_assert_int_eq( values[i][j], i );
+	}
+	free_arena( arena );
+}
+END_TEST
+
+START_TEST( test_alloc_from_arena_large ) {
+	struct arena_t* arena = create_arena( 64 );
+	ck_assert_ptr_nonnull( arena );
+	char* small1 = alloc_from_arena( arena, 8 );
+	char* large = alloc_from_arena( arena, 1000 );
+	char* small2 = alloc_from_arena( arena, 8 );
+	ck_assert_ptr_nonnull( small1 );
+	ck_assert_ptr_nonnull( large );
+	ck_assert_ptr_nonnull( small2 );
+	memset( large, 'x', 1000 );
+	// The large allocation must not have consumed the current block
+	ck_assert_ptr_eq( small2, small1 + _Alignof( max_align_t ) );
+	free_arena( arena );
+}
+END_TEST
+
+START_TEST( test_copy_string_to_arena ) {
+	struct arena_t* arena = create_arena( 64 );
+	ck_assert_ptr_nonnull( arena );
+	char* copy = copy_string_to_arena( arena, "test string", 4 );
+	ck_assert_ptr_nonnull( copy );
+	ck_assert_str_eq( copy, "test" );
+	free_arena( arena );
+}
+END_TEST
+
+START_TEST( test_free_arena_null ) {
+	free_arena( NULL );
+}
+END_TEST
+
+Suite* create_arena_suite( void ) {
+	Suite* s = suite_create( "arena" );
+	TCase* tc;
+
+	tc = tcase_create( "test_alloc_from_arena_aligned" );
+	tcase_add_test( tc, test_alloc_from_arena_aligned );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_alloc_from_arena_many_blocks" );
+	tcase_add_test( tc, test_alloc_from_arena_many_blocks );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_alloc_from_arena_large" );
+	tcase_add_test( tc, test_alloc_from_arena_large );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_copy_string_to_arena" );
+	tcase_add_test( tc, test_copy_string_to_arena );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_free_arena_null" );
+	tcase_add_test( tc, test_free_arena_null );
+	suite_add_tcase( s, tc );
+
+	return s;
+}
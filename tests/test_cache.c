@@ -0,0 +1,184 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <check.h>
+
+#include "../src/cache.h"
+
+START_TEST( test_create_cache_with_zero_capacity ) {
+	ck_assert_ptr_null( create_cache( 0, 60 ) );
+}
+END_TEST
+
+START_TEST( test_create_cache_with_zero_ttl ) {
+	ck_assert_ptr_null( create_cache( 10, 0 ) );
+}
+END_TEST
+
+START_TEST( test_lookup_cache_miss ) {
+	struct cache_t* cache = create_cache( 10, 60 );
+	ck_assert_ptr_nonnull( cache );
+	ck_assert_ptr_null( lookup_cache( cache, "list@example.org" ) );
+	free_cache( cache );
+}
+END_TEST
+
+START_TEST( test_lookup_cache_null ) {
+	ck_assert_ptr_null( lookup_cache( NULL, "list@example.org" ) );
+	ck_assert_int_eq( insert_cache( NULL, "list@example.org", NULL ), 0 );
+}
+END_TEST
+
+START_TEST( test_lookup_cache_hit ) {
+	struct cache_t* cache = create_cache( 10, 60 );
+	struct string_array_t* value = create_string_array( 2 );
+	push_onto_string_array( value, "alice@example.org" );
+	push_onto_string_array( value, "bob@example.org" );
+	ck_assert_int_eq( insert_cache( cache, "list@example.org", value ), 0 );
+	free_string_array( value );
+
+	struct string_array_t* result = lookup_cache( cache, "list@example.org" );
+	ck_assert_ptr_nonnull( result );
+	ck_assert_int_eq( get_string_array_size( result ), 2 );
+	ck_assert_str_eq( get_string_array_at( result, 0 ), "alice@example.org" );
+	ck_assert_str_eq( get_string_array_at( result, 1 ), "bob@example.org" );
+	free_string_array( result );
+	free_cache( cache );
+}
+END_TEST
+
+START_TEST( test_lookup_cache_negative_hit ) {
+	struct cache_t* cache = create_cache( 10, 60 );
+	struct string_array_t* value = create_string_array( 1 );
+	insert_cache( cache, "user@example.org", value );
+	free_string_array( value );
+
+	struct string_array_t* result = lookup_cache( cache, "user@example.org" );
+	ck_assert_ptr_nonnull( result );
+	ck_assert_int_eq( get_string_array_size( result ), 0 );
+	free_string_array( result );
+	free_cache( cache );
+}
+END_TEST
+
+START_TEST( test_insert_cache_replaces ) {
+	struct cache_t* cache = create_cache( 10, 60 );
+	struct string_array_t* value = create_string_array( 1 );
+	insert_cache( cache, "list@example.org", value );
+	push_onto_string_array( value, "alice@example.org" );
+	insert_cache( cache, "list@example.org", value );
+	free_string_array( value );
+	ck_assert_int_eq( get_cache_size( cache ), 1 );
+
+	struct string_array_t* result = lookup_cache( cache, "list@example.org" );
+	ck_assert_int_eq( get_string_array_size( result ), 1 );
+	free_string_array( result );
+	free_cache( cache );
+}
+END_TEST
+
+START_TEST( test_insert_cache_is_bounded ) {
+	struct cache_t* cache = create_cache( 32, 60 );
+	struct string_array_t* value = create_string_array( 1 );
+	char key[32];
+	for( int i = 0; i != 1000; ++i ) {
+		snprintf( key, sizeof( key ), "list%d@example.org", i );
+		ck_assert_int_eq( insert_cache( cache, key, value ), 0 );
+	}
+	free_string_array( value );
+	ck_assert_int_le( get_cache_size( cache ), 32 );
+	// The most recent entry must have survived
+	struct string_array_t* result = lookup_cache( cache, "list999@example.org" );
+	ck_assert_ptr_nonnull( result );
+	free_string_array( result );
+	free_cache( cache );
+}
+END_TEST
+
+START_TEST( test_insert_cache_evicts_least_recently_used ) {
+	struct cache_t* cache = create_cache( 2, 60 );
+	struct string_array_t* value = create_string_array( 1 );
+	insert_cache( cache, "a@example.org", value );
+	insert_cache( cache, "b@example.org", value );
+
+	// Touch "a" such that "b" becomes the least recently used entry
+	struct string_array_t* result = lookup_cache( cache, "a@example.org" );
+	ck_assert_ptr_nonnull( result );
+	free_string_array( result );
+
+	insert_cache( cache, "c@example.org", value );
+	free_string_array( value );
+	ck_assert_int_eq( get_cache_size( cache ), 2 );
+
+	result = lookup_cache( cache, "a@example.org" );
+	ck_assert_ptr_nonnull( result );
+	free_string_array( result );
+	ck_assert_ptr_null( lookup_cache( cache, "b@example.org" ) );
+	result = lookup_cache( cache, "c@example.org" );
+	ck_assert_ptr_nonnull( result );
+	free_string_array( result );
+	free_cache( cache );
+}
+END_TEST
+
+START_TEST( test_lookup_stale_cache_hit ) {
+	struct cache_t* cache = create_cache( 10, 60 );
+	struct string_array_t* value = create_string_array( 1 );
+	push_onto_string_array( value, "alice@example.org" );
+	insert_cache( cache, "list@example.org", value );
+	free_string_array( value );
+
+	struct string_array_t* result = lookup_stale_cache( cache, "list@example.org" );
+	ck_assert_ptr_nonnull( result );
+	ck_assert_int_eq( get_string_array_size( result ), 1 );
+	free_string_array( result );
+	ck_assert_ptr_null( lookup_stale_cache( cache, "other@example.org" ) );
+	free_cache( cache );
+}
+END_TEST
+
+Suite* create_cache_suite( void ) {
+	Suite* s = suite_create( "cache" );
+	TCase* tc;
+
+	tc = tcase_create( "test_create_cache_with_zero_capacity" );
+	tcase_add_test( tc, test_create_cache_with_zero_capacity );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_create_cache_with_zero_ttl" );
+	tcase_add_test( tc, test_create_cache_with_zero_ttl );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_lookup_cache_miss" );
+	tcase_add_test( tc, test_lookup_cache_miss );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_lookup_cache_null" );
+	tcase_add_test( tc, test_lookup_cache_null );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_lookup_cache_hit" );
+	tcase_add_test( tc, test_lookup_cache_hit );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_lookup_cache_negative_hit" );
+	tcase_add_test( tc, test_lookup_cache_negative_hit );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_insert_cache_replaces" );
+	tcase_add_test( tc, test_insert_cache_replaces );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_insert_cache_is_bounded" );
+	tcase_add_test( tc, test_insert_cache_is_bounded );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_insert_cache_evicts_least_recently_used" );
+	tcase_add_test( tc, test_insert_cache_evicts_least_recently_used );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_lookup_stale_cache_hit" );
+	tcase_add_test( tc, test_lookup_stale_cache_hit );
+	suite_add_tcase( s, tc );
+
+	return s;
+}
@@ -2,6 +2,7 @@
 #include <check.h>
 
 #include "../src/extstring.h"
+#include "../src/arena.h"
 
 static char const * const TEST_STRING = "test string";
 
@@ -82,6 +83,19 @@ START_TEST( test_str_replace_all ) {
 }
 END_TEST
 
+START_TEST( test_str_replace_arena ) {
+	struct arena_t* arena = create_arena( 64 );
+	char * result = str_replace_arena( arena, TEST_STRING, "t", "TT" );
+	ck_assert_ptr_nonnull( result );
+	ck_assert_str_eq( result, "TTesTT sTTring" );
+	result = str_replace_arena( arena, TEST_STRING, NULL, NULL );
+	ck_assert_ptr_nonnull( result );
+	ck_assert_ptr_ne( result, TEST_STRING );
+	ck_assert_str_eq( result, TEST_STRING );
+	free_arena( arena );
+}
+END_TEST
+
 START_TEST( test_str_or_null_with_null ) {
 	ck_assert_str_eq( str_or_null( NULL ), "(null)" );
 }
@@ -132,6 +146,10 @@ Suite* create_ext_string_suite( void ) {
 	tcase_add_test( tc, test_str_replace_all );
 	suite_add_tcase( s, tc );
 
+	tc = tcase_create( "test_str_replace_arena" );
+	tcase_add_test( tc, test_str_replace_arena );
+	suite_add_tcase( s, tc );
+
 	tc = tcase_create( "test_str_or_null_with_null" );
 	tcase_add_test( tc, test_str_or_null_with_null );
 	suite_add_tcase( s, tc );
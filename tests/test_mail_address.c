@@ -0,0 +1,76 @@
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+
+#include "../src/mail_address.h"
+
+/**
+ * Normalizes a null-terminated address into a null-terminated key.
+ */
+static char const * normalize( char const * address, int options, char* key ) {
+	size_t const key_len = normalize_mail_address( address, strlen( address ), options, key );
+	key[key_len] = '\0';
+	return key;
+}
+
+START_TEST( test_normalize_mail_address_domain ) {
+	char key[64];
+	ck_assert_str_eq( normalize( "Alice@Example.ORG", 0, key ), "Alice@example.org" );
+	ck_assert_str_eq( normalize( "alice@example.org", 0, key ), "alice@example.org" );
+	// Only the part after the last `@` is the domain
+	ck_assert_str_eq( normalize( "\"A@B\"@Example.org", 0, key ), "\"A@B\"@example.org" );
+	// An address without domain is all local part
+	ck_assert_str_eq( normalize( "Postmaster", 0, key ), "Postmaster" );
+}
+END_TEST
+
+START_TEST( test_normalize_mail_address_fold_local_part ) {
+	char key[64];
+	ck_assert_str_eq( normalize( "Alice@Example.ORG", MAIL_ADDRESS_FOLD_LOCAL_PART, key ), "alice@example.org" );
+	ck_assert_str_eq( normalize( "Postmaster", MAIL_ADDRESS_FOLD_LOCAL_PART, key ), "postmaster" );
+}
+END_TEST
+
+START_TEST( test_normalize_mail_address_strip_tag ) {
+	char key[64];
+	ck_assert_str_eq( normalize( "alice+lists@example.org", MAIL_ADDRESS_STRIP_TAG, key ), "alice@example.org" );
+	ck_assert_str_eq( normalize( "alice+a+b@example.org", MAIL_ADDRESS_STRIP_TAG, key ), "alice@example.org" );
+	// A leading `+` is not a separator
+	ck_assert_str_eq( normalize( "+alice@example.org", MAIL_ADDRESS_STRIP_TAG, key ), "+alice@example.org" );
+	// A `+` in the domain is not a separator either
+	ck_assert_str_eq( normalize( "alice@ex+ample.org", MAIL_ADDRESS_STRIP_TAG, key ), "alice@ex+ample.org" );
+	ck_assert_str_eq(
+		normalize( "Alice+Lists@Example.org", MAIL_ADDRESS_STRIP_TAG | MAIL_ADDRESS_FOLD_LOCAL_PART, key ),
+		"alice@example.org"
+	);
+}
+END_TEST
+
+START_TEST( test_hash_mail_address_key ) {
+	ck_assert_uint_eq( hash_mail_address_key( "abc", 3 ), hash_mail_address_key( "abcd", 3 ) );
+	ck_assert( hash_mail_address_key( "abc", 3 ) != hash_mail_address_key( "abd", 3 ) );
+}
+END_TEST
+
+Suite* create_mail_address_suite( void ) {
+	Suite* s = suite_create( "mail_address" );
+	TCase* tc;
+
+	tc = tcase_create( "test_normalize_mail_address_domain" );
+	tcase_add_test( tc, test_normalize_mail_address_domain );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_normalize_mail_address_fold_local_part" );
+	tcase_add_test( tc, test_normalize_mail_address_fold_local_part );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_normalize_mail_address_strip_tag" );
+	tcase_add_test( tc, test_normalize_mail_address_strip_tag );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_hash_mail_address_key" );
+	tcase_add_test( tc, test_hash_mail_address_key );
+	suite_add_tcase( s, tc );
+
+	return s;
+}
@@ -0,0 +1,178 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <check.h>
+
+#include "../src/metrics.h"
+
+/**
+ * Formats all metrics into a newly allocated buffer.
+ */
+static char* format_all_metrics( void ) {
+	size_t const len = format_metrics( NULL, 0 );
+	char* const buf = malloc( len + 1 );
+	ck_assert_ptr_ne( buf, NULL );
+	ck_assert_uint_eq( format_metrics( buf, len + 1 ), len );
+	ck_assert_uint_eq( strlen( buf ), len );
+	return buf;
+}
+
+static void* count_in_thread( void* arg ) {
+	(void)arg;
+	for( int i = 0; i != 1000; ++i )
+		count_metric( METRIC_BCCS_ADDED, 1 );
+	return NULL;
+}
+
+START_TEST( test_metrics_disabled ) {
+	ck_assert_int_eq( are_metrics_enabled(), 0 );
+	count_metric( METRIC_EOM_CALLBACKS, 1 );
+	ck_assert_uint_eq( start_metric_observation(), 0 );
+	observe_metric( METRIC_LDAP_LIST_LATENCY, 0 );
+	char* const text = format_all_metrics();
+	ck_assert_ptr_ne( strstr( text, "milter_alias_callbacks_total{callback=\"eom\"} 0\n" ), NULL );
+	ck_assert_ptr_ne( strstr( text, "milter_alias_ldap_query_duration_seconds_count{query=\"list\"} 0\n" ), NULL );
+	free( text );
+	free_metrics();
+}
+END_TEST
+
+START_TEST( test_metrics_counters ) {
+	enable_metrics();
+	ck_assert_int_ne( are_metrics_enabled(), 0 );
+	count_metric( METRIC_ENVFROM_CALLBACKS, 1 );
+	count_metric( METRIC_ENVFROM_CALLBACKS, 2 );
+	count_metric( METRIC_ACCT_CACHE_MISSES, 5 );
+	count_metric( METRIC_LDAP_RECONNECTS, 1 );
+	char* const text = format_all_metrics();
+	ck_assert_ptr_ne( strstr( text, "# TYPE milter_alias_callbacks_total counter\n" ), NULL );
+	ck_assert_ptr_ne( strstr( text, "milter_alias_callbacks_total{callback=\"envfrom\"} 3\n" ), NULL );
+	ck_assert_ptr_ne( strstr( text, "milter_alias_callbacks_total{callback=\"eom\"} 0\n" ), NULL );
+	ck_assert_ptr_ne( strstr( text, "milter_alias_cache_misses_total{cache=\"acct\"} 5\n" ), NULL );
+	ck_assert_ptr_ne( strstr( text, "milter_alias_ldap_reconnects_total 1\n" ), NULL );
+	free( text );
+	free_metrics();
+	ck_assert_int_eq( are_metrics_enabled(), 0 );
+}
+END_TEST
+
+START_TEST( test_metrics_threads ) {
+	enable_metrics();
+	pthread_t threads[4];
+	for( int i = 0; i != 4; ++i )
+		ck_assert_int_eq( pthread_create( &threads[i], NULL, count_in_thread, NULL ), 0 );
+	for( int i = 0; i != 4; ++i )
+		pthread_join( threads[i], NULL );
+	// Shards of exited threads are reused
+	ck_assert_int_eq( pthread_create( &threads[0], NULL, count_in_thread, NULL ), 0 );
+	pthread_join( threads[0], NULL );
+	char* const text = format_all_metrics();
+	ck_assert_ptr_ne( strstr( text, "milter_alias_bccs_added_total 5000\n" ), NULL );
+	free( text );
+	free_metrics();
+}
+END_TEST
+
+START_TEST( test_metrics_histograms ) {
+	enable_metrics();
+	uint64_t const start = start_metric_observation();
+	ck_assert( start != 0 );
+	observe_metric( METRIC_LDAP_SYNC_LATENCY, start );
+	observe_metric( METRIC_LDAP_SYNC_LATENCY, start );
+	char* const text = format_all_metrics();
+	ck_assert_ptr_ne( strstr( text, "# TYPE milter_alias_ldap_query_duration_seconds histogram\n" ), NULL );
+	ck_assert_ptr_ne( strstr( text, "milter_alias_ldap_query_duration_seconds_bucket{query=\"sync\",le=\"+Inf\"} 2\n" ), NULL );
+	ck_assert_ptr_ne( strstr( text, "milter_alias_ldap_query_duration_seconds_bucket{query=\"sync\",le=\"16.777216\"} 2\n" ), NULL );
+	ck_assert_ptr_ne( strstr( text, "milter_alias_ldap_query_duration_seconds_count{query=\"sync\"} 2\n" ), NULL );
+	ck_assert_ptr_ne( strstr( text, "milter_alias_ldap_query_duration_seconds_count{query=\"list\"} 0\n" ), NULL );
+	free( text );
+	free_metrics();
+}
+END_TEST
+
+START_TEST( test_metrics_quantiles ) {
+	enable_metrics();
+	// All durations lie in the bucket from 3072µs to 3327µs
+	for( int i = 0; i != 1000; ++i )
+		observe_metric( METRIC_EOM_LATENCY, start_metric_observation() - 3072 );
+	// The slowest observation lies in the bucket from 1048576µs to 1179647µs
+	observe_metric( METRIC_EOM_LATENCY, start_metric_observation() - 1048576 );
+	char* const text = format_all_metrics();
+	ck_assert_ptr_ne( strstr( text, "# TYPE milter_alias_phase_duration_seconds histogram\n" ), NULL );
+	ck_assert_ptr_ne( strstr( text, "milter_alias_phase_duration_seconds_bucket{phase=\"eom\",le=\"0.001024\"} 0\n" ), NULL );
+	ck_assert_ptr_ne( strstr( text, "milter_alias_phase_duration_seconds_bucket{phase=\"eom\",le=\"0.004096\"} 1000\n" ), NULL );
+	ck_assert_ptr_ne( strstr( text, "milter_alias_phase_duration_seconds_bucket{phase=\"eom\",le=\"4.194304\"} 1001\n" ), NULL );
+	ck_assert_ptr_ne( strstr( text, "# TYPE milter_alias_phase_duration_quantile_seconds gauge\n" ), NULL );
+	ck_assert_ptr_ne( strstr( text, "milter_alias_phase_duration_quantile_seconds{phase=\"eom\",quantile=\"0.5\"} 0.003327\n" ), NULL );
+	ck_assert_ptr_ne( strstr( text, "milter_alias_phase_duration_quantile_seconds{phase=\"eom\",quantile=\"0.99\"} 0.003327\n" ), NULL );
+	ck_assert_ptr_ne( strstr( text, "milter_alias_phase_duration_quantile_seconds{phase=\"eom\",quantile=\"0.999\"} 0.003327\n" ), NULL );
+	ck_assert_ptr_ne( strstr( text, "milter_alias_phase_duration_quantile_seconds{phase=\"addrcpt\",quantile=\"0.5\"} 0.000000\n" ), NULL );
+	free( text );
+	free_metrics();
+}
+END_TEST
+
+START_TEST( test_format_metric_summary ) {
+	enable_metrics();
+	char buf[256];
+	ck_assert_uint_eq( format_metric_summary( METRIC_EOM_LATENCY, buf, sizeof( buf ) ), 0 );
+	ck_assert_str_eq( buf, "" );
+	for( int i = 0; i != 10; ++i )
+		observe_metric( METRIC_EOM_LATENCY, start_metric_observation() - 3072 );
+	observe_metric( METRIC_EOM_LATENCY, start_metric_observation() - 1048576 );
+	ck_assert( format_metric_summary( METRIC_EOM_LATENCY, buf, sizeof( buf ) ) != 0 );
+	ck_assert_str_eq( buf, "phase=\"eom\" count=11 p50=3.327ms p99=1179.647ms p99.9=1179.647ms" );
+	// Only observations since the previous summary are summarized
+	ck_assert_uint_eq( format_metric_summary( METRIC_EOM_LATENCY, buf, sizeof( buf ) ), 0 );
+	observe_metric( METRIC_EOM_LATENCY, start_metric_observation() - 3072 );
+	format_metric_summary( METRIC_EOM_LATENCY, buf, sizeof( buf ) );
+	ck_assert_str_eq( buf, "phase=\"eom\" count=1 p50=3.327ms p99=3.327ms p99.9=3.327ms" );
+	free_metrics();
+}
+END_TEST
+
+START_TEST( test_format_metrics_truncated ) {
+	enable_metrics();
+	char buf[16];
+	size_t const len = format_metrics( buf, sizeof( buf ) );
+	ck_assert_uint_gt( len, sizeof( buf ) );
+	ck_assert_uint_eq( strlen( buf ), sizeof( buf ) - 1 );
+	ck_assert_int_eq( strncmp( buf, "# HELP ", 7 ), 0 );
+	free_metrics();
+}
+END_TEST
+
+Suite* create_metrics_suite( void ) {
+	Suite* s = suite_create( "metrics" );
+	TCase* tc;
+
+	tc = tcase_create( "test_metrics_disabled" );
+	tcase_add_test( tc, test_metrics_disabled );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_metrics_counters" );
+	tcase_add_test( tc, test_metrics_counters );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_metrics_threads" );
+	tcase_add_test( tc, test_metrics_threads );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_metrics_histograms" );
+	tcase_add_test( tc, test_metrics_histograms );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_metrics_quantiles" );
+	tcase_add_test( tc, test_metrics_quantiles );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_format_metric_summary" );
+	tcase_add_test( tc, test_format_metric_summary );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_format_metrics_truncated" );
+	tcase_add_test( tc, test_format_metrics_truncated );
+	suite_add_tcase( s, tc );
+
+	return s;
+}
@@ -0,0 +1,220 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sysexits.h>
+#include <check.h>
+
+#include "../src/arena.h"
+#include "../src/mail_address.h"
+#include "../src/nested_list.h"
+
+/**
+ * A directory of mailing lists for the fake resolver.
+ *
+ * Each entry is a list followed by its members and terminated by `NULL`.
+ */
+static char const * const * const TEST_LISTS[] = {
+	(char const * const []){ "list@example.org", "alice@example.org", "team@example.org", NULL },
+	(char const * const []){ "team@example.org", "bob@example.org", "sub@example.org", "list@example.org", NULL },
+	(char const * const []){ "sub@example.org", "carol@example.org", "alice@example.org", "loop@example.org", NULL },
+	(char const * const []){ "loop@example.org", "sub@example.org", "dave@example.org", NULL },
+	NULL
+};
+
+/**
+ * The state of the fake resolver.
+ */
+struct test_resolver_t {
+	struct arena_t* arena; /**< The arena of the results. */
+	unsigned int calls; /**< The number of calls. */
+	unsigned int resolved; /**< The number of resolved addresses. */
+	unsigned int last_level; /**< The level of the last call. */
+	int result_code; /**< The result of each call. */
+};
+
+static int resolve_test_lists(
+	void* context,
+	struct string_array_t const * addresses,
+	unsigned int level,
+	struct string_array_t** results
+) {
+	struct test_resolver_t* const resolver = (struct test_resolver_t*)context;
+	++resolver->calls;
+	resolver->last_level = level;
+	if( resolver->result_code != EX_OK )
+		return resolver->result_code;
+	for( size_t i = 0; i != get_string_array_size( addresses ); ++i ) {
+		++resolver->resolved;
+		results[i] = create_string_array_arena( resolver->arena, 1 );
+		for( size_t j = 0; TEST_LISTS[j] != NULL; ++j ) {
+			if( strcmp( TEST_LISTS[j][0], get_string_array_at( addresses, i ) ) != 0 )
+				continue;
+			for( size_t k = 1; TEST_LISTS[j][k] != NULL; ++k )
+				push_onto_string_array( results[i], TEST_LISTS[j][k] );
+		}
+	}
+	return EX_OK;
+}
+
+/**
+ * Expands the members of `list@example.org` and joins them sorted with
+ * commas into `buf`.
+ */
+static int expand_test_list( unsigned int const depth, struct test_resolver_t* const resolver, char* const buf, size_t const size ) {
+	struct string_array_t* const members = create_string_array_arena( resolver->arena, 2 );
+	push_onto_string_array( members, "alice@example.org" );
+	push_onto_string_array( members, "team@example.org" );
+	struct string_array_t* expanded = NULL;
+	int const result_code = expand_nested_lists(
+		resolver->arena, "list@example.org", members, depth, 0, resolve_test_lists, resolver, &expanded
+	);
+	buf[0] = '\0';
+	if( expanded == NULL )
+		return result_code;
+	sort_string_array( expanded );
+	for( size_t i = 0; i != get_string_array_size( expanded ); ++i ) {
+		if( i != 0 )
+			strncat( buf, ",", size - strlen( buf ) - 1 );
+		strncat( buf, get_string_array_at( expanded, i ), size - strlen( buf ) - 1 );
+	}
+	return result_code;
+}
+
+START_TEST( test_expand_nested_lists_depth_one ) {
+	struct test_resolver_t resolver = { create_arena( 4096 ), 0, 0, 0, EX_OK };
+	char buf[256];
+	ck_assert_int_eq( expand_test_list( 1, &resolver, buf, sizeof( buf ) ), EX_OK );
+	ck_assert_str_eq( buf, "alice@example.org,team@example.org" );
+	ck_assert_int_eq( resolver.calls, 0 );
+	free_arena( resolver.arena );
+}
+END_TEST
+
+START_TEST( test_expand_nested_lists_depth_two ) {
+	struct test_resolver_t resolver = { create_arena( 4096 ), 0, 0, 0, EX_OK };
+	char buf[256];
+	ck_assert_int_eq( expand_test_list( 2, &resolver, buf, sizeof( buf ) ), EX_OK );
+	// `sub` is kept as it is on the last level and the list itself is dropped
+	ck_assert_str_eq( buf, "alice@example.org,bob@example.org,sub@example.org" );
+	ck_assert_int_eq( resolver.calls, 1 );
+	ck_assert_int_eq( resolver.resolved, 2 );
+	free_arena( resolver.arena );
+}
+END_TEST
+
+START_TEST( test_expand_nested_lists_breaks_cycles ) {
+	struct test_resolver_t resolver = { create_arena( 4096 ), 0, 0, 0, EX_OK };
+	char buf[256];
+	ck_assert_int_eq( expand_test_list( 10, &resolver, buf, sizeof( buf ) ), EX_OK );
+	// `list -> team -> list` and `sub -> loop -> sub` are cycles; `alice` is
+	// a member at two levels, but added once
+	ck_assert_str_eq( buf, "alice@example.org,bob@example.org,carol@example.org,dave@example.org" );
+	// Each address is resolved at most once and the expansion stops as soon
+	// as no new address is left, long before the depth is reached
+	ck_assert_int_eq( resolver.resolved, 7 );
+	ck_assert_int_eq( resolver.calls, 4 );
+	ck_assert_int_eq( resolver.last_level, 4 );
+	free_arena( resolver.arena );
+}
+END_TEST
+
+START_TEST( test_expand_nested_lists_self_member ) {
+	struct test_resolver_t resolver = { create_arena( 4096 ), 0, 0, 0, EX_OK };
+	struct string_array_t* const members = create_string_array_arena( resolver.arena, 2 );
+	push_onto_string_array( members, "List@Example.org" );
+	push_onto_string_array( members, "erin@example.org" );
+	struct string_array_t* expanded = NULL;
+	// The list is a member of itself by a different spelling
+	ck_assert_int_eq(
+		expand_nested_lists(
+			resolver.arena, "list@example.org", members, 3, MAIL_ADDRESS_FOLD_LOCAL_PART, resolve_test_lists, &resolver, &expanded
+		),
+		EX_OK
+	);
+	ck_assert_ptr_nonnull( expanded );
+	ck_assert_int_eq( get_string_array_size( expanded ), 1 );
+	ck_assert_str_eq( get_string_array_at( expanded, 0 ), "erin@example.org" );
+	free_arena( resolver.arena );
+}
+END_TEST
+
+START_TEST( test_expand_nested_lists_error ) {
+	struct test_resolver_t resolver = { create_arena( 4096 ), 0, 0, 0, EX_TEMPFAIL };
+	char buf[256];
+	ck_assert_int_eq( expand_test_list( 3, &resolver, buf, sizeof( buf ) ), EX_TEMPFAIL );
+	ck_assert_str_eq( buf, "" );
+	ck_assert_int_eq( resolver.calls, 1 );
+	free_arena( resolver.arena );
+}
+END_TEST
+
+START_TEST( test_match_nested_list_key ) {
+	char const * const keys[] = { "list", "team", "List" };
+	int is_match[3] = { 0, 0, 0 };
+	ck_assert_int_eq( match_nested_list_key( keys, 3, "LIST", 4, is_match ), 2 );
+	ck_assert_int_eq( is_match[0], 1 );
+	ck_assert_int_eq( is_match[1], 0 );
+	ck_assert_int_eq( is_match[2], 1 );
+}
+END_TEST
+
+START_TEST( test_match_nested_list_key_prefix ) {
+	char const * const keys[] = { "list", "team" };
+	int is_match[2] = { 0, 0 };
+	// Values are not NUL-terminated and must match the whole key
+	ck_assert_int_eq( match_nested_list_key( keys, 2, "listx", 3, is_match ), 0 );
+	ck_assert_int_eq( match_nested_list_key( keys, 2, "listx", 5, is_match ), 0 );
+	ck_assert_int_eq( match_nested_list_key( keys, 2, "teams", 4, is_match ), 1 );
+	ck_assert_int_eq( is_match[0], 0 );
+	ck_assert_int_eq( is_match[1], 1 );
+}
+END_TEST
+
+START_TEST( test_match_nested_list_key_keeps_flags ) {
+	char const * const keys[] = { "list", "team" };
+	int is_match[2] = { 1, 0 };
+	// An entry may have several key values; flags accumulate
+	ck_assert_int_eq( match_nested_list_key( keys, 2, "team", 4, is_match ), 1 );
+	ck_assert_int_eq( is_match[0], 1 );
+	ck_assert_int_eq( is_match[1], 1 );
+}
+END_TEST
+
+Suite* create_nested_list_suite( void ) {
+	Suite* s = suite_create( "nested_list" );
+	TCase* tc;
+
+	tc = tcase_create( "test_expand_nested_lists_depth_one" );
+	tcase_add_test( tc, test_expand_nested_lists_depth_one );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_expand_nested_lists_depth_two" );
+	tcase_add_test( tc, test_expand_nested_lists_depth_two );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_expand_nested_lists_breaks_cycles" );
+	tcase_add_test( tc, test_expand_nested_lists_breaks_cycles );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_expand_nested_lists_self_member" );
+	tcase_add_test( tc, test_expand_nested_lists_self_member );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_expand_nested_lists_error" );
+	tcase_add_test( tc, test_expand_nested_lists_error );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_match_nested_list_key" );
+	tcase_add_test( tc, test_match_nested_list_key );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_match_nested_list_key_prefix" );
+	tcase_add_test( tc, test_match_nested_list_key_prefix );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_match_nested_list_key_keeps_flags" );
+	tcase_add_test( tc, test_match_nested_list_key_keeps_flags );
+	suite_add_tcase( s, tc );
+
+	return s;
+}
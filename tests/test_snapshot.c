@@ -0,0 +1,168 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <check.h>
+
+#include "../src/snapshot.h"
+
+static struct alias_index_t* create_test_index( char const * const key, char const * const value ) {
+	struct string_array_t* keys = create_string_array( 1 );
+	struct string_array_t* values = create_string_array( 1 );
+	push_onto_string_array( keys, key );
+	push_onto_string_array( values, value );
+	struct alias_index_t* index = create_alias_index( keys, values );
+	free_string_array( keys );
+	free_string_array( values );
+	return index;
+}
+
+/**
+ * Creates an empty temporary file and returns its path.
+ */
+static char* create_test_file( void ) {
+	char* path = malloc( 32 );
+	strcpy( path, "/tmp/test_snapshot_XXXXXX" );
+	int fd = mkstemp( path );
+	ck_assert_int_ne( fd, -1 );
+	close( fd );
+	return path;
+}
+
+static void remove_test_file( char* path ) {
+	unlink( path );
+	free( path );
+}
+
+START_TEST( test_open_alias_index_roundtrip ) {
+	struct alias_index_t* index = create_test_index( "list@example.org", "alice@example.org" );
+	ck_assert_ptr_nonnull( index );
+	size_t size = 0;
+	void const * data = get_alias_index_data( index, &size );
+	ck_assert_int_eq( size % 8, 0 );
+
+	struct alias_index_t* opened = open_alias_index( data, size );
+	ck_assert_ptr_nonnull( opened );
+	ck_assert_int_eq( get_alias_index_size( opened ), 1 );
+	struct string_array_t* result = lookup_alias_index( opened, "LIST@example.org" );
+	ck_assert_ptr_nonnull( result );
+	ck_assert_str_eq( get_string_array_at( result, 0 ), "alice@example.org" );
+	free_string_array( result );
+	free_alias_index( opened );
+
+	// A truncated block must be rejected
+	ck_assert_ptr_null( open_alias_index( data, size - 8 ) );
+	free_alias_index( index );
+}
+END_TEST
+
+START_TEST( test_write_and_map_snapshot ) {
+	struct snapshot_t* snapshot = create_snapshot(
+		create_test_index( "list@example.org", "alice@example.org" ),
+		create_test_index( "alice", "alice@example.org" )
+	);
+	ck_assert_ptr_nonnull( snapshot );
+	char* path = create_test_file();
+	ck_assert_int_eq( write_snapshot( snapshot, path ), 0 );
+
+	struct snapshot_t* mapped = map_snapshot( path );
+	ck_assert_ptr_nonnull( mapped );
+	ck_assert_int_eq( get_snapshot_time( mapped ), get_snapshot_time( snapshot ) );
+	struct string_array_t* result = lookup_alias_index( get_snapshot_mail_lists( mapped ), "list@example.org" );
+	ck_assert_ptr_nonnull( result );
+	ck_assert_str_eq( get_string_array_at( result, 0 ), "alice@example.org" );
+	free_string_array( result );
+	ck_assert_ptr_nonnull( get_snapshot_mail_accts( mapped ) );
+	result = lookup_alias_index( get_snapshot_mail_accts( mapped ), "alice" );
+	ck_assert_ptr_nonnull( result );
+	free_string_array( result );
+
+	free_snapshot( mapped );
+	free_snapshot( snapshot );
+	remove_test_file( path );
+}
+END_TEST
+
+START_TEST( test_write_and_map_snapshot_without_accts ) {
+	struct snapshot_t* snapshot = create_snapshot(
+		create_test_index( "list@example.org", "alice@example.org" ), NULL
+	);
+	ck_assert_ptr_nonnull( snapshot );
+	char* path = create_test_file();
+	ck_assert_int_eq( write_snapshot( snapshot, path ), 0 );
+
+	struct snapshot_t* mapped = map_snapshot( path );
+	ck_assert_ptr_nonnull( mapped );
+	ck_assert_ptr_null( get_snapshot_mail_accts( mapped ) );
+	free_snapshot( mapped );
+	free_snapshot( snapshot );
+	remove_test_file( path );
+}
+END_TEST
+
+START_TEST( test_map_snapshot_missing ) {
+	errno = 0;
+	ck_assert_ptr_null( map_snapshot( "/nonexistent/milter-alias.snapshot" ) );
+	ck_assert_int_eq( errno, ENOENT );
+}
+END_TEST
+
+START_TEST( test_map_snapshot_corrupt ) {
+	struct snapshot_t* snapshot = create_snapshot(
+		create_test_index( "list@example.org", "alice@example.org" ), NULL
+	);
+	char* path = create_test_file();
+	ck_assert_int_eq( write_snapshot( snapshot, path ), 0 );
+	free_snapshot( snapshot );
+
+	// Flip the version
+	FILE* file = fopen( path, "r+b" );
+	ck_assert_ptr_nonnull( file );
+	fseek( file, 8, SEEK_SET );
+	fputc( 0x7f, file );
+	fclose( file );
+	errno = 0;
+	ck_assert_ptr_null( map_snapshot( path ) );
+	ck_assert_int_eq( errno, EINVAL );
+
+	// A file shorter than its header
+	file = fopen( path, "wb" );
+	ck_assert_ptr_nonnull( file );
+	fputs( "MLTALIAS", file );
+	fclose( file );
+	errno = 0;
+	ck_assert_ptr_null( map_snapshot( path ) );
+	ck_assert_int_eq( errno, EINVAL );
+
+	remove_test_file( path );
+}
+END_TEST
+
+Suite* create_snapshot_suite( void ) {
+	Suite* s = suite_create( "snapshot" );
+	TCase* tc;
+
+	tc = tcase_create( "test_open_alias_index_roundtrip" );
+	tcase_add_test( tc, test_open_alias_index_roundtrip );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_write_and_map_snapshot" );
+	tcase_add_test( tc, test_write_and_map_snapshot );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_write_and_map_snapshot_without_accts" );
+	tcase_add_test( tc, test_write_and_map_snapshot_without_accts );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_map_snapshot_missing" );
+	tcase_add_test( tc, test_map_snapshot_missing );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_map_snapshot_corrupt" );
+	tcase_add_test( tc, test_map_snapshot_corrupt );
+	suite_add_tcase( s, tc );
+
+	return s;
+}
@@ -1,12 +1,31 @@
+#include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <sysexits.h>
 #include <check.h>
 
 #include "../src/string_array.h"
+#include "../src/arena.h"
+#include "../src/mail_address.h"
 
 char const * const TEST_STRING_1 = "test string 1";
 char const * const TEST_STRING_2 = "test string 2";
 char const * const TEST_STRING_3 = "test string 3";
 
+/**
+ * Identical to string_array_entry_t.
+ * Used for whitebox testing.
+ */
+struct string_array_entry_test_t {
+	size_t offset; /**< The offset of the first character into the pool. */
+	size_t len; /**< The length of the string without the terminating null byte. */
+	size_t key_offset; /**< The offset of the normalized key into the pool. */
+	size_t key_len; /**< The length of the normalized key. */
+	uint64_t hash; /**< The hash of the normalized key. */
+};
+
 /**
  * Identical to string_array_t.
  * Used for whitebox testing.
@@ -20,16 +39,29 @@ struct string_array_test_t {
 	 */
 	size_t capacity;
 	size_t size; /**< The number of actual elements in the array; always smaller than capacity. */
-	char** values; /**< The internal pointer to the beginning of the memory block */
+	struct string_array_entry_test_t* entries; /**< The positions of the strings in the pool. */
+	char* pool; /**< The string pool. */
+	size_t pool_size; /**< The number of used bytes of the pool. */
+	size_t pool_capacity; /**< The size of the pool in bytes. */
+	struct arena_t* arena; /**< The arena which owns the array and its strings or `NULL`. */
+	int key_options; /**< The options of the normalized keys or -1. */
 };
 
+/**
+ * Returns the i-th string directly from the string pool.
+ */
+static char const * get_test_value( struct string_array_test_t const * arr, size_t i ) {
+	return arr->pool + arr->entries[i].offset;
+}
+
 START_TEST( test_create_string_array_with_zero_capacity ) {
 	struct string_array_test_t* arr = (struct string_array_test_t*) create_string_array( 0 );
 	ck_assert_ptr_nonnull( arr );
 	ck_assert_int_eq( arr->capacity, 0 );
 	ck_assert_int_eq( arr->size, 0 );
-	ck_assert_ptr_nonnull( arr->values );
-	ck_assert_ptr_null( arr->values[0] );
+	ck_assert_ptr_nonnull( arr->entries );
+	ck_assert_ptr_nonnull( arr->pool );
+	ck_assert_int_eq( arr->pool_size, 0 );
 	free_string_array( (struct string_array_t*) arr );
 }
 END_TEST
@@ -39,15 +71,16 @@ START_TEST( test_create_string_array_with_non_zero_capacity ) {
 	ck_assert_ptr_nonnull( arr );
 	ck_assert_int_eq( arr->capacity, 20 );
 	ck_assert_int_eq( arr->size, 0 );
-	ck_assert_ptr_nonnull( arr->values );
-	ck_assert_ptr_null( arr->values[0] );
-	for( uintptr_t i = 1; i != 20; ++i ) {
-		// Just assign some dummy pointer values to each entry in the array
+	ck_assert_ptr_nonnull( arr->entries );
+	ck_assert_ptr_nonnull( arr->pool );
+	for( size_t i = 0; i != 20; ++i ) {
+		// Just assign some dummy values to each entry in the array
 		// as a quick-and-dirty test that the size of the underlying array is
 		// indeed the capacity.
 		// If it was not, this write access should trigger a segmentation fault
 		// during tests with some luck.
-		arr->values[i] = (char*)i;
+		arr->entries[i].offset = i;
+		arr->entries[i].len = i;
 	}
 	free_string_array( (struct string_array_t*) arr );
 }
@@ -66,10 +99,10 @@ START_TEST( test_push_onto_string_array ) {
 	struct string_array_t* arr = create_string_array( 1 );
 	push_onto_string_array( arr, TEST_STRING_1 );
 	struct string_array_test_t* arr_test = (struct string_array_test_t*)arr;
-	ck_assert_ptr_nonnull( arr_test->values[0] );
-	ck_assert_ptr_ne( TEST_STRING_1, arr_test->values[0] );
-	ck_assert_str_eq( TEST_STRING_1, arr_test->values[0] );
-	ck_assert_ptr_null( arr_test->values[1] );
+	ck_assert_int_eq( arr_test->size, 1 );
+	ck_assert_ptr_ne( TEST_STRING_1, get_test_value( arr_test, 0 ) );
+	ck_assert_str_eq( TEST_STRING_1, get_test_value( arr_test, 0 ) );
+	ck_assert_int_eq( arr_test->entries[0].len, strlen( TEST_STRING_1 ) );
 	free_string_array( arr );
 }
 END_TEST
@@ -81,11 +114,11 @@ START_TEST( test_push_onto_string_array_l ) {
 
 	push_onto_string_array_l( arr, str_without_nul, 4 );
 	struct string_array_test_t* arr_test = (struct string_array_test_t*)arr;
-	ck_assert_ptr_nonnull( arr_test->values[0] );
-	ck_assert_ptr_ne( str_without_nul, arr_test->values[0] );
-	ck_assert_str_eq( "test", arr_test->values[0] );
-	ck_assert( arr_test->values[0][4] == '\0' );
-	ck_assert_ptr_null( arr_test->values[1] );
+	ck_assert_int_eq( arr_test->size, 1 );
+	ck_assert_ptr_ne( str_without_nul, get_test_value( arr_test, 0 ) );
+	ck_assert_str_eq( "test", get_test_value( arr_test, 0 ) );
+	ck_assert( get_test_value( arr_test, 0 )[4] == '\0' );
+	ck_assert_int_eq( arr_test->pool_size, 5 );
 	free_string_array( arr );
 }
 END_TEST
@@ -98,26 +131,68 @@ START_TEST( test_string_array_reallocation ) {
 	struct string_array_test_t* arr_test = (struct string_array_test_t*)arr;
 	ck_assert_int_eq( arr_test->capacity, 4 );
 
-	ck_assert_ptr_nonnull( arr_test->values[0] );
-	ck_assert_ptr_ne( TEST_STRING_1, arr_test->values[0] );
-	ck_assert_str_eq( TEST_STRING_1, arr_test->values[0] );
+	ck_assert_ptr_ne( TEST_STRING_1, get_test_value( arr_test, 0 ) );
+	ck_assert_str_eq( TEST_STRING_1, get_test_value( arr_test, 0 ) );
+
+	ck_assert_ptr_ne( TEST_STRING_2, get_test_value( arr_test, 1 ) );
+	ck_assert_str_eq( TEST_STRING_2, get_test_value( arr_test, 1 ) );
 
-	ck_assert_ptr_nonnull( arr_test->values[1] );
-	ck_assert_ptr_ne( TEST_STRING_2, arr_test->values[1] );
-	ck_assert_str_eq( TEST_STRING_2, arr_test->values[1] );
+	ck_assert_ptr_ne( TEST_STRING_3, get_test_value( arr_test, 2 ) );
+	ck_assert_str_eq( TEST_STRING_3, get_test_value( arr_test, 2 ) );
+
+	// All strings are stored back to back in the pool
+	ck_assert_int_eq( arr_test->entries[1].offset, arr_test->entries[0].offset + strlen( TEST_STRING_1 ) + 1 );
+	ck_assert_int_eq( arr_test->entries[2].offset, arr_test->entries[1].offset + strlen( TEST_STRING_2 ) + 1 );
+	free_string_array( arr );
+}
+END_TEST
 
-	ck_assert_ptr_nonnull( arr_test->values[2] );
-	ck_assert_ptr_ne( TEST_STRING_3, arr_test->values[2] );
-	ck_assert_str_eq( TEST_STRING_3, arr_test->values[2] );
+START_TEST( test_string_array_pool_growth ) {
+	struct string_array_t* arr = create_string_array( 1 );
+	char buf[200];
+	for( int i = 0; i != 100; ++i ) {
+		memset( buf, 'a' + i % 26, sizeof( buf ) - 1 );
+		buf[ i + 1 ] = '\0';
+		ck_assert_ptr_nonnull( push_onto_string_array( arr, buf ) );
+	}
+	ck_assert_int_eq( get_string_array_size( arr ), 100 );
+	for( int i = 0; i != 100; ++i ) {
+		char const * value = get_string_array_at( arr, i );
+		ck_assert_int_eq( strlen( value ), i + 1 );
+		ck_assert( value[0] == 'a' + i % 26 );
+	}
+	free_string_array( arr );
+}
+END_TEST
 
-	ck_assert_ptr_null( arr_test->values[3] );
+START_TEST( test_copy_string_array ) {
+	struct string_array_t* arr = create_string_array( 2 );
+	push_onto_string_array( arr, TEST_STRING_1 );
+	push_onto_string_array( arr, TEST_STRING_2 );
+	struct string_array_t* copy = copy_string_array( arr );
+	ck_assert_ptr_nonnull( copy );
+	ck_assert_int_eq( get_string_array_size( copy ), 2 );
+	ck_assert_ptr_ne( get_string_array_at( arr, 0 ), get_string_array_at( copy, 0 ) );
+	ck_assert_str_eq( TEST_STRING_1, get_string_array_at( copy, 0 ) );
+	ck_assert_str_eq( TEST_STRING_2, get_string_array_at( copy, 1 ) );
 	free_string_array( arr );
+	free_string_array( copy );
+}
+END_TEST
+
+START_TEST( test_copy_empty_string_array ) {
+	struct string_array_t* arr = create_string_array( 0 );
+	struct string_array_t* copy = copy_string_array( arr );
+	ck_assert_ptr_nonnull( copy );
+	ck_assert_int_eq( get_string_array_size( copy ), 0 );
+	free_string_array( arr );
+	free_string_array( copy );
 }
 END_TEST
 
 START_TEST( test_sort_string_array ) {
 	struct string_array_t* arr = create_string_array( 4 );
-	void* old = ((struct string_array_test_t*)arr)->values;
+	void* old = ((struct string_array_test_t*)arr)->entries;
 
 	push_onto_string_array( arr, TEST_STRING_2 );
 	push_onto_string_array( arr, TEST_STRING_1 );
@@ -128,7 +203,7 @@ START_TEST( test_sort_string_array ) {
 	ck_assert_str_eq( TEST_STRING_3, get_string_array_at( arr, 2 ) );
 
 	// Sorting should be in place
-	ck_assert_ptr_eq( old,  ((struct string_array_test_t*)arr)->values );
+	ck_assert_ptr_eq( old,  ((struct string_array_test_t*)arr)->entries );
 
 	free_string_array( arr );
 }
@@ -222,6 +297,140 @@ START_TEST( test_substract_string_array_with_duplicates_at_end ) {
 }
 END_TEST
 
+START_TEST( test_string_array_in_arena ) {
+	struct arena_t* arena = create_arena( 64 );
+	struct string_array_t* arr = create_string_array_arena( arena, 1 );
+	ck_assert_ptr_nonnull( arr );
+	push_onto_string_array( arr, TEST_STRING_3 );
+	push_onto_string_array( arr, TEST_STRING_1 );
+	push_onto_string_array( arr, TEST_STRING_2 );
+	push_onto_string_array( arr, TEST_STRING_1 );
+	ck_assert_int_eq( get_string_array_size( arr ), 4 );
+	ck_assert_int_eq( ((struct string_array_test_t*)arr)->capacity, 4 );
+
+	struct string_array_t* diff = create_string_array_arena( arena, 1 );
+	push_onto_string_array( diff, TEST_STRING_2 );
+	sort_string_array( arr );
+	substract_string_array( arr, diff );
+	ck_assert_int_eq( get_string_array_size( arr ), 2 );
+	ck_assert_str_eq( get_string_array_at( arr, 0 ), TEST_STRING_1 );
+	ck_assert_str_eq( get_string_array_at( arr, 1 ), TEST_STRING_3 );
+
+	// A copy is independent of the arena
+	struct string_array_t* copy = copy_string_array( arr );
+	free_string_array( arr );
+	free_string_array( diff );
+	free_arena( arena );
+	ck_assert_str_eq( get_string_array_at( copy, 1 ), TEST_STRING_3 );
+	free_string_array( copy );
+}
+END_TEST
+
+START_TEST( test_substract_mail_addresses_small ) {
+	struct string_array_t* arr = create_string_array( 4 );
+	push_onto_string_array( arr, "carol@Example.org" );
+	push_onto_string_array( arr, "alice@example.org" );
+	push_onto_string_array( arr, "Bob@example.org" );
+	push_onto_string_array( arr, "carol@example.ORG" );
+	push_onto_string_array( arr, "bob@example.org" );
+
+	struct string_array_t* diff = create_string_array( 1 );
+	push_onto_string_array( diff, "ALICE@example.org" );
+	push_onto_string_array( diff, "Bob@EXAMPLE.org" );
+
+	substract_mail_addresses( arr, diff );
+	// The local part is case-sensitive, the domain is not
+	ck_assert_int_eq( get_string_array_size( arr ), 3 );
+	sort_string_array( arr );
+	ck_assert_str_eq( get_string_array_at( arr, 0 ), "alice@example.org" );
+	ck_assert_str_eq( get_string_array_at( arr, 1 ), "bob@example.org" );
+	ck_assert_int_eq( strncmp( get_string_array_at( arr, 2 ), "carol@", 6 ), 0 );
+
+	substract_mail_addresses( arr, NULL );
+	ck_assert_int_eq( get_string_array_size( arr ), 3 );
+
+	free_string_array( arr );
+	free_string_array( diff );
+}
+END_TEST
+
+START_TEST( test_substract_mail_addresses_large ) {
+	char address[64];
+	struct string_array_t* arr = create_string_array( 1 );
+	struct string_array_t* diff = create_string_array( 1 );
+	// Every address appears twice in `arr`, once with an upper-case domain;
+	// every third address is in `diff`
+	for( int i = 0; i != 500; ++i ) {
+		sprintf( address, "member%d@example.org", i );
+		push_onto_string_array( arr, address );
+		if( i % 3 == 0 )
+			push_onto_string_array( diff, address );
+	}
+	for( int i = 499; i >= 0; --i ) {
+		sprintf( address, "member%d@EXAMPLE.org", i );
+		push_onto_string_array( arr, address );
+	}
+
+	substract_mail_addresses( arr, diff );
+	ck_assert_int_eq( get_string_array_size( arr ), 333 );
+	sort_string_array( arr );
+	for( size_t i = 0; i != get_string_array_size( arr ); ++i ) {
+		int member = -1;
+		ck_assert_int_eq( sscanf( get_string_array_at( arr, i ), "member%d@", &member ), 1 );
+		ck_assert_int_ne( member % 3, 0 );
+		if( i > 0 )
+			ck_assert_int_ne( strcasecmp( get_string_array_at( arr, i - 1 ), get_string_array_at( arr, i ) ), 0 );
+	}
+
+	free_string_array( arr );
+	free_string_array( diff );
+}
+END_TEST
+
+START_TEST( test_mail_address_normalization ) {
+	struct string_array_test_t* arr = (struct string_array_test_t*) create_string_array( 1 );
+	push_onto_string_array( (struct string_array_t*) arr, "Alice+Lists@Example.org" );
+	ck_assert_int_eq( set_mail_address_normalization( (struct string_array_t*) arr, MAIL_ADDRESS_STRIP_TAG ), EX_OK );
+	push_onto_string_array( (struct string_array_t*) arr, "bob@example.org" );
+	ck_assert_int_eq( get_string_array_size( (struct string_array_t*) arr ), 2 );
+	// The strings are unchanged
+	ck_assert_str_eq( get_string_array_at( (struct string_array_t*) arr, 0 ), "Alice+Lists@Example.org" );
+	ck_assert_str_eq( get_string_array_at( (struct string_array_t*) arr, 1 ), "bob@example.org" );
+	ck_assert_int_eq( arr->entries[0].key_len, strlen( "Alice@example.org" ) );
+	ck_assert_int_eq( memcmp( arr->pool + arr->entries[0].key_offset, "Alice@example.org", arr->entries[0].key_len ), 0 );
+	// A key which equals the string is not stored twice
+	ck_assert_int_eq( arr->entries[1].key_offset, arr->entries[1].offset );
+	ck_assert_uint_eq( arr->entries[1].hash, hash_mail_address_key( "bob@example.org", strlen( "bob@example.org" ) ) );
+
+	struct string_array_test_t* copy = (struct string_array_test_t*) copy_string_array( (struct string_array_t*) arr );
+	ck_assert_int_eq( copy->key_options, MAIL_ADDRESS_STRIP_TAG );
+	ck_assert_int_eq( memcmp( copy->pool + copy->entries[0].key_offset, "Alice@example.org", copy->entries[0].key_len ), 0 );
+	free_string_array( (struct string_array_t*) copy );
+	free_string_array( (struct string_array_t*) arr );
+}
+END_TEST
+
+START_TEST( test_substract_mail_addresses_normalized ) {
+	struct string_array_t* arr = create_string_array( 1 );
+	set_mail_address_normalization( arr, MAIL_ADDRESS_FOLD_LOCAL_PART | MAIL_ADDRESS_STRIP_TAG );
+	push_onto_string_array( arr, "Alice@Example.ORG" );
+	push_onto_string_array( arr, "bob@example.org" );
+	push_onto_string_array( arr, "BOB+home@example.org" );
+
+	// `diff` is normalized like `arr`
+	struct string_array_t* diff = create_string_array( 1 );
+	push_onto_string_array( diff, "alice+lists@example.org" );
+
+	ck_assert_int_eq( substract_mail_addresses( arr, diff ), EX_OK );
+	ck_assert_int_eq( get_string_array_size( arr ), 1 );
+	// Either spelling of Bob's address remains
+	ck_assert_int_eq( strncasecmp( get_string_array_at( arr, 0 ), "bob", 3 ), 0 );
+
+	free_string_array( arr );
+	free_string_array( diff );
+}
+END_TEST
+
 Suite* create_string_array_suite( void ) {
 	Suite* s = suite_create( "string_array" );
 	TCase* tc;
@@ -250,6 +459,18 @@ Suite* create_string_array_suite( void ) {
 	tcase_add_test( tc, test_string_array_reallocation );
 	suite_add_tcase( s, tc );
 
+	tc = tcase_create( "test_string_array_pool_growth" );
+	tcase_add_test( tc, test_string_array_pool_growth );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_copy_string_array" );
+	tcase_add_test( tc, test_copy_string_array );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_copy_empty_string_array" );
+	tcase_add_test( tc, test_copy_empty_string_array );
+	suite_add_tcase( s, tc );
+
 	tc = tcase_create( "test_sort_string_array" );
 	tcase_add_test( tc, test_sort_string_array );
 	suite_add_tcase( s, tc );
@@ -270,5 +491,25 @@ Suite* create_string_array_suite( void ) {
 	tcase_add_test( tc, test_substract_string_array_with_duplicates_at_end );
 	suite_add_tcase( s, tc );
 
+	tc = tcase_create( "test_substract_mail_addresses_small" );
+	tcase_add_test( tc, test_substract_mail_addresses_small );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_substract_mail_addresses_large" );
+	tcase_add_test( tc, test_substract_mail_addresses_large );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_mail_address_normalization" );
+	tcase_add_test( tc, test_mail_address_normalization );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_substract_mail_addresses_normalized" );
+	tcase_add_test( tc, test_substract_mail_addresses_normalized );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_string_array_in_arena" );
+	tcase_add_test( tc, test_string_array_in_arena );
+	suite_add_tcase( s, tc );
+
 	return s;
 }
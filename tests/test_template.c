@@ -0,0 +1,112 @@
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+
+#include "../src/template.h"
+
+static char const * const TEST_ADDRESS = "alice@example.org";
+
+START_TEST( test_expand_template_placeholders ) {
+	struct template_t* template = compile_template( "(&(uid=%n)(dc=%d)(mail=%u))", TEMPLATE_ESCAPE_FILTER );
+	ck_assert_ptr_nonnull( template );
+	ck_assert_int_ne( has_template_placeholders( template ), 0 );
+	char buf[128];
+	size_t len = expand_template( template, TEST_ADDRESS, buf, sizeof( buf ) );
+	ck_assert_str_eq( buf, "(&(uid=alice)(dc=example.org)(mail=alice@example.org))" );
+	ck_assert_int_eq( len, strlen( buf ) );
+	free_template( template );
+}
+END_TEST
+
+START_TEST( test_expand_template_without_domain ) {
+	struct template_t* template = compile_template( "%n|%d|%u", TEMPLATE_ESCAPE_NONE );
+	ck_assert_ptr_nonnull( template );
+	char buf[64];
+	expand_template( template, "alice", buf, sizeof( buf ) );
+	ck_assert_str_eq( buf, "alice||alice" );
+	free_template( template );
+}
+END_TEST
+
+START_TEST( test_expand_template_literal ) {
+	struct template_t* template = compile_template( "ou=lists,dc=example,dc=org %x 100%", TEMPLATE_ESCAPE_DN );
+	ck_assert_ptr_nonnull( template );
+	ck_assert_int_eq( has_template_placeholders( template ), 0 );
+	char buf[64];
+	expand_template( template, TEST_ADDRESS, buf, sizeof( buf ) );
+	ck_assert_str_eq( buf, "ou=lists,dc=example,dc=org %x 100%" );
+	free_template( template );
+}
+END_TEST
+
+START_TEST( test_expand_template_truncated ) {
+	struct template_t* template = compile_template( "mail=%u", TEMPLATE_ESCAPE_NONE );
+	ck_assert_ptr_nonnull( template );
+	ck_assert_int_eq( expand_template( template, TEST_ADDRESS, NULL, 0 ), 22 );
+	char buf[8];
+	ck_assert_int_eq( expand_template( template, TEST_ADDRESS, buf, sizeof( buf ) ), 22 );
+	ck_assert_str_eq( buf, "mail=al" );
+	free_template( template );
+}
+END_TEST
+
+START_TEST( test_expand_template_escape_filter ) {
+	struct template_t* template = compile_template( "(mail=%u)", TEMPLATE_ESCAPE_FILTER );
+	ck_assert_ptr_nonnull( template );
+	char buf[64];
+	expand_template( template, "*)(uid=\\", buf, sizeof( buf ) );
+	ck_assert_str_eq( buf, "(mail=\\2a\\29\\28uid=\\5c)" );
+	free_template( template );
+}
+END_TEST
+
+START_TEST( test_expand_template_escape_dn ) {
+	struct template_t* template = compile_template( "uid=%n,ou=people", TEMPLATE_ESCAPE_DN );
+	ck_assert_ptr_nonnull( template );
+	char buf[64];
+	expand_template( template, "a,b+c=d@example.org", buf, sizeof( buf ) );
+	ck_assert_str_eq( buf, "uid=a\\,b\\+c\\=d,ou=people" );
+	free_template( template );
+}
+END_TEST
+
+START_TEST( test_compile_template_null ) {
+	ck_assert_ptr_null( compile_template( NULL, TEMPLATE_ESCAPE_NONE ) );
+	free_template( NULL );
+}
+END_TEST
+
+Suite* create_template_suite( void ) {
+	Suite* s = suite_create( "template" );
+	TCase* tc;
+
+	tc = tcase_create( "test_expand_template_placeholders" );
+	tcase_add_test( tc, test_expand_template_placeholders );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_expand_template_without_domain" );
+	tcase_add_test( tc, test_expand_template_without_domain );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_expand_template_literal" );
+	tcase_add_test( tc, test_expand_template_literal );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_expand_template_truncated" );
+	tcase_add_test( tc, test_expand_template_truncated );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_expand_template_escape_filter" );
+	tcase_add_test( tc, test_expand_template_escape_filter );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_expand_template_escape_dn" );
+	tcase_add_test( tc, test_expand_template_escape_dn );
+	suite_add_tcase( s, tc );
+
+	tc = tcase_create( "test_compile_template_null" );
+	tcase_add_test( tc, test_compile_template_null );
+	suite_add_tcase( s, tc );
+
+	return s;
+}